@@ -0,0 +1,48 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <functional>
+#include <string>
+
+/// Small registry for the micro benchmarks in VRayZmqServer_bench
+/// Each benchmark is a function registered with BENCHMARK(name) that prints it's results with @Bench::report
+/// With -json <file> the results are also written to a JSON file, so runs of different releases can be compared
+namespace Bench {
+
+typedef std::function<void()> Function;
+
+/// Register benchmark @name, returns true so it can initialize a static
+bool add(const char * name, const Function & function);
+
+/// Print a single result and keep it for the JSON output
+/// @name - the benchmark and case, for example "mpscQueue/8 producers"
+/// @metric - what is measured
+void report(const std::string & name, const std::string & metric, double value, const char * unit);
+
+/// Monotonic time in seconds
+double now();
+
+/// Call @step until @seconds pass, it runs at least once
+/// @elapsed - set to the time the calls took
+/// @return - number of calls
+template <typename F>
+int runFor(double seconds, F step, double & elapsed) {
+	int count = 0;
+	const double begin = now();
+	do {
+		step();
+		++count;
+		elapsed = now() - begin;
+	} while (elapsed < seconds);
+	return count;
+}
+
+} // namespace Bench
+
+/// Define and register benchmark function @name
+#define BENCHMARK(name) \
+	static void name(); \
+	static const bool name##Registered = Bench::add(#name, name); \
+	static void name()
+
+#endif // BENCH_H
@@ -0,0 +1,142 @@
+#include "bench.h"
+
+#include <zmq.hpp>
+#include <zmq_wrapper.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Per message work of the ZmqProxyServer loop: each client message is received as [id, control, payload] on the
+// frontend ROUTER, it's ControlFrame is parsed and all three frames are sent to the worker's DEALER through the
+// backend ROUTER. The forward cases run the same socket layout over inproc with the client, the proxy and the
+// worker on their own threads, so they measure the proxy hop without the network.
+
+namespace {
+
+/// Frames parsed or made per case
+const int FRAME_COUNT = 10000000;
+
+/// Id of the single client, the worker uses it as identity like RendererController does
+const uint64_t CLIENT_ID = 42;
+
+/// Parse a DATA control frame FRAME_COUNT times, the proxy does this for every client message
+void runParse() {
+	const zmq::message_t control = ControlFrame::make(ClientType::Exporter, ControlMessage::DATA_MSG);
+	uint64_t dataFrames = 0;
+	const double begin = Bench::now();
+	for (int c = 0; c < FRAME_COUNT; ++c) {
+		const ControlFrame frame(control);
+		dataFrames += frame.control == ControlMessage::DATA_MSG;
+	}
+	const double elapsed = Bench::now() - begin;
+	Bench::report("controlFrame/parse", "per frame", elapsed / FRAME_COUNT * 1e9, "ns");
+	if (dataFrames != FRAME_COUNT) {
+		printf("controlFrame/parse: frame parsed wrong\n");
+	}
+}
+
+/// Make FRAME_COUNT control frames, the controller makes one for every message it sends
+void runMake() {
+	size_t bytes = 0;
+	const double begin = Bench::now();
+	for (int c = 0; c < FRAME_COUNT; ++c) {
+		const zmq::message_t control = ControlFrame::make(ClientType::Exporter, ControlMessage::DATA_MSG);
+		bytes += control.size();
+	}
+	const double elapsed = Bench::now() - begin;
+	Bench::report("controlFrame/make", "per frame", elapsed / FRAME_COUNT * 1e9, "ns");
+	if (!bytes) {
+		printf("controlFrame/make: empty frames\n");
+	}
+}
+
+/// Forward @count messages with @payloadSize bytes from a client through a proxy loop to a worker
+void runForward(const std::string & name, int count, size_t payloadSize) {
+	zmq::context_t context(1);
+	zmq::socket_t frontend(context, ZMQ_ROUTER);
+	zmq::socket_t backend(context, ZMQ_ROUTER);
+	const int noLimit = 0;
+	frontend.setsockopt(ZMQ_SNDHWM, &noLimit, sizeof(noLimit));
+	backend.setsockopt(ZMQ_SNDHWM, &noLimit, sizeof(noLimit));
+	const int mandatory = 1;
+	backend.setsockopt(ZMQ_ROUTER_MANDATORY, &mandatory, sizeof(mandatory));
+	frontend.bind("inproc://bench-frontend");
+	backend.bind("inproc://bench-backend");
+
+	// worker: handshake so the backend can route to it, then take all messages
+	zmq::socket_t worker(context, ZMQ_DEALER);
+	worker.setsockopt(ZMQ_IDENTITY, &CLIENT_ID, sizeof(CLIENT_ID));
+	worker.connect("inproc://bench-backend");
+	zmq::message_t emptyFrame(0);
+	worker.send(ControlFrame::make(ClientType::Exporter, ControlMessage::RENDERER_CREATE_MSG), ZMQ_SNDMORE);
+	worker.send(emptyFrame);
+	{
+		zmq::message_t id, control, payload;
+		backend.recv(&id);
+		backend.recv(&control);
+		backend.recv(&payload);
+	}
+
+	double received = 0.;
+	std::thread workerThread([&worker, &received, count]() {
+		zmq::message_t control, payload;
+		for (int c = 0; c < count; ++c) {
+			worker.recv(&control);
+			worker.recv(&payload);
+		}
+		received = Bench::now();
+	});
+
+	// proxy: same steps as the frontend part of ZmqProxyServer::run
+	std::thread proxyThread([&frontend, &backend, count]() {
+		for (int c = 0; c < count; ++c) {
+			zmq::message_t id, control, payload;
+			frontend.recv(&id);
+			frontend.recv(&control);
+			frontend.recv(&payload);
+			const ControlFrame frame(control);
+			if (frame.control == ControlMessage::STOP_MSG) {
+				break;
+			}
+			backend.send(id, ZMQ_SNDMORE);
+			backend.send(control, ZMQ_SNDMORE);
+			backend.send(payload);
+		}
+	});
+
+	zmq::socket_t client(context, ZMQ_DEALER);
+	client.setsockopt(ZMQ_IDENTITY, &CLIENT_ID, sizeof(CLIENT_ID));
+	client.connect("inproc://bench-frontend");
+	const std::vector<char> data(payloadSize, 'x');
+	const double begin = Bench::now();
+	for (int c = 0; c < count; ++c) {
+		zmq::message_t payload(payloadSize);
+		memcpy(payload.data(), data.data(), payloadSize);
+		client.send(ControlFrame::make(ClientType::Exporter, ControlMessage::DATA_MSG), ZMQ_SNDMORE);
+		client.send(payload);
+	}
+	proxyThread.join();
+	workerThread.join();
+	const double elapsed = received - begin;
+
+	const std::string caseName = "proxyForward/" + name;
+	Bench::report(caseName, "messages", count / elapsed, "/s");
+	Bench::report(caseName, "payload", payloadSize * static_cast<double>(count) / elapsed / (1 << 20), "MB/s");
+}
+
+} // namespace
+
+BENCHMARK(controlFrame) {
+	runParse();
+	runMake();
+}
+
+BENCHMARK(proxyForward) {
+	runForward("64 B", 500000, 64);
+	runForward("64 KB", 50000, 64 * 1024);
+	runForward("4 MB", 500, 4 * 1024 * 1024);
+}
@@ -0,0 +1,173 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "bench.h"
+#include "fake_renderer.h"
+#include "image_pipeline.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+// RendererController's ImagePipeline driven by FakeRenderer instead of V-Ray: RT images go through the same
+// resampler, viewport delta, half float packing and JPEG encoder, buckets through the BucketBatcher, and the image
+// messages are built. They are not sent, the cost of that is measured by the load client against a running server.
+
+namespace {
+
+/// Time each case runs
+const double CASE_SECONDS = 2.;
+
+/// Rate that is never reached, callbacks are emitted as fast as the pipeline takes them
+const double UNLIMITED_RATE = 1e6;
+
+/// What is done with each RT image
+enum class RtMode {
+	Jpeg, ///< Encode as JPG
+	Half, ///< Pack as RGBA_HALF
+	Delta, ///< Send only the changed tiles, full image on keyframes
+};
+
+/// Get the pipeline settings for @mode, the rest are the server's defaults
+ImagePipeline::Settings getPipelineSettings(RtMode mode) {
+	ImagePipeline::Settings settings;
+	settings.viewportDelta = mode == RtMode::Delta;
+	settings.bucketHalf = true;
+	return settings;
+}
+
+/// Calls the ImagePipeline from the renderer's callbacks the way RendererController does, drops the messages
+class PipelineDriver {
+public:
+	PipelineDriver(RtMode mode, int downscale)
+		: rtFormat(mode == RtMode::Jpeg ? VRayBaseTypes::AttrImage::ImageType::JPG :
+		           mode == RtMode::Half ? ImageUtils::RGBA_HALF : VRayBaseTypes::AttrImage::ImageType::RGBA_REAL, 60, downscale)
+		, pipeline(getPipelineSettings(mode), [this](zmq::message_t && message, MessageKind) {
+			outputBytes += message.size();
+			return message.size();
+		})
+		, callbackTime(0)
+		, outputBytes(0)
+	{}
+
+	void imageUpdate(FakeRenderer &, FakeRenderer::Image * img, void *) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		sendImage(img, rtFormat, VRayBaseTypes::ImageSourceType::RtImageUpdate);
+		callbackTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	void bucketReady(FakeRenderer & renderer, int x, int y, const char *, FakeRenderer::Image * img, void *) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		int width, height, imageWidth, imageHeight;
+		size_t count;
+		img->getSize(width, height);
+		renderer.getImageSize(imageWidth, imageHeight);
+		const ImageUtils::Region bucket(x, y, width, height);
+		const VRay::AColor * data = img->getPixelData(count);
+		if (!pipeline.addBucket(data, bucket, imageWidth, imageHeight, start)) {
+			pipeline.sendBucket(data, bucket);
+		}
+		callbackTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	void imageDone(FakeRenderer & renderer, void *) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		pipeline.finishBuckets();
+		std::unique_ptr<FakeRenderer::Image> img(renderer.getImage());
+		if (img) {
+			sendImage(img.get(), ImagePipeline::Format(VRayBaseTypes::AttrImage::ImageType::RGBA_REAL, 60, 1), VRayBaseTypes::ImageSourceType::ImageReady);
+		}
+		callbackTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	/// Total time spent in the callbacks
+	double getCallbackSeconds() const { return callbackTime * 1e-9; }
+
+	/// Bytes of the messages that would be sent to the client
+	uint64_t getOutputBytes() const { return outputBytes; }
+
+private:
+	/// Send the full image like RendererController::sendImages without render elements
+	void sendImage(FakeRenderer::Image * img, const ImagePipeline::Format & format, VRayBaseTypes::ImageSourceType sourceType) {
+		int width, height;
+		size_t count;
+		if (!img->getSize(width, height)) {
+			return;
+		}
+		VRayBaseTypes::AttrImageSet set(sourceType);
+		size_t queuedBytes = 0;
+		pipeline.addImage(img->getPixelData(count), width, height, ImageUtils::Region(0, 0, width, height), format, set, queuedBytes);
+		pipeline.queueImageSet(std::move(set));
+	}
+
+	const ImagePipeline::Format rtFormat; ///< How RT images are sent
+	ImagePipeline pipeline; ///< The controller's image stages
+	uint64_t callbackTime; ///< Nanoseconds spent in the callbacks, only written by the render thread
+	uint64_t outputBytes; ///< Only written by the render thread
+};
+
+/// Render with @settings for CASE_SECONDS and report the rates and the time spent in the pipeline
+void runCase(const std::string & name, const FakeRenderer::Settings & settings, RtMode mode, int downscale) {
+	PipelineDriver driver(mode, downscale);
+	FakeRenderer renderer(settings);
+	renderer.setOnRTImageUpdated<PipelineDriver, &PipelineDriver::imageUpdate>(driver);
+	renderer.setOnBucketReady<PipelineDriver, &PipelineDriver::bucketReady>(driver);
+	renderer.setOnImageReady<PipelineDriver, &PipelineDriver::imageDone>(driver);
+
+	// a small scene so commits restart the frame like edits from the client do
+	for (int c = 0; c < 100; ++c) {
+		const std::string plugin = "node" + std::to_string(c);
+		renderer.newPlugin(plugin, "Node");
+		renderer.setValue(plugin, "transform", std::to_string(c));
+	}
+	renderer.commit();
+
+	renderer.startSync();
+	uint64_t framesDone = 0;
+	int edits = 0;
+	double elapsed = 0.;
+	Bench::runFor(CASE_SECONDS, [&]() {
+		if (settings.production) {
+			// start the next frame as soon as one is done
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			if (renderer.getCounters().frames == framesDone) {
+				return;
+			}
+			++framesDone;
+		} else {
+			// an edit every half second, the RT image starts converging again
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		}
+		renderer.setValue("node0", "transform", std::to_string(++edits));
+		renderer.commit();
+	}, elapsed);
+	renderer.stop();
+
+	const FakeRenderer::Counters counters = renderer.getCounters();
+	const uint64_t callbacks = settings.production ? counters.buckets : counters.rtImages;
+	const std::string caseName = "fakePipeline/" + name;
+	Bench::report(caseName, settings.production ? "buckets" : "rt images", callbacks / elapsed, "/s");
+	Bench::report(caseName, "pipeline per callback", callbacks ? driver.getCallbackSeconds() / callbacks * 1e6 : 0., "us");
+	Bench::report(caseName, "output", driver.getOutputBytes() / elapsed / (1 << 20), "MB/s");
+	if (settings.production) {
+		Bench::report(caseName, "frames", static_cast<double>(counters.frames), "");
+	}
+}
+
+} // namespace
+
+BENCHMARK(fakePipeline) {
+	FakeRenderer::Settings rt;
+	rt.rtImagesPerSecond = UNLIMITED_RATE;
+	rt.progressPerSecond = 0.;
+	runCase("rt 1080p jpeg", rt, RtMode::Jpeg, 1);
+	runCase("rt 1080p jpeg 1/2", rt, RtMode::Jpeg, 2);
+	runCase("rt 1080p half", rt, RtMode::Half, 1);
+	runCase("rt 1080p delta", rt, RtMode::Delta, 1);
+
+	FakeRenderer::Settings production;
+	production.production = true;
+	production.bucketsPerSecond = UNLIMITED_RATE;
+	production.progressPerSecond = 0.;
+	runCase("production 1080p buckets 64", production, RtMode::Half, 1);
+	production.bucketSize = 16;
+	runCase("production 1080p buckets 16", production, RtMode::Half, 1);
+}
@@ -0,0 +1,333 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "fake_renderer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+/// Level of the dump messages, V-Ray's MessageInfo
+const int DUMP_LEVEL = 29999;
+
+/// RT images stop changing after this pass, the noise is then below what the client can see
+const int CONVERGED_PASS = 12;
+
+/// Passes reported as the whole progress of an RT frame
+const int RT_PROGRESS_PASSES = 100;
+
+/// Size of the checker squares of the final image
+const int CHECKER_SIZE = 32;
+
+/// Integer hash, spreads the bits of @value over the result
+uint32_t mix(uint32_t value) {
+	value ^= value >> 16;
+	value *= 0x7feb352dU;
+	value ^= value >> 15;
+	value *= 0x846ca68bU;
+	value ^= value >> 16;
+	return value;
+}
+
+/// Get the time of the callback after the one @due, a thread that fell behind skips the missed ones
+high_resolution_clock::time_point nextDue(high_resolution_clock::time_point due, high_resolution_clock::time_point now, double perSecond) {
+	const auto period = duration_cast<high_resolution_clock::duration>(duration<double>(1. / perSecond));
+	due += period;
+	return due < now - period ? now : due;
+}
+}
+
+FakeRenderer::FakeRenderer(const Settings & settings)
+	: settings(settings)
+	, sceneVersion(0)
+	, dirty(false)
+	, canvasWidth(0)
+	, canvasHeight(0)
+	, running(false)
+	, aborted(false)
+	, woken(false)
+	, rtImageCount(0)
+	, bucketCount(0)
+	, frameCount(0)
+	, progressCount(0)
+{}
+
+FakeRenderer::~FakeRenderer() {
+	stop();
+}
+
+bool FakeRenderer::newPlugin(const string & name, const string & type) {
+	lock_guard<mutex> lock(sceneMtx);
+	Plugin plugin;
+	plugin.type = type;
+	dirty = true;
+	return plugins.emplace(name, move(plugin)).second;
+}
+
+bool FakeRenderer::removePlugin(const string & name) {
+	lock_guard<mutex> lock(sceneMtx);
+	dirty = true;
+	return plugins.erase(name) != 0;
+}
+
+bool FakeRenderer::setValue(const string & name, const string & property, const string & value) {
+	lock_guard<mutex> lock(sceneMtx);
+	auto iter = plugins.find(name);
+	if (iter == plugins.end()) {
+		return false;
+	}
+	iter->second.properties[property] = value;
+	dirty = true;
+	return true;
+}
+
+bool FakeRenderer::getValue(const string & name, const string & property, string & value) const {
+	lock_guard<mutex> lock(sceneMtx);
+	auto plugin = plugins.find(name);
+	if (plugin == plugins.end()) {
+		return false;
+	}
+	auto iter = plugin->second.properties.find(property);
+	if (iter == plugin->second.properties.end()) {
+		return false;
+	}
+	value = iter->second;
+	return true;
+}
+
+size_t FakeRenderer::getPluginCount() const {
+	lock_guard<mutex> lock(sceneMtx);
+	return plugins.size();
+}
+
+void FakeRenderer::commit() {
+	{
+		lock_guard<mutex> lock(sceneMtx);
+		if (!dirty) {
+			return;
+		}
+		++sceneVersion;
+		dirty = false;
+	}
+	wakeUp();
+}
+
+void FakeRenderer::reset() {
+	stop();
+	lock_guard<mutex> lock(sceneMtx);
+	plugins.clear();
+	++sceneVersion;
+	dirty = false;
+}
+
+bool FakeRenderer::setImageSize(int width, int height) {
+	if (width <= 0 || height <= 0) {
+		return false;
+	}
+	{
+		lock_guard<mutex> lock(sceneMtx);
+		settings.width = width;
+		settings.height = height;
+	}
+	wakeUp();
+	return true;
+}
+
+bool FakeRenderer::getImageSize(int & width, int & height) const {
+	lock_guard<mutex> lock(sceneMtx);
+	width = settings.width;
+	height = settings.height;
+	return true;
+}
+
+bool FakeRenderer::startSync() {
+	if (running) {
+		return false;
+	}
+	rtImageCount = bucketCount = frameCount = progressCount = 0;
+	aborted = false;
+	running = true;
+	thread = std::thread(&FakeRenderer::run, this);
+	return true;
+}
+
+void FakeRenderer::stop() {
+	{
+		lock_guard<mutex> lock(threadMtx);
+		running = false;
+	}
+	threadCond.notify_all();
+	if (thread.joinable()) {
+		thread.join();
+		aborted = true;
+	}
+}
+
+void FakeRenderer::wakeUp() {
+	{
+		lock_guard<mutex> lock(threadMtx);
+		woken = true;
+	}
+	threadCond.notify_all();
+}
+
+FakeRenderer::Image * FakeRenderer::getImage() {
+	return new Image(canvas.data(), canvasWidth, canvasHeight);
+}
+
+FakeRenderer::Counters FakeRenderer::getCounters() const {
+	Counters counters;
+	counters.rtImages = rtImageCount;
+	counters.buckets = bucketCount;
+	counters.frames = frameCount;
+	counters.progress = progressCount;
+	return counters;
+}
+
+VRay::AColor FakeRenderer::shade(int x, int y, uint32_t version) const {
+	// gradients with a checker that moves with each commit, smooth areas and sharp edges like a real image
+	const bool checker = ((x + static_cast<int>(version) * 7) / CHECKER_SIZE + y / CHECKER_SIZE) & 1;
+	return VRay::AColor(
+		static_cast<float>(x) / canvasWidth,
+		static_cast<float>(y) / canvasHeight,
+		checker ? 0.8f : 0.2f,
+		1.f);
+}
+
+void FakeRenderer::renderPass(int pass, uint32_t version) {
+	const float noise = pass < CONVERGED_PASS ? 0.5f / static_cast<float>(1 << pass) : 0.f;
+	const uint32_t passSeed = mix(settings.seed ^ mix(version) ^ mix(static_cast<uint32_t>(std::min(pass, CONVERGED_PASS))));
+	for (int y = 0; y < canvasHeight; ++y) {
+		VRay::AColor * row = canvas.data() + static_cast<size_t>(y) * canvasWidth;
+		for (int x = 0; x < canvasWidth; ++x) {
+			VRay::AColor color = shade(x, y, version);
+			if (noise > 0.f) {
+				const float offset = (static_cast<float>(mix(passSeed ^ static_cast<uint32_t>(y * canvasWidth + x)) >> 8) / 16777216.f - 0.5f) * noise;
+				color.color.r += offset;
+				color.color.g += offset;
+				color.color.b += offset;
+			}
+			row[x] = color;
+		}
+	}
+}
+
+void FakeRenderer::renderBucket(int x, int y, int width, int height, uint32_t version) {
+	bucket.resize(static_cast<size_t>(width) * height);
+	for (int row = 0; row < height; ++row) {
+		VRay::AColor * bucketRow = bucket.data() + static_cast<size_t>(row) * width;
+		VRay::AColor * canvasRow = canvas.data() + static_cast<size_t>(y + row) * canvasWidth + x;
+		for (int column = 0; column < width; ++column) {
+			bucketRow[column] = canvasRow[column] = shade(x + column, y + row, version);
+		}
+	}
+}
+
+void FakeRenderer::run() {
+	const auto start = high_resolution_clock::now();
+	auto nextImage = start, nextBucket = start, nextProgress = start;
+	uint32_t renderedVersion = 0;
+	int pass = 0;
+	int bucketIndex = 0;
+	bool frameDone = false;
+	bool first = true;
+	char message[128];
+
+	while (running) {
+		uint32_t version;
+		int width, height;
+		{
+			lock_guard<mutex> lock(sceneMtx);
+			version = sceneVersion;
+			width = settings.width;
+			height = settings.height;
+		}
+		if (first || version != renderedVersion || width != canvasWidth || height != canvasHeight) {
+			// scene or size changed, start the frame again
+			first = false;
+			renderedVersion = version;
+			canvasWidth = width;
+			canvasHeight = height;
+			canvas.assign(static_cast<size_t>(width) * height, VRay::AColor(0.f, 0.f, 0.f, 0.f));
+			pass = 0;
+			bucketIndex = 0;
+			frameDone = false;
+		}
+
+		const int bucketSize = std::max(settings.bucketSize, 1);
+		const int columns = (canvasWidth + bucketSize - 1) / bucketSize;
+		const int bucketTotal = columns * ((canvasHeight + bucketSize - 1) / bucketSize);
+
+		auto now = high_resolution_clock::now();
+		if (settings.progressPerSecond > 0. && now >= nextProgress) {
+			int done, total;
+			if (settings.production) {
+				done = bucketIndex;
+				total = bucketTotal;
+				snprintf(message, sizeof(message), "Rendering bucket %d of %d", done, total);
+			} else {
+				done = std::min(pass, RT_PROGRESS_PASSES);
+				total = RT_PROGRESS_PASSES;
+				snprintf(message, sizeof(message), "Rendering pass %d", pass);
+			}
+			if (onProgress) {
+				onProgress(*this, message, done, total);
+			}
+			if (onDumpMessage) {
+				onDumpMessage(*this, message, DUMP_LEVEL);
+			}
+			++progressCount;
+			nextProgress = nextDue(nextProgress, now, settings.progressPerSecond);
+		}
+
+		if (!settings.production) {
+			if (settings.rtImagesPerSecond > 0. && now >= nextImage) {
+				renderPass(pass++, version);
+				Image image(canvas.data(), canvasWidth, canvasHeight);
+				if (onRTImageUpdated) {
+					onRTImageUpdated(*this, &image);
+				}
+				++rtImageCount;
+				nextImage = nextDue(nextImage, high_resolution_clock::now(), settings.rtImagesPerSecond);
+			}
+		} else if (!frameDone && settings.bucketsPerSecond > 0. && now >= nextBucket) {
+			const int x = (bucketIndex % columns) * bucketSize;
+			const int y = (bucketIndex / columns) * bucketSize;
+			const int bucketWidth = std::min(bucketSize, canvasWidth - x);
+			const int bucketHeight = std::min(bucketSize, canvasHeight - y);
+			renderBucket(x, y, bucketWidth, bucketHeight, version);
+			Image image(bucket.data(), bucketWidth, bucketHeight);
+			if (onBucketReady) {
+				onBucketReady(*this, x, y, "localhost", &image);
+			}
+			++bucketCount;
+			if (++bucketIndex == bucketTotal) {
+				frameDone = true;
+				++frameCount;
+				if (onImageReady) {
+					onImageReady(*this);
+				}
+			}
+			nextBucket = nextDue(nextBucket, high_resolution_clock::now(), settings.bucketsPerSecond);
+		}
+
+		// sleep until the next callback is due
+		auto wake = now + seconds(1);
+		if (settings.progressPerSecond > 0.) {
+			wake = std::min(wake, nextProgress);
+		}
+		if (!settings.production && settings.rtImagesPerSecond > 0.) {
+			wake = std::min(wake, nextImage);
+		}
+		if (settings.production && !frameDone && settings.bucketsPerSecond > 0.) {
+			wake = std::min(wake, nextBucket);
+		}
+		now = high_resolution_clock::now();
+		if (wake > now) {
+			unique_lock<mutex> lock(threadMtx);
+			threadCond.wait_until(lock, wake, [this] { return !running || woken; });
+			woken = false;
+		}
+	}
+}
@@ -0,0 +1,234 @@
+#ifndef FAKE_RENDERER_H
+#define FAKE_RENDERER_H
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+
+#include <vraysdk.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Deterministic stand-in for VRay::VRayRenderer's callbacks, so the image pipeline can be benchmarked without V-Ray
+/// It is not a RendererBackend, RendererController still needs the AppSDK for it's plugin values.
+/// Plugins are kept in memory as property name to value text. After @startSync a thread emits progress, buckets
+/// and RT images at the configured rates through callbacks registered like the SDK's setOnX<T, &T::method>.
+/// The pixels depend only on the seed, the RT pass and the number of commits, so every run sends the same images.
+class FakeRenderer {
+public:
+	/// Image passed to the callbacks, same accessors as VRay::VRayImage, valid only during the callback
+	class Image {
+	public:
+		Image(): pixels(nullptr), width(0), height(0) {}
+		Image(const VRay::AColor * pixels, int width, int height): pixels(pixels), width(width), height(height) {}
+
+		bool getSize(int & outWidth, int & outHeight) const {
+			outWidth = width;
+			outHeight = height;
+			return pixels != nullptr;
+		}
+
+		/// @count - set to the number of pixels
+		const VRay::AColor * getPixelData(size_t & count) const {
+			count = static_cast<size_t>(width) * height;
+			return pixels;
+		}
+
+	private:
+		const VRay::AColor * pixels; ///< Tightly packed pixels
+		int width; ///< Width of @pixels
+		int height; ///< Height of @pixels
+	};
+
+	/// What is emitted and how often, a rate <= 0 disables that callback
+	struct Settings {
+		Settings()
+			: width(1920)
+			, height(1080)
+			, bucketSize(64)
+			, production(false)
+			, rtImagesPerSecond(30.)
+			, bucketsPerSecond(2000.)
+			, progressPerSecond(10.)
+			, seed(1)
+		{}
+
+		int width; ///< Image width, changed by @setImageSize
+		int height; ///< Image height, changed by @setImageSize
+		int bucketSize; ///< Size of the square buckets in production mode
+		bool production; ///< Emit buckets and one final image instead of RT images
+		double rtImagesPerSecond; ///< RT image updates per second
+		double bucketsPerSecond; ///< Buckets per second in production mode
+		double progressPerSecond; ///< Progress and dump messages per second
+		uint32_t seed; ///< Seed for the pixels
+	};
+
+	explicit FakeRenderer(const Settings & settings);
+	~FakeRenderer();
+
+	FakeRenderer(const FakeRenderer &) = delete;
+	FakeRenderer & operator=(const FakeRenderer &) = delete;
+
+	/// Create plugin @name, fails if it exists
+	bool newPlugin(const std::string & name, const std::string & type);
+
+	/// Remove plugin @name
+	/// @return - false if there is no such plugin
+	bool removePlugin(const std::string & name);
+
+	/// Set @property of plugin @name to @value
+	/// @return - false if there is no such plugin
+	bool setValue(const std::string & name, const std::string & property, const std::string & value);
+
+	/// Get @property of plugin @name
+	/// @return - false if the plugin or the property does not exist
+	bool getValue(const std::string & name, const std::string & property, std::string & value) const;
+
+	/// Get number of plugins in the scene
+	size_t getPluginCount() const;
+
+	/// Apply the changes since the last commit, RT rendering starts again from the first pass
+	void commit();
+
+	/// Remove all plugins and stop rendering
+	void reset();
+
+	/// Change the image size, the current frame starts again
+	bool setImageSize(int width, int height);
+
+	bool getImageSize(int & width, int & height) const;
+
+	/// Start emitting callbacks on the render thread
+	bool startSync();
+
+	/// Stop the render thread, no callbacks are running after it returns
+	void stop();
+
+	/// True after @stop until the next @startSync, like VRayRenderer::isAborted
+	bool isAborted() const { return aborted; }
+
+	/// Get the final image of a production frame, the caller owns it like VRayRenderer::getImage
+	/// The pixels are valid only during the image ready callback
+	Image * getImage();
+
+	/// Number of callbacks emitted since @startSync
+	struct Counters {
+		uint64_t rtImages; ///< RT image updates
+		uint64_t buckets; ///< Buckets
+		uint64_t frames; ///< Finished production frames
+		uint64_t progress; ///< Progress messages
+	};
+	Counters getCounters() const;
+
+	template <class T, void (T::*TMethod)(FakeRenderer &, const char * msg, int elementNumber, int elementsCount, void *)>
+	void setOnProgress(T & object, const void * userData = nullptr) {
+		T * target = &object;
+		void * arg = const_cast<void *>(userData);
+		onProgress = [target, arg](FakeRenderer & renderer, const char * msg, int elementNumber, int elementsCount) {
+			(target->*TMethod)(renderer, msg, elementNumber, elementsCount, arg);
+		};
+	}
+
+	template <class T, void (T::*TMethod)(FakeRenderer &, Image * img, void *)>
+	void setOnRTImageUpdated(T & object, const void * userData = nullptr) {
+		T * target = &object;
+		void * arg = const_cast<void *>(userData);
+		onRTImageUpdated = [target, arg](FakeRenderer & renderer, Image * img) {
+			(target->*TMethod)(renderer, img, arg);
+		};
+	}
+
+	template <class T, void (T::*TMethod)(FakeRenderer &, void *)>
+	void setOnImageReady(T & object, const void * userData = nullptr) {
+		T * target = &object;
+		void * arg = const_cast<void *>(userData);
+		onImageReady = [target, arg](FakeRenderer & renderer) {
+			(target->*TMethod)(renderer, arg);
+		};
+	}
+
+	template <class T, void (T::*TMethod)(FakeRenderer &, int x, int y, const char * host, Image * img, void *)>
+	void setOnBucketReady(T & object, const void * userData = nullptr) {
+		T * target = &object;
+		void * arg = const_cast<void *>(userData);
+		onBucketReady = [target, arg](FakeRenderer & renderer, int x, int y, const char * host, Image * img) {
+			(target->*TMethod)(renderer, x, y, host, img, arg);
+		};
+	}
+
+	template <class T, void (T::*TMethod)(FakeRenderer &, const char * msg, int level, void *)>
+	void setOnDumpMessage(T & object, const void * userData = nullptr) {
+		T * target = &object;
+		void * arg = const_cast<void *>(userData);
+		onDumpMessage = [target, arg](FakeRenderer & renderer, const char * msg, int level) {
+			(target->*TMethod)(renderer, msg, level, arg);
+		};
+	}
+
+private:
+	/// One plugin of the scene
+	struct Plugin {
+		std::string type; ///< Plugin type
+		std::map<std::string, std::string> properties; ///< Property name to value text
+	};
+
+	/// Render thread base
+	void run();
+
+	/// Wake the render thread so it notices a changed scene, it could be waiting after a finished frame
+	void wakeUp();
+
+	/// Fill @canvas with RT pass @pass, the noise halves every pass like in a converging image
+	void renderPass(int pass, uint32_t version);
+
+	/// Fill @bucket with the pixels of the final image at @x, @y and copy them in @canvas
+	void renderBucket(int x, int y, int width, int height, uint32_t version);
+
+	/// Pixel of the final image, the RT passes converge to it
+	VRay::AColor shade(int x, int y, uint32_t version) const;
+
+	Settings settings; ///< Rates and sizes, width and height are protected by @sceneMtx
+
+	mutable std::mutex sceneMtx; ///< Protects @plugins, @sceneVersion and the image size
+	std::map<std::string, Plugin> plugins; ///< The scene
+	uint32_t sceneVersion; ///< Incremented by each @commit and @reset
+	bool dirty; ///< Set by plugin changes, cleared by @commit
+
+	std::vector<VRay::AColor> canvas; ///< Current RT pass or final image, only used by the render thread
+	std::vector<VRay::AColor> bucket; ///< Current bucket, only used by the render thread
+	int canvasWidth; ///< Width of @canvas
+	int canvasHeight; ///< Height of @canvas
+
+	std::function<void(FakeRenderer &, const char *, int, int)> onProgress;
+	std::function<void(FakeRenderer &, Image *)> onRTImageUpdated;
+	std::function<void(FakeRenderer &)> onImageReady;
+	std::function<void(FakeRenderer &, int, int, const char *, Image *)> onBucketReady;
+	std::function<void(FakeRenderer &, const char *, int)> onDumpMessage;
+
+	std::atomic<bool> running; ///< Cleared by @stop
+	std::atomic<bool> aborted; ///< Set by @stop, cleared by @startSync
+	bool woken; ///< Set by @wakeUp, protected by @threadMtx
+	std::mutex threadMtx; ///< Guards the sleeps of the render thread so @stop and @wakeUp can wake it
+	std::condition_variable threadCond; ///< Signaled by @stop
+	std::thread thread; ///< The render thread
+
+	std::atomic<uint64_t> rtImageCount; ///< See Counters::rtImages
+	std::atomic<uint64_t> bucketCount; ///< See Counters::buckets
+	std::atomic<uint64_t> frameCount; ///< See Counters::frames
+	std::atomic<uint64_t> progressCount; ///< See Counters::progress
+};
+
+#endif // FAKE_RENDERER_H
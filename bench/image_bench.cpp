@@ -0,0 +1,100 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "bench.h"
+#include "utils/image_resampler.h"
+#include "utils/image_utils.h"
+#include "utils/jpeg_encoder.h"
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The per image work of RendererController::sendImages on a 1080p frame: cropping the render region out of the
+// renderer's image, converting to the formats sent to the client, shrinking to the display size and JPEG encoding.
+// Each step runs alone so a regression shows up in the step that caused it, the whole pipeline is in fakePipeline.
+
+namespace {
+
+const int WIDTH = 1920;
+const int HEIGHT = 1080;
+
+/// Min time each case runs, short steps are repeated until it passes
+const double CASE_SECONDS = 0.5;
+
+/// Image with smooth gradients and some noise, close to a converging RT image
+std::vector<VRay::AColor> makeImage(int width, int height) {
+	std::vector<VRay::AColor> image(static_cast<size_t>(width) * height);
+	uint32_t seed = 12345;
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			seed = seed * 1664525u + 1013904223u;
+			const float noise = (seed >> 8) * (1.f / (1 << 24)) * 0.1f;
+			const float u = static_cast<float>(x) / width;
+			const float v = static_cast<float>(y) / height;
+			image[static_cast<size_t>(y) * width + x] = VRay::AColor(u + noise, v + noise, 0.5f + 0.5f * std::sin(u * 20.f), 1.f);
+		}
+	}
+	return image;
+}
+
+/// Run @step until CASE_SECONDS pass, report time per image and the rate of source pixels
+template <typename F>
+void runCase(const std::string & name, size_t pixels, F step) {
+	step();
+	double elapsed = 0.;
+	const int count = Bench::runFor(CASE_SECONDS, step, elapsed);
+	const std::string caseName = "imageConversion/" + name;
+	Bench::report(caseName, "per image", elapsed / count * 1e3, "ms");
+	Bench::report(caseName, "source", pixels * count / elapsed / 1e6, "Mpix/s");
+}
+
+} // namespace
+
+BENCHMARK(imageConversion) {
+	const std::vector<VRay::AColor> image = makeImage(WIDTH, HEIGHT);
+	const size_t area = image.size();
+	// render region in the middle of the frame, read straight from the renderer's image like sendImages does
+	const ImageUtils::Region region(WIDTH / 6, HEIGHT / 6, WIDTH * 2 / 3, HEIGHT * 2 / 3);
+
+	std::vector<VRay::AColor> cropped(region.area());
+	runCase("crop region", region.area(), [&]() {
+		ImageUtils::copyRegion(image.data(), WIDTH, region, cropped.data());
+	});
+
+	std::vector<uint8_t> packed(area * ImageUtils::packedPixelSize(ImageUtils::RGBA_HALF));
+	runCase("rgba half", area, [&]() {
+		ImageUtils::convertToPacked(image.data(), area, ImageUtils::RGBA_HALF, packed.data());
+	});
+	runCase("rgba srgb8", area, [&]() {
+		ImageUtils::convertToPacked(image.data(), area, ImageUtils::RGBA_SRGB_8, packed.data());
+	});
+
+	// render elements are sent at their native channel count
+	std::vector<float> channels(area * 3);
+	runCase("3 channels", area, [&]() {
+		ImageUtils::packChannels(image.data(), area, 3, channels.data());
+	});
+	runCase("1 channel", area, [&]() {
+		ImageUtils::packChannels(image.data(), area, 1, channels.data());
+	});
+
+	ImageResampler resampler;
+	std::vector<VRay::AColor> scaled(area);
+	runCase("resize 1/2", area, [&]() {
+		resampler.resize(image.data(), WIDTH, WIDTH, HEIGHT, WIDTH / 2, HEIGHT / 2, scaled.data());
+	});
+	runCase("resize to 1280x720", area, [&]() {
+		resampler.resize(image.data(), WIDTH, WIDTH, HEIGHT, 1280, 720, scaled.data());
+	});
+
+	JpegEncoder encoder;
+	runCase("jpeg q60", area, [&]() {
+		encoder.encode(image.data(), WIDTH, WIDTH, HEIGHT, 60);
+	});
+	runCase("jpeg q90", area, [&]() {
+		encoder.encode(image.data(), WIDTH, WIDTH, HEIGHT, 90);
+	});
+	runCase("jpeg region", region.area(), [&]() {
+		encoder.encode(image.data() + static_cast<size_t>(region.top) * WIDTH + region.left, WIDTH, region.width, region.height, 60);
+	});
+}
@@ -0,0 +1,245 @@
+#include "load_client.h"
+
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+/// Time between heartbeat PINGs, well below HEARBEAT_TIMEOUT
+const milliseconds HEARTBEAT_INTERVAL(HEARBEAT_TIMEOUT / 4);
+
+/// Max time to wait for the server to create the renderer after connect
+const milliseconds CREATE_TIMEOUT(EXPORTER_TIMEOUT);
+
+/// Longest poll while waiting for the next message time, so @stop is noticed
+const milliseconds MAX_POLL(50);
+
+double toSeconds(high_resolution_clock::duration duration) {
+	return duration_cast<nanoseconds>(duration).count() * 1e-9;
+}
+
+bool isConnect(const zmq::message_t & control) {
+	const ControlFrame frame(control);
+	return frame.control == ControlMessage::EXPORTER_CONNECT_MSG || frame.control == ControlMessage::HEARTBEAT_CONNECT_MSG;
+}
+}
+
+void LoadScript::add(uint64_t timeNs, zmq::message_t && control, zmq::message_t && payload) {
+	storage.push_back(move(control));
+	const zmq::message_t & controlStored = storage.back();
+	storage.push_back(move(payload));
+	const zmq::message_t & payloadStored = storage.back();
+
+	Step step;
+	step.timeNs = timeNs;
+	step.control = static_cast<const char *>(controlStored.data());
+	step.controlSize = controlStored.size();
+	step.payload = static_cast<const char *>(payloadStored.data());
+	step.payloadSize = payloadStored.size();
+	steps.push_back(step);
+}
+
+LoadClient::LoadClient(zmq::context_t & context, const LoadSettings & settings, uint64_t id, const LoadScript & script)
+	: context(context)
+	, settings(settings)
+	, id(id)
+	, script(&script)
+	, type(ClientType::Exporter)
+	, pingWaiting(false)
+	, created(false)
+	, running(false)
+	, done(false)
+	, results()
+{}
+
+LoadClient::LoadClient(zmq::context_t & context, const LoadSettings & settings, uint64_t id)
+	: context(context)
+	, settings(settings)
+	, id(id)
+	, script(nullptr)
+	, type(ClientType::Heartbeat)
+	, pingWaiting(false)
+	, created(false)
+	, running(false)
+	, done(false)
+	, results()
+{}
+
+void LoadClient::start() {
+	results = Results();
+	results.firstImageSeconds = -1;
+	running = true;
+	thread = std::thread(&LoadClient::run, this);
+}
+
+void LoadClient::stop() {
+	running = false;
+}
+
+void LoadClient::join() {
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void LoadClient::ping(zmq::socket_t & socket, time_point now) {
+	if (pingWaiting || !created) {
+		return;
+	}
+	// the controller answers all PINGs received in one poll with one PONG, so only one can be in flight
+	socket.send(ControlFrame::make(type, ControlMessage::PING_MSG), ZMQ_SNDMORE);
+	socket.send(zmq::message_t(0));
+	pingWaiting = true;
+	pingTime = now;
+}
+
+bool LoadClient::receive(zmq::socket_t & socket, time_point now) {
+	while (true) {
+		zmq::message_t control, payload;
+		try {
+			if (!socket.recv(&control, ZMQ_DONTWAIT)) {
+				return true;
+			}
+			socket.recv(&payload);
+		} catch (zmq::error_t & ex) {
+			fprintf(stderr, "Client %llu failed receiving: %s\n", static_cast<unsigned long long>(id), ex.what());
+			return false;
+		}
+
+		const ControlFrame frame(control);
+		if (frame.control == ControlMessage::PONG_MSG) {
+			if (pingWaiting) {
+				results.pingSeconds.push_back(toSeconds(now - pingTime));
+				pingWaiting = false;
+			}
+		} else if (frame.control == ControlMessage::RENDERER_CREATE_MSG || frame.control == ControlMessage::HEARTBEAT_CREATE_MSG) {
+			created = true;
+		} else if (frame.control == ControlMessage::DATA_MSG && payload.size()) {
+			const VRayMessage message = VRayMessage::fromZmqMessage(payload);
+			if (message.getValueType() == VRayBaseTypes::ValueType::ValueTypeImageSet) {
+				if (!results.images) {
+					results.firstImageSeconds = toSeconds(now - connectTime);
+				}
+				++results.images;
+			}
+		}
+	}
+}
+
+bool LoadClient::waitCreated(zmq::socket_t & socket) {
+	const auto deadline = high_resolution_clock::now() + CREATE_TIMEOUT;
+	while (!created && running) {
+		const auto now = high_resolution_clock::now();
+		if (now >= deadline) {
+			fprintf(stderr, "Client %llu: server did not create renderer in time\n", static_cast<unsigned long long>(id));
+			return false;
+		}
+		zmq::pollitem_t item = {socket, 0, ZMQ_POLLIN, 0};
+		zmq::poll(&item, 1, static_cast<long>(MAX_POLL.count()));
+		if (!receive(socket, high_resolution_clock::now())) {
+			return false;
+		}
+	}
+	return created;
+}
+
+void LoadClient::run() {
+	zmq::socket_t socket(context, ZMQ_DEALER);
+	try {
+		socket.setsockopt(ZMQ_IDENTITY, &id, sizeof(id));
+		socket.setsockopt(ZMQ_SNDHWM, 0);
+		socket.setsockopt(ZMQ_RCVHWM, 0);
+		socket.connect(settings.address.c_str());
+	} catch (zmq::error_t & ex) {
+		fprintf(stderr, "Client %llu failed to connect: %s\n", static_cast<unsigned long long>(id), ex.what());
+		results.failed = true;
+		done = true;
+		return;
+	}
+
+	const auto start = high_resolution_clock::now();
+	connectTime = start;
+	try {
+		if (!script) {
+			socket.send(ControlFrame::make(ClientType::Heartbeat, ControlMessage::HEARTBEAT_CONNECT_MSG), ZMQ_SNDMORE);
+			socket.send(zmq::message_t(0));
+			results.failed = !waitCreated(socket);
+			auto lastPing = start;
+			while (running && !results.failed) {
+				const auto now = high_resolution_clock::now();
+				if (now - lastPing >= HEARTBEAT_INTERVAL) {
+					// a lost PONG must not stop the heartbeat, the server would drop us
+					pingWaiting = false;
+					ping(socket, now);
+					lastPing = now;
+				}
+				zmq::pollitem_t item = {socket, 0, ZMQ_POLLIN, 0};
+				zmq::poll(&item, 1, static_cast<long>(MAX_POLL.count()));
+				results.failed = !receive(socket, high_resolution_clock::now());
+			}
+		} else {
+			time_point firstSend, lastSend;
+			int sinceLastPing = 0;
+			for (const LoadScript::Step & step : script->steps) {
+				if (!running || results.failed) {
+					break;
+				}
+				if (settings.speed > 0) {
+					const auto due = start + nanoseconds(static_cast<int64_t>(step.timeNs / settings.speed));
+					for (auto now = high_resolution_clock::now(); now < due && running; now = high_resolution_clock::now()) {
+						const auto wait = min(duration_cast<milliseconds>(due - now) + milliseconds(1), MAX_POLL);
+						zmq::pollitem_t item = {socket, 0, ZMQ_POLLIN, 0};
+						zmq::poll(&item, 1, static_cast<long>(wait.count()));
+						results.failed = results.failed || !receive(socket, high_resolution_clock::now());
+					}
+				}
+
+				// frames are sent without copy, the script keeps them alive
+				zmq::message_t control(const_cast<char *>(step.control), step.controlSize, nullptr);
+				zmq::message_t payload(const_cast<char *>(step.payload), step.payloadSize, nullptr);
+				const bool connect = isConnect(control);
+				const auto now = high_resolution_clock::now();
+				if (connect) {
+					connectTime = now;
+					created = false;
+				}
+				socket.send(control, ZMQ_SNDMORE);
+				socket.send(payload);
+				if (!results.messages) {
+					firstSend = now;
+				}
+				lastSend = now;
+				++results.messages;
+				results.bytes += step.payloadSize;
+
+				if (connect) {
+					results.failed = !waitCreated(socket);
+				} else {
+					results.failed = !receive(socket, now);
+					if (++sinceLastPing >= settings.pingEvery) {
+						ping(socket, now);
+						sinceLastPing = 0;
+					}
+				}
+			}
+			results.sendSeconds = toSeconds(lastSend - firstSend);
+
+			// wait for the renderer to catch up and send images
+			ping(socket, high_resolution_clock::now());
+			const auto lingerEnd = high_resolution_clock::now() + milliseconds(settings.lingerMs);
+			while (running && !results.failed && high_resolution_clock::now() < lingerEnd) {
+				zmq::pollitem_t item = {socket, 0, ZMQ_POLLIN, 0};
+				zmq::poll(&item, 1, static_cast<long>(MAX_POLL.count()));
+				results.failed = !receive(socket, high_resolution_clock::now());
+			}
+		}
+	} catch (zmq::error_t & ex) {
+		fprintf(stderr, "Client %llu failed: %s\n", static_cast<unsigned long long>(id), ex.what());
+		results.failed = true;
+	}
+
+	socket.setsockopt(ZMQ_LINGER, 0);
+	socket.close();
+	done = true;
+}
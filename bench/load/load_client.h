@@ -0,0 +1,118 @@
+#ifndef LOAD_CLIENT_H
+#define LOAD_CLIENT_H
+
+#include <zmq.hpp>
+#include <zmq_wrapper.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Messages one exporter client sends, in order
+struct LoadScript {
+	/// One message
+	struct Step {
+		uint64_t timeNs; ///< When to send it relative to the client start, before applying the speed
+		const char * control; ///< Control frame
+		size_t controlSize; ///< Size of @control
+		const char * payload; ///< Payload frame
+		size_t payloadSize; ///< Size of @payload
+	};
+
+	std::vector<Step> steps; ///< The messages
+	std::deque<zmq::message_t> storage; ///< Frames of messages added with @add, recorded ones point into the SessionReader
+
+	/// Append message made with the wrapper, takes ownership of the frames
+	void add(uint64_t timeNs, zmq::message_t && control, zmq::message_t && payload);
+};
+
+/// Settings shared by all clients of a load run
+struct LoadSettings {
+	LoadSettings()
+		: speed(1.0)
+		, pingEvery(16)
+		, lingerMs(5000)
+	{}
+
+	std::string address; ///< Server address, for example tcp://127.0.0.1:5555
+	double speed; ///< Multiplier for the script times, 0 sends everything as fast as possible
+	int pingEvery; ///< Send PING after this many messages if there is no PING waiting for PONG
+	int lingerMs; ///< How long to wait for images and PONG after the last message
+};
+
+/// One stand-in for a Blender exporter or heartbeat client, runs on it's own thread
+/// Exporters send their script and measure the PING round trip through the message stream, which is answered
+/// only after the server handled the messages before it. Heartbeat clients only ping until stopped.
+class LoadClient {
+public:
+	/// Results, valid after @join
+	struct Results {
+		uint64_t messages; ///< Messages sent
+		uint64_t bytes; ///< Payload bytes sent
+		double sendSeconds; ///< Time from the first to the last message sent
+		std::vector<double> pingSeconds; ///< Round trip of each answered PING
+		double firstImageSeconds; ///< Time from connecting to the first image received, < 0 if none
+		uint64_t images; ///< Image messages received
+		bool failed; ///< True if the client could not connect or send
+	};
+
+	/// Exporter that sends @script, @script must outlive the client
+	LoadClient(zmq::context_t & context, const LoadSettings & settings, uint64_t id, const LoadScript & script);
+
+	/// Heartbeat client
+	LoadClient(zmq::context_t & context, const LoadSettings & settings, uint64_t id);
+
+	LoadClient(const LoadClient &) = delete;
+	LoadClient & operator=(const LoadClient &) = delete;
+
+	/// Start the client thread
+	void start();
+
+	/// Ask heartbeat client to stop, exporters stop by themselves after their script
+	void stop();
+
+	/// Wait for the client thread
+	void join();
+
+	/// Check if the thread returned
+	bool isDone() const { return done; }
+
+	const Results & getResults() const { return results; }
+
+private:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// Thread base
+	void run();
+
+	/// Send PING if none is waiting for PONG
+	void ping(zmq::socket_t & socket, time_point now);
+
+	/// Receive all available messages
+	/// @return - false on socket error
+	bool receive(zmq::socket_t & socket, time_point now);
+
+	/// Wait for the server to create our renderer after connect message
+	bool waitCreated(zmq::socket_t & socket);
+
+	zmq::context_t & context; ///< Context for the socket
+	const LoadSettings settings; ///< Copy of the run settings
+	const uint64_t id; ///< Client id, used as socket identity
+	const LoadScript * script; ///< Messages to send, null for heartbeat clients
+	const ClientType type; ///< Exporter or heartbeat
+
+	time_point connectTime; ///< When the connect message was sent
+	time_point pingTime; ///< When the waiting PING was sent
+	bool pingWaiting; ///< True if PONG was not yet received for the last PING
+	bool created; ///< True after the server created our renderer
+
+	std::atomic<bool> running; ///< Cleared by @stop
+	std::atomic<bool> done; ///< Set when @run returns
+	std::thread thread; ///< The client thread
+	Results results; ///< Written by the client thread
+};
+
+#endif // LOAD_CLIENT_H
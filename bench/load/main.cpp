@@ -0,0 +1,341 @@
+#include "load_client.h"
+#include "session_reader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Load benchmark for a running VRayZmqServer: starts exporter clients that replay a recording made with
+// -recordSession or send a generated scene, plus heartbeat clients, and reports what they measured.
+
+using namespace std;
+using namespace std::chrono;
+using namespace VRayBaseTypes;
+
+namespace {
+
+/// Time between generated edits, same as a viewport dragging at 30 fps
+const uint64_t EDIT_INTERVAL_NS = 33 * 1000 * 1000;
+
+/// Time between RSS samples
+const milliseconds RSS_INTERVAL(100);
+
+struct Settings {
+	Settings()
+		: port("5555")
+		, host("127.0.0.1")
+		, exporters(1)
+		, heartbeats(1)
+		, objects(100)
+		, vertices(10000)
+		, edits(300)
+		, width(1280)
+		, height(720)
+		, serverPid(0)
+	{}
+
+	std::string port; ///< Server port
+	std::string host; ///< Server host
+	std::string replay; ///< Recording to replay, empty for generated scene
+	int exporters; ///< Number of exporter clients
+	int heartbeats; ///< Number of heartbeat clients
+	int objects; ///< Meshes in the generated scene
+	int vertices; ///< Vertices per generated mesh
+	int edits; ///< Transform changes sent after the generated scene is rendering
+	int width; ///< Image width of the generated scene
+	int height; ///< Image height of the generated scene
+	int serverPid; ///< Process to sample RSS of, 0 to skip
+	LoadSettings client; ///< Settings for each client
+};
+
+void printHelp() {
+	puts("VRayZmqServer_load - load benchmark for a running VRayZmqServer");
+	puts("-host <host>\tServer host, default 127.0.0.1");
+	puts("-p <port>\tServer port, default 5555");
+	puts("-replay <file>\tReplay session recorded with -recordSession, each recorded exporter is one client");
+	puts("-exporters <n>\tNumber of exporter clients, recorded sessions are repeated to fill them, default 1");
+	puts("-heartbeats <n>\tNumber of heartbeat clients, default 1");
+	puts("-speed <x>\tPlay the messages x times faster than recorded, 0 sends as fast as possible, default 1");
+	puts("-objects <n>\tMeshes in the generated scene, default 100");
+	puts("-vertices <n>\tVertices per generated mesh, default 10000");
+	puts("-edits <n>\tTransform changes at 30 per second after the generated scene starts rendering, default 300");
+	puts("-size <w> <h>\tImage size of the generated scene, default 1280 720");
+	puts("-pingEvery <n>\tMeasure latency with PING after every n messages, default 16");
+	puts("-linger <ms>\tWait for images after the last message, default 5000");
+	puts("-serverPid <pid>\tSample resident memory of the server process (Linux only)");
+}
+
+bool parseArgv(Settings & settings, int argc, char * argv[]) {
+	for (int c = 1; c < argc; ++c) {
+		const bool hasValue = c + 1 < argc;
+		if (!strcmp(argv[c], "-host") && hasValue) {
+			settings.host = argv[++c];
+		} else if (!strcmp(argv[c], "-p") && hasValue) {
+			settings.port = argv[++c];
+		} else if (!strcmp(argv[c], "-replay") && hasValue) {
+			settings.replay = argv[++c];
+		} else if (!strcmp(argv[c], "-exporters") && hasValue) {
+			settings.exporters = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-heartbeats") && hasValue) {
+			settings.heartbeats = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-speed") && hasValue) {
+			settings.client.speed = atof(argv[++c]);
+		} else if (!strcmp(argv[c], "-objects") && hasValue) {
+			settings.objects = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-vertices") && hasValue) {
+			settings.vertices = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-edits") && hasValue) {
+			settings.edits = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-size") && c + 2 < argc) {
+			settings.width = atoi(argv[++c]);
+			settings.height = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-pingEvery") && hasValue) {
+			settings.client.pingEvery = max(1, atoi(argv[++c]));
+		} else if (!strcmp(argv[c], "-linger") && hasValue) {
+			settings.client.lingerMs = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-serverPid") && hasValue) {
+			settings.serverPid = atoi(argv[++c]);
+		} else {
+			return false;
+		}
+	}
+	return settings.exporters >= 0 && settings.heartbeats >= 0;
+}
+
+/// Add DATA message to @script
+void addData(LoadScript & script, uint64_t timeNs, zmq::message_t && payload) {
+	script.add(timeNs, ControlFrame::make(ClientType::Exporter, ControlMessage::DATA_MSG), move(payload));
+}
+
+/// Make script that exports @settings.objects meshes, starts RT rendering and moves the objects around
+void generateScene(const Settings & settings, LoadScript & script) {
+	script.add(0, ControlFrame::make(ClientType::Exporter, ControlMessage::EXPORTER_CONNECT_MSG), zmq::message_t(0));
+	addData(script, 0, VRayMessage::msgRendererInit(VRayMessage::RendererType::RT, VRayMessage::DRFlags::None));
+	addData(script, 0, VRayMessage::msgRendererResize(settings.width, settings.height));
+
+	mt19937 rng(42);
+	uniform_real_distribution<float> coord(-10.f, 10.f);
+	const int triangles = max(1, settings.vertices - 2);
+	for (int c = 0; c < settings.objects; ++c) {
+		const std::string mesh = "mesh" + to_string(c);
+		const std::string node = "node" + to_string(c);
+
+		AttrListVector vertices(settings.vertices);
+		for (int v = 0; v < settings.vertices; ++v) {
+			(*vertices)[v] = AttrVector(coord(rng), coord(rng), coord(rng));
+		}
+		AttrListInt faces(triangles * 3);
+		for (int f = 0; f < triangles; ++f) {
+			(*faces)[f * 3] = f;
+			(*faces)[f * 3 + 1] = f + 1;
+			(*faces)[f * 3 + 2] = f + 2;
+		}
+
+		addData(script, 0, VRayMessage::msgPluginCreate(mesh, "GeomStaticMesh"));
+		addData(script, 0, VRayMessage::msgPluginSetProperty(mesh, "vertices", vertices));
+		addData(script, 0, VRayMessage::msgPluginSetProperty(mesh, "faces", faces));
+		addData(script, 0, VRayMessage::msgPluginCreate(node, "Node"));
+		addData(script, 0, VRayMessage::msgPluginSetProperty(node, "geometry", AttrPlugin(mesh)));
+		addData(script, 0, VRayMessage::msgPluginSetProperty(node, "transform", AttrTransform()));
+	}
+	addData(script, 0, VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetCommitAction, static_cast<int>(CommitAction::CommitNow)));
+	addData(script, 0, VRayMessage::msgRendererAction(VRayMessage::RendererAction::Start));
+
+	for (int c = 0; c < settings.edits; ++c) {
+		const uint64_t time = (c + 1) * EDIT_INTERVAL_NS;
+		AttrTransform tm;
+		tm.offs = AttrVector(coord(rng), coord(rng), coord(rng));
+		const std::string node = "node" + to_string(c % max(1, settings.objects));
+		addData(script, time, VRayMessage::msgPluginSetProperty(node, "transform", tm));
+		addData(script, time, VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetCommitAction, static_cast<int>(CommitAction::CommitNow)));
+	}
+}
+
+/// Make script from recorded session, times are made relative to it's first message
+void makeReplayScript(const SessionReader::Session & session, LoadScript & script) {
+	const uint64_t start = session.messages.empty() ? 0 : session.messages.front().timeNs;
+	for (const SessionReader::Message & message : session.messages) {
+		LoadScript::Step step;
+		step.timeNs = message.timeNs - start;
+		step.control = message.control;
+		step.controlSize = message.controlSize;
+		step.payload = message.payload;
+		step.payloadSize = message.payloadSize;
+		script.steps.push_back(step);
+	}
+}
+
+/// Check if the first message of @session is an exporter connecting
+bool isExporterSession(const SessionReader::Session & session) {
+	if (session.messages.empty()) {
+		return false;
+	}
+	const SessionReader::Message & first = session.messages.front();
+	const zmq::message_t control(first.control, first.controlSize);
+	return ControlFrame(control).control == ControlMessage::EXPORTER_CONNECT_MSG;
+}
+
+/// Get resident memory of process @pid in bytes, 0 if not available
+uint64_t getRss(int pid) {
+#ifdef __linux__
+	std::ifstream status(("/proc/" + to_string(pid) + "/status").c_str());
+	std::string line;
+	while (getline(status, line)) {
+		if (!line.compare(0, 6, "VmRSS:")) {
+			return strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+		}
+	}
+#else
+	(void)pid;
+#endif
+	return 0;
+}
+
+void report(const std::string & name, const std::string & metric, double value, const char * unit) {
+	printf("%-40s %-24s %14.3f %s\n", name.c_str(), metric.c_str(), value, unit);
+}
+
+/// Report percentiles of @samples in milliseconds
+void reportLatency(const std::string & name, std::vector<double> samples) {
+	if (samples.empty()) {
+		printf("%-40s no samples\n", name.c_str());
+		return;
+	}
+	sort(samples.begin(), samples.end());
+	report(name, "samples", static_cast<double>(samples.size()), "");
+	report(name, "p50", samples[samples.size() / 2] * 1e3, "ms");
+	report(name, "p90", samples[samples.size() * 90 / 100] * 1e3, "ms");
+	report(name, "p99", samples[samples.size() * 99 / 100] * 1e3, "ms");
+	report(name, "max", samples.back() * 1e3, "ms");
+}
+
+} // namespace
+
+int main(int argc, char * argv[]) {
+	Settings settings;
+	if (!parseArgv(settings, argc, argv)) {
+		printHelp();
+		return 1;
+	}
+	settings.client.address = "tcp://" + settings.host + ":" + settings.port;
+
+	SessionReader reader;
+	std::vector<std::unique_ptr<LoadScript>> scripts;
+	if (!settings.replay.empty()) {
+		if (!reader.load(settings.replay)) {
+			return 1;
+		}
+		if (reader.getDroppedCount()) {
+			printf("Warning: recording is missing %llu messages, replay may fail\n", static_cast<unsigned long long>(reader.getDroppedCount()));
+		}
+		for (const SessionReader::Session & session : reader.getSessions()) {
+			// recorded heartbeat clients are replaced by -heartbeats
+			if (isExporterSession(session)) {
+				scripts.emplace_back(new LoadScript());
+				makeReplayScript(session, *scripts.back());
+			}
+		}
+		if (scripts.empty()) {
+			fprintf(stderr, "No exporter sessions in %s\n", settings.replay.c_str());
+			return 1;
+		}
+	} else {
+		scripts.emplace_back(new LoadScript());
+		generateScene(settings, *scripts.back());
+	}
+
+	zmq::context_t context(1);
+	mt19937_64 rng(random_device{}());
+	std::vector<std::unique_ptr<LoadClient>> exporters, heartbeats;
+	for (int c = 0; c < settings.heartbeats; ++c) {
+		heartbeats.emplace_back(new LoadClient(context, settings.client, rng()));
+	}
+	for (int c = 0; c < settings.exporters; ++c) {
+		exporters.emplace_back(new LoadClient(context, settings.client, rng(), *scripts[c % scripts.size()]));
+	}
+
+	printf("Load on %s: %d exporters (%d %s), %d heartbeats, speed %g\n", settings.client.address.c_str(),
+		settings.exporters, static_cast<int>(scripts.size()), settings.replay.empty() ? "generated scene" : "recorded sessions",
+		settings.heartbeats, settings.client.speed);
+
+	const uint64_t rssBefore = settings.serverPid ? getRss(settings.serverPid) : 0;
+	uint64_t rssPeak = rssBefore;
+
+	const auto begin = high_resolution_clock::now();
+	for (auto & client : heartbeats) {
+		client->start();
+	}
+	for (auto & client : exporters) {
+		client->start();
+	}
+
+	while (true) {
+		bool running = false;
+		for (const auto & client : exporters) {
+			running = running || !client->isDone();
+		}
+		if (!running) {
+			break;
+		}
+		if (settings.serverPid) {
+			rssPeak = max(rssPeak, getRss(settings.serverPid));
+		}
+		this_thread::sleep_for(RSS_INTERVAL);
+	}
+	const double elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - begin).count() * 1e-9;
+
+	for (auto & client : heartbeats) {
+		client->stop();
+	}
+	for (auto & client : heartbeats) {
+		client->join();
+	}
+	for (auto & client : exporters) {
+		client->join();
+	}
+
+	uint64_t messages = 0, bytes = 0, images = 0;
+	int failed = 0;
+	double sendSeconds = 0;
+	std::vector<double> exporterPings, heartbeatPings, firstImages;
+	for (const auto & client : exporters) {
+		const LoadClient::Results & results = client->getResults();
+		messages += results.messages;
+		bytes += results.bytes;
+		images += results.images;
+		failed += results.failed;
+		sendSeconds = max(sendSeconds, results.sendSeconds);
+		exporterPings.insert(exporterPings.end(), results.pingSeconds.begin(), results.pingSeconds.end());
+		if (results.firstImageSeconds >= 0) {
+			firstImages.push_back(results.firstImageSeconds);
+		}
+	}
+	for (const auto & client : heartbeats) {
+		const LoadClient::Results & results = client->getResults();
+		failed += results.failed;
+		heartbeatPings.insert(heartbeatPings.end(), results.pingSeconds.begin(), results.pingSeconds.end());
+	}
+
+	report("load", "run time", elapsed, "s");
+	report("load", "failed clients", failed, "");
+	report("load/send", "messages", static_cast<double>(messages), "");
+	report("load/send", "messages/s", sendSeconds > 0 ? messages / sendSeconds : 0, "msg/s");
+	report("load/send", "throughput", sendSeconds > 0 ? bytes / sendSeconds / (1024 * 1024) : 0, "MB/s");
+	reportLatency("load/exporter ping", exporterPings);
+	reportLatency("load/heartbeat ping", heartbeatPings);
+	report("load/images", "received", static_cast<double>(images), "");
+	reportLatency("load/time to first image", firstImages);
+	if (settings.serverPid) {
+		report("load/server", "RSS before", rssBefore / (1024. * 1024.), "MB");
+		report("load/server", "RSS peak", rssPeak / (1024. * 1024.), "MB");
+	}
+	return failed ? 2 : 0;
+}
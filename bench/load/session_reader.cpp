@@ -0,0 +1,74 @@
+#include "session_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+SessionReader::SessionReader()
+	: header()
+	, droppedCount(0)
+{}
+
+bool SessionReader::load(const std::string & path) {
+	std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+	if (!file) {
+		fprintf(stderr, "Failed to open recording %s\n", path.c_str());
+		return false;
+	}
+	const std::streamoff fileSize = file.tellg();
+	file.seekg(0);
+	data.resize(static_cast<size_t>(fileSize));
+	if (!file.read(data.data(), fileSize)) {
+		fprintf(stderr, "Failed to read recording %s\n", path.c_str());
+		return false;
+	}
+
+	if (data.size() < sizeof(header)) {
+		fprintf(stderr, "Recording %s is too small\n", path.c_str());
+		return false;
+	}
+	memcpy(&header, data.data(), sizeof(header));
+	if (memcmp(header.magic, SessionFormat::MAGIC, sizeof(header.magic)) || header.version != SessionFormat::VERSION) {
+		fprintf(stderr, "%s is not a session recording or has unsupported version\n", path.c_str());
+		return false;
+	}
+
+	sessions.clear();
+	droppedCount = 0;
+	std::unordered_map<uint64_t, size_t> sessionIndex;
+
+	size_t offset = sizeof(header);
+	while (offset + sizeof(SessionFormat::RecordHeader) <= data.size()) {
+		const SessionFormat::RecordHeader & record = *reinterpret_cast<const SessionFormat::RecordHeader *>(data.data() + offset);
+		const uint64_t size = SessionFormat::recordSize(record);
+		if (offset + size > data.size()) {
+			// the server was stopped while writing the last record
+			fprintf(stderr, "Recording %s ends with incomplete record, ignoring it\n", path.c_str());
+			break;
+		}
+		droppedCount += record.droppedBefore;
+
+		const char * frames = data.data() + offset + sizeof(record);
+		uint64_t clientId = 0;
+		memcpy(&clientId, frames, record.idSize < sizeof(clientId) ? record.idSize : sizeof(clientId));
+
+		auto iter = sessionIndex.find(clientId);
+		if (iter == sessionIndex.end()) {
+			iter = sessionIndex.emplace(clientId, sessions.size()).first;
+			sessions.push_back(Session());
+			sessions.back().clientId = clientId;
+		}
+
+		Message message;
+		message.timeNs = record.timeNs;
+		message.control = frames + record.idSize;
+		message.controlSize = record.controlSize;
+		message.payload = message.control + record.controlSize;
+		message.payloadSize = static_cast<size_t>(record.payloadSize);
+		sessions[iter->second].messages.push_back(message);
+
+		offset += static_cast<size_t>(size);
+	}
+	return true;
+}
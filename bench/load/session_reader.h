@@ -0,0 +1,52 @@
+#ifndef SESSION_READER_H
+#define SESSION_READER_H
+
+#include "session_format.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Reads a recording made by the server with -recordSession and splits it into the sessions of each client
+/// The frames point into the loaded file, so the reader must outlive everything that uses them.
+class SessionReader {
+public:
+	/// One recorded message
+	struct Message {
+		uint64_t timeNs; ///< When the server received it, relative to the start of the recording
+		const char * control; ///< Control frame
+		size_t controlSize; ///< Size of @control
+		const char * payload; ///< Payload frame
+		size_t payloadSize; ///< Size of @payload
+	};
+
+	/// All messages of one client in the order they were received
+	struct Session {
+		uint64_t clientId; ///< Id of the client in the recording
+		std::vector<Message> messages; ///< The messages
+	};
+
+	SessionReader();
+
+	/// Load and index the recording at @path
+	/// @return - false if the file can't be read or is not a valid recording
+	bool load(const std::string & path);
+
+	/// Get the sessions in the order the clients connected
+	const std::vector<Session> & getSessions() const { return sessions; }
+
+	/// Get the number of messages the recorder dropped, replaying a recording with gaps may not work
+	uint64_t getDroppedCount() const { return droppedCount; }
+
+	/// Get the header of the loaded recording
+	const SessionFormat::FileHeader & getHeader() const { return header; }
+
+private:
+	std::vector<char> data; ///< The whole file, 8 byte aligned by the allocator
+	SessionFormat::FileHeader header; ///< Copy of the file header
+	std::vector<Session> sessions; ///< Index of the messages in @data
+	uint64_t droppedCount; ///< Sum of droppedBefore of all records
+};
+
+#endif // SESSION_READER_H
@@ -0,0 +1,97 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "bench.h"
+#include "utils/logger.h"
+
+#include <cstdint>
+#include <string>
+
+// Logging overhead in the ZmqProxyServer forwarding loop: every forwarded message logs each socket operation at
+// Info level, which is disabled unless the server runs with -log info. The "function" cases call Logger::log which
+// evaluates all arguments, the "macro" cases use LOGGER_LOG which skips them for disabled levels.
+
+namespace {
+
+/// Messages forwarded per case
+const int MESSAGE_COUNT = 2000000;
+
+/// Name long enough to not fit in the small string buffer, like most plugin names
+const char PLUGIN_NAME[] = "BRDFVRayMtl@MaterialNodeTree_Material_Surface";
+
+/// Number of bytes the null callback received, keeps the formatting from being optimized out
+uint64_t loggedBytes = 0;
+
+/// Stands in for the socket calls between log messages
+inline void forward(volatile uint64_t & sink, int value) {
+	sink = sink + static_cast<uint64_t>(value);
+}
+
+/// One forwarded message with the same log calls as the proxy loop, logged with Logger::log
+void forwardFunction(volatile uint64_t & sink, int id) {
+	Logger::log(Logger::Info, "frontend.recv(&idMsg)");
+	forward(sink, id);
+	Logger::log(Logger::Info, "frontend.recv(&ctrlMsg)");
+	forward(sink, id);
+	Logger::log(Logger::Info, "frontend.recv(&payloadMsg)");
+	forward(sink, id);
+	Logger::log(Logger::Info, "backend.send(idMsg, ZMQ_SNDMORE) client", id);
+	forward(sink, id);
+	Logger::log(Logger::Info, "backend.send(ctrlMsg, ZMQ_SNDMORE) client", id);
+	forward(sink, id);
+	Logger::log(Logger::APIDump, "renderer.getPlugin(\"", std::string(PLUGIN_NAME), "\").setValue(\"diffuse\", ", id, ");");
+	forward(sink, id);
+}
+
+/// Same as @forwardFunction with LOGGER_LOG
+void forwardMacro(volatile uint64_t & sink, int id) {
+	LOGGER_LOG(Logger::Info, "frontend.recv(&idMsg)");
+	forward(sink, id);
+	LOGGER_LOG(Logger::Info, "frontend.recv(&ctrlMsg)");
+	forward(sink, id);
+	LOGGER_LOG(Logger::Info, "frontend.recv(&payloadMsg)");
+	forward(sink, id);
+	LOGGER_LOG(Logger::Info, "backend.send(idMsg, ZMQ_SNDMORE) client", id);
+	forward(sink, id);
+	LOGGER_LOG(Logger::Info, "backend.send(ctrlMsg, ZMQ_SNDMORE) client", id);
+	forward(sink, id);
+	LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", std::string(PLUGIN_NAME), "\").setValue(\"diffuse\", ", id, ");");
+	forward(sink, id);
+}
+
+/// The loop without any logging
+void forwardNone(volatile uint64_t & sink, int id) {
+	for (int c = 0; c < 6; ++c) {
+		forward(sink, id);
+	}
+}
+
+/// Run @function for MESSAGE_COUNT messages with the global logger at @level, report time per message
+template <typename F>
+void runForwarding(const char * name, Logger::Level level, F function, int count = MESSAGE_COUNT) {
+	Logger::getInstance().setCurrentlevel(level);
+	volatile uint64_t sink = 0;
+	const double begin = Bench::now();
+	for (int c = 0; c < count; ++c) {
+		function(sink, c);
+	}
+	const double elapsed = Bench::now() - begin;
+	Bench::report(std::string("logger/") + name, "per message", elapsed / count * 1e9, "ns");
+}
+
+} // namespace
+
+BENCHMARK(loggerForwarding) {
+	Logger::getInstance().setCallback([](Logger::Level, const std::string & msg) {
+		loggedBytes += msg.size();
+	});
+
+	runForwarding("none", Logger::Warning, forwardNone);
+	runForwarding("function/disabled", Logger::Warning, forwardFunction);
+	runForwarding("macro/disabled", Logger::Warning, forwardMacro);
+	// formatting is much slower, fewer messages are enough
+	runForwarding("function/enabled", Logger::APIDump, forwardFunction, MESSAGE_COUNT / 20);
+	runForwarding("macro/enabled", Logger::APIDump, forwardMacro, MESSAGE_COUNT / 20);
+
+	Bench::report("logger/enabled", "bytes formatted", static_cast<double>(loggedBytes), "B");
+	Logger::getInstance().setCallback(Logger::StringCb());
+	Logger::getInstance().setCurrentlevel(Logger::Debug);
+}
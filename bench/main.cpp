@@ -0,0 +1,142 @@
+#define VRAY_RUNTIME_LOAD_PRIMARY
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+
+#include <vraysdk.hpp>
+
+#include "bench.h"
+#include "utils/version.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Entry {
+	const char * name;
+	Bench::Function function;
+};
+
+/// One reported value, kept for the JSON output
+struct Result {
+	std::string name;
+	std::string metric;
+	double value;
+	const char * unit;
+};
+
+std::vector<Entry> & getEntries() {
+	static std::vector<Entry> entries;
+	return entries;
+}
+
+std::vector<Result> & getResults() {
+	static std::vector<Result> results;
+	return results;
+}
+
+/// Write @text as a JSON string, benchmark names are ours so only quotes and backslashes are escaped
+void writeJsonString(std::ostream & out, const std::string & text) {
+	out << '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			out << '\\';
+		}
+		out << c;
+	}
+	out << '"';
+}
+
+/// Write all results to @path with the server version and the time of the run
+bool writeJson(const std::string & path) {
+	std::ofstream out(path, std::ios::trunc);
+	if (!out) {
+		return false;
+	}
+	char date[32] = {0, };
+	const std::time_t now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+	out.precision(10);
+	out << "{\n\t\"version\": \"" << VERSION_MAJOR << '.' << VERSION_MINOR << "\",\n\t\"date\": \"" << date << "\",\n\t\"results\": [";
+	const std::vector<Result> & results = getResults();
+	for (size_t c = 0; c < results.size(); ++c) {
+		const Result & result = results[c];
+		out << (c ? ",\n\t\t{" : "\n\t\t{") << "\"name\": ";
+		writeJsonString(out, result.name);
+		out << ", \"metric\": ";
+		writeJsonString(out, result.metric);
+		out << ", \"value\": " << result.value << ", \"unit\": ";
+		writeJsonString(out, result.unit);
+		out << '}';
+	}
+	out << "\n\t]\n}\n";
+	return !!out;
+}
+
+} // namespace
+
+namespace Bench {
+
+bool add(const char * name, const Function & function) {
+	getEntries().push_back(Entry{name, function});
+	return true;
+}
+
+void report(const std::string & name, const std::string & metric, double value, const char * unit) {
+	printf("%-40s %-24s %14.3f %s\n", name.c_str(), metric.c_str(), value, unit);
+	fflush(stdout);
+	getResults().push_back(Result{name, metric, value, unit});
+}
+
+double now() {
+	using namespace std::chrono;
+	return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace Bench
+
+/// Run all benchmarks, or only the ones whose name contains one of the arguments
+/// -list prints the names, -json <file> also writes the results to <file>
+int main(int argc, char * argv[]) {
+	if (argc > 1 && !strcmp(argv[1], "-list")) {
+		for (const Entry & entry : getEntries()) {
+			puts(entry.name);
+		}
+		return 0;
+	}
+
+	std::string jsonPath;
+	std::vector<const char *> filters;
+	for (int c = 1; c < argc; ++c) {
+		if (!strcmp(argv[c], "-json") && c + 1 < argc) {
+			jsonPath = argv[++c];
+		} else {
+			filters.push_back(argv[c]);
+		}
+	}
+
+	for (const Entry & entry : getEntries()) {
+		bool selected = filters.empty();
+		for (size_t c = 0; c < filters.size() && !selected; ++c) {
+			selected = strstr(entry.name, filters[c]) != nullptr;
+		}
+		if (selected) {
+			entry.function();
+		}
+	}
+
+	if (!jsonPath.empty() && !writeJson(jsonPath)) {
+		fprintf(stderr, "Failed to write %s\n", jsonPath.c_str());
+		return 1;
+	}
+	return 0;
+}
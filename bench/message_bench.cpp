@@ -0,0 +1,145 @@
+#include "bench.h"
+
+#include <zmq.hpp>
+#include <zmq_wrapper.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Decoding of client messages on the controller's run thread. VRayMessage::fromZmqMessage runs for every DATA
+// message before RendererController::handle, the payloads here are the ones the exporter sends most: transform
+// edits while the user drags an object, meshes on export and plugin and value lists for instancers and materials.
+
+using namespace VRayBaseTypes;
+
+namespace {
+
+/// Min time each case runs
+const double CASE_SECONDS = 0.5;
+
+/// Names like the exporter's, too long for the small string buffer
+std::string pluginName(const char * prefix, int index) {
+	return std::string(prefix) + "@Object_" + std::to_string(index) + "_MaterialNodeTree";
+}
+
+/// Decode @payload until CASE_SECONDS pass, report time per message and decode rate
+void runDecode(const std::string & name, const zmq::message_t & payload) {
+	double elapsed = 0.;
+	const int count = Bench::runFor(CASE_SECONDS, [&payload]() {
+		const VRayMessage message = VRayMessage::fromZmqMessage(payload);
+	}, elapsed);
+	const std::string caseName = "fromZmqMessage/" + name;
+	Bench::report(caseName, "per message", elapsed / count * 1e6, "us");
+	Bench::report(caseName, "decode", payload.size() * count / elapsed / (1 << 20), "MB/s");
+}
+
+/// Counts the values found by @walkValue
+struct WalkResult {
+	size_t floats;
+	size_t plugins;
+	size_t nameBytes;
+};
+
+/// Walk a decoded value the way RendererController::toVrayValue recurses, building the plugin reference names
+/// It does not create VRay::Values or look the plugins up in the renderer, both need a loaded AppSDK, so this is only
+/// the message side of that conversion and not a measure of toVrayValue itself
+void walkValue(const AttrValue & value, WalkResult & result) {
+	switch (value.type) {
+	case ValueType::ValueTypeListValue: {
+		const auto & list = value.as<AttrListValue>();
+		for (int c = 0; c < list.getCount(); ++c) {
+			walkValue((*list)[c], result);
+		}
+		break;
+	}
+	case ValueType::ValueTypeListPlugin: {
+		const auto & list = value.as<AttrListPlugin>();
+		for (int c = 0; c < list.getCount(); ++c) {
+			const auto & plugin = (*list)[c];
+			auto pluginRef = plugin.plugin;
+			if (!plugin.output.empty()) {
+				pluginRef += "::" + plugin.output;
+			}
+			result.nameBytes += pluginRef.size();
+			++result.plugins;
+		}
+		break;
+	}
+	case ValueType::ValueTypeFloat:
+		++result.floats;
+		break;
+	default:
+		break;
+	}
+}
+
+/// Decode @payload and walk it's value until CASE_SECONDS pass
+void runWalk(const std::string & name, const zmq::message_t & payload) {
+	const VRayMessage message = VRayMessage::fromZmqMessage(payload);
+	WalkResult result = {0, 0, 0};
+	double elapsed = 0.;
+	const int count = Bench::runFor(CASE_SECONDS, [&message, &result]() {
+		walkValue(message.getAttrValue(), result);
+	}, elapsed);
+	const std::string caseName = "attrValueWalk/" + name;
+	Bench::report(caseName, "per value", elapsed / count * 1e6, "us");
+	Bench::report(caseName, "items", (result.floats + result.plugins) / elapsed / 1e6, "M/s");
+}
+
+/// List of @count lists with @size floats each, like the exporter's ramp and curve values
+AttrListValue makeNestedList(int count, int size) {
+	AttrListValue outer(count);
+	for (int c = 0; c < count; ++c) {
+		AttrListValue inner(size);
+		for (int i = 0; i < size; ++i) {
+			(*inner)[i] = AttrValue(static_cast<float>(c * size + i) * 0.01f);
+		}
+		(*outer)[c] = AttrValue(inner);
+	}
+	return outer;
+}
+
+/// List of @count plugin references, every other one to a plugin output
+AttrListPlugin makePluginList(int count) {
+	AttrListPlugin list(count);
+	for (int c = 0; c < count; ++c) {
+		AttrPlugin plugin(pluginName("Node", c));
+		if (c % 2) {
+			plugin.output = "out_color";
+		}
+		(*list)[c] = plugin;
+	}
+	return list;
+}
+
+} // namespace
+
+BENCHMARK(fromZmqMessage) {
+	AttrTransform transform;
+	transform.offs = AttrVector(1.f, 2.f, 3.f);
+	runDecode("transform edit", VRayMessage::msgPluginSetProperty(pluginName("Node", 0), "transform", transform));
+
+	runDecode("renderer action", VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetCommitAction, static_cast<int>(CommitAction::CommitNow)));
+
+	const int vertexCount = 100000;
+	AttrListVector vertices(vertexCount);
+	for (int c = 0; c < vertexCount; ++c) {
+		(*vertices)[c] = AttrVector(c * 0.1f, c * 0.2f, c * 0.3f);
+	}
+	runDecode("mesh 100k vertices", VRayMessage::msgPluginSetProperty(pluginName("Geom", 0), "vertices", vertices));
+
+	AttrListInt faces(vertexCount * 3);
+	for (int c = 0; c < vertexCount * 3; ++c) {
+		(*faces)[c] = c / 3 + c % 3;
+	}
+	runDecode("mesh 100k faces", VRayMessage::msgPluginSetProperty(pluginName("Geom", 0), "faces", faces));
+
+	runDecode("plugin list 1k", VRayMessage::msgPluginSetProperty(pluginName("Instancer", 0), "nodes", makePluginList(1000)));
+	runDecode("nested list 100x16", VRayMessage::msgPluginSetProperty(pluginName("TexRamp", 0), "values", makeNestedList(100, 16)));
+}
+
+BENCHMARK(attrValueWalk) {
+	runWalk("nested list 100x16", VRayMessage::msgPluginSetProperty(pluginName("TexRamp", 0), "values", makeNestedList(100, 16)));
+	runWalk("plugin list 1k", VRayMessage::msgPluginSetProperty(pluginName("Instancer", 0), "nodes", makePluginList(1000)));
+}
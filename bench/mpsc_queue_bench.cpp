@@ -0,0 +1,137 @@
+#include "bench.h"
+#include "utils/mpsc_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Outbound message queue of RendererController: many V-Ray callback threads produce, the run thread consumes
+// and sends up to MAX_CONSEQ_MESSAGES per iteration. The "locked" case is the previous design where the
+// consumer holds the queue lock while sending, the sending is simulated with a short spin.
+
+namespace {
+
+/// Messages sent per consumer iteration, same as MAX_CONSEQ_MESSAGES
+const int BATCH_SIZE = 16;
+
+/// Simulated cost of zmq send for one message
+const double SEND_SECONDS = 1e-6;
+
+/// Messages pushed by each producer
+const int PUSH_COUNT = 100000;
+
+struct Message {
+	uint64_t producer;
+	uint64_t sequence;
+};
+
+void spin(double seconds) {
+	const double end = Bench::now() + seconds;
+	while (Bench::now() < end) {}
+}
+
+/// Queue with the same interface as MpscQueue, guarded by mutex
+class LockedQueue {
+public:
+	void push(Message && message) {
+		std::lock_guard<std::mutex> lock(mtx);
+		messages.push_back(message);
+	}
+
+	/// Take and "send" up to BATCH_SIZE messages while holding the lock
+	int sendBatch() {
+		std::lock_guard<std::mutex> lock(mtx);
+		int sent = 0;
+		for (; sent < BATCH_SIZE && !messages.empty(); ++sent) {
+			spin(SEND_SECONDS);
+			messages.pop_front();
+		}
+		return sent;
+	}
+
+private:
+	std::mutex mtx;
+	std::deque<Message> messages;
+};
+
+/// MpscQueue consumer, sends without any lock held
+class LockFreeQueue {
+public:
+	void push(Message && message) {
+		queue.push(std::move(message));
+	}
+
+	int sendBatch() {
+		int sent = 0;
+		for (; sent < BATCH_SIZE && queue.peek(); ++sent) {
+			spin(SEND_SECONDS);
+			queue.pop();
+		}
+		return sent;
+	}
+
+private:
+	MpscQueue<Message> queue;
+};
+
+/// Run @producers threads pushing into @queue while one thread consumes, report push latency and throughput
+template <typename Queue>
+void runContention(const char * name, int producers) {
+	Queue queue;
+	std::atomic<int> ready(0);
+	std::atomic<bool> start(false);
+	std::vector<std::vector<double>> latencies(producers);
+	std::vector<std::thread> threads;
+
+	for (int p = 0; p < producers; ++p) {
+		threads.emplace_back([&, p]() {
+			std::vector<double> & samples = latencies[p];
+			samples.reserve(PUSH_COUNT);
+			++ready;
+			while (!start) {}
+			for (int c = 0; c < PUSH_COUNT; ++c) {
+				const double before = Bench::now();
+				queue.push(Message{static_cast<uint64_t>(p), static_cast<uint64_t>(c)});
+				samples.push_back(Bench::now() - before);
+			}
+		});
+	}
+	while (ready != producers) {}
+
+	const double begin = Bench::now();
+	start = true;
+	const int total = producers * PUSH_COUNT;
+	for (int sent = 0; sent < total;) {
+		sent += queue.sendBatch();
+	}
+	const double elapsed = Bench::now() - begin;
+	for (std::thread & thread : threads) {
+		thread.join();
+	}
+
+	std::vector<double> all;
+	all.reserve(total);
+	for (const std::vector<double> & samples : latencies) {
+		all.insert(all.end(), samples.begin(), samples.end());
+	}
+	std::sort(all.begin(), all.end());
+
+	const std::string caseName = std::string(name) + "/" + std::to_string(producers) + " producers";
+	Bench::report(caseName, "messages/s", total / elapsed, "msg/s");
+	Bench::report(caseName, "push p50", all[all.size() / 2] * 1e9, "ns");
+	Bench::report(caseName, "push p99", all[all.size() * 99 / 100] * 1e9, "ns");
+	Bench::report(caseName, "push max", all.back() * 1e9, "ns");
+}
+
+} // namespace
+
+BENCHMARK(mpscQueueContention) {
+	const int maxProducers = std::max(2, static_cast<int>(std::thread::hardware_concurrency()) * 2);
+	for (int producers = 1; producers <= maxProducers; producers *= 2) {
+		runContention<LockedQueue>("mpscQueue/locked", producers);
+		runContention<LockFreeQueue>("mpscQueue/lockFree", producers);
+	}
+}
@@ -91,7 +91,7 @@ endmacro()
 
 macro(link_with_zmq _name)
 	if(UNIX)
-		target_link_libraries(${PROJECT_NAME}
+		target_link_libraries(${_name}
 			${LIBS_ROOT}/${CMAKE_SYSTEM_NAME}/zmq/lib/Release/libzmq.a
 			${LIBS_ROOT}/${CMAKE_SYSTEM_NAME}/sodium/lib/Release/libsodium.a
 			)
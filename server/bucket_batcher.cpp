@@ -0,0 +1,109 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "bucket_batcher.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace ImageUtils;
+
+namespace {
+/// Smallest rectangle containing both @a and @b
+Region unite(const Region & a, const Region & b) {
+	const int left = std::min(a.left, b.left);
+	const int top = std::min(a.top, b.top);
+	const int right = std::max(a.left + a.width, b.left + b.width);
+	const int bottom = std::max(a.top + a.height, b.top + b.height);
+	return Region(left, top, right - left, bottom - top);
+}
+}
+
+BucketBatcher::BucketBatcher(int maxDelayMs, size_t maxPixels, float minDensity)
+	: maxDelay(maxDelayMs)
+	, maxPixels(maxPixels)
+	, minDensity(minDensity)
+	, width(0)
+	, height(0)
+	, area(0)
+{}
+
+bool BucketBatcher::fits(const Region & bucket, int imageWidth, int imageHeight) const {
+	if (buckets.empty()) {
+		return true;
+	}
+	if (imageWidth != width || imageHeight != height) {
+		return false;
+	}
+	const Region united = unite(bounds, bucket);
+	return united.area() <= maxPixels && area + bucket.area() >= united.area() * minDensity;
+}
+
+bool BucketBatcher::add(const VRay::AColor * data, const Region & bucket, int imageWidth, int imageHeight, time_point now) {
+	if (imageWidth != width || imageHeight != height) {
+		// new image size, nothing from the old canvas is valid
+		width = imageWidth;
+		height = imageHeight;
+		canvas.assign(static_cast<size_t>(width) * height, VRay::AColor());
+		known.assign(static_cast<size_t>(width) * height, 0);
+	}
+
+	pasteRegion(data, bucket, canvas.data(), width);
+	for (int row = 0; row < bucket.height; ++row) {
+		memset(known.data() + static_cast<size_t>(bucket.top + row) * width + bucket.left, 1, bucket.width);
+	}
+
+	if (buckets.empty()) {
+		bounds = bucket;
+		firstAdded = now;
+	} else {
+		bounds = unite(bounds, bucket);
+	}
+	buckets.push_back(bucket);
+	area += bucket.area();
+	return bounds.area() >= maxPixels;
+}
+
+bool BucketBatcher::due(time_point now) const {
+	return !buckets.empty() && now - firstAdded >= maxDelay;
+}
+
+bool BucketBatcher::getDeadline(time_point & deadline) const {
+	if (buckets.empty()) {
+		return false;
+	}
+	deadline = firstAdded + maxDelay;
+	return true;
+}
+
+bool BucketBatcher::isKnown(const Region & region) const {
+	for (int row = 0; row < region.height; ++row) {
+		const uint8_t * line = known.data() + static_cast<size_t>(region.top + row) * width + region.left;
+		if (memchr(line, 0, region.width)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int BucketBatcher::take(std::vector<Region> & regions) {
+	regions.clear();
+	const int count = static_cast<int>(buckets.size());
+	if (count == 1 || (count > 1 && isKnown(bounds))) {
+		regions.push_back(bounds);
+	} else {
+		regions.swap(buckets);
+	}
+	buckets.clear();
+	area = 0;
+	return count;
+}
+
+void BucketBatcher::copy(const Region & region, VRay::AColor * out) const {
+	copyRegion(canvas.data(), width, region, out);
+}
+
+void BucketBatcher::reset() {
+	std::vector<VRay::AColor>().swap(canvas);
+	std::vector<uint8_t>().swap(known);
+	width = height = 0;
+	buckets.clear();
+	area = 0;
+}
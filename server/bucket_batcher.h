@@ -0,0 +1,68 @@
+#ifndef BUCKET_BATCHER_H
+#define BUCKET_BATCHER_H
+
+#include "utils/image_utils.h"
+#include <chrono>
+#include <vector>
+
+/// Gathers buckets from production renders so they can be sent as a few larger images
+/// Buckets are copied into a canvas of the full image, a batch is sent as the bounding rectangle of its buckets.
+/// Pixels in the rectangle that are not part of the batch are sent from the canvas, which is only allowed if the
+/// client already has them - otherwise each bucket of the batch is sent on it's own.
+class BucketBatcher {
+public:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// @maxDelayMs - max time a bucket waits in the batch
+	/// @maxPixels - max size of the batch's bounding rectangle
+	/// @minDensity - min part of the bounding rectangle that must be covered by the batch's buckets
+	BucketBatcher(int maxDelayMs, size_t maxPixels, float minDensity);
+
+	/// Check if @bucket can be added to the current batch, if not the batch must be taken first
+	/// @imageWidth, @imageHeight - size of the image the bucket is part of
+	bool fits(const ImageUtils::Region & bucket, int imageWidth, int imageHeight) const;
+
+	/// Copy a bucket in the canvas and add it to the batch
+	/// @data - tightly packed bucket pixels
+	/// @bucket - where the bucket is in the image, must be inside it
+	/// @return - true if the batch is full and should be taken
+	bool add(const VRay::AColor * data, const ImageUtils::Region & bucket, int imageWidth, int imageHeight, time_point now);
+
+	/// Check if the first bucket in the batch waited longer than the max delay
+	bool due(time_point now) const;
+
+	/// Get the time the batch becomes @due
+	/// @return - false if the batch is empty
+	bool getDeadline(time_point & deadline) const;
+
+	/// Get the regions to send for the current batch and start a new one
+	/// @regions - the bounding rectangle or each bucket on it's own, cleared if batch is empty
+	/// @return - number of buckets in the batch
+	int take(std::vector<ImageUtils::Region> & regions);
+
+	/// Copy @region of the canvas into @out, which must have space for @region.area() pixels
+	void copy(const ImageUtils::Region & region, VRay::AColor * out) const;
+
+	/// Free the canvas, the batch must be empty
+	void reset();
+
+private:
+	/// Check if every pixel of @region was sent to the client or is part of the batch
+	bool isKnown(const ImageUtils::Region & region) const;
+
+	const std::chrono::milliseconds maxDelay; ///< Max time a bucket waits
+	const size_t maxPixels; ///< Max area of @bounds
+	const float minDensity; ///< Min value of @area / @bounds area
+
+	std::vector<VRay::AColor> canvas; ///< Last data of all buckets for the current image
+	std::vector<uint8_t> known; ///< Non zero for each pixel of @canvas that was written
+	int width; ///< Width of @canvas
+	int height; ///< Height of @canvas
+
+	std::vector<ImageUtils::Region> buckets; ///< Buckets in the current batch
+	ImageUtils::Region bounds; ///< Bounding rectangle of @buckets
+	size_t area; ///< Sum of the areas of @buckets
+	time_point firstAdded; ///< Time the first bucket of the batch was added
+};
+
+#endif // BUCKET_BATCHER_H
@@ -0,0 +1,116 @@
+#include "client_link.h"
+#include <algorithm>
+
+using namespace std::chrono;
+
+namespace {
+/// Length of a drain rate measurement window
+const int WINDOW_MS = 100;
+/// Weight of a new saturated window in the drain rate estimate
+const double RATE_SMOOTHING = 0.3;
+}
+
+ClientLink::ClientLink(const std::function<void()> & onDrained)
+	: onDrained(onDrained)
+	, queuedTotal(0)
+	, forwardedTotal(0)
+	, drainRate(0)
+	, windowBytes(0)
+	, windowBlocked(false)
+	, refused(false)
+	, wakeBelow(0)
+	, stats()
+{}
+
+void ClientLink::queued(size_t bytes, time_point now) {
+	std::lock_guard<std::mutex> lock(mtx);
+	queuedTotal += bytes;
+	if (queuedTotal > forwardedTotal) {
+		pending.push_back(Pending{queuedTotal, now});
+	}
+}
+
+bool ClientLink::hasRoom(size_t window) {
+	std::lock_guard<std::mutex> lock(mtx);
+	const uint64_t outstanding = queuedTotal - std::min(queuedTotal, forwardedTotal);
+	if (outstanding < window) {
+		wakeBelow = 0;
+		return true;
+	}
+	wakeBelow = window;
+	return false;
+}
+
+void ClientLink::forwarded(size_t bytes, time_point now) {
+	bool wake = false;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		closeWindow(now);
+		forwardedTotal += bytes;
+		windowBytes += bytes;
+		refused = false;
+		stats.forwardedBytes += bytes;
+		while (!pending.empty() && pending.front().end <= forwardedTotal) {
+			stats.maxDelayUs = std::max<int64_t>(stats.maxDelayUs, duration_cast<microseconds>(now - pending.front().time).count());
+			pending.pop_front();
+		}
+		const uint64_t outstanding = queuedTotal - std::min(queuedTotal, forwardedTotal);
+		if (wakeBelow && outstanding < wakeBelow) {
+			wakeBelow = 0;
+			wake = true;
+		}
+	}
+	if (wake && onDrained) {
+		onDrained();
+	}
+}
+
+void ClientLink::blocked(time_point now) {
+	std::lock_guard<std::mutex> lock(mtx);
+	closeWindow(now);
+	windowBlocked = true;
+	refused = true;
+	++stats.blocked;
+}
+
+ClientLink::Sample ClientLink::sample(time_point now) {
+	std::lock_guard<std::mutex> lock(mtx);
+	closeWindow(now);
+	Sample result;
+	result.outstanding = static_cast<size_t>(queuedTotal - std::min(queuedTotal, forwardedTotal));
+	result.drainRate = drainRate;
+	if (!pending.empty()) {
+		result.delayUs = duration_cast<microseconds>(now - pending.front().time).count();
+	}
+	return result;
+}
+
+ClientLink::Stats ClientLink::takeStats() {
+	std::lock_guard<std::mutex> lock(mtx);
+	Stats result = stats;
+	stats = Stats();
+	return result;
+}
+
+void ClientLink::closeWindow(time_point now) {
+	if (windowStart == time_point()) {
+		windowStart = now;
+		return;
+	}
+	const int64_t elapsedUs = duration_cast<microseconds>(now - windowStart).count();
+	if (elapsedUs < WINDOW_MS * 1000) {
+		return;
+	}
+	const double rate = windowBytes * 1e6 / elapsedUs;
+	if (windowBlocked) {
+		// the socket was full, so it took exactly what the connection could carry
+		drainRate = drainRate > 0 ? drainRate + (rate - drainRate) * RATE_SMOOTHING : rate;
+	} else {
+		// nothing was held back, the connection can carry at least this much
+		drainRate = std::max(drainRate, rate);
+	}
+	windowStart = now;
+	windowBytes = 0;
+	// a message still held makes the next window saturated too
+	windowBlocked = refused;
+}
@@ -0,0 +1,88 @@
+#ifndef CLIENT_LINK_H
+#define CLIENT_LINK_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+/// Measures how fast a client takes the messages it's controller sends
+/// Sends from the controller go to the proxy over inproc and return at memory speed. The proxy's frontend socket
+/// has a small send HWM, so once the client's connection falls behind the proxy holds the controller's messages
+/// until the socket takes them. The bytes between the controller's send and the frontend taking them, and the
+/// rate the frontend takes them while it is full, are what the client's link really drains.
+/// The controller calls @queued, the proxy @forwarded and @blocked, any thread can call @sample.
+class ClientLink {
+public:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// State of the link at a point in time
+	struct Sample {
+		Sample(): outstanding(0), drainRate(0), delayUs(0) {}
+
+		size_t outstanding; ///< Bytes sent to the proxy that the frontend socket did not take yet
+		double drainRate; ///< Estimated bytes per second the client's connection takes, 0 until measured
+		int64_t delayUs; ///< Time the oldest outstanding message has waited in the proxy
+	};
+
+	/// Counters since the last call to @takeStats
+	struct Stats {
+		uint64_t forwardedBytes; ///< Bytes the frontend socket took
+		uint64_t blocked; ///< Times the frontend socket refused a message
+		int64_t maxDelayUs; ///< Max time a message waited in the proxy
+	};
+
+	/// @onDrained - called from the proxy thread when the outstanding bytes drop below the window passed to @hasRoom, can be empty
+	explicit ClientLink(const std::function<void()> & onDrained);
+
+	ClientLink(const ClientLink &) = delete;
+	ClientLink & operator=(const ClientLink &) = delete;
+
+	/// Controller thread: a message with @bytes payload is being sent to the proxy, call before the payload frame is sent
+	void queued(size_t bytes, time_point now);
+
+	/// Controller thread: check if less than @window bytes are outstanding
+	/// If not, @onDrained is called once they drop below @window
+	bool hasRoom(size_t window);
+
+	/// Proxy thread: the frontend socket took a message with @bytes payload
+	/// Messages of the client are taken in the order they were queued
+	void forwarded(size_t bytes, time_point now);
+
+	/// Proxy thread: the frontend socket refused a message, the link is the bottleneck until it drains
+	void blocked(time_point now);
+
+	/// Get the current state of the link
+	Sample sample(time_point now);
+
+	/// Get the counters and reset them
+	Stats takeStats();
+
+private:
+	/// Update @drainRate with the window that ended at @now
+	void closeWindow(time_point now);
+
+	/// A message sent by the controller and not yet taken by the frontend
+	struct Pending {
+		uint64_t end; ///< @queuedTotal after the message was queued
+		time_point time; ///< When the controller sent it
+	};
+
+	const std::function<void()> onDrained; ///< Wakes the controller when the link takes messages again
+
+	std::mutex mtx; ///< Protects all members below
+	uint64_t queuedTotal; ///< Bytes queued by the controller since the start
+	uint64_t forwardedTotal; ///< Bytes taken by the frontend since the start
+	std::deque<Pending> pending; ///< Outstanding messages, oldest first
+	double drainRate; ///< Estimated bytes per second taken by the client
+	time_point windowStart; ///< Start of the current rate measurement window
+	uint64_t windowBytes; ///< Bytes taken by the frontend in the current window
+	bool windowBlocked; ///< True if the frontend refused a message in the current window
+	bool refused; ///< True if the frontend refused a message and took none since
+	size_t wakeBelow; ///< Call @onDrained when outstanding bytes drop below this, 0 if nobody waits
+	Stats stats; ///< Counters for @takeStats
+};
+
+#endif // CLIENT_LINK_H
@@ -0,0 +1,230 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "image_pipeline.h"
+#include "utils/logger.h"
+#include "utils/trace_profiler.h"
+
+using namespace VRayBaseTypes;
+using namespace std;
+
+ImagePipeline::ImagePipeline(const Settings & settings, const Sink & sink)
+	: settings(settings)
+	, sink(sink)
+	, viewportDelta(64, settings.deltaKeyframeInterval, 1.f / 512.f, 0.5f)
+	, viewportDeltaReset(false)
+	, lastRtType(AttrImage::ImageType::NONE)
+	, displayWidth(0)
+	, displayHeight(0)
+	, bucketBatcher(settings.bucketBatchMs, 1 << 19, 0.5f)
+	, jpegCount(0)
+	, jpegEncodeTime(0)
+	, jpegBytes(0)
+	, bucketMessages(0)
+	, bucketBytes(0)
+{}
+
+void ImagePipeline::setDisplaySize(int width, int height) {
+	displayWidth = std::max(0, width);
+	displayHeight = std::max(0, height);
+}
+
+bool ImagePipeline::addImage(const VRay::AColor * pixels, int width, int height, const ImageUtils::Region & region, const Format & format,
+                             AttrImageSet & set, size_t & queuedBytes) {
+	TRACE_ZONE("ImagePipeline::addImage");
+	BufferPool & pool = BufferPool::getInstance();
+	const bool rtImage = set.sourceType == ImageSourceType::RtImageUpdate;
+	if (rtImage && format.type != lastRtType) {
+		// the client shows the last RT image in another format (adaptive quality switched to JPG or RGBA_HALF and back),
+		// so tiles that did not change since the last RGBA_REAL image must be sent again. Size changes make a keyframe in @viewportDelta
+		viewportDelta.reset();
+		lastRtType = format.type;
+	}
+
+	// the image that is sent: the region of the renderer's image or a downscaled copy of it
+	const VRay::AColor * data = pixels + static_cast<size_t>(region.top) * width + region.left;
+	int stride = width;
+	int outWidth = region.width;
+	int outHeight = region.height;
+	const int fitWidth = displayWidth, fitHeight = displayHeight;
+	if (rtImage && fitWidth > 0 && fitHeight > 0) {
+		// scale so the full image covers the display, the region keeps it's part of it
+		const double scale = std::max(static_cast<double>(fitWidth) / width, static_cast<double>(fitHeight) / height);
+		if (scale < 1.) {
+			outWidth = static_cast<int>(std::ceil(outWidth * scale));
+			outHeight = static_cast<int>(std::ceil(outHeight * scale));
+		}
+	}
+	outWidth = (outWidth + format.downscale - 1) / format.downscale;
+	outHeight = (outHeight + format.downscale - 1) / format.downscale;
+	if (outWidth != region.width || outHeight != region.height) {
+		if (!pool.acquire(downscaleBuffer, static_cast<size_t>(outWidth) * outHeight * sizeof(VRay::AColor))) {
+			LOGGER_LOG(Logger::Error, "No buffer to downscale image", outWidth, "x", outHeight, "- not sending it");
+			return false;
+		}
+		resampler.resize(data, stride, region.width, region.height, outWidth, outHeight, downscaleBuffer.as<VRay::AColor>());
+		data = downscaleBuffer.as<VRay::AColor>();
+		stride = outWidth;
+	}
+	const size_t outArea = static_cast<size_t>(outWidth) * outHeight;
+
+	AttrImage attrImage;
+	if (format.type == AttrImage::ImageType::RGBA_REAL || ImageUtils::isPackedType(format.type)) {
+		// use the data directly if the rows are contiguous, copy only if the region is narrower than the image
+		if (stride != outWidth) {
+			if (!pool.acquire(regionBuffer, outArea * sizeof(VRay::AColor))) {
+				LOGGER_LOG(Logger::Error, "No buffer to copy render region", outWidth, "x", outHeight, "- not sending it");
+				return false;
+			}
+			ImageUtils::copyRegion(pixels, width, region, regionBuffer.as<VRay::AColor>());
+			data = regionBuffer.as<VRay::AColor>();
+			LOGGER_LOG(Logger::Profile, "Render region copy:", outArea * sizeof(VRay::AColor) / 1024, "KB");
+		}
+		if (ImageUtils::isPackedType(format.type)) {
+			const size_t packedSize = outArea * ImageUtils::packedPixelSize(format.type);
+			if (!pool.acquire(packBuffer, packedSize)) {
+				LOGGER_LOG(Logger::Error, "No buffer to pack image", outWidth, "x", outHeight, "- not sending it");
+				return false;
+			}
+			ImageUtils::convertToPacked(data, outArea, format.type, packBuffer.data());
+			attrImage = AttrImage(packBuffer.data(), packedSize, format.type, outWidth, outHeight);
+		} else {
+			if (settings.viewportDelta && rtImage && sendViewportDelta(data, outWidth, outHeight, queuedBytes)) {
+				return true;
+			}
+			attrImage = AttrImage(data, outArea * sizeof(VRay::AColor), format.type, outWidth, outHeight);
+		}
+	} else if (format.type == AttrImage::ImageType::JPG) {
+		// encode the region straight from the renderer's image, strips are encoded in parallel
+		// the encoder applies the sRGB curve, so the image looks the same as RGBA_SRGB_8 and VRayImage::getJpeg
+		const auto encodeStart = chrono::high_resolution_clock::now();
+		if (!jpegEncoder.encode(data, stride, outWidth, outHeight, format.quality)) {
+			LOGGER_LOG(Logger::Error, "Failed to encode jpeg image", outWidth, "x", outHeight);
+			return false;
+		}
+		const auto encodeTime = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - encodeStart).count();
+		jpegEncodeTime += encodeTime;
+		jpegBytes += jpegEncoder.getSize();
+		++jpegCount;
+		LOGGER_LOG(Logger::Profile, "Jpeg encode:", encodeTime / 1000., "ms,", jpegEncoder.getStripCount(), "strips,", jpegEncoder.getSize() / 1024, "KB");
+		attrImage = AttrImage(jpegEncoder.getData(), jpegEncoder.getSize(), AttrImage::ImageType::JPG, outWidth, outHeight);
+	}
+	set.images.emplace(RenderChannelType::RenderChannelTypeNone, std::move(attrImage));
+	return true;
+}
+
+size_t ImagePipeline::queueImageSet(AttrImageSet && set) {
+	const bool rtImage = set.sourceType == ImageSourceType::RtImageUpdate;
+	size_t size = 0;
+	// when only the changed tiles were sent for the RT image there could be nothing else to send
+	if (!set.images.empty() || !rtImage || !settings.viewportDelta) {
+		size = sink(VRayMessage::msgImageSet(std::move(set)), rtImage ? MessageKind::RtImage : MessageKind::Ordered);
+	}
+	downscaleBuffer.reset();
+	regionBuffer.reset();
+	packBuffer.reset();
+	return size;
+}
+
+bool ImagePipeline::sendViewportDelta(const VRay::AColor * data, int width, int height, size_t & queuedBytes) {
+	if (viewportDeltaReset.exchange(false)) {
+		viewportDelta.reset();
+	}
+
+	if (viewportDelta.update(data, width, height, dirtyTiles)) {
+		LOGGER_LOG(Logger::Debug, "Sending RT image keyframe", width, "x", height);
+		return false;
+	}
+
+	size_t sentArea = 0;
+	BufferPool::Buffer tileBuffer;
+	for (const ImageUtils::Region & tile : dirtyTiles) {
+		if (!BufferPool::getInstance().acquire(tileBuffer, tile.area() * sizeof(VRay::AColor))) {
+			// the full image needs no copy and replaces the tiles already sent
+			LOGGER_LOG(Logger::Error, "No buffer for RT image tile - sending the full image");
+			return false;
+		}
+		ImageUtils::copyRegion(data, width, tile, tileBuffer.as<VRay::AColor>());
+		sentArea += tile.area();
+
+		AttrImageSet set(ImageSourceType::BucketImageReady);
+		set.images.emplace(RenderChannelType::RenderChannelTypeNone,
+			AttrImage(tileBuffer.data(), tile.area() * sizeof(VRay::AColor), AttrImage::ImageType::RGBA_REAL, tile.width, tile.height, tile.left, tile.top));
+
+		queuedBytes += sink(VRayMessage::msgImageSet(std::move(set)), MessageKind::RtImageDelta);
+	}
+
+	LOGGER_LOG(Logger::Debug, "RT image delta:", dirtyTiles.size(), "spans,", sentArea * 100 / (static_cast<size_t>(width) * height), "% of image");
+	return true;
+}
+
+bool ImagePipeline::addBucket(const VRay::AColor * data, const ImageUtils::Region & bucket, int imageWidth, int imageHeight, BucketBatcher::time_point now) {
+	if (settings.bucketBatchMs <= 0 ||
+	    bucket.left < 0 || bucket.top < 0 || bucket.left + bucket.width > imageWidth || bucket.top + bucket.height > imageHeight) {
+		return false;
+	}
+	if (!bucketBatcher.fits(bucket, imageWidth, imageHeight)) {
+		flushBuckets();
+	}
+	if (bucketBatcher.add(data, bucket, imageWidth, imageHeight, now)) {
+		flushBuckets();
+	}
+	return true;
+}
+
+void ImagePipeline::sendBucket(const VRay::AColor * data, const ImageUtils::Region & bucket) {
+	AttrImageSet set(ImageSourceType::BucketImageReady);
+	set.images.emplace(RenderChannelType::RenderChannelTypeNone,
+		AttrImage(data, bucket.area() * sizeof(VRay::AColor), AttrImage::ImageType::RGBA_REAL, bucket.width, bucket.height, bucket.left, bucket.top));
+
+	bucketBytes += sink(VRayMessage::msgImageSet(std::move(set)), MessageKind::Ordered);
+	++bucketMessages;
+}
+
+void ImagePipeline::flushBuckets() {
+	TRACE_ZONE("ImagePipeline::flushBuckets");
+	bucketBatcher.take(bucketRegions);
+	BufferPool & pool = BufferPool::getInstance();
+	BufferPool::Buffer bucketBuffer, bucketPackBuffer;
+	for (const ImageUtils::Region & region : bucketRegions) {
+		if (!pool.acquire(bucketBuffer, region.area() * sizeof(VRay::AColor))) {
+			LOGGER_LOG(Logger::Error, "No buffer for bucket batch", region.width, "x", region.height, "- not sending it");
+			continue;
+		}
+		bucketBatcher.copy(region, bucketBuffer.as<VRay::AColor>());
+
+		AttrImageSet set(ImageSourceType::BucketImageReady);
+		if (settings.bucketHalf) {
+			const size_t packedSize = region.area() * ImageUtils::packedPixelSize(ImageUtils::RGBA_HALF);
+			if (!pool.acquire(bucketPackBuffer, packedSize)) {
+				LOGGER_LOG(Logger::Error, "No buffer to pack bucket batch", region.width, "x", region.height, "- not sending it");
+				continue;
+			}
+			ImageUtils::convertToPacked(bucketBuffer.as<VRay::AColor>(), region.area(), ImageUtils::RGBA_HALF, bucketPackBuffer.data());
+			set.images.emplace(RenderChannelType::RenderChannelTypeNone,
+				AttrImage(bucketPackBuffer.data(), packedSize, ImageUtils::RGBA_HALF, region.width, region.height, region.left, region.top));
+		} else {
+			set.images.emplace(RenderChannelType::RenderChannelTypeNone,
+				AttrImage(bucketBuffer.data(), region.area() * sizeof(VRay::AColor), AttrImage::ImageType::RGBA_REAL, region.width, region.height, region.left, region.top));
+		}
+
+		bucketBytes += sink(VRayMessage::msgImageSet(std::move(set)), MessageKind::Ordered);
+		++bucketMessages;
+	}
+}
+
+void ImagePipeline::finishBuckets() {
+	flushBuckets();
+	bucketBatcher.reset();
+}
+
+ImagePipeline::Stats ImagePipeline::takeStats() {
+	Stats stats;
+	stats.jpegCount = jpegCount.exchange(0);
+	stats.jpegEncodeTime = jpegEncodeTime.exchange(0);
+	stats.jpegBytes = jpegBytes.exchange(0);
+	stats.bucketMessages = bucketMessages.exchange(0);
+	stats.bucketBytes = bucketBytes.exchange(0);
+	return stats;
+}
@@ -0,0 +1,155 @@
+#ifndef IMAGE_PIPELINE_H
+#define IMAGE_PIPELINE_H
+
+#include "zmq_wrapper.hpp"
+
+#include <vraysdk.hpp>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "viewport_delta.h"
+#include "bucket_batcher.h"
+#include "utils/jpeg_encoder.h"
+#include "utils/image_resampler.h"
+#include "utils/image_utils.h"
+#include "utils/buffer_pool.h"
+
+/// Kind of message in the send queue
+enum class MessageKind {
+	Ordered, ///< Sent in order, never dropped
+	RtImage, ///< Full RT image update, replaced in place by a newer one while it is still in the queue
+	RtImageDelta, ///< Changed tiles of an RT image, sent in order since they depend on the previous image
+};
+
+/// Turns the renderer's images and buckets into image messages, it never calls the renderer
+/// RendererController feeds it from the V-Ray callbacks and the benchmarks from FakeRenderer, the messages are
+/// passed to the sink given to the constructor.
+/// The image and the bucket functions may run on different threads, each group must be serialized by the caller.
+class ImagePipeline {
+public:
+	/// Takes a message to send, returns it's size
+	typedef std::function<size_t(zmq::message_t && message, MessageKind kind)> Sink;
+
+	/// Part of ControllerSettings used by the pipeline
+	struct Settings {
+		Settings()
+			: viewportDelta(false)
+			, deltaKeyframeInterval(30)
+			, bucketBatchMs(30)
+			, bucketHalf(false)
+		{}
+
+		bool viewportDelta; ///< Send only changed tiles of RGBA_REAL RT images as bucket images
+		int deltaKeyframeInterval; ///< When @viewportDelta is on, send the full RT image every N updates
+		int bucketBatchMs; ///< Max time buckets are gathered before being sent as a single image, 0 sends each bucket right away
+		bool bucketHalf; ///< Send batched buckets as RGBA_HALF instead of RGBA_REAL
+	};
+
+	/// How the main image is encoded
+	struct Format {
+		Format(VRayBaseTypes::AttrImage::ImageType type, int quality, int downscale)
+			: type(type), quality(quality), downscale(downscale) {}
+
+		VRayBaseTypes::AttrImage::ImageType type; ///< JPG, RGBA_REAL or a packed type
+		int quality; ///< Jpeg quality used if @type is JPG
+		int downscale; ///< The image is sent at 1/@downscale of it's size, RT images are also fit to the display size
+	};
+
+	/// Counters since the last call to @takeStats
+	struct Stats {
+		Stats(): jpegCount(0), jpegEncodeTime(0), jpegBytes(0), bucketMessages(0), bucketBytes(0) {}
+
+		uint64_t jpegCount; ///< Number of JPG images encoded
+		uint64_t jpegEncodeTime; ///< Total time in microseconds spent encoding JPG images
+		uint64_t jpegBytes; ///< Total size of the encoded JPG images
+		uint64_t bucketMessages; ///< Bucket messages sent
+		uint64_t bucketBytes; ///< Size of the bucket messages sent
+	};
+
+	ImagePipeline(const Settings & settings, const Sink & sink);
+
+	ImagePipeline(const ImagePipeline &) = delete;
+	ImagePipeline & operator=(const ImagePipeline &) = delete;
+
+	/// Set the size the client displays RT images at, 0 if unknown. Can be called from any thread
+	void setDisplaySize(int width, int height);
+
+	/// Send the next RT image in full. Can be called from any thread
+	void resetViewportDelta() { viewportDeltaReset = true; }
+
+	/// Convert the main image and add it to @set, RT images may be sent as changed tiles instead
+	/// The converted image stays valid until @queueImageSet
+	/// @pixels - the renderer's image
+	/// @width, @height - size of @pixels
+	/// @region - part of @pixels that is sent, must be inside the image
+	/// @format - how the image is encoded
+	/// @set - receives the image, it's sourceType tells RT images apart
+	/// @queuedBytes - incremented with the size of the sent tiles
+	/// @return - false if the image could not be encoded
+	bool addImage(const VRay::AColor * pixels, int width, int height, const ImageUtils::Region & region, const Format & format,
+	              VRayBaseTypes::AttrImageSet & set, size_t & queuedBytes);
+
+	/// Send @set and free the buffers of the image added by @addImage
+	/// @return - size of the sent message, 0 if there was nothing to send
+	size_t queueImageSet(VRayBaseTypes::AttrImageSet && set);
+
+	/// Gather bucket @data, a full batch is sent right away
+	/// @bucket - the bucket's place in the image
+	/// @imageWidth, @imageHeight - size of the full image
+	/// @return - false if buckets are not batched or @bucket is outside of the image, send it with @sendBucket
+	bool addBucket(const VRay::AColor * data, const ImageUtils::Region & bucket, int imageWidth, int imageHeight, BucketBatcher::time_point now);
+
+	/// Send bucket @data on it's own as RGBA_REAL
+	void sendBucket(const VRay::AColor * data, const ImageUtils::Region & bucket);
+
+	/// Send the gathered buckets
+	void flushBuckets();
+
+	/// Send the gathered buckets and start over for the next image
+	void finishBuckets();
+
+	/// Check if the oldest gathered bucket waited long enough
+	bool bucketsDue(BucketBatcher::time_point now) const { return bucketBatcher.due(now); }
+
+	/// Get when the gathered buckets must be sent
+	/// @return - false if there are none
+	bool getBucketDeadline(BucketBatcher::time_point & deadline) const { return bucketBatcher.getDeadline(deadline); }
+
+	/// Get the counters and reset them, can be called from any thread
+	Stats takeStats();
+
+private:
+	/// Send the changed parts of RT image as bucket images
+	/// @data - the image data for the render region, tightly packed
+	/// @width, @height - size of @data
+	/// @queuedBytes - incremented with the size of the sent messages
+	/// @return - false if the full image should be sent instead
+	bool sendViewportDelta(const VRay::AColor * data, int width, int height, size_t & queuedBytes);
+
+	const Settings settings; ///< Settings passed from the controller
+	const Sink sink; ///< Takes the messages
+
+	JpegEncoder jpegEncoder; ///< Encodes JPG images, keeps it's buffers between images
+	ImageResampler resampler; ///< Shrinks RT images to the display size, keeps it's buffers between images
+	ViewportDelta viewportDelta; ///< Last RT image sent to client, used if settings.viewportDelta is on
+	std::atomic<bool> viewportDeltaReset; ///< Set when @viewportDelta must send a keyframe on next update
+	std::vector<ImageUtils::Region> dirtyTiles; ///< Reused between calls to @sendViewportDelta
+	VRayBaseTypes::AttrImage::ImageType lastRtType; ///< Format of the last RT image, @viewportDelta is reset when it changes
+	std::atomic<int> displayWidth; ///< Width the client displays RT images at, 0 if unknown
+	std::atomic<int> displayHeight; ///< Height the client displays RT images at, 0 if unknown
+	BufferPool::Buffer downscaleBuffer; ///< Main image shrunk by @resampler, until @queueImageSet
+	BufferPool::Buffer regionBuffer; ///< Render region copied out of the main image, until @queueImageSet
+	BufferPool::Buffer packBuffer; ///< Main image in a packed type, until @queueImageSet
+
+	BucketBatcher bucketBatcher; ///< Gathers buckets if settings.bucketBatchMs is not 0
+	std::vector<ImageUtils::Region> bucketRegions; ///< Reused between calls to @flushBuckets
+
+	std::atomic<uint64_t> jpegCount; ///< For @Stats::jpegCount
+	std::atomic<uint64_t> jpegEncodeTime; ///< For @Stats::jpegEncodeTime
+	std::atomic<uint64_t> jpegBytes; ///< For @Stats::jpegBytes
+	std::atomic<uint64_t> bucketMessages; ///< For @Stats::bucketMessages
+	std::atomic<uint64_t> bucketBytes; ///< For @Stats::bucketBytes
+};
+
+#endif // IMAGE_PIPELINE_H
@@ -0,0 +1,93 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "instancer_cache.h"
+#include <cstring>
+#include <limits>
+
+using namespace VRayBaseTypes;
+
+InstancerCache::InstancerCache()
+	: frameNumber(0)
+	, lastSetFrame(std::numeric_limits<float>::lowest())
+{}
+
+bool InstancerCache::sameInstance(const Instance & instance, const AttrInstancer::Item & item) {
+	return instance.index == item.index &&
+	       !memcmp(&instance.tm, &item.tm, sizeof(VRay::Transform)) &&
+	       !memcmp(&instance.vel, &item.vel, sizeof(VRay::Transform)) &&
+	       instance.node == item.node.plugin;
+}
+
+InstancerCache::Instance InstancerCache::makeInstance(const AttrInstancer::Item & item, const PluginResolver & resolve) {
+	Instance instance;
+	instance.index = item.index;
+	instance.tm = *reinterpret_cast<const VRay::Transform*>(&item.tm);
+	instance.vel = *reinterpret_cast<const VRay::Transform*>(&item.vel);
+	instance.node = item.node.plugin;
+
+	instance.value = VRay::VUtils::ValueRefList(4);
+	instance.value[0].setDouble(item.index);
+	instance.value[1].setTransform(instance.tm);
+	instance.value[2].setTransform(instance.vel);
+	const VRay::Plugin node = resolve(item.node.plugin);
+	instance.resolved = !!node;
+	instance.value[3].setPlugin(node);
+	return instance;
+}
+
+InstancerCache::UpdateStats InstancerCache::update(const AttrInstancer & inst, const PluginResolver & resolve) {
+	UpdateStats stats;
+	const int count = inst.data.getCount();
+
+	std::vector<Instance> updated;
+	std::unordered_map<int, int> updatedMap;
+	updated.reserve(count);
+	updatedMap.reserve(count);
+
+	for (int c = 0; c < count; ++c) {
+		const AttrInstancer::Item & item = (*inst.data)[c];
+		const auto cached = indexMap.find(item.index);
+		if (cached == indexMap.end()) {
+			++stats.added;
+			updated.push_back(makeInstance(item, resolve));
+		} else {
+			Instance & instance = instances[cached->second];
+			stats.reordered = stats.reordered || cached->second != c;
+			if (!sameInstance(instance, item)) {
+				++stats.modified;
+				updated.push_back(makeInstance(item, resolve));
+			} else if (instance.resolved) {
+				++stats.reused;
+				updated.push_back(std::move(instance));
+			} else {
+				// the node plugin did not exist when the instance was built, it may have been created since
+				Instance rebuilt = makeInstance(item, resolve);
+				if (rebuilt.resolved) {
+					++stats.modified;
+				} else {
+					++stats.reused;
+				}
+				updated.push_back(std::move(rebuilt));
+			}
+			// each cached instance can be matched only once, what is left in the map is removed
+			indexMap.erase(cached);
+		}
+		updatedMap[item.index] = c;
+	}
+
+	stats.removed = static_cast<int>(indexMap.size());
+	stats.frameChanged = frameNumber != inst.frameNumber;
+
+	frameNumber = inst.frameNumber;
+	instances.swap(updated);
+	indexMap.swap(updatedMap);
+	return stats;
+}
+
+VRay::VUtils::ValueRefList InstancerCache::makeValue() const {
+	VRay::VUtils::ValueRefList instancer(static_cast<int>(instances.size()) + 1);
+	instancer[0] = VRay::VUtils::Value(frameNumber);
+	for (int c = 0; c < static_cast<int>(instances.size()); ++c) {
+		instancer[c + 1].setList(instances[c].value);
+	}
+	return instancer;
+}
@@ -0,0 +1,91 @@
+#ifndef INSTANCER_CACHE_H
+#define INSTANCER_CACHE_H
+
+#include "zmq_wrapper.hpp"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+
+#include <vraysdk.hpp>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Last instancer list set for a single plugin property
+/// Blender re-sends the full AttrInstancer even if only one particle moved, this keeps the per-instance
+/// V-Ray lists from the previous update so only added or modified instances are rebuilt on the server.
+/// V-Ray still gets the full top-level list on every change and parses all instances again, the AppSDK
+/// can't set a part of a list value.
+class InstancerCache {
+public:
+	/// Callback used to resolve the node plugin referenced by an instance
+	typedef std::function<VRay::Plugin(const std::string &)> PluginResolver;
+
+	/// Counters for the last call to @update
+	struct UpdateStats {
+		int added; ///< Instances not present in the previous list
+		int modified; ///< Instances with changed transform, velocity or node, or whose node plugin exists now
+		int removed; ///< Instances from the previous list that are missing in the new one
+		int reused; ///< Instances whose V-Ray list was reused as is
+		bool reordered; ///< True if the client sent the instances in different order
+		bool frameChanged; ///< True if the instancer frame number is different
+
+		UpdateStats(): added(0), modified(0), removed(0), reused(0), reordered(false), frameChanged(false) {}
+
+		/// True if the new list differs from the previous one in any way
+		bool changed() const { return added || modified || removed || reordered || frameChanged; }
+	};
+
+	InstancerCache();
+
+	/// Diff @inst against the previous list and rebuild only changed instances
+	/// @inst - the instancer data received from the client
+	/// @resolve - called for each added/modified instance and each instance whose node was null to get its node plugin
+	/// @return - counters of what changed since the last update
+	UpdateStats update(const VRayBaseTypes::AttrInstancer & inst, const PluginResolver & resolve);
+
+	/// Build the list that is passed to V-Ray, the per-instance lists are shared with the cache
+	VRay::VUtils::ValueRefList makeValue() const;
+
+	/// Frame number of the last update
+	float getFrameNumber() const { return frameNumber; }
+
+	/// Number of instances in the cache
+	int getCount() const { return static_cast<int>(instances.size()); }
+
+	/// Renderer frame at which the list was last set in V-Ray
+	float getLastSetFrame() const { return lastSetFrame; }
+
+	/// Remember the renderer frame at which the list was set in V-Ray
+	void setLastSetFrame(float frame) { lastSetFrame = frame; }
+
+private:
+	/// Cached data for one instance, kept in the order received from the client
+	struct Instance {
+		int index; ///< The particle index
+		VRay::Transform tm; ///< Instance transform
+		VRay::Transform vel; ///< Instance velocity
+		std::string node; ///< Name of the referenced node plugin
+		VRay::VUtils::ValueRefList value; ///< The list set in V-Ray for this instance
+		bool resolved; ///< False if the node plugin was null when @value was built
+	};
+
+	/// Check if @item has the same data as the cached @instance
+	static bool sameInstance(const Instance & instance, const VRayBaseTypes::AttrInstancer::Item & item);
+
+	/// Create the V-Ray list for a single instance
+	static Instance makeInstance(const VRayBaseTypes::AttrInstancer::Item & item, const PluginResolver & resolve);
+
+	float frameNumber; ///< The frame number from the last update
+	float lastSetFrame; ///< The renderer frame at which the list was last set
+	std::vector<Instance> instances; ///< All instances in order
+	std::unordered_map<int, int> indexMap; ///< Maps particle index to position in @instances
+};
+
+#endif // INSTANCER_CACHE_H
@@ -0,0 +1,152 @@
+#include "latency_tracer.h"
+
+using namespace std::chrono;
+
+namespace {
+/// Traces in flight for longer are dropped, the edit did not lead to an RT image being sent
+const milliseconds TRACE_TIMEOUT(10000);
+
+/// Duration from @begin to @end in nanoseconds, 0 if the stamps of different threads are slightly out of order
+uint64_t elapsedNs(LatencyTracer::time_point begin, LatencyTracer::time_point end) {
+	return end > begin ? static_cast<uint64_t>(duration_cast<nanoseconds>(end - begin).count()) : 0;
+}
+}
+
+LatencyTracer::LatencyTracer()
+	: phase(Idle)
+	, awaitedSequence(0)
+	, dropped(0)
+{
+	for (int c = 0; c < STAMP_COUNT; ++c) {
+		receivedTimes[c].sequence.store(0, std::memory_order_relaxed);
+		receivedTimes[c].time.store(0, std::memory_order_relaxed);
+		forwardedTimes[c].sequence.store(0, std::memory_order_relaxed);
+		forwardedTimes[c].time.store(0, std::memory_order_relaxed);
+	}
+}
+
+const char * LatencyTracer::getStageName(Stage stage) {
+	switch (stage) {
+	case Proxy: return "proxy";
+	case Decode: return "decode";
+	case Apply: return "apply";
+	case Render: return "render";
+	case Encode: return "encode";
+	case Queue: return "queue";
+	case Return: return "return";
+	case Total: return "total";
+	default: return "unknown";
+	}
+}
+
+void LatencyTracer::store(Stamp * stamps, uint64_t sequence, time_point time) {
+	Stamp & stamp = stamps[sequence % STAMP_COUNT];
+	// readers compare the sequence before and after reading the time
+	stamp.sequence.store(0);
+	stamp.time.store(time.time_since_epoch().count());
+	stamp.sequence.store(sequence);
+}
+
+bool LatencyTracer::find(Stamp * stamps, uint64_t sequence, time_point & time) {
+	Stamp & stamp = stamps[sequence % STAMP_COUNT];
+	if (stamp.sequence.load() != sequence) {
+		return false;
+	}
+	const int64_t ticks = stamp.time.load();
+	if (stamp.sequence.load() != sequence) {
+		return false;
+	}
+	time = time_point(clock::duration(ticks));
+	return true;
+}
+
+void LatencyTracer::received(uint64_t sequence, time_point time) {
+	store(receivedTimes, sequence, time);
+}
+
+void LatencyTracer::applied(uint64_t sequence, time_point dequeued, time_point decoded, time_point applied) {
+	std::lock_guard<std::mutex> lock(mtx);
+	if (phase != Idle) {
+		if (applied - applyTime < TRACE_TIMEOUT) {
+			return;
+		}
+		++dropped;
+		phase = Idle;
+		awaitedSequence = 0;
+	}
+
+	if (!find(receivedTimes, sequence, receiveTime)) {
+		// the proxy did not stamp this message, it's sequence does not match the controller's
+		return;
+	}
+	dequeueTime = dequeued;
+	decodeTime = decoded;
+	applyTime = applied;
+	phase = Applied;
+}
+
+void LatencyTracer::imageStarted(time_point time) {
+	if (phase.load(std::memory_order_relaxed) != Applied) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mtx);
+	// an update that started before the change was applied might not show it
+	if (phase == Applied && time >= applyTime) {
+		imageStartTime = time;
+		phase = Rendering;
+	}
+}
+
+void LatencyTracer::imageSent(time_point queued, uint64_t sequence, time_point time) {
+	if (phase.load(std::memory_order_relaxed) != Rendering) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mtx);
+	// messages queued before the update started belong to an older image
+	if (phase != Rendering || queued < imageStartTime) {
+		return;
+	}
+	imageQueueTime = queued;
+	sendTime = time;
+	phase = Sent;
+	awaitedSequence = sequence;
+
+	// the proxy may have forwarded it already, then it did not see @awaitedSequence
+	time_point forwardTime;
+	if (find(forwardedTimes, sequence, forwardTime)) {
+		complete(forwardTime);
+	}
+}
+
+void LatencyTracer::forwarded(uint64_t sequence, time_point time) {
+	store(forwardedTimes, sequence, time);
+	if (awaitedSequence.load() != sequence) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mtx);
+	if (phase == Sent && awaitedSequence == sequence) {
+		complete(time);
+	}
+}
+
+void LatencyTracer::complete(time_point forwarded) {
+	stages[Proxy].record(elapsedNs(receiveTime, dequeueTime));
+	stages[Decode].record(elapsedNs(dequeueTime, decodeTime));
+	stages[Apply].record(elapsedNs(decodeTime, applyTime));
+	stages[Render].record(elapsedNs(applyTime, imageStartTime));
+	stages[Encode].record(elapsedNs(imageStartTime, imageQueueTime));
+	stages[Queue].record(elapsedNs(imageQueueTime, sendTime));
+	stages[Return].record(elapsedNs(sendTime, forwarded));
+	stages[Total].record(elapsedNs(receiveTime, forwarded));
+	phase = Idle;
+	awaitedSequence = 0;
+}
+
+LatencyTracer::Stats LatencyTracer::takeStats() {
+	Stats stats;
+	for (int c = 0; c < STAGE_COUNT; ++c) {
+		stats.stages[c] = stages[c].take();
+	}
+	stats.dropped = dropped.exchange(0);
+	return stats;
+}
@@ -0,0 +1,119 @@
+#ifndef LATENCY_TRACER_H
+#define LATENCY_TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "utils/latency_histogram.h"
+
+/// Measures how long a client's scene change takes to reach it as pixels, split in stages
+/// One edit at a time is traced from the moment the proxy receives it to the moment the proxy sends the first
+/// RT image started after it was applied. Edits arriving while a trace is in flight are not traced, so while
+/// the client drags a slider every few edits are sampled.
+/// Messages are matched between the proxy and the controller by their sequence number: both count the
+/// messages of the client in each direction and the inproc socket keeps them in order, so no id is added
+/// to the protocol.
+class LatencyTracer {
+public:
+	typedef std::chrono::high_resolution_clock clock;
+	typedef clock::time_point time_point;
+
+	/// Stages of a traced edit, each is measured from the end of the previous one
+	enum Stage {
+		Proxy, ///< Frontend receive in the proxy until the controller takes the message
+		Decode, ///< Parsing the message
+		Apply, ///< Applying the change to the renderer
+		Render, ///< Until the first RT image update started after the change
+		Encode, ///< Converting and encoding that image until it's first message is queued
+		Queue, ///< Waiting in the controller's send queue
+		Return, ///< Forwarding by the proxy until the frontend send
+		Total, ///< Frontend receive until frontend send
+		STAGE_COUNT,
+	};
+
+	/// Stage durations recorded since the last @takeStats
+	struct Stats {
+		LatencyHistogram::Snapshot stages[STAGE_COUNT]; ///< Duration of each stage in nanoseconds
+		uint64_t dropped; ///< Traces abandoned since no image was sent for them in time
+
+		Stats(): dropped(0) {}
+	};
+
+	LatencyTracer();
+
+	LatencyTracer(const LatencyTracer &) = delete;
+	LatencyTracer & operator=(const LatencyTracer &) = delete;
+
+	/// Get the name of @stage for the stats output
+	static const char * getStageName(Stage stage);
+
+	/// Proxy thread: the @sequence-th message of the client was received from the frontend at @time
+	void received(uint64_t sequence, time_point time);
+
+	/// Controller thread: the @sequence-th message from the proxy changed the scene, starts a trace if none is in flight
+	/// @dequeued - when the controller received the message
+	/// @decoded - when the message was parsed
+	/// @applied - when the change was applied
+	void applied(uint64_t sequence, time_point dequeued, time_point decoded, time_point applied);
+
+	/// Renderer callback: an RT image update started at @time
+	void imageStarted(time_point time);
+
+	/// Controller thread: a message of an RT image queued at @queued was sent at @time as the @sequence-th message to the proxy
+	void imageSent(time_point queued, uint64_t sequence, time_point time);
+
+	/// Proxy thread: the @sequence-th message from the controller was sent to the client at @time, completes the trace it ends
+	void forwarded(uint64_t sequence, time_point time);
+
+	/// Get the stage durations recorded since the last call and reset them
+	Stats takeStats();
+
+private:
+	/// How far a trace got
+	enum Phase {
+		Idle, ///< No trace in flight
+		Applied, ///< Waiting for an RT image update to start
+		Rendering, ///< Waiting for a message of that image to be sent
+		Sent, ///< Waiting for the proxy to forward it
+	};
+
+	/// Time the proxy handled a message, written by the proxy thread and read by the controller thread
+	struct Stamp {
+		std::atomic<uint64_t> sequence; ///< Sequence number of the message, 0 while the slot is written
+		std::atomic<int64_t> time; ///< The time in clock ticks
+	};
+
+	/// Number of stamps kept in each direction, the controller is never that many messages away from the proxy when it matters
+	static const int STAMP_COUNT = 1024;
+
+	/// Store @time of the @sequence-th message in @stamps
+	static void store(Stamp * stamps, uint64_t sequence, time_point time);
+
+	/// Get the @time of the @sequence-th message from @stamps
+	/// @return - false if it was not stored yet or was overwritten
+	static bool find(Stamp * stamps, uint64_t sequence, time_point & time);
+
+	/// Record the stages of the current trace and start waiting for the next one, @mtx must be locked
+	void complete(time_point forwarded);
+
+	Stamp receivedTimes[STAMP_COUNT]; ///< Frontend receive times of the client's messages, indexed by sequence number
+	Stamp forwardedTimes[STAMP_COUNT]; ///< Frontend send times of the controller's messages, indexed by sequence number
+
+	std::mutex mtx; ///< Protects the trace times, @phase is also read without it to skip the lock
+	std::atomic<int> phase; ///< The Phase of the trace in flight
+	std::atomic<uint64_t> awaitedSequence; ///< In Sent phase, the sequence number of the message the proxy must forward
+	time_point receiveTime; ///< Frontend receive of the traced edit
+	time_point dequeueTime; ///< Controller receive of the traced edit
+	time_point decodeTime; ///< End of parsing
+	time_point applyTime; ///< End of applying
+	time_point imageStartTime; ///< Start of the first RT image update after applying
+	time_point imageQueueTime; ///< When the first sent message of the image was queued
+	time_point sendTime; ///< When the controller sent it
+
+	LatencyHistogram stages[STAGE_COUNT]; ///< Duration of each stage
+	std::atomic<uint64_t> dropped; ///< See Stats::dropped
+};
+
+#endif // LATENCY_TRACER_H
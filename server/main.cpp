@@ -12,6 +12,8 @@
 
 #include "zmq_proxy_server.h"
 #include "utils/logger.h"
+#include "utils/async_log_writer.h"
+#include "utils/trace_profiler.h"
 #include "utils/version.h"
 #include <string>
 #include <fstream>
@@ -19,6 +21,12 @@
 
 #include <QApplication>
 
+/// Number of log messages that can wait for the log writer thread
+const int LOG_RING_SIZE = 8192;
+
+/// Max time log messages stay in the stdout and dumpInfoLog buffers
+const int LOG_FLUSH_INTERVAL_MS = 100;
+
 struct ArgvSettings {
 	ArgvSettings()
 	    : port("")
@@ -27,6 +35,7 @@ struct ArgvSettings {
 	    , dumpInfoLog(false)
 	    , showProfileLog(false)
 	    , logLevel(Logger::Warning)
+	    , hugePages(false)
 	{}
 	std::string port;
 	bool showVFB;
@@ -34,6 +43,10 @@ struct ArgvSettings {
 	bool dumpInfoLog;
 	bool showProfileLog;
 	Logger::Level logLevel;
+	bool hugePages;
+	std::string recordSession;
+	std::string profileTrace;
+	ControllerSettings controller;
 };
 
 bool parseArgv(ArgvSettings & settings, int argc, char * argv[]) {
@@ -69,6 +82,40 @@ bool parseArgv(ArgvSettings & settings, int argc, char * argv[]) {
 			settings.dumpInfoLog = true;
 		} else if (!strcmp(argv[c], "-showProfile")) {
 			settings.showProfileLog = true;
+		} else if (!strcmp(argv[c], "-viewportDelta")) {
+			settings.controller.viewportDelta = true;
+		} else if (!strcmp(argv[c], "-keyframeInterval") && c + 1 < argc) {
+			settings.controller.deltaKeyframeInterval = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-adaptiveQuality")) {
+			settings.controller.adaptiveQuality = true;
+		} else if (!strcmp(argv[c], "-targetFps") && c + 1 < argc) {
+			settings.controller.targetFps = static_cast<float>(atof(argv[++c]));
+		} else if (!strcmp(argv[c], "-maxLatency") && c + 1 < argc) {
+			settings.controller.maxLatencyMs = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-progressiveViewport")) {
+			settings.controller.progressiveViewport = true;
+		} else if (!strcmp(argv[c], "-bucketBatch") && c + 1 < argc) {
+			settings.controller.bucketBatchMs = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-bucketHalf")) {
+			settings.controller.bucketHalf = true;
+		} else if (!strcmp(argv[c], "-progressInterval") && c + 1 < argc) {
+			settings.controller.progressIntervalMs = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-vrayLogLevel") && c + 1 < argc) {
+			settings.controller.vrayLogLevel = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-maxVRayLogs") && c + 1 < argc) {
+			settings.controller.maxVRayLogsPerSecond = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-sendSlice") && c + 1 < argc) {
+			settings.controller.sendSliceMs = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-sendBatch") && c + 1 < argc) {
+			settings.controller.sendBatchKB = atoi(argv[++c]);
+		} else if (!strcmp(argv[c], "-traceLatency")) {
+			settings.controller.traceLatency = true;
+		} else if (!strcmp(argv[c], "-hugePages")) {
+			settings.hugePages = true;
+		} else if (!strcmp(argv[c], "-recordSession") && c + 1 < argc) {
+			settings.recordSession = argv[++c];
+		} else if (!strcmp(argv[c], "-profileTrace") && c + 1 < argc) {
+			settings.profileTrace = argv[++c];
 		} else {
 			return false;
 		}
@@ -87,6 +134,23 @@ void printHelp() {
 	puts("-p <port-num>\tPort number to listen on");
 	puts("-vfb\t\tSet show VFB option");
 	puts("-log <level>\t1-4, 1 = Info, 2 = Debug, 3 = Warning, 4 = Error");
+	puts("-viewportDelta\tSend only changed tiles of RGBA_REAL viewport images");
+	puts("-keyframeInterval <n>\tWith -viewportDelta send full viewport image every n updates");
+	puts("-adaptiveQuality\tLower viewport image quality, format and size when images can't be sent fast enough");
+	puts("-targetFps <n>\tWith -adaptiveQuality the desired viewport image rate, default 24");
+	puts("-maxLatency <ms>\tWith -adaptiveQuality the max time a viewport image may wait to be sent, default 200");
+	puts("-progressiveViewport\tSend viewport images at half resolution while the scene is being changed");
+	puts("-bucketBatch <ms>\tMax time buckets are gathered before being sent together, default 30, 0 sends each bucket");
+	puts("-bucketHalf\tSend batched buckets as half float");
+	puts("-progressInterval <ms>\tMin time between progress updates sent to the client, default 100, 0 sends all");
+	puts("-vrayLogLevel <level>\tMax level of V-Ray log messages sent to the client, default 29999 (info)");
+	puts("-maxVRayLogs <n>\tMax V-Ray log messages sent per second, default 50, 0 for no limit");
+	puts("-sendSlice <ms>\tMax time spent sending messages before checking for incoming ones, default 5");
+	puts("-sendBatch <KB>\tMax size of messages sent before checking for incoming ones, less if the client drains slower, default 4096");
+	puts("-traceLatency\tReport time from scene changes to the first viewport image showing them, with -log 2");
+	puts("-hugePages\tUse transparent huge pages for image buffers (Linux only)");
+	puts("-recordSession <file>\tRecord all messages from clients with their timing to <file> for replay");
+	puts("-profileTrace <file>\tWrite a timeline of the server's threads to <file>, open it in chrome://tracing or ui.perfetto.dev");
 }
 
 /// Parse command line arguments, initialize logger, initialize server and start it
@@ -105,14 +169,20 @@ int main(int argc, char *argv[]) {
 		infoDump.open("dumpInfoLog.txt", std::ios::trunc | std::ios::ate);
 	}
 	Logger::getInstance().setCurrentlevel(settings.logLevel);
+	if (settings.logLevel < LOGGER_MIN_LEVEL) {
+		printf("Log messages below level %d are not compiled in this build\n", LOGGER_MIN_LEVEL);
+	}
 
 	const auto begin = std::chrono::high_resolution_clock::now();
 	auto lastProfileTime = begin;
 	auto lastLogTime = begin;
 
-	Logger::getInstance().setCallback([filterLevel, &settings, &infoDump, &lastLogTime, &firstLog, &lastProfileTime] (Logger::Level lvl, const std::string & msg) {
+	// messages are formatted and written on the writer thread, which is the only one touching the state captured here
+	AsyncLogWriter logWriter(LOG_RING_SIZE, LOG_FLUSH_INTERVAL_MS, [filterLevel, &settings, &infoDump, &lastLogTime, &firstLog, &lastProfileTime] (const AsyncLogWriter::Entry & entry) {
 		using namespace std;
 		using namespace std::chrono;
+		const Logger::Level lvl = entry.level;
+		const std::string & msg = entry.message;
 		if (filterLevel <= Logger::Info && lvl == Logger::Info) {
 			printf("ZMQ_INFO: %s\n", msg.c_str());
 		} else if (filterLevel <= Logger::Debug && lvl == Logger::Debug) {
@@ -124,7 +194,7 @@ int main(int argc, char *argv[]) {
 		} else if (lvl == Logger::APIDump && settings.dumpInfoLog) {
 			if (settings.dumpInfoLog && infoDump) {
 				if (!firstLog) {
-					const auto now = high_resolution_clock::now();
+					const auto now = entry.time;
 					const auto sleepTime = duration_cast<milliseconds>(now - lastLogTime).count();
 					if (sleepTime > 10) {
 						infoDump << "Sleep(" << sleepTime << ");\n";
@@ -134,10 +204,9 @@ int main(int argc, char *argv[]) {
 				firstLog = false;
 				infoDump.write(msg.c_str(), msg.length());
 				infoDump.write("\n", 1);
-				infoDump.flush();
 			}
 		} else if (lvl == Logger::Profile && settings.showProfileLog) {
-			const auto now = high_resolution_clock::now();
+			const auto now = entry.time;
 			const auto passed = now - lastProfileTime;
 			lastProfileTime = now;
 			const int minutes = duration_cast<chrono::minutes>(passed).count() % 60;
@@ -145,8 +214,27 @@ int main(int argc, char *argv[]) {
 			const int milliseconds = duration_cast<chrono::milliseconds>(passed).count() % 1000;
 			printf("[%2d:%2d:%4d]\t%s\n", minutes, seconds, milliseconds, msg.c_str());
 		}
+	}, [&infoDump] () {
+		fflush(stdout);
+		if (infoDump.is_open()) {
+			infoDump.flush();
+		}
+	});
+	logWriter.installCrashHandler();
+
+	Logger::getInstance().setCallback([&logWriter] (Logger::Level lvl, const std::string & msg) {
+		logWriter.push(lvl, msg);
 	});
 
+	// started before any of the server's threads so they can name themselves in the trace
+	if (!settings.profileTrace.empty()) {
+		if (TraceProfiler::getInstance().start(settings.profileTrace)) {
+			TraceProfiler::getInstance().setThreadName("main");
+		} else {
+			LOGGER_LOG(Logger::Error, "Failed to create profile trace", settings.profileTrace);
+		}
+	}
+
 	// fix paths in order to load correct appsdk with matching vray and plugins
 #ifdef _WIN32
 	const char * os_pathsep = ";";
@@ -163,7 +251,7 @@ int main(int argc, char *argv[]) {
 		// lets make sure we load all vray stuff from the same place
 		std::string vrayPath(path);
 		vrayPath = vrayPath.substr(0, vrayPath.find_last_of("/\\"));
-		Logger::log(Logger::Debug, "Setting VRAY_PATH to", vrayPath);
+		LOGGER_LOG(Logger::Debug, "Setting VRAY_PATH to", vrayPath);
 		// putenv requires valid memory until exit or variable unset
 		static char vrayPathBuf[1024] = {0, };
 		strncpy(vrayPathBuf, ("VRAY_PATH=" + vrayPath).c_str(), 1024);
@@ -182,7 +270,7 @@ int main(int argc, char *argv[]) {
 #else
 		putenv(pathBuf);
 #endif
-		Logger::log(Logger::Debug, "New PATH", pathBuf);
+		LOGGER_LOG(Logger::Debug, "New PATH", pathBuf);
 	}
 
 	printInfo();
@@ -200,23 +288,32 @@ int main(int argc, char *argv[]) {
 		char *argv[1] = { nullptr };
 		QApplication qapp(argc, argv);
 
-		ZmqProxyServer server(settings.port, settings.showVFB, settings.checkHearbeat);
+		settings.controller.showVFB = settings.showVFB;
+		BufferPool::getInstance().setHugePages(settings.hugePages);
+		ZmqProxyServer server(settings.port, settings.controller, settings.checkHearbeat);
+		if (!settings.recordSession.empty()) {
+			server.recordSession(settings.recordSession);
+		}
+		server.reportLogStats(&logWriter);
 		std::thread serverRunner(&ZmqProxyServer::run, &server);
 
 		// blocks until qApp->quit() is called
 		retCode = qapp.exec();
 
 		if (serverRunner.joinable()) {
-			Logger::log(Logger::Debug, "Joining server thread.");
+			LOGGER_LOG(Logger::Debug, "Joining server thread.");
 			serverRunner.join();
 		}
 
 	} catch (std::exception & e) {
-		Logger::log(Logger::Error, e.what());
+		LOGGER_LOG(Logger::Error, e.what());
 	} catch (VRay::VRayException & e) {
-		Logger::log(Logger::Error, e.what());
+		LOGGER_LOG(Logger::Error, e.what());
 	}
 
-	Logger::log(Logger::Debug, "Main thread stopping.");
+	LOGGER_LOG(Logger::Debug, "Main thread stopping.");
+	TraceProfiler::getInstance().stop();
+	Logger::getInstance().setCallback(Logger::StringCb());
+	logWriter.stop();
 	return retCode;
 }
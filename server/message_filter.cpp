@@ -0,0 +1,175 @@
+#include "message_filter.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std::chrono;
+
+namespace {
+/// Repeats of a log line are reported if no other line comes for this long
+const milliseconds REPEAT_NOTE_DELAY(1000);
+
+/// Window for the log line limit
+const milliseconds LOG_WINDOW(1000);
+}
+
+MessageFilter::MessageFilter(int progressIntervalMs, int maxLogLevel, int maxLogsPerSecond, const ProgressSink & progressSink, const LogSink & logSink)
+	: progressSink(progressSink)
+	, logSink(logSink)
+	, progressInterval(progressIntervalMs)
+	, maxLogLevel(maxLogLevel)
+	, maxLogsPerSecond(maxLogsPerSecond)
+	, pendingProgress(0.f)
+	, hasPendingProgress(false)
+	, lastLogLevel(0)
+	, repeatCount(0)
+	, logWindowCount(0)
+	, throttledCount(0)
+	, throttledLevel(std::numeric_limits<int>::max())
+	, stats()
+{}
+
+void MessageFilter::progress(float value, const char * msg, time_point now) {
+	std::lock_guard<std::mutex> lock(mtx);
+	Progress out;
+	if (msg && *msg && lastProgressMessage != msg) {
+		lastProgressMessage = msg;
+		out.message = msg;
+		out.hasMessage = true;
+	}
+
+	if (hasPendingProgress) {
+		// replaced by the newer value, both if it is sent now or kept for later
+		++stats.progressSuppressed;
+		hasPendingProgress = false;
+	}
+	// the final value is never held back
+	if (now - lastProgress >= progressInterval || value >= 1.f) {
+		lastProgress = now;
+		out.value = value;
+		out.hasValue = true;
+		++stats.progressSent;
+	} else {
+		pendingProgress = value;
+		hasPendingProgress = true;
+	}
+	if (out.hasValue || out.hasMessage) {
+		progressSink(out);
+	}
+}
+
+void MessageFilter::log(int level, const char * msg, time_point now) {
+	std::lock_guard<std::mutex> lock(mtx);
+	std::vector<Log> & out = logs;
+	out.clear();
+	if (level > maxLogLevel) {
+		++stats.logsFiltered;
+		return;
+	}
+	if (level == lastLogLevel && lastLog == msg) {
+		lastLogTime = now;
+		++repeatCount;
+		++stats.logsRepeated;
+		return;
+	}
+
+	if (maxLogsPerSecond > 0) {
+		if (now - logWindowStart >= LOG_WINDOW) {
+			logWindowStart = now;
+			logWindowCount = 0;
+			addThrottleNote(out);
+		}
+		if (logWindowCount >= maxLogsPerSecond) {
+			++throttledCount;
+			throttledLevel = std::min(throttledLevel, level);
+			++stats.logsThrottled;
+			if (!out.empty()) {
+				logSink(out);
+			}
+			return;
+		}
+		++logWindowCount;
+	}
+
+	addRepeatNote(out);
+	lastLog = msg;
+	lastLogLevel = level;
+	lastLogTime = now;
+
+	out.push_back(Log());
+	out.back().level = level;
+	out.back().message = msg;
+	++stats.logsSent;
+	logSink(out);
+}
+
+void MessageFilter::flushDue(time_point now) {
+	std::lock_guard<std::mutex> lock(mtx);
+	Progress progressOut;
+	if (hasPendingProgress && now - lastProgress >= progressInterval) {
+		hasPendingProgress = false;
+		lastProgress = now;
+		progressOut.value = pendingProgress;
+		progressOut.hasValue = true;
+		++stats.progressSent;
+		progressSink(progressOut);
+	}
+
+	std::vector<Log> & logOut = logs;
+	logOut.clear();
+	if (repeatCount && now - lastLogTime >= REPEAT_NOTE_DELAY) {
+		addRepeatNote(logOut);
+	}
+	if (throttledCount && now - logWindowStart >= LOG_WINDOW) {
+		addThrottleNote(logOut);
+	}
+	if (!logOut.empty()) {
+		logSink(logOut);
+	}
+}
+
+bool MessageFilter::getDeadline(time_point & deadline) {
+	std::lock_guard<std::mutex> lock(mtx);
+	bool found = false;
+	auto earliest = [&deadline, &found](time_point when) {
+		deadline = found ? std::min(deadline, when) : when;
+		found = true;
+	};
+	if (hasPendingProgress) {
+		earliest(lastProgress + progressInterval);
+	}
+	if (repeatCount) {
+		earliest(lastLogTime + REPEAT_NOTE_DELAY);
+	}
+	if (throttledCount) {
+		earliest(logWindowStart + LOG_WINDOW);
+	}
+	return found;
+}
+
+void MessageFilter::addRepeatNote(std::vector<Log> & out) {
+	if (!repeatCount) {
+		return;
+	}
+	out.push_back(Log());
+	out.back().level = lastLogLevel;
+	out.back().message = "Last message repeated " + std::to_string(repeatCount) + " times";
+	repeatCount = 0;
+}
+
+void MessageFilter::addThrottleNote(std::vector<Log> & out) {
+	if (!throttledCount) {
+		return;
+	}
+	out.push_back(Log());
+	out.back().level = throttledLevel;
+	out.back().message = std::to_string(throttledCount) + " messages not shown, more than " + std::to_string(maxLogsPerSecond) + " per second";
+	throttledCount = 0;
+	throttledLevel = std::numeric_limits<int>::max();
+}
+
+MessageFilter::Stats MessageFilter::takeStats() {
+	std::lock_guard<std::mutex> lock(mtx);
+	const Stats result = stats;
+	stats = Stats();
+	return result;
+}
@@ -0,0 +1,111 @@
+#ifndef MESSAGE_FILTER_H
+#define MESSAGE_FILTER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// Coalesces the small messages V-Ray produces in bursts before they are queued for the client
+/// Progress is sent at most once per interval with the newest value, progress text only when it changes.
+/// V-Ray log lines are filtered by level, repeats of the same line are counted instead of sent and lines over
+/// the per second limit are dropped. What is held back is passed on by @flushDue once it is due.
+/// What passes is handed to the sinks while the filter's lock is held, so messages decided on different threads
+/// are queued in the order they were decided and an older held back progress can't follow a newer one.
+/// All methods are thread safe.
+class MessageFilter {
+public:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// Progress that should be sent
+	struct Progress {
+		float value; ///< Progress in [0, 1]
+		bool hasValue; ///< True if @value should be sent
+		std::string message; ///< Progress text
+		bool hasMessage; ///< True if @message should be sent
+
+		Progress(): value(0.f), hasValue(false), hasMessage(false) {}
+	};
+
+	/// Log line that should be sent
+	struct Log {
+		int level; ///< V-Ray message level
+		std::string message; ///< The text
+
+		Log(): level(0) {}
+	};
+
+	/// Counters since the last call to @takeStats
+	struct Stats {
+		uint64_t progressSent; ///< Progress values sent
+		uint64_t progressSuppressed; ///< Progress values replaced by a newer one before being sent
+		uint64_t logsSent; ///< Log lines sent
+		uint64_t logsFiltered; ///< Log lines above the max level
+		uint64_t logsRepeated; ///< Log lines that repeated the previous one
+		uint64_t logsThrottled; ///< Log lines over the per second limit
+	};
+
+	/// Queues progress to send, called with the filter's lock held so it must not call back into the filter
+	typedef std::function<void(const Progress & progress)> ProgressSink;
+
+	/// Queues log lines to send, called with the filter's lock held so it must not call back into the filter
+	typedef std::function<void(const std::vector<Log> & logs)> LogSink;
+
+	/// @progressIntervalMs - min time between two progress updates, 0 sends all of them
+	/// @maxLogLevel - V-Ray log lines with greater level are not sent, higher levels are less important
+	/// @maxLogsPerSecond - max log lines sent per second, 0 for no limit
+	/// @progressSink, @logSink - receive what passes the filter
+	MessageFilter(int progressIntervalMs, int maxLogLevel, int maxLogsPerSecond, const ProgressSink & progressSink, const LogSink & logSink);
+
+	/// Filter progress from V-Ray
+	/// @msg - progress text, can be null or empty
+	void progress(float value, const char * msg, time_point now);
+
+	/// Filter V-Ray log line, it can be sent with notes for the lines held back before it
+	void log(int level, const char * msg, time_point now);
+
+	/// Send the progress and the log notes held back that are due by @now, call periodically
+	void flushDue(time_point now);
+
+	/// Get the earliest time @flushDue has something to send
+	/// @return - false if nothing is held back
+	bool getDeadline(time_point & deadline);
+
+	/// Get the counters and reset them
+	Stats takeStats();
+
+private:
+	/// Append note for @repeatCount repeats of the last line and reset the count
+	void addRepeatNote(std::vector<Log> & out);
+
+	/// Append note for @throttledCount dropped lines and reset the count
+	void addThrottleNote(std::vector<Log> & out);
+
+	std::mutex mtx; ///< Protects all members, held while the sinks are called
+	const ProgressSink progressSink; ///< Receives progress to send
+	const LogSink logSink; ///< Receives log lines to send
+	std::vector<Log> logs; ///< Reused for the lines passed to @logSink
+	const std::chrono::milliseconds progressInterval; ///< Min time between progress updates
+	const int maxLogLevel; ///< Log lines with greater level are dropped
+	const int maxLogsPerSecond; ///< Max log lines per second, 0 for no limit
+
+	time_point lastProgress; ///< When progress value was last sent
+	float pendingProgress; ///< Newest progress value not yet sent
+	bool hasPendingProgress; ///< True if @pendingProgress should be sent
+	std::string lastProgressMessage; ///< Last progress text sent
+
+	std::string lastLog; ///< Text of the last log line sent
+	int lastLogLevel; ///< Level of the last log line sent
+	time_point lastLogTime; ///< When @lastLog was last received
+	int repeatCount; ///< Times @lastLog was repeated since it was sent
+	time_point logWindowStart; ///< Start of the current one second window for the log limit
+	int logWindowCount; ///< Log lines sent in the current window
+	int throttledCount; ///< Log lines dropped because of the limit since the last note
+	int throttledLevel; ///< Most important level of the dropped lines
+
+	Stats stats; ///< Counters for @takeStats
+};
+
+#endif // MESSAGE_FILTER_H
@@ -0,0 +1,29 @@
+#ifndef RENDERER_BACKEND_H
+#define RENDERER_BACKEND_H
+
+#include "utils/logging_renderer.hpp"
+
+/// Policy of the renderer wrapper, chosen with APPSDK_CALL_LOG in CMake
+/// NullLogger compiles to plain VRayRenderer calls, TimingLogger adds a latency histogram for each
+/// method to the stats output and StreamLogger logs every call with it's arguments
+#if defined(APPSDK_CALL_LOG_TIMING)
+typedef TimingLogger RendererLogPolicy;
+#elif defined(APPSDK_CALL_LOG_STREAM)
+typedef StreamLogger RendererLogPolicy;
+#else
+typedef NullLogger RendererLogPolicy;
+#endif
+
+/// The renderer type the server creates and drives
+/// All calls of RendererController and PersistentRenderer go through this type. Callbacks still receive
+/// VRay::VRayRenderer since the SDK calls them with it, use @getSdkRenderer to compare the two.
+/// It always wraps the SDK renderer: the controller sets values through VRay::Plugin and VRay::Value, which only a
+/// loaded AppSDK creates, so bench/FakeRenderer can't stand in here. The benchmarks drive ImagePipeline instead.
+typedef VRay::LoggingVRayRenderer<RendererLogPolicy> RendererBackend;
+
+/// Get the SDK renderer of @backend, the one passed to it's callbacks
+inline const VRay::VRayRenderer * getSdkRenderer(const RendererBackend * backend) {
+	return backend ? &backend->getBase() : nullptr;
+}
+
+#endif // RENDERER_BACKEND_H
@@ -0,0 +1,88 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "renderer_callbacks.h"
+#include "renderer_controller.h"
+#include <thread>
+
+RendererCallbacks::Scope::Scope(RendererCallbacks & callbacks)
+	: callbacks(callbacks)
+{
+	const uint32_t previous = callbacks.state.fetch_add(1, std::memory_order_acquire);
+	entered = !(previous & DETACHED);
+	if (!entered) {
+		callbacks.state.fetch_sub(1, std::memory_order_release);
+		LOGGER_LOG(Logger::Debug, "Should not call callbacks on deallocated RendererController");
+	}
+}
+
+RendererCallbacks::Scope::~Scope() {
+	if (entered) {
+		callbacks.state.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+RendererCallbacks::RendererCallbacks(RendererController & controller)
+	: controller(controller)
+	, state(DETACHED)
+{}
+
+void RendererCallbacks::attach(RendererBackend & renderer) {
+	state.fetch_and(~DETACHED, std::memory_order_release);
+
+	renderer.setOnProgress<RendererCallbacks, &RendererCallbacks::onProgress>(*this);
+	renderer.setOnRTImageUpdated<RendererCallbacks, &RendererCallbacks::imageUpdate>(*this);
+	renderer.setOnImageReady<RendererCallbacks, &RendererCallbacks::imageDone>(*this);
+	renderer.setOnBucketReady<RendererCallbacks, &RendererCallbacks::bucketReady>(*this);
+	renderer.setOnVFBClosed<RendererCallbacks, &RendererCallbacks::closeVFB>(*this);
+
+	renderer.setOnDumpMessage<RendererCallbacks, &RendererCallbacks::vrayMessageDumpHandler>(*this);
+}
+
+void RendererCallbacks::detach() {
+	state.fetch_or(DETACHED, std::memory_order_acq_rel);
+	// callbacks are short compared to the time a renderer lives, so just wait for the running ones
+	while (state.load(std::memory_order_acquire) != DETACHED) {
+		std::this_thread::yield();
+	}
+}
+
+void RendererCallbacks::onProgress(VRay::VRayRenderer & renderer, const char * msg, int elementNumber, int elementsCount, void * arg) {
+	Scope scope(*this);
+	if (scope) {
+		controller.onProgress(renderer, msg, elementNumber, elementsCount, arg);
+	}
+}
+
+void RendererCallbacks::imageUpdate(VRay::VRayRenderer & renderer, VRay::VRayImage * img, void * arg) {
+	Scope scope(*this);
+	if (scope) {
+		controller.imageUpdate(renderer, img, arg);
+	}
+}
+
+void RendererCallbacks::imageDone(VRay::VRayRenderer & renderer, void * arg) {
+	Scope scope(*this);
+	if (scope) {
+		controller.imageDone(renderer, arg);
+	}
+}
+
+void RendererCallbacks::closeVFB(VRay::VRayRenderer & renderer, void * arg) {
+	Scope scope(*this);
+	if (scope) {
+		controller.closeVFB(renderer, arg);
+	}
+}
+
+void RendererCallbacks::bucketReady(VRay::VRayRenderer & renderer, int x, int y, const char * host, VRay::VRayImage * img, void * arg) {
+	Scope scope(*this);
+	if (scope) {
+		controller.bucketReady(renderer, x, y, host, img, arg);
+	}
+}
+
+void RendererCallbacks::vrayMessageDumpHandler(VRay::VRayRenderer & renderer, const char * msg, int level, void * arg) {
+	Scope scope(*this);
+	if (scope) {
+		controller.vrayMessageDumpHandler(renderer, msg, level, arg);
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef RENDERER_CALLBACKS_H
+#define RENDERER_CALLBACKS_H
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+
+#include <vraysdk.hpp>
+#include <atomic>
+#include <cstdint>
+
+#include "renderer_backend.h"
+
+class RendererController;
+
+/// Target of all V-Ray callbacks of one renderer, forwards them to the RendererController while it is attached
+/// Each controller has it's own instance, so callbacks of different renderers never wait for each other.
+/// Owned with shared_ptr by the controller and by the persistent renderer, callbacks that V-Ray already started
+/// for a renderer that outlives it's controller find this detached and return without touching the controller.
+class RendererCallbacks {
+public:
+	explicit RendererCallbacks(RendererController & controller);
+
+	RendererCallbacks(const RendererCallbacks &) = delete;
+	RendererCallbacks & operator=(const RendererCallbacks &) = delete;
+
+	/// Set all callbacks of @renderer to this object and start forwarding them to the controller
+	void attach(RendererBackend & renderer);
+
+	/// Stop forwarding callbacks, waits for the ones running in the controller to return
+	/// Must not be called from a callback
+	void detach();
+
+	/// Callbacks set with @attach
+	void onProgress(VRay::VRayRenderer & renderer, const char * msg, int elementNumber, int elementsCount, void * arg);
+	void imageUpdate(VRay::VRayRenderer & renderer, VRay::VRayImage * img, void * arg);
+	void imageDone(VRay::VRayRenderer & renderer, void * arg);
+	void closeVFB(VRay::VRayRenderer & renderer, void * arg);
+	void bucketReady(VRay::VRayRenderer & renderer, int x, int y, const char * host, VRay::VRayImage * img, void * arg);
+	void vrayMessageDumpHandler(VRay::VRayRenderer & renderer, const char * msg, int level, void * arg);
+
+private:
+	/// Marks a callback running in the controller for the duration of the scope
+	class Scope {
+	public:
+		explicit Scope(RendererCallbacks & callbacks);
+		~Scope();
+
+		/// False if the callbacks are detached and the controller must not be used
+		explicit operator bool() const { return entered; }
+
+	private:
+		RendererCallbacks & callbacks;
+		bool entered;
+	};
+
+	/// Set in @state while detached, the rest of the bits count the running callbacks
+	static const uint32_t DETACHED = 1u << 31;
+
+	RendererController & controller; ///< The controller callbacks are forwarded to
+	std::atomic<uint32_t> state; ///< DETACHED flag and number of callbacks running in @controller
+};
+
+#endif // RENDERER_CALLBACKS_H
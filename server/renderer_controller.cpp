@@ -1,18 +1,48 @@
 #define VRAY_RUNTIME_LOAD_SECONDARY
 #include <algorithm>
+#include <cstring>
 #include <unordered_map>
 #include "renderer_controller.h"
 #include "utils/logger.h"
+#include "utils/image_utils.h"
+#include "utils/trace_profiler.h"
 
 using namespace VRayBaseTypes;
 using namespace std;
 
+/// With progressive viewport, RT images are sent at lower resolution for this long after a scene change
+const int PROGRESSIVE_VIEWPORT_MS = 300;
+
+/// Max time the run thread waits in poll when there is nothing to do
+const int IDLE_POLL_MS = 1000;
+
+/// Max messages sent before polling again, small messages are otherwise only limited by the send budget
+const int MAX_BATCH_MESSAGES = 256;
+
+/// Messages wait in the send queue once the proxy holds this much of the client's connection time, so a newer
+/// RT image can still replace the one in the queue
+const int LINK_WINDOW_MS = 50;
+
+/// Least bytes the proxy may hold for the client, used until the connection's drain rate is measured
+const size_t MIN_LINK_WINDOW = 1 << 20;
+
+/// Get the part of @settings used by ImagePipeline
+static ImagePipeline::Settings getPipelineSettings(const ControllerSettings & settings) {
+	ImagePipeline::Settings pipelineSettings;
+	pipelineSettings.viewportDelta = settings.viewportDelta;
+	pipelineSettings.deltaKeyframeInterval = settings.deltaKeyframeInterval;
+	pipelineSettings.bucketBatchMs = settings.bucketBatchMs;
+	pipelineSettings.bucketHalf = settings.bucketHalf;
+	return pipelineSettings;
+}
+
 
 struct PersistentRenderer {
-	VRay::VRayRenderer * renderer; ///< Pointer to saved instance of vray renderer
+	RendererBackend * renderer; ///< Pointer to saved instance of vray renderer
 	mutex mtx; ///< Protects access to all members, since we can have multiple RendererController instances
 	bool hasController; ///< True if there is associated RendererController with the @renderer
 	bool closedVFB; ///< True if the current renderer has not controller (@hasController == false) and the VFB was closed
+	std::shared_ptr<RendererCallbacks> callbacks; ///< Callbacks of the controller that saved @renderer, kept for callbacks V-Ray already started
 
 	PersistentRenderer()
 		: renderer(nullptr)
@@ -22,18 +52,19 @@ struct PersistentRenderer {
 
 	/// If not instance is saved, save the passed argument and set it to null
 	/// @param instance - the instance that will be saved if none is
+	/// @param instanceCallbacks - the detached callbacks of the instance's controller
 	/// @return - true if instance was saved, false otherwise
-	bool saveInstance(VRay::VRayRenderer *& instance);
+	bool saveInstance(RendererBackend *& instance, const std::shared_ptr<RendererCallbacks> & instanceCallbacks);
 
 	/// Obtain the saved pointer, and set hasController to true
 	/// @return - the saved pointer, could be nullptr
-	VRay::VRayRenderer * useSavedInstance();
+	RendererBackend * useSavedInstance();
 
 	/// Signal that vfb was closed for some instance, if the passed instance
 	/// is the same as the saved, free it and set the argument to nullptr;
 	/// @param instance - pointer to the argument for the VFB close callback
 	/// @return true if saved renderer is the one VFB is closed for
-	bool rendererVFBClosed(VRay::VRayRenderer * instance);
+	bool rendererVFBClosed(const VRay::VRayRenderer * instance);
 
 private:
 
@@ -52,14 +83,15 @@ void PersistentRenderer::checkForDelete() {
 	if (closedVFB) {
 		delete renderer;
 		renderer = nullptr;
+		callbacks.reset();
 		closedVFB = false;
 	}
 }
 
-bool PersistentRenderer::rendererVFBClosed(VRay::VRayRenderer * instance) {
-	if (instance == renderer) {
+bool PersistentRenderer::rendererVFBClosed(const VRay::VRayRenderer * instance) {
+	if (renderer && getSdkRenderer(renderer) == instance) {
 		renderer = nullptr;
-		Logger::log(Logger::Debug, "VFB closed for persisten renderer, abandoning instance");
+		LOGGER_LOG(Logger::Debug, "VFB closed for persisten renderer, abandoning instance");
 		return true;
 	}
 	return false;
@@ -67,16 +99,16 @@ bool PersistentRenderer::rendererVFBClosed(VRay::VRayRenderer * instance) {
 
 
 void PersistentRenderer::vfbClosedCB(VRay::VRayRenderer & cbRenderer, void *) {
-	if (renderer == &cbRenderer) {
-		Logger::log(Logger::Debug, "VFB Closed after RendererController is stopped");
+	if (renderer && getSdkRenderer(renderer) == &cbRenderer) {
+		LOGGER_LOG(Logger::Debug, "VFB Closed after RendererController is stopped");
 		closedVFB = true;
 	} else {
-		Logger::log(Logger::Debug, "VFB Closed after RendererController is stopped NOT OWNING RENDERER");
+		LOGGER_LOG(Logger::Debug, "VFB Closed after RendererController is stopped NOT OWNING RENDERER");
 	}
 }
 
 
-bool PersistentRenderer::saveInstance(VRay::VRayRenderer *& instance) {
+bool PersistentRenderer::saveInstance(RendererBackend *& instance, const std::shared_ptr<RendererCallbacks> & instanceCallbacks) {
 	lock_guard<mutex> lock(mtx);
 	const auto saved = renderer;
 	checkForDelete();
@@ -84,7 +116,7 @@ bool PersistentRenderer::saveInstance(VRay::VRayRenderer *& instance) {
 		assert(saved != instance && "Renderer still in use by RendererController is freed");
 	}
 	if (!renderer || (renderer == instance && hasController)) {
-		Logger::log(Logger::Debug, "Destroying RendererController for persistentInstance, saving renderer to persist");
+		LOGGER_LOG(Logger::Debug, "Destroying RendererController for persistentInstance, saving renderer to persist");
 		hasController = false;
 		instance->setOnProgress(nullptr);
 		instance->setOnRTImageUpdated(nullptr);
@@ -95,6 +127,7 @@ bool PersistentRenderer::saveInstance(VRay::VRayRenderer *& instance) {
 		// instance->clearAllPropertyValuesUpToTime(std::numeric_limits<float>::max());
 		instance->reset();
 		renderer = instance;
+		callbacks = instanceCallbacks;
 		instance->setOnVFBClosed<PersistentRenderer, &PersistentRenderer::vfbClosedCB>(*this);
 		instance = nullptr;
 		return true;
@@ -104,32 +137,47 @@ bool PersistentRenderer::saveInstance(VRay::VRayRenderer *& instance) {
 }
 
 
-VRay::VRayRenderer * PersistentRenderer::useSavedInstance() {
+RendererBackend * PersistentRenderer::useSavedInstance() {
 	lock_guard<mutex> lock(mtx);
 	checkForDelete();
 	if (renderer && !hasController) {
-		Logger::log(Logger::Debug, "PersistentRenderer::useSavedInstance re-using saved instance");
+		LOGGER_LOG(Logger::Debug, "PersistentRenderer::useSavedInstance re-using saved instance");
 		hasController = true;
 		return renderer;
 	}
-	Logger::log(Logger::Debug, "PersistentRenderer::useSavedInstance called but there is no persistent renderer");
+	LOGGER_LOG(Logger::Debug, "PersistentRenderer::useSavedInstance called but there is no persistent renderer");
 	return nullptr;
 }
 
 
-RendererController::RendererController(zmq::context_t & zmqContext, uint64_t clientId, ClientType type, bool showVFB)
+RendererController::RendererController(zmq::context_t & zmqContext, uint64_t clientId, ClientType type, const ControllerSettings & settings)
 	: runState(IDLE)
 	, clType(type)
 	, clientId(clientId)
 	, zmqContext(zmqContext)
+	, rtImagesReplaced(0)
 	, renderer(nullptr)
 	, type(VRayMessage::RendererType::None)
 	, currentFrame(-1000)
 	, jpegQuality(60)
 	, viewportType(VRayBaseTypes::AttrImage::ImageType::JPG)
+	, settings(settings)
+	, imagePipeline(getPipelineSettings(settings), [this](zmq::message_t && message, MessageKind kind) {
+		return queueMessage(std::move(message), kind);
+	})
+	, viewportQuality(settings.targetFps, settings.maxLatencyMs)
+	, lastSceneChange(0)
+	, bucketCount(0)
+	, messageFilter(settings.progressIntervalMs, settings.vrayLogLevel, settings.maxVRayLogsPerSecond,
+		[this](const MessageFilter::Progress & progress) { queueProgress(progress); },
+		[this](const std::vector<MessageFilter::Log> & logs) { queueLogs(logs); })
+	, sendBudget(settings.sendSliceMs, static_cast<size_t>(settings.sendBatchKB) * 1024, MAX_BATCH_MESSAGES)
+	, latencyTracer(settings.traceLatency ? new LatencyTracer() : nullptr)
+	, clientLink([this]() { wakeup.signal(); })
 	, vfbClosed(false)
+	, callbacks(std::make_shared<RendererCallbacks>(*this))
 {
-	options.enableFrameBuffer = showVFB;
+	options.enableFrameBuffer = settings.showVFB;
 	options.showFrameBuffer = false;
 	options.inProcess = true;
 	options.noDR = true;
@@ -141,15 +189,17 @@ RendererController::~RendererController() {
 }
 
 void RendererController::stopRenderer(bool lockMtx) {
-	Logger::log(Logger::Debug, "Freeing RendererController object");
+	LOGGER_LOG(Logger::Debug, "Freeing RendererController object");
 	unique_lock<mutex> rendLock(rendererMtx, defer_lock);
 	if (lockMtx) {
 		rendLock.lock();
 	}
 	if (renderer) {
+		TRACE_ZONE("RendererController::stopRenderer");
 		renderer->stop();
+		callbacks->detach();
 		if (canPersistCurrentRenderer()) {
-			persistent.saveInstance(renderer);
+			persistent.saveInstance(renderer, callbacks);
 		}
 		delete renderer;
 		renderer = nullptr;
@@ -161,22 +211,23 @@ bool RendererController::canPersistCurrentRenderer() const
 {
 	if (type == VRayMessage::RendererType::Animation || type == VRayMessage::RendererType::SingleFrame) {
 		if (vfbClosed) {
-			Logger::log(Logger::Info, "Can't persist instance with closed vfb");
+			LOGGER_LOG(Logger::Info, "Can't persist instance with closed vfb");
 			return false;
 		} else {
 			return true;
 		}
 	}
-	Logger::log(Logger::Info, "Can't persist instance which is not for final render");
+	LOGGER_LOG(Logger::Info, "Can't persist instance which is not for final render");
 	return false;
 }
 
 
 void RendererController::handle(VRayMessage && message) {
+	TRACE_ZONE("RendererController::handle");
 	bool success = false;
 	try {
 		if (vfbClosed) {
-			Logger::log(Logger::Info, "RendererController::handle :: VFB was closed - stopping client");
+			LOGGER_LOG(Logger::Info, "RendererController::handle :: VFB was closed - stopping client");
 			stopRenderer();
 			return;
 		}
@@ -184,16 +235,17 @@ void RendererController::handle(VRayMessage && message) {
 		switch (message.getType()) {
 		case VRayMessage::Type::ChangePlugin:
 			if (!renderer) {
-				Logger::getInstance().log(Logger::Warning, "Can't change plugin - no renderer loaded!");
+				LOGGER_LOG(Logger::Warning, "Can't change plugin - no renderer loaded!");
 				return;
 			}
+			lastSceneChange = chrono::high_resolution_clock::now().time_since_epoch().count();
 			this->pluginMessage(std::move(message));
 			break;
 		case VRayMessage::Type::ChangeRenderer: {
 			const auto actionType = message.getRendererAction();
 			if (actionType == VRayMessage::RendererAction::Init) {
 				if (renderer) {
-					Logger::log(Logger::Error, "Already init");
+					LOGGER_LOG(Logger::Error, "Already init");
 					return;
 				}
 
@@ -207,7 +259,7 @@ void RendererController::handle(VRayMessage && message) {
 					options.inProcess = false;
 				}
 			} else if (!renderer) {
-				Logger::log(Logger::Warning, "Can't change renderer - no renderer loaded!");
+				LOGGER_LOG(Logger::Warning, "Can't change renderer - no renderer loaded!");
 				return;
 			}
 
@@ -215,14 +267,14 @@ void RendererController::handle(VRayMessage && message) {
 			break;
 		}
 		default:
-			Logger::log(Logger::Error, "Unknown message type");
+			LOGGER_LOG(Logger::Error, "Unknown message type");
 			return;
 		}
 	} catch (VRay::VRayException & e) {
-		Logger::log(Logger::Error, e.what());
+		LOGGER_LOG(Logger::Error, e.what());
 		transitionState(runState, IDLE);
 	} catch (std::exception & e) {
-		Logger::log(Logger::Error, e.what());
+		LOGGER_LOG(Logger::Error, e.what());
 	}
 }
 
@@ -253,7 +305,7 @@ std::pair<bool, VRay::Value> RendererController::toVrayValue(const VRayBaseTypes
 			auto plg = renderer->getPlugin(pluginRef);
 			if (!plg) {
 				auto buffLog = Logger::getInstance().makeBuffered();
-				buffLog.log(Logger::Error, "Failed setting:", message.getProperty(), "=", pluginRef, "for plugin", message.getPlugin());
+				Logger::log(buffLog, Logger::Error, "Failed setting:", message.getProperty(), "=", pluginRef, "for plugin", message.getPlugin());
 				delayedMessages[plugin.plugin].emplace_back(std::move(message), std::move(buffLog));
 				return {false, VRay::Value()};
 			}
@@ -264,7 +316,7 @@ std::pair<bool, VRay::Value> RendererController::toVrayValue(const VRayBaseTypes
 	case ValueType::ValueTypeFloat:
 		return {true, VRay::Value(val.as<AttrSimpleType<float>>().value)};
 	default:
-		Logger::log(Logger::Error, "Could not convert generic value of type", val.type, "to vray value!");
+		LOGGER_LOG(Logger::Error, "Could not convert generic value of type", val.type, "to vray value!");
 		return {false, VRay::Value()};
 	}
 }
@@ -275,31 +327,33 @@ void RendererController::pluginMessage(VRayMessage && message) {
 	if (message.getPluginAction() == VRayMessage::PluginAction::Update) {
 		VRay::Plugin plugin = renderer->getPlugin(message.getPlugin());
 		if (!plugin) {
-			Logger::getInstance().log(Logger::Warning, "Failed to load plugin: ", message.getPlugin());
+			LOGGER_LOG(Logger::Warning, "Failed to load plugin: ", message.getPlugin());
 			return;
 		}
 
+		// values are set through VRay::Plugin which the renderer wrapper does not see, so time them here
+		RendererLogPolicy::Scope logScope("Plugin::setValueAtTime");
 		switch (message.getValueType()) {
 		case VRayBaseTypes::ValueType::ValueTypeMatrix:
 			success = plugin.setValueAtTime(message.getProperty(), *message.getValue<const VRay::Matrix>(), currentFrame);
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<const VRay::Matrix>(), ", ", currentFrame, "); // success == ", success);
 
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeTransform:
 			success = plugin.setValueAtTime(message.getProperty(), *message.getValue<const VRay::Transform>(), currentFrame);
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<const VRay::Transform>(), ", ", currentFrame, "); // success == ", success);
 
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeInt:
 			success = plugin.setValueAtTime(message.getProperty(), *message.getValue<int>(), currentFrame);
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<int>(), ", ", currentFrame, "); // success == ", success);
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeFloat:
 			success = plugin.setValueAtTime(message.getProperty(), *message.getValue<float>(), currentFrame);
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<float>(), ", ", currentFrame, "); // success == ", success);
 			break;
 		case VRayBaseTypes::ValueType::ValueTypePlugin:
@@ -313,21 +367,21 @@ void RendererController::pluginMessage(VRayMessage && message) {
 
 			if (attrPlugin.plugin == "NULL") {
 				success = plugin.setValueAtTime(message.getProperty(), VRay::Plugin(), currentFrame);
-				Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+				LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 					"\").setValueAtTime(\"", message.getProperty(), "\", \"NULL\", ", currentFrame, "); // success == ", success);
 			} else {
 				if (!renderer->getPlugin(attrPlugin.plugin)) {
-					Logger::log(Logger::Debug, "Plugin [", message.getPlugin(), "] references (",  attrPlugin.plugin, ") which is not yet exported - delaying.");
+					LOGGER_LOG(Logger::Debug, "Plugin [", message.getPlugin(), "] references (",  attrPlugin.plugin, ") which is not yet exported - delaying.");
 
 					// save message and it's error if it is not processed before commit
 					auto buffLog = Logger::getInstance().makeBuffered();
-					buffLog.log(Logger::Error, "Failed setting:", message.getProperty(), "=", pluginData, "for plugin", message.getPlugin());
+					Logger::log(buffLog, Logger::Error, "Failed setting:", message.getProperty(), "=", pluginData, "for plugin", message.getPlugin());
 
 					delayedMessages[attrPlugin.plugin].emplace_back(std::move(message), std::move(buffLog));
 				} else {
 					success = plugin.setValueAsStringAtTime(message.getProperty(), pluginData, currentFrame);
 
-					Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+					LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 						"\").setValueAsStringAtTime(\"", message.getProperty(), "\",\"", pluginData, "\", ", currentFrame, "); // success == ", success);
 				}
 			}
@@ -337,28 +391,28 @@ void RendererController::pluginMessage(VRayMessage && message) {
 		case VRayBaseTypes::ValueType::ValueTypeVector:
 			success = plugin.setValueAtTime(message.getProperty(), *message.getValue<VRay::Vector>(), currentFrame);
 
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<VRay::Vector>(), ", ", currentFrame, "); // success == ", success);
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeString:
 			if (message.getValueSetter() == VRayMessage::ValueSetter::AsString) {
 				success = plugin.setValueAsStringAtTime(message.getProperty(), *message.getValue<std::string>(), currentFrame);
-				Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+				LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 					"\").setValueAsStringAtTime(\"", message.getProperty(), ",", *message.getValue<std::string>(), "\", ", currentFrame, "); // success == ", success);
 			} else {
 				success = plugin.setValueAtTime(message.getProperty(), *message.getValue<std::string>(), currentFrame);
-				Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+				LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 					"\").setValueAtTime(\"", message.getProperty(), "\",\"", *message.getValue<std::string>(), "\", ", currentFrame, "); // success == ", success);
 			}
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeColor:
 			success = plugin.setValueAtTime(message.getProperty(), *message.getValue<VRay::Color>(), currentFrame);
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 					"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<VRay::Color>(), ", ", currentFrame, "); // success == ", success);
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeAColor:
 			success = plugin.setValueAtTime(message.getProperty(), *message.getValue<VRay::AColor>(), currentFrame);
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 					"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<VRay::AColor>(), ", ", currentFrame, "); // success == ", success);
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeListInt:
@@ -366,7 +420,7 @@ void RendererController::pluginMessage(VRayMessage && message) {
 				**message.getValue<VRayBaseTypes::AttrListInt>(),
 				message.getValue<VRayBaseTypes::AttrListInt>()->getBytesCount(), currentFrame);
 
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<VRayBaseTypes::AttrListInt>()->getData(), ", ", currentFrame, "); // success == ", success);
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeListFloat:
@@ -374,7 +428,7 @@ void RendererController::pluginMessage(VRayMessage && message) {
 				**message.getValue<VRayBaseTypes::AttrListFloat>(),
 				message.getValue<VRayBaseTypes::AttrListFloat>()->getBytesCount(), currentFrame);
 
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<VRayBaseTypes::AttrListFloat>()->getData(), ", ", currentFrame, "); // success == ", success);
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeListVector:
@@ -382,7 +436,7 @@ void RendererController::pluginMessage(VRayMessage && message) {
 				**message.getValue<VRayBaseTypes::AttrListVector>(),
 				message.getValue<VRayBaseTypes::AttrListVector>()->getBytesCount(), currentFrame);
 
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<VRayBaseTypes::AttrListVector>()->getData(), ", ", currentFrame, "); // success == ", success);
 			break;
 		case VRayBaseTypes::ValueType::ValueTypeListPlugin:
@@ -395,10 +449,10 @@ void RendererController::pluginMessage(VRayMessage && message) {
 				const auto & messagePlugin = (*plist)[c];
 				const auto vrayPlugin = renderer->getPlugin(messagePlugin.plugin);
 				if (!vrayPlugin) {
-					Logger::log(Logger::Debug, "Plugin [", message.getPlugin(), "] references (", messagePlugin.plugin, ") which is not yet exported - delaying.");
+					LOGGER_LOG(Logger::Debug, "Plugin [", message.getPlugin(), "] references (", messagePlugin.plugin, ") which is not yet exported - delaying.");
 
 					auto buffLog = Logger::getInstance().makeBuffered();
-					buffLog.log(Logger::Error, "Failed setting:", message.getProperty(), "=", messagePlugin.plugin, "for plugin", message.getPlugin());
+					Logger::log(buffLog, Logger::Error, "Failed setting:", message.getProperty(), "=", messagePlugin.plugin, "for plugin", message.getPlugin());
 
 					delayed = true;
 					delayedMessages[messagePlugin.plugin].emplace_back(std::move(message), std::move(buffLog));
@@ -409,13 +463,13 @@ void RendererController::pluginMessage(VRayMessage && message) {
 			if (!delayed) {
 				success = plugin.setValueAtTime(message.getProperty(), pluginList, currentFrame);
 
-				Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+				LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 					"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<VRayBaseTypes::AttrListPlugin>()->getData(), ", ", currentFrame, "); // success == ", success);
 			}
 #else
 			VRay::VUtils::ValueRefList pluginList(plist.getCount());
 
-			Logger::log(Logger::APIDump, "{VUtils::ValueRefList l(", plist.getCount(), ");");
+			LOGGER_LOG(Logger::APIDump, "{VUtils::ValueRefList l(", plist.getCount(), ");");
 
 			for (int c = 0; c < plist.getCount(); ++c) {
 				const auto & messagePlugin = (*plist)[c];
@@ -423,16 +477,16 @@ void RendererController::pluginMessage(VRayMessage && message) {
 				VRay::VUtils::ObjectID pluginId = { VRay::NO_ID };
 
 				if (!vrayPlugin) {
-					Logger::log(Logger::Warning, "Missing plugin", messagePlugin.plugin, "referenced in plugin list for", message.getPlugin());
+					LOGGER_LOG(Logger::Warning, "Missing plugin", messagePlugin.plugin, "referenced in plugin list for", message.getPlugin());
 				} else {
 					pluginId = {vrayPlugin.getId()};
 				}
-				Logger::log(Logger::APIDump, "l[", c, "].setObjectID(VUtils::ObjectID{renderer.getPlugin(\"", messagePlugin.plugin, "\").getId()});");
+				LOGGER_LOG(Logger::APIDump, "l[", c, "].setObjectID(VUtils::ObjectID{renderer.getPlugin(\"", messagePlugin.plugin, "\").getId()});");
 
 				pluginList[c].setObjectID(pluginId);
 			}
 			success = plugin.setValueAtTime(message.getProperty(), pluginList, currentFrame);
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",l, ", currentFrame, ");} // success == ", success);
 #endif
 			break;
@@ -448,7 +502,7 @@ void RendererController::pluginMessage(VRayMessage && message) {
 			}
 			success = plugin.setValueAtTime(message.getProperty(), stringList, currentFrame);
 
-			Logger::log(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
+			LOGGER_LOG(Logger::APIDump, "renderer.getPlugin(\"", message.getPlugin(),
 				"\").setValueAtTime(\"", message.getProperty(), "\",", *message.getValue<VRayBaseTypes::AttrListString>()->getData(), ", ", currentFrame, "); // success == ", success);
 			break;
 		}
@@ -491,102 +545,101 @@ void RendererController::pluginMessage(VRayMessage && message) {
 			success = plugin.setValueAtTime(message.getProperty(), map_channels, currentFrame);
 
 			// TODO: maybe implement - tricky as it usually contains alot of data
-			Logger::log(Logger::APIDump, "// AttrMapChannels unimplemented log success == ", success);
+			LOGGER_LOG(Logger::APIDump, "// AttrMapChannels unimplemented log success == ", success);
 			break;
 		}
 		case VRayBaseTypes::ValueType::ValueTypeInstancer:
 		{
-			bool delayed = false;
 			const VRayBaseTypes::AttrInstancer & inst = *message.getValue<VRayBaseTypes::AttrInstancer>();
-			VRay::VUtils::ValueRefList instancer(inst.data.getCount() + 1);
-			instancer[0] = VRay::VUtils::Value(inst.frameNumber);
-
-			auto logBuff = Logger::getInstance().makeBuffered();
-			// TODO: fixme
-			logBuff.log(Logger::APIDump, "{\n\tVUtils::ValueRefList i(", inst.data.getCount() + 1, ");\n\ti[0]=VUtils::Value(", inst.frameNumber, ");");
-
-			for (int i = 0; i < inst.data.getCount(); ++i) {
-				const VRayBaseTypes::AttrInstancer::Item &item = (*inst.data)[i];
-
-				VRay::VUtils::ValueRefList instance(4);
 
-				const VRay::Transform * tm, *vel;
-				tm = reinterpret_cast<const VRay::Transform*>(&item.tm);
-				vel = reinterpret_cast<const VRay::Transform*>(&item.vel);
-
-				instance[0].setDouble(item.index);
-				instance[1].setTransform(*tm);
-				instance[2].setTransform(*vel);
-
-				auto refPlugin = renderer->getPlugin(item.node.plugin);
+			auto resolveNode = [this, &message](const std::string & node) {
+				auto refPlugin = renderer->getPlugin(node);
 				if (!refPlugin) {
-					refPlugin = renderer->getOrCreatePlugin(item.node.plugin, "Node");
+					refPlugin = renderer->getOrCreatePlugin(node, "Node");
 					if (!refPlugin) {
-						Logger::log(Logger::Warning, "Instancer (", message.getPlugin() ,") referencing not existing plugin [", item.node.plugin, "]");
+						LOGGER_LOG(Logger::Warning, "Instancer (", message.getPlugin() ,") referencing not existing plugin [", node, "]");
 					}
 				}
+				return refPlugin;
+			};
+
+			InstancerCache & cache = instancers[message.getPlugin() + "::" + message.getProperty()];
+			const InstancerCache::UpdateStats stats = cache.update(inst, resolveNode);
+			LOGGER_LOG(Logger::Debug, "Instancer (", message.getPlugin(), ") added", stats.added, "modified", stats.modified,
+				"removed", stats.removed, "reused", stats.reused);
+
+			// nothing moved since last update, V-Ray already has the same list for this frame
+			if (stats.changed() || cache.getLastSetFrame() != currentFrame) {
+				success = plugin.setValueAtTime(message.getProperty(), cache.makeValue(), currentFrame);
+				cache.setLastSetFrame(currentFrame);
+			}
 
-				// TODO: fixme
-				logBuff.log(Logger::APIDump, "\t{\n\t\tVUtils::ValueRefList in(4);");
-				logBuff.log(Logger::APIDump, "\t\tin[0].setDouble(", item.index, ");");
-				logBuff.log(Logger::APIDump, "\t\tin[1].setTransform(", *tm, ");");
-				logBuff.log(Logger::APIDump, "\t\tin[2].setTransform(", *vel, ");");
-				logBuff.log(Logger::APIDump, "\t\tin[3].setPlugin(renderer.getPlugin(\"", item.node.plugin, "\"));");
-				logBuff.log(Logger::APIDump, "\t\ti[", i + 1, "].setList(in);\n\t}");
+			if (Logger::isEnabled(Logger::APIDump)) {
+				auto logBuff = Logger::getInstance().makeBuffered();
+				Logger::log(logBuff, Logger::APIDump, "{\n\tVUtils::ValueRefList i(", inst.data.getCount() + 1, ");\n\ti[0]=VUtils::Value(", inst.frameNumber, ");");
 
-				instance[3].setPlugin(refPlugin);
-				instancer[i + 1].setList(instance);
-			}
+				for (int i = 0; i < inst.data.getCount(); ++i) {
+					const VRayBaseTypes::AttrInstancer::Item &item = (*inst.data)[i];
 
-			if (instancer.size() == inst.data.getCount() + 1) {
-				success = plugin.setValueAtTime(message.getProperty(), instancer, currentFrame);
-			}
+					const VRay::Transform * tm, *vel;
+					tm = reinterpret_cast<const VRay::Transform*>(&item.tm);
+					vel = reinterpret_cast<const VRay::Transform*>(&item.vel);
 
-			logBuff.log(Logger::APIDump, "\trenderer.getPlugin(\"", message.getPlugin(), "\").setValueAtTime(\"", message.getProperty(), "\",i, ", currentFrame, ");\n} // success == ", success);
+					Logger::log(logBuff, Logger::APIDump, "\t{\n\t\tVUtils::ValueRefList in(4);");
+					Logger::log(logBuff, Logger::APIDump, "\t\tin[0].setDouble(", item.index, ");");
+					Logger::log(logBuff, Logger::APIDump, "\t\tin[1].setTransform(", *tm, ");");
+					Logger::log(logBuff, Logger::APIDump, "\t\tin[2].setTransform(", *vel, ");");
+					Logger::log(logBuff, Logger::APIDump, "\t\tin[3].setPlugin(renderer.getPlugin(\"", item.node.plugin, "\"));");
+					Logger::log(logBuff, Logger::APIDump, "\t\ti[", i + 1, "].setList(in);\n\t}");
+				}
+
+				Logger::log(logBuff, Logger::APIDump, "\trenderer.getPlugin(\"", message.getPlugin(), "\").setValueAtTime(\"", message.getProperty(), "\",i, ", currentFrame, ");\n} // success == ", success);
 
-			Logger::getInstance().log(logBuff); // dump buff
+				Logger::getInstance().log(logBuff); // dump buff
+			}
 
 			break;
 		}
 		default:
-			Logger::getInstance().log(Logger::Warning, "Missing case for", message.getValueType());
+			LOGGER_LOG(Logger::Warning, "Missing case for", message.getValueType());
 			success = false;
 		}
 
 		if (!success) {
-			Logger::log(Logger::Warning, "Failed to set property:", message.getProperty(), "for:", message.getPlugin());
+			LOGGER_LOG(Logger::Warning, "Failed to set property:", message.getProperty(), "for:", message.getPlugin());
 		}
 	} else if (message.getPluginAction() == VRayMessage::PluginAction::Create) {
 		const bool created = renderer->getOrCreatePlugin(message.getPlugin(), message.getPluginType());
 		if (!created) {
-			Logger::log(Logger::Warning, "Failed to create plugin:", message.getPlugin());
+			LOGGER_LOG(Logger::Warning, "Failed to create plugin:", message.getPlugin());
 		} else {
 			auto toInsert = delayedMessages.find(message.getPlugin());
 			if (toInsert != delayedMessages.end()) {
 				for (auto & msg : toInsert->second) {
-					Logger::log(Logger::Debug, "Inserting delayed plugin [", msg.first.getPlugin(), "] referencing (", toInsert->first, ").");
+					LOGGER_LOG(Logger::Debug, "Inserting delayed plugin [", msg.first.getPlugin(), "] referencing (", toInsert->first, ").");
 					handle(std::move(msg.first));
 				}
 				delayedMessages.erase(toInsert);
 			}
 		}
-		Logger::log(Logger::APIDump, "renderer.getOrCreatePlugin(\"", message.getPlugin(), "\",\"", message.getPluginType(), "\"); // success == ", created);
+		LOGGER_LOG(Logger::APIDump, "renderer.getOrCreatePlugin(\"", message.getPlugin(), "\",\"", message.getPluginType(), "\"); // success == ", created);
 	} else if (message.getPluginAction() == VRayMessage::PluginAction::Remove) {
 		bool removed = false;
 		VRay::Plugin plugin = renderer->getPlugin(message.getPlugin().c_str());
 		if (plugin) {
 			if (!renderer->removePlugin(plugin)) {
 				auto err = renderer->getLastError();
-				Logger::log(Logger::Error, err.toString());
+				LOGGER_LOG(Logger::Error, err.toString());
 			} else {
 				removed = true;
-				Logger::log(Logger::Debug, "Removed plugin", message.getPlugin());
+				instancers.clear();
+				LOGGER_LOG(Logger::Debug, "Removed plugin", message.getPlugin());
 			}
 		} else {
-			Logger::log(Logger::Warning, "Failed to find plugin to remove:", message.getPlugin());
+			LOGGER_LOG(Logger::Warning, "Failed to find plugin to remove:", message.getPlugin());
 		}
 
-		Logger::log(Logger::APIDump, "renderer.removePlugin(renderer.getPlugin(\"", message.getPlugin(), "\")); // success == ", removed);
+		LOGGER_LOG(Logger::APIDump, "renderer.removePlugin(renderer.getPlugin(\"", message.getPlugin(), "\")); // success == ", removed);
 	} else if (message.getPluginAction() == VRayMessage::PluginAction::Replace) {
 		bool replaced = false;
 		VRay::Plugin oldPlugin = renderer->getPlugin(message.getPlugin());
@@ -594,16 +647,17 @@ void RendererController::pluginMessage(VRayMessage && message) {
 		if (oldPlugin && newPlugin) {
 			if (!renderer->replacePlugin(oldPlugin, newPlugin)) {
 				auto err = renderer->getLastError();
-				Logger::log(Logger::Error, "Failed to replace plugin:", message.getPlugin(), "With", message.getPluginNew(), " Error:", err.toString());
+				LOGGER_LOG(Logger::Error, "Failed to replace plugin:", message.getPlugin(), "With", message.getPluginNew(), " Error:", err.toString());
 			} else {
 				replaced = true;
-				Logger::log(Logger::Debug, "Replaced plugin", message.getPlugin());
+				instancers.clear();
+				LOGGER_LOG(Logger::Debug, "Replaced plugin", message.getPlugin());
 			}
 		} else {
-			Logger::log(Logger::Warning, "Failed to find plugin/s to replace:", message.getPlugin(), message.getPluginNew());
+			LOGGER_LOG(Logger::Warning, "Failed to find plugin/s to replace:", message.getPlugin(), message.getPluginNew());
 		}
 
-		Logger::log(Logger::APIDump, "renderer.replacePlugin(renderer.getPlugin(\"", message.getPlugin(), "\"), renderer.getPlugin(\"", message.getPluginNew() ,"\")); // success == ", replaced);
+		LOGGER_LOG(Logger::APIDump, "renderer.replacePlugin(renderer.getPlugin(\"", message.getPlugin(), "\"), renderer.getPlugin(\"", message.getPluginNew() ,"\")); // success == ", replaced);
 	}
 }
 
@@ -616,88 +670,93 @@ void RendererController::rendererMessage(VRayMessage && message) {
 	const VRayMessage::RendererAction action = message.getRendererAction();
 	switch (action) {
 	case VRayMessage::RendererAction::SetCurrentFrame:
-		Logger::log(Logger::APIDump, "renderer.setCurrentFrame(", message.getValue<AttrSimpleType<float>>()->value, ");");
+		LOGGER_LOG(Logger::APIDump, "renderer.setCurrentFrame(", message.getValue<AttrSimpleType<float>>()->value, ");");
 		currentFrame = message.getValue<AttrSimpleType<float>>()->value;
 		renderer->setCurrentFrame(message.getValue<AttrSimpleType<float>>()->value);
 		break;
 	case VRayMessage::RendererAction::SetCurrentTime:
-		Logger::log(Logger::APIDump, "renderer.setCurrentTime(", message.getValue<AttrSimpleType<float>>()->value, ");");
+		LOGGER_LOG(Logger::APIDump, "renderer.setCurrentTime(", message.getValue<AttrSimpleType<float>>()->value, ");");
 		currentFrame = message.getValue<AttrSimpleType<float>>()->value;
 		renderer->setCurrentTime(message.getValue<AttrSimpleType<float>>()->value);
 		break;
 	case VRayMessage::RendererAction::ClearFrameValues:
-		Logger::log(Logger::APIDump, "renderer.clearAllPropertyValuesUpToTime(", message.getValue<AttrSimpleType<float>>()->value, ");");
+		LOGGER_LOG(Logger::APIDump, "renderer.clearAllPropertyValuesUpToTime(", message.getValue<AttrSimpleType<float>>()->value, ");");
 		completed = renderer->clearAllPropertyValuesUpToTime(message.getValue<AttrSimpleType<float>>()->value);
+		instancers.clear();
 		break;
 	case VRayMessage::RendererAction::Pause:
-		Logger::log(Logger::APIDump, "renderer.pause();");
+		LOGGER_LOG(Logger::APIDump, "renderer.pause();");
 		completed = renderer->pause();
 		break;
 	case VRayMessage::RendererAction::Resume:
-		Logger::log(Logger::APIDump, "renderer.resume()");
+		LOGGER_LOG(Logger::APIDump, "renderer.resume()");
 		completed = renderer->resume();
 		break;
 	case VRayMessage::RendererAction::Start:
-		Logger::log(Logger::APIDump, "renderer.startSync();");
+		LOGGER_LOG(Logger::APIDump, "renderer.startSync();");
 		renderer->startSync();
 		break;
 	case VRayMessage::RendererAction::Stop:
-		Logger::log(Logger::APIDump, "renderer.stop();");
+		LOGGER_LOG(Logger::APIDump, "renderer.stop();");
 		stopRenderer(false);
 		break;
 	case VRayMessage::RendererAction::Reset: {
-		Logger::log(Logger::APIDump, "renderer.reset();");
+		LOGGER_LOG(Logger::APIDump, "renderer.reset();");
 		renderer->reset();
+		instancers.clear();
 		break;
 	}
 	case VRayMessage::RendererAction::Free:
-		Logger::log(Logger::Debug, "RendererAction::Free :: stop and free");
+	{
+		TRACE_ZONE("RendererController::free");
+		LOGGER_LOG(Logger::Debug, "RendererAction::Free :: stop and free");
 		renderer->stop();
 		{
 			std::lock_guard<std::mutex> lk(elemsToSendMtx);
 			elementsToSend.clear();
 		}
+		callbacks->detach();
 		{
 			lock_guard<mutex> persistentLock(persistent.mtx);
 			if (persistent.renderer == renderer) {
 				persistent.renderer = nullptr;
 				persistent.hasController = false;
 				persistent.closedVFB = false;
+				persistent.callbacks.reset();
 			}
 		}
 		delete renderer;
 		renderer = nullptr;
 		vfbClosed = true;
+		instancers.clear();
 		break;
+	}
 	case VRayMessage::RendererAction::Init:
 	{
+		TRACE_ZONE("RendererController::init");
 		if (type == VRayMessage::RendererType::None) {
-			Logger::log(Logger::Error, "Invalid RendererType::None");
+			LOGGER_LOG(Logger::Error, "Invalid RendererType::None");
 		}
 
 		if (type == VRayMessage::RendererType::Animation || type == VRayMessage::RendererType::SingleFrame) {
 			renderer = persistent.useSavedInstance();
 		}
+		instancers.clear();
+		imagePipeline.resetViewportDelta();
 
 		options.keepRTRunning = type == VRayMessage::RendererType::RT;
-		Logger::log(Logger::APIDump, "RendererOptions o;o.keepRTRunning=", options.keepRTRunning, ";o.noDR=true;o.showFrameBuffer=", options.showFrameBuffer, ";VRayRenderer renderer(o);");
+		LOGGER_LOG(Logger::APIDump, "RendererOptions o;o.keepRTRunning=", options.keepRTRunning, ";o.noDR=true;o.showFrameBuffer=", options.showFrameBuffer, ";VRayRenderer renderer(o);");
 		if (!renderer) {
-			renderer = new VRay::VRayRenderer(options);
+			renderer = new RendererBackend(options);
 		} else {
 			renderer->setOptions(options);
 		}
 
 		const bool useAnimatedValues = false;
 		renderer->useAnimatedValues(useAnimatedValues);
-		Logger::log(Logger::APIDump, "renderer.useAnimatedValues(", useAnimatedValues, "); // success == ", completed);
+		LOGGER_LOG(Logger::APIDump, "renderer.useAnimatedValues(", useAnimatedValues, "); // success == ", completed);
 
-		renderer->setOnProgress<RendererController, &RendererController::onProgress>(*this);
-		renderer->setOnRTImageUpdated<RendererController, &RendererController::imageUpdate>(*this);
-		renderer->setOnImageReady<RendererController, &RendererController::imageDone>(*this);
-		renderer->setOnBucketReady<RendererController, &RendererController::bucketReady>(*this);
-		renderer->setOnVFBClosed<RendererController, &RendererController::closeVFB>(*this);
-
-		renderer->setOnDumpMessage<RendererController, &RendererController::vrayMessageDumpHandler>(*this);
+		callbacks->attach(*renderer);
 
 		break;
 	}
@@ -707,10 +766,10 @@ void RendererController::rendererMessage(VRayMessage && message) {
 		const auto after = static_cast<VRay::RendererOptions::RenderMode>(message.getValue<AttrSimpleType<int>>()->value);
 		if (before != after) {
 			const bool restart = renderer->getState() > VRay::RendererState::IDLE_FRAME_DONE; // restart only if it was already running
-			Logger::log(Logger::APIDump, "renderer.setRenderMode(RendererOptions::RenderMode(", after, ")); // success == ", completed);
+			LOGGER_LOG(Logger::APIDump, "renderer.setRenderMode(RendererOptions::RenderMode(", after, ")); // success == ", completed);
 			completed = renderer->setRenderMode(after);
 			if (completed && restart) {
-				Logger::log(Logger::APIDump, "renderer.startSync();");
+				LOGGER_LOG(Logger::APIDump, "renderer.startSync();");
 				renderer->startSync();
 			}
 		}
@@ -725,15 +784,15 @@ void RendererController::rendererMessage(VRayMessage && message) {
 			completed = false;
 		}
 
-		Logger::log(Logger::APIDump, "renderer.setImageSize(", width, ",", height, "); // success == ", completed);
+		LOGGER_LOG(Logger::APIDump, "renderer.setImageSize(", width, ",", height, "); // success == ", completed);
 		break;
 	case VRayMessage::RendererAction::SetRenderRegion: {
 		const auto & coords = *message.getValue<AttrListInt>()->getData();
 		if (coords.size() != 4) {
-			Logger::log(Logger::Error, "SetRenderRegion expects 4 ints");
+			LOGGER_LOG(Logger::Error, "SetRenderRegion expects 4 ints");
 		} else {
 			completed = renderer->setRenderRegion(coords[0], coords[1], coords[2], coords[3]);
-			Logger::log(Logger::APIDump, "renderer.setRenderRegion(", coords[0], ",", coords[1], ",", coords[2], ",", coords[3], "); // success == ", completed);
+			LOGGER_LOG(Logger::APIDump, "renderer.setRenderRegion(", coords[0], ",", coords[1], ",", coords[2], ",", coords[3], "); // success == ", completed);
 		}
 
 		break;
@@ -741,25 +800,25 @@ void RendererController::rendererMessage(VRayMessage && message) {
 	case VRayMessage::RendererAction::SetCropRegion: {
 		const auto & coords = *message.getValue<AttrListInt>()->getData();
 		if (coords.size() != 4) {
-			Logger::log(Logger::Error, "SetRenderRegion expects 4 ints");
+			LOGGER_LOG(Logger::Error, "SetRenderRegion expects 4 ints");
 		} else {
 			completed = renderer->setCropRegion(coords[2], coords[3], coords[0], coords[1]);
-			Logger::log(Logger::APIDump, "renderer.setCropRegion(", coords[2], coords[3], coords[0], coords[1], "); // success == ", completed);
+			LOGGER_LOG(Logger::APIDump, "renderer.setCropRegion(", coords[2], coords[3], coords[0], coords[1], "); // success == ", completed);
 		}
 
 		break;
 		}
 	case VRayMessage::RendererAction::ResetsHosts:
 		completed = 0 == renderer->resetHosts(message.getValue<AttrSimpleType<std::string>>()->value);
-		Logger::log(Logger::APIDump, "renderer.addHosts(\"", message.getValue<AttrSimpleType<std::string>>()->value, "\"); // success == ", completed);
+		LOGGER_LOG(Logger::APIDump, "renderer.addHosts(\"", message.getValue<AttrSimpleType<std::string>>()->value, "\"); // success == ", completed);
 		break;
 	case VRayMessage::RendererAction::LoadScene:
 		completed = 0 == renderer->load(message.getValue<AttrSimpleType<std::string>>()->value);
-		Logger::log(Logger::APIDump, "renderer.load(\"", message.getValue<AttrSimpleType<std::string>>()->value, "\"); // success == ", completed);
+		LOGGER_LOG(Logger::APIDump, "renderer.load(\"", message.getValue<AttrSimpleType<std::string>>()->value, "\"); // success == ", completed);
 		break;
 	case VRayMessage::RendererAction::AppendScene:
 		completed = 0 == renderer->append(message.getValue<AttrSimpleType<std::string>>()->value);
-		Logger::log(Logger::APIDump, "renderer.append(\"", message.getValue<AttrSimpleType<std::string>>()->value, "\"); // success == ", completed);
+		LOGGER_LOG(Logger::APIDump, "renderer.append(\"", message.getValue<AttrSimpleType<std::string>>()->value, "\"); // success == ", completed);
 		break;
 	case VRayMessage::RendererAction::ExportScene:
 	{
@@ -769,18 +828,24 @@ void RendererController::rendererMessage(VRayMessage && message) {
 
 		completed = 0 == renderer->exportScene(message.getValue<AttrSimpleType<std::string>>()->value, exportParams);
 
-		Logger::log(Logger::APIDump, "renderer.exportScene(\"", message.getValue<AttrSimpleType<std::string>>()->value, "\"); // success == ", completed);
+		LOGGER_LOG(Logger::APIDump, "renderer.exportScene(\"", message.getValue<AttrSimpleType<std::string>>()->value, "\"); // success == ", completed);
 		break;
 	}
 	case VRayMessage::RendererAction::GetImage:
 	{
+		// low 16 bits are the element type, the rest is optional image format, 0 means 4 floats per pixel like before
+		const int value = message.getValue<AttrSimpleType<int>>()->value;
+		const auto elementType = static_cast<VRay::RenderElement::Type>(value & 0xffff);
+		const auto format = static_cast<VRayBaseTypes::AttrImage::ImageType>(value >> 16);
 		std::lock_guard<std::mutex> lk(elemsToSendMtx);
-		elementsToSend.insert(static_cast<VRay::RenderElement::Type>(message.getValue<AttrSimpleType<int>>()->value));
+		const bool knownFormat = ImageUtils::isPackedType(format) || format == ImageUtils::NATIVE_CHANNELS;
+		elementsToSend[elementType] = knownFormat ? format : VRayBaseTypes::AttrImage::ImageType::NONE;
 	}
 		break;
 	case VRayMessage::RendererAction::SetQuality:
 		jpegQuality = message.getValue<AttrSimpleType<int>>()->value;
 		jpegQuality = std::max(0, std::min(100, jpegQuality));
+		viewportQuality.setRequested(viewportType, jpegQuality);
 		break;
 	case VRayMessage::RendererAction::SetCurrentCamera: {
 		// TODO: can we not delay and create here
@@ -788,17 +853,16 @@ void RendererController::rendererMessage(VRayMessage && message) {
 		const auto cameraPlugin = renderer->getPlugin(cameraPluginName);
 		if (!cameraPlugin) {
 			// lets try to delay, maybe out of order export
-			Logger::log(Logger::Debug, "Plugin [", message.getPlugin(), "] references (", cameraPluginName, ") which is not yet exported - delaying.");
+			LOGGER_LOG(Logger::Debug, "Plugin [", message.getPlugin(), "] references (", cameraPluginName, ") which is not yet exported - delaying.");
 
 			auto buffLog = Logger::getInstance().makeBuffered();
-			// TODO: fixme
-			buffLog.log(Logger::Warning, "Failed to find", cameraPluginName, "to set as current camera.");
+			Logger::log(buffLog, Logger::Warning, "Failed to find", cameraPluginName, "to set as current camera.");
 
 			delayedMessages[message.getValue<AttrSimpleType<std::string>>()->value].emplace_back(std::move(message), std::move(buffLog));
 		} else {
 			completed = renderer->setCamera(cameraPlugin);
 		}
-		Logger::log(Logger::APIDump, "renderer.setCamera(renderer.getPlugin(\"", cameraPluginName, "\")); // success == ", completed);
+		LOGGER_LOG(Logger::APIDump, "renderer.setCamera(renderer.getPlugin(\"", cameraPluginName, "\")); // success == ", completed);
 		break;
 	}
 	case VRayMessage::RendererAction::SetCommitAction: {
@@ -806,24 +870,24 @@ void RendererController::rendererMessage(VRayMessage && message) {
 		switch (static_cast<CommitAction>(message.getValue<AttrSimpleType<int>>()->value)) {
 		case CommitAction::CommitNow:
 			renderer->commit(false);
-			Logger::log(Logger::APIDump, "renderer.commit(false);");
+			LOGGER_LOG(Logger::APIDump, "renderer.commit(false);");
 			isFlush = true;
 			break;
 		case CommitAction::CommitNowForce:
 			renderer->commit(true);
-			Logger::log(Logger::APIDump, "renderer.commit(true);");
+			LOGGER_LOG(Logger::APIDump, "renderer.commit(true);");
 			isFlush = true;
 			break;
 		case CommitAction::CommitAutoOn:
 			renderer->setAutoCommit(true);
-			Logger::log(Logger::APIDump, "renderer.setAutoCommit(true);");
+			LOGGER_LOG(Logger::APIDump, "renderer.setAutoCommit(true);");
 			break;
 		case CommitAction::CommitAutoOff:
 			renderer->setAutoCommit(false);
-			Logger::log(Logger::APIDump, "renderer.setAutoCommit(false);");
+			LOGGER_LOG(Logger::APIDump, "renderer.setAutoCommit(false);");
 			break;
 		default:
-			Logger::log(Logger::Warning, "Invalid CommitAction: ", message.getValue<AttrSimpleType<int>>()->value);
+			LOGGER_LOG(Logger::Warning, "Invalid CommitAction: ", message.getValue<AttrSimpleType<int>>()->value);
 		}
 
 		if (isFlush) {
@@ -843,271 +907,352 @@ void RendererController::rendererMessage(VRayMessage && message) {
 			const bool show = message.getValue<AttrSimpleType<int>>()->value;
 
 			renderer->vfb.show(show, false);
-			Logger::log(Logger::APIDump, "renderer.vfb.show(", show, ", false);");
+			LOGGER_LOG(Logger::APIDump, "renderer.vfb.show(", show, ", false);");
 
 			renderer->vfb.setAlwaysOnTop(true);
-			Logger::log(Logger::APIDump, "renderer.vfb.setAlwaysOnTop(true);");
+			LOGGER_LOG(Logger::APIDump, "renderer.vfb.setAlwaysOnTop(true);");
 		}
 		break;
 	case VRayMessage::RendererAction::SetViewportImageFormat:
-		viewportType = static_cast<VRayBaseTypes::AttrImage::ImageType>(message.getValue<AttrSimpleType<int>>()->value);
-		Logger::log(Logger::Debug, "Viewport image type set to", viewportType);
+		if (message.getValueType() == VRayBaseTypes::ValueType::ValueTypeListInt) {
+			// format followed by the size the client displays the viewport at
+			const auto & values = *message.getValue<AttrListInt>()->getData();
+			if (values.size() != 3) {
+				LOGGER_LOG(Logger::Error, "SetViewportImageFormat expects 1 or 3 ints");
+				completed = false;
+				break;
+			}
+			viewportType = static_cast<VRayBaseTypes::AttrImage::ImageType>(values[0]);
+			imagePipeline.setDisplaySize(values[1], values[2]);
+			LOGGER_LOG(Logger::Debug, "Viewport display size", values[1], "x", values[2]);
+		} else {
+			viewportType = static_cast<VRayBaseTypes::AttrImage::ImageType>(message.getValue<AttrSimpleType<int>>()->value);
+		}
+		imagePipeline.resetViewportDelta();
+		viewportQuality.setRequested(viewportType, jpegQuality);
+		LOGGER_LOG(Logger::Debug, "Viewport image type set to", viewportType);
 		break;
 	default:
-		Logger::log(Logger::Warning, "Invalid renderer action: ", static_cast<int>(message.getRendererAction()));
+		LOGGER_LOG(Logger::Warning, "Invalid renderer action: ", static_cast<int>(message.getRendererAction()));
 	}
 
 	if (!completed) {
 		const auto * err = renderer ? renderer->getLastError().toString() : "[empty] renderer";
-		Logger::log(Logger::Warning,
+		LOGGER_LOG(Logger::Warning,
 			"Failed renderer action:", static_cast<int>(action),
 			"\n\tgetLastError().toString() :", err);
 	}
 }
 
-void RendererController::sendImages(VRay::VRayImage * img, VRayBaseTypes::AttrImage::ImageType fullImageType, VRayBaseTypes::ImageSourceType sourceType) {
+void RendererController::sendImages(VRay::VRayImage * img, VRayBaseTypes::AttrImage::ImageType fullImageType, VRayBaseTypes::ImageSourceType sourceType, int quality, int downscale) {
+	TRACE_ZONE("RendererController::sendImages");
+	const auto start = chrono::high_resolution_clock::now();
+	size_t queuedBytes = 0;
 	AttrImageSet set(sourceType);
 
 	auto allElements = renderer->getRenderElements();
-	std::unordered_set<VRay::RenderElement::Type, std::hash<int>> elToSend;
+	ElementFormats elToSend;
 	{
 		std::lock_guard<std::mutex> lk(elemsToSendMtx);
 		elToSend = elementsToSend;
 	}
 
-	for (const auto &type : elToSend) {
+	for (const auto &element : elToSend) {
+		const VRay::RenderElement::Type type = element.first;
 		switch (type) {
 		case VRay::RenderElement::Type::NONE:
 		{
-			int left, top, rWidth, rHeight;
-			renderer->getRenderRegion(left, top, rWidth, rHeight);
-			// The image we recieve is owned by the renderer and will be freed by it, so we can safely overwrite the pointer
-			img = img->crop(left, top, rWidth, rHeight);
-			size_t size;
 			int width, height;
 			if (!img->getSize(width, height)) {
-				Logger::log(Logger::Error, "Failed to get size of final image");
+				LOGGER_LOG(Logger::Error, "Failed to get size of final image");
 				break;
 			}
-			AttrImage attrImage;
-			if (fullImageType == VRayBaseTypes::AttrImage::ImageType::RGBA_REAL) {
-				// TODO(optimisation): we dont need to crop the image for this case, we can jus copy it inside the AttrImage
-				VRay::AColor * data = img->getPixelData(size);
-				size *= sizeof(VRay::AColor);
-				attrImage = AttrImage(data, size, fullImageType, width, height);
-			} else if (fullImageType == VRayBaseTypes::AttrImage::ImageType::JPG) {
-				// TODO: check if we need to changeGamma
-				std::unique_ptr<VRay::Jpeg> jpeg(img->getJpeg(size, jpegQuality));
-				attrImage = AttrImage(jpeg.get(), size, VRayBaseTypes::AttrImage::ImageType::JPG, width, height);
+			int left, top, rWidth, rHeight;
+			if (!renderer->getRenderRegion(left, top, rWidth, rHeight)) {
+				left = top = 0;
+				rWidth = width;
+				rHeight = height;
 			}
-			set.images.emplace(static_cast<VRayBaseTypes::RenderChannelType>(type), std::move(attrImage));
-			delete img;
+			ImageUtils::Region region(left, top, rWidth, rHeight);
+			if (!region.clip(width, height)) {
+				LOGGER_LOG(Logger::Error, "Render region is outside of the image");
+				break;
+			}
+			size_t size;
+			const VRay::AColor * pixels = img->getPixelData(size);
+			imagePipeline.addImage(pixels, width, height, region, ImagePipeline::Format(fullImageType, quality, downscale), set, queuedBytes);
 			break;
 		}
 		case VRay::RenderElement::Type::ZDEPTH:
 		case VRay::RenderElement::Type::REALCOLOR:
 		case VRay::RenderElement::Type::NORMALS:
 		case VRay::RenderElement::Type::RENDERID:
-			try {
-				auto element = allElements.getByType(type);
-				if (element) {
-					VRay::RenderElement::PixelFormat pixelFormat = element.getDefaultPixelFormat();
-
-					VRayBaseTypes::AttrImage::ImageType imgType = VRayBaseTypes::AttrImage::ImageType::NONE;
-					switch (pixelFormat) {
-					case VRay::RenderElement::PF_BW_FLOAT:
-						imgType = VRayBaseTypes::AttrImage::ImageType::BW_REAL;
-						break;
-					case VRay::RenderElement::PF_RGB_FLOAT:
-						imgType = VRayBaseTypes::AttrImage::ImageType::RGB_REAL;
-						break;
-					case VRay::RenderElement::PF_RGBA_FLOAT:
-						imgType = VRayBaseTypes::AttrImage::ImageType::RGBA_REAL;
-						break;
-					default:
-						imgType = VRayBaseTypes::AttrImage::ImageType::NONE;
-					}
+			elementJobs.emplace_back(type, element.second);
+			break;
 
+		default:
+			LOGGER_LOG(Logger::Warning, "Element requested, but not found", static_cast<int>(type));
+		}
+	}
+
+	// the AppSDK is only called from this thread, the elements don't depend on each other so they are converted in parallel
+	elementJobs.erase(std::remove_if(elementJobs.begin(), elementJobs.end(), [this, &allElements](ElementJob & job) {
+		return !fetchElement(allElements, job);
+	}), elementJobs.end());
+	TaskPool::getInstance().parallelFor(static_cast<int>(elementJobs.size()), [this](int index) {
+		convertElement(elementJobs[index]);
+	});
+	for (const ElementJob & job : elementJobs) {
+		if (job.ready) {
+			set.images.emplace(static_cast<VRayBaseTypes::RenderChannelType>(job.type), AttrImage(job.buffer.data(), job.size, job.imageType, job.width, job.height));
+		}
+	}
+	elementJobs.clear();
 
-					if (imgType == VRayBaseTypes::AttrImage::ImageType::NONE) {
-						Logger::log(Logger::Error, "Unsupported pixel format!", pixelFormat);
-					} else {
-						Logger::log(Logger::Debug, "Render channel:", type, "Pixel format:", pixelFormat);
-						VRay::VRayImage *img = element.getImage();
+	queuedBytes += imagePipeline.queueImageSet(std::move(set));
 
-						int width, height;
-						if (!img->getSize(width, height)) {
-							Logger::log(Logger::Error, "Failed to get image size of final image");
-						}
-						size_t size;
-						VRay::AColor *data = img->getPixelData(size);
-						size *= sizeof(VRay::AColor);
+	const auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count();
+	if (sourceType == VRayBaseTypes::ImageSourceType::RtImageUpdate && settings.adaptiveQuality) {
+		viewportQuality.imageQueued(queuedBytes, elapsed);
+	}
+	LOGGER_LOG(Logger::Profile, "sendImages:", elapsed / 1000., "ms");
+}
 
-						set.images.emplace(static_cast<VRayBaseTypes::RenderChannelType>(type), VRayBaseTypes::AttrImage(data, size, imgType, width, height));
-						delete img;
-					}
-				}
-			} catch (VRay::InvalidRenderElementErr &e) {
-				Logger::log(Logger::Warning, e.what(), static_cast<int>(type));
-			} catch (VRay::VRayException &e) {
-				Logger::log(Logger::Error, e.what(), static_cast<int>(type));
-			}
-		break;
+bool RendererController::fetchElement(const VRay::RenderElements & elements, ElementJob & job) {
+	try {
+		auto renderElement = elements.getByType(job.type);
+		if (!renderElement) {
+			return false;
+		}
+		VRay::RenderElement::PixelFormat pixelFormat = renderElement.getDefaultPixelFormat();
 
+		switch (pixelFormat) {
+		case VRay::RenderElement::PF_BW_FLOAT:
+			job.imageType = VRayBaseTypes::AttrImage::ImageType::BW_REAL;
+			job.channels = 1;
+			break;
+		case VRay::RenderElement::PF_RGB_FLOAT:
+			job.imageType = VRayBaseTypes::AttrImage::ImageType::RGB_REAL;
+			job.channels = 3;
+			break;
+		case VRay::RenderElement::PF_RGBA_FLOAT:
+			job.imageType = VRayBaseTypes::AttrImage::ImageType::RGBA_REAL;
+			job.channels = 4;
+			break;
 		default:
-			Logger::log(Logger::Warning, "Element requested, but not found", static_cast<int>(type));
+			LOGGER_LOG(Logger::Error, "Unsupported pixel format!", pixelFormat);
+			return false;
+		}
+
+		LOGGER_LOG(Logger::Debug, "Render channel:", job.type, "Pixel format:", pixelFormat);
+		job.image.reset(renderElement.getImage());
+		if (!job.image || !job.image->getSize(job.width, job.height)) {
+			LOGGER_LOG(Logger::Error, "Failed to get image size of render element", static_cast<int>(job.type));
+			return false;
 		}
+		job.pixels = job.image->getPixelData(job.pixelCount);
+		return job.pixels != nullptr;
+	} catch (VRay::InvalidRenderElementErr &e) {
+		LOGGER_LOG(Logger::Warning, e.what(), static_cast<int>(job.type));
+	} catch (VRay::VRayException &e) {
+		LOGGER_LOG(Logger::Error, e.what(), static_cast<int>(job.type));
 	}
+	return false;
+}
 
-	{
-		lock_guard<mutex> lock(messageMtx);
-		outstandingMessages.push(VRayMessage::msgImageSet(std::move(set)));
+void RendererController::convertElement(ElementJob & job) {
+	const bool packed = ImageUtils::isPackedType(job.format);
+	// only clients that asked for it get single channel and RGB elements without the unused channels of AColor
+	const bool nativeChannels = !packed && job.channels < 4 && job.format == ImageUtils::NATIVE_CHANNELS;
+	if (packed) {
+		job.size = job.pixelCount * ImageUtils::packedPixelSize(job.format);
+	} else if (nativeChannels) {
+		job.size = job.pixelCount * job.channels * sizeof(float);
+	} else {
+		job.size = job.pixelCount * sizeof(VRay::AColor);
 	}
+	job.buffer = BufferPool::getInstance().acquire(job.size);
+	if (!job.buffer) {
+		LOGGER_LOG(Logger::Error, "No buffer for render element", static_cast<int>(job.type), "- not sending it");
+		return;
+	}
+
+	if (packed) {
+		job.imageType = job.format;
+		ImageUtils::convertToPacked(job.pixels, job.pixelCount, job.format, job.buffer.data());
+	} else if (nativeChannels) {
+		ImageUtils::packChannels(job.pixels, job.pixelCount, job.channels, job.buffer.as<float>());
+	} else {
+		memcpy(job.buffer.data(), job.pixels, job.size);
+	}
+	job.ready = true;
 }
 
-void RendererController::onProgress(VRay::VRayRenderer & cbRenderer, const char* msg, int elementNumber, int elementsCount, void *) {
-	unique_lock<mutex> persistentLock(persistent.mtx);
+size_t RendererController::queueMessage(zmq::message_t && message, MessageKind kind) {
+	const size_t size = message.size();
+	if (kind != MessageKind::RtImage) {
+		if (kind == MessageKind::RtImageDelta) {
+			// tiles are relative to the queued image, so it can't be replaced anymore
+			rtImageSlot.reset();
+		}
+		outstandingMessages.push(OutgoingMessage(std::move(message), kind));
+		wakeup.signal();
+		return size;
+	}
 
-	if (&cbRenderer == persistent.renderer) {
-		if (!persistent.hasController) {
-			Logger::log(Logger::Debug, "Should not call callbacks on deallocated RendererController");
-			return;
+	// client only needs the newest image, replacing it in the slot keeps the order of all other messages
+	OutgoingMessage * image = new OutgoingMessage(std::move(message), kind);
+	if (rtImageSlot) {
+		OutgoingMessage * pending = rtImageSlot->image.load(std::memory_order_acquire);
+		// the sending thread only ever takes the image out, so once this fails the slot stays empty
+		while (pending && !rtImageSlot->image.compare_exchange_weak(pending, image, std::memory_order_acq_rel)) {}
+		if (pending) {
+			const size_t replacedSize = pending->message.size();
+			delete pending;
+			++rtImagesReplaced;
+			if (settings.adaptiveQuality) {
+				viewportQuality.imageDropped(replacedSize);
+			}
+			return size;
 		}
 	}
 
+	rtImageSlot = std::make_shared<RtImageSlot>(image);
+	OutgoingMessage place;
+	place.kind = kind;
+	place.slot = rtImageSlot;
+	outstandingMessages.push(std::move(place));
+	wakeup.signal();
+	return size;
+}
+
+void RendererController::onProgress(VRay::VRayRenderer & cbRenderer, const char* msg, int elementNumber, int elementsCount, void *) {
 	float progress = static_cast<float>(elementNumber) / elementsCount;
 
-	lock_guard<mutex> lock(messageMtx);
-	if (msg && *msg) {
-		outstandingMessages.push(VRayMessage::msgRendererState(VRayMessage::RendererState::ProgressMessage, std::string(msg)));
+	messageFilter.progress(progress, msg, chrono::high_resolution_clock::now());
+	// the run thread has to send held back progress later
+	wakeup.signal();
+}
+
+void RendererController::queueProgress(const MessageFilter::Progress & progress) {
+	if (progress.hasMessage) {
+		queueMessage(VRayMessage::msgRendererState(VRayMessage::RendererState::ProgressMessage, progress.message));
+	}
+	if (progress.hasValue) {
+		queueMessage(VRayMessage::msgRendererState(VRayMessage::RendererState::Progress, progress.value));
 	}
-	outstandingMessages.push(VRayMessage::msgRendererState(VRayMessage::RendererState::Progress, progress));
 }
 
+void RendererController::queueLogs(const std::vector<MessageFilter::Log> & logs) {
+	for (const MessageFilter::Log & line : logs) {
+		queueMessage(VRayMessage::msgVRayLog(line.level, line.message.c_str()));
+	}
+}
 
-void RendererController::imageUpdate(VRay::VRayRenderer &cbRenderer, VRay::VRayImage * img, void *) {
-	unique_lock<mutex> persistentLock(persistent.mtx);
 
-	if (&cbRenderer == persistent.renderer) {
-		if (!persistent.hasController) {
-			Logger::log(Logger::Debug, "Should not call callbacks on deallocated RendererController");
-			return;
-		}
+
+void RendererController::imageUpdate(VRay::VRayRenderer &cbRenderer, VRay::VRayImage * img, void *) {
+	if (latencyTracer) {
+		latencyTracer->imageStarted(chrono::high_resolution_clock::now());
 	}
+	lock_guard<mutex> imageLock(imageMtx);
 
 	if (renderer && !renderer->isAborted()) {
-		sendImages(img, viewportType, VRayBaseTypes::ImageSourceType::RtImageUpdate);
+		const auto now = chrono::high_resolution_clock::now();
+		// while the client is changing the scene send a fast low resolution pass, full detail once it settles
+		const auto sinceChange = now - chrono::high_resolution_clock::time_point(chrono::high_resolution_clock::duration(lastSceneChange));
+		const int progressiveScale = settings.progressiveViewport && sinceChange < chrono::milliseconds(PROGRESSIVE_VIEWPORT_MS) ? 2 : 1;
+		if (settings.adaptiveQuality) {
+			const ViewportQuality::Level level = viewportQuality.getLevel(now, clientLink.sample(now));
+			sendImages(img, level.type, VRayBaseTypes::ImageSourceType::RtImageUpdate, level.quality, level.downscale * progressiveScale);
+		} else {
+			sendImages(img, viewportType, VRayBaseTypes::ImageSourceType::RtImageUpdate, jpegQuality, progressiveScale);
+		}
 	}
 }
 
 
 void RendererController::imageDone(VRay::VRayRenderer &cbRenderer, void *) {
-	unique_lock<mutex> persistentLock(persistent.mtx);
+	lock_guard<mutex> imageLock(imageMtx);
 
-	if (&cbRenderer == persistent.renderer) {
-		if (!persistent.hasController) {
-			Logger::log(Logger::Debug, "Should not call callbacks on deallocated RendererController");
-			return;
+	if (renderer) {
+		{
+			// buckets must reach the client before the final image
+			lock_guard<mutex> lock(bucketMtx);
+			imagePipeline.finishBuckets();
 		}
-	}
 
-	if (renderer) {
 		if (!renderer->isAborted()) {
 			VRay::VRayImage * img = renderer->getImage();
-			sendImages(img, VRayBaseTypes::AttrImage::ImageType::RGBA_REAL, VRayBaseTypes::ImageSourceType::ImageReady);
+			sendImages(img, VRayBaseTypes::AttrImage::ImageType::RGBA_REAL, VRayBaseTypes::ImageSourceType::ImageReady, jpegQuality, 1);
 			delete img;
 		}
 
 		VRayMessage::RendererState state = renderer->isAborted() ? VRayMessage::RendererState::Abort : VRayMessage::RendererState::Continue;
-		{
-			lock_guard<mutex> lock(messageMtx);
-			outstandingMessages.push(VRayMessage::msgRendererState(state, this->currentFrame));
-		}
+		queueMessage(VRayMessage::msgRendererState(state, this->currentFrame));
 
 		if (type == VRayMessage::RendererType::Animation) {
-			Logger::log(Logger::Debug, "Animation frame completed ", currentFrame);
+			LOGGER_LOG(Logger::Debug, "Animation frame completed ", currentFrame);
 		} else {
-			Logger::log(Logger::Debug, "Renderer::OnImageReady");
+			LOGGER_LOG(Logger::Debug, "Renderer::OnImageReady");
 		}
 	}
 }
 
 void RendererController::bucketReady(VRay::VRayRenderer &cbRenderer, int x, int y, const char *, VRay::VRayImage * img, void *) {
-	unique_lock<mutex> persistentLock(persistent.mtx);
-
-	if (&cbRenderer == persistent.renderer) {
-		if (!persistent.hasController) {
-			Logger::log(Logger::Debug, "Should not call callbacks on deallocated RendererController");
-			return;
-		}
-	}
-
 	if (renderer && !renderer->isAborted()) {
-		AttrImageSet set(VRayBaseTypes::ImageSourceType::BucketImageReady);
-
 		int width, height;
 		size_t size;
 		if (!img->getSize(width, height)) {
-			Logger::log(Logger::Error, "Failed to get size of bucket");
+			LOGGER_LOG(Logger::Error, "Failed to get size of bucket");
 			return;
 		}
 		const VRay::AColor * data = img->getPixelData(size);
-		size *= sizeof(VRay::AColor);
-		set.images.emplace(VRayBaseTypes::RenderChannelType::RenderChannelTypeNone, VRayBaseTypes::AttrImage(data, size, VRayBaseTypes::AttrImage::ImageType::RGBA_REAL, width, height, x, y));
-
-		{
-			lock_guard<mutex> lock(messageMtx);
-			outstandingMessages.push(VRayMessage::msgImageSet(std::move(set)));
+		++bucketCount;
+
+		int imageWidth, imageHeight;
+		const ImageUtils::Region bucket(x, y, width, height);
+		if (settings.bucketBatchMs > 0 && renderer->getImageSize(imageWidth, imageHeight)) {
+			lock_guard<mutex> lock(bucketMtx);
+			if (imagePipeline.addBucket(data, bucket, imageWidth, imageHeight, chrono::high_resolution_clock::now())) {
+				// the run thread flushes the batch when it's delay passes
+				wakeup.signal();
+				return;
+			}
 		}
+		imagePipeline.sendBucket(data, bucket);
 	}
 }
 
-
 void RendererController::closeVFB(VRay::VRayRenderer & cbRenderer, void *) {
-	unique_lock<mutex> persistentLock(persistent.mtx);
-
-	if (&cbRenderer == persistent.renderer) {
-		if (!persistent.hasController) {
-			Logger::log(Logger::Debug, "Should not call callbacks on deallocated RendererController");
-			return;
-		}
-	}
 	vfbClosed = true;
+	lock_guard<mutex> persistentLock(persistent.mtx);
 	if (!persistent.rendererVFBClosed(&cbRenderer)) {
-		Logger::log(Logger::Debug, "RendererController::closeVFB :: Marking vfb as closed");
+		LOGGER_LOG(Logger::Debug, "RendererController::closeVFB :: Marking vfb as closed");
 	}
 
-	Logger::log(Logger::Debug, "RendererController::closeVFB :: Sending abort message to client");
+	LOGGER_LOG(Logger::Debug, "RendererController::closeVFB :: Sending abort message to client");
 	// TODO: fix rendering after user stopped render in blender
-	//lock_guard<mutex> lock(messageMtx);
-	//outstandingMessages.push(VRayMessage::msgRendererState(VRayMessage::RendererState::Abort, this->currentFrame));
+	//queueMessage(VRayMessage::msgRendererState(VRayMessage::RendererState::Abort, this->currentFrame));
 }
 
 
 void RendererController::vrayMessageDumpHandler(VRay::VRayRenderer &cbRenderer, const char * msg, int level, void *) {
-	unique_lock<mutex> persistentLock(persistent.mtx);
-
-	if (&cbRenderer == persistent.renderer) {
-		if (!persistent.hasController) {
-			Logger::log(Logger::Debug, "Should not call callbacks on deallocated RendererController");
-			return;
-		}
-	}
-
-	lock_guard<mutex> lock(messageMtx);
-	outstandingMessages.push(VRayMessage::msgVRayLog(level, msg));
+	messageFilter.log(level, msg, chrono::high_resolution_clock::now());
+	wakeup.signal();
 }
 
 void RendererController::stop() {
 	if (runState != RUNNING) {
-		Logger::log(Logger::Warning, "Can't stop stopped RendererController");
+		LOGGER_LOG(Logger::Warning, "Can't stop stopped RendererController");
 		return;
 	}
 	transitionState(RUNNING, IDLE);
+	wakeup.signal();
 
 	assert(runnerThread.joinable() && "Missmatch between runState and actual thread state.");
 	if (runnerThread.joinable()) {
-		Logger::log(Logger::Debug, "Joining RendererController::runnerThread");
+		LOGGER_LOG(Logger::Debug, "Joining RendererController::runnerThread");
 		runnerThread.join();
 	}
 
@@ -1125,7 +1270,7 @@ bool RendererController::start() {
 	transitionState(IDLE, STARTING);
 
 	runnerThread = thread(&RendererController::run, this);
-	Logger::log(Logger::Debug, "RendererController::start :: thread started");
+	LOGGER_LOG(Logger::Debug, "RendererController::start :: thread started");
 
 	{
 		unique_lock<mutex> l(stateMtx);
@@ -1138,6 +1283,64 @@ bool RendererController::isRunning() const {
 	return runState == RUNNING && vfbClosed == false;
 }
 
+void RendererController::reportStats(int64_t periodMs) {
+	const ImagePipeline::Stats imageStats = imagePipeline.takeStats();
+	if (imageStats.jpegCount && periodMs > 0) {
+		LOGGER_LOG(Logger::Debug, "Client (", clientId, ") jpeg:", imageStats.jpegCount * 1000. / periodMs, "fps, avg encode",
+			imageStats.jpegEncodeTime / 1000. / imageStats.jpegCount, "ms, avg size", imageStats.jpegBytes / 1024 / imageStats.jpegCount, "KB");
+	}
+
+	const uint64_t buckets = bucketCount.exchange(0);
+	if (buckets && periodMs > 0) {
+		LOGGER_LOG(Logger::Debug, "Client (", clientId, ") buckets:", buckets * 1000. / periodMs, "per second in",
+			imageStats.bucketMessages * 1000. / periodMs, "messages per second,", imageStats.bucketBytes / 1024. * 1000. / periodMs, "KB/s");
+	}
+
+	const MessageFilter::Stats filterStats = messageFilter.takeStats();
+	if (filterStats.progressSuppressed || filterStats.logsFiltered || filterStats.logsRepeated || filterStats.logsThrottled) {
+		LOGGER_LOG(Logger::Debug, "Client (", clientId, ") progress sent", filterStats.progressSent, "coalesced", filterStats.progressSuppressed,
+			"; V-Ray log sent", filterStats.logsSent, "filtered", filterStats.logsFiltered, "repeated", filterStats.logsRepeated, "throttled", filterStats.logsThrottled);
+	}
+
+	const SendBudget::Stats sendStats = sendBudget.takeStats();
+	if (sendStats.batches) {
+		LOGGER_LOG(Logger::Debug, "Client (", clientId, ") send batches:", sendStats.batches, "avg", sendStats.messages / sendStats.batches,
+			"messages", sendStats.bytes / 1024 / sendStats.batches, "KB, budget", sendStats.budgetBytes / 1024, "KB, ended by bytes", sendStats.byteLimited, "by time", sendStats.timeLimited);
+	}
+
+	const uint64_t replaced = rtImagesReplaced.exchange(0);
+	if (replaced) {
+		LOGGER_LOG(Logger::Debug, "Client (", clientId, ") replaced", replaced, "RT images before they were sent");
+	}
+
+	if (settings.adaptiveQuality) {
+		const ViewportQuality::Stats stats = viewportQuality.takeStats();
+		LOGGER_LOG(Logger::Debug, "Client (", clientId, ") viewport quality level", stats.level, "of", stats.levelCount - 1,
+			"down", stats.downgrades, "up", stats.upgrades, "latency", stats.latencyMs, "ms, link delay", stats.linkDelayMs, "ms, produce", stats.produceMs,
+			"ms, queued", stats.sendRate / 1024, "KB/s, drained", stats.drainRate / 1024, "KB/s");
+	}
+
+	const ClientLink::Stats linkStats = clientLink.takeStats();
+	if (linkStats.blocked && periodMs > 0) {
+		LOGGER_LOG(Logger::Debug, "Client (", clientId, ") link:", linkStats.forwardedBytes / 1024. * 1000. / periodMs, "KB/s, socket full",
+			linkStats.blocked, "times, max delay", linkStats.maxDelayUs / 1000., "ms");
+	}
+
+	if (latencyTracer) {
+		const LatencyTracer::Stats traceStats = latencyTracer->takeStats();
+		if (traceStats.stages[LatencyTracer::Total].count || traceStats.dropped) {
+			LOGGER_LOG(Logger::Debug, "Client (", clientId, ") edit to pixel:", traceStats.stages[LatencyTracer::Total].count, "traced,", traceStats.dropped, "dropped");
+		}
+		for (int c = 0; c < LatencyTracer::STAGE_COUNT; ++c) {
+			const LatencyHistogram::Snapshot & stage = traceStats.stages[c];
+			if (stage.count) {
+				LOGGER_LOG(Logger::Debug, "Client (", clientId, ") edit to pixel", string(LatencyTracer::getStageName(static_cast<LatencyTracer::Stage>(c))) + ":",
+					"avg", stage.averageNs() / 1e6, "ms, p50 <", stage.percentileNs(0.5) / 1e6, "ms, p99 <", stage.percentileNs(0.99) / 1e6, "ms, max", stage.maxNs / 1e6, "ms");
+			}
+		}
+	}
+}
+
 void RendererController::transitionState(RunState current, RunState newState) {
 	auto stateToStr = [](RunState rs) {
 		switch (rs) {
@@ -1148,7 +1351,7 @@ void RendererController::transitionState(RunState current, RunState newState) {
 		}
 		return "UNKNOWN";
 	};
-	Logger::log(Logger::Info, "transitionState(", stateToStr(current), ",", stateToStr(newState), ");");
+	LOGGER_LOG(Logger::Info, "transitionState(", stateToStr(current), ",", stateToStr(newState), ");");
 
 	{
 		lock_guard<mutex> l(stateMtx);
@@ -1159,6 +1362,8 @@ void RendererController::transitionState(RunState current, RunState newState) {
 }
 
 void RendererController::run() {
+	// the same 3 digits of the id the log shows
+	TraceProfiler::getInstance().setThreadName("RendererController " + to_string(clientId % 1000));
 	zmq::socket_t zmqRendererSocket(zmqContext, ZMQ_DEALER);
 	zmq::message_t emtpyFrame(0);
 
@@ -1178,29 +1383,81 @@ void RendererController::run() {
 		}
 		zmqRendererSocket.send(emtpyFrame);
 	} catch (zmq::error_t & ex) {
-		Logger::log(Logger::Error, "Error while creating worker:", ex.what());
+		LOGGER_LOG(Logger::Error, "Error while creating worker:", ex.what());
 		transitionState(STARTING, IDLE);
 		return;
 	}
-	zmq::pollitem_t backEndPoll = {zmqRendererSocket, 0, ZMQ_POLLIN | ZMQ_POLLOUT, 0};
+	// the socket and the wakeup signalled when something is queued, without it the queue is checked every 10 ms
+	const Wakeup::Scope wakeupScope(wakeup, zmqContext);
+	if (!wakeup.isValid()) {
+		LOGGER_LOG(Logger::Warning, "Failed to create wakeup sockets, outgoing messages are checked every 10 ms");
+	}
+	zmq::pollitem_t pollItems[2] = {{zmqRendererSocket, 0, ZMQ_POLLIN, 0}, {nullptr, 0, 0, 0}};
+	zmq::pollitem_t & backEndPoll = pollItems[0];
+	if (wakeup.isValid()) {
+		pollItems[1] = wakeup.getPollItem();
+	}
+	const int pollCount = wakeup.isValid() ? 2 : 1;
 
 	bool sendHB = false;
+	// RT image taken out of it's slot, kept until it is sent
+	std::unique_ptr<OutgoingMessage> rtImage;
+	// messages received from and sent to the proxy, the latency tracer matches them with the proxy's counts
+	uint64_t receivedMessages = 0;
+	uint64_t sentMessages = 1; // the handshake
 
 	transitionState(STARTING, RUNNING);
 	while (runState == RUNNING) {
-		bool diWork = false;
+		const auto now = chrono::high_resolution_clock::now();
+		// time of the next bucket batch or held back message that has to be sent
+		auto deadline = now + chrono::milliseconds(IDLE_POLL_MS);
+		BucketBatcher::time_point pending;
+		if (settings.bucketBatchMs > 0) {
+			// buckets are flushed from the callback when a batch is full, this sends the last ones when rendering slows down
+			unique_lock<mutex> lock(bucketMtx, try_to_lock);
+			if (!lock) {
+				deadline = now + chrono::milliseconds(1);
+			} else if (imagePipeline.bucketsDue(now)) {
+				imagePipeline.flushBuckets();
+			} else if (imagePipeline.getBucketDeadline(pending)) {
+				deadline = std::min(deadline, pending);
+			}
+		}
+		// progress held back by the filter is sent once it's interval passes, even if V-Ray stopped reporting
+		messageFilter.flushDue(now);
+		if (messageFilter.getDeadline(pending)) {
+			deadline = std::min(deadline, pending);
+		}
+
+		// while the proxy holds enough for the client's connection messages stay queued, and RT images in their slot,
+		// the link wakes this thread when it drains
+		const double drainRate = clientLink.sample(now).drainRate;
+		const size_t linkWindow = std::max(MIN_LINK_WINDOW, static_cast<size_t>(drainRate * LINK_WINDOW_MS / 1000));
+		const bool linkOpen = clientLink.hasRoom(linkWindow);
+
+		// wait for POLLOUT only if there is something to send, otherwise poll would return right away
+		const bool hasOutgoing = sendHB || (linkOpen && (rtImage || !outstandingMessages.empty()));
+		backEndPoll.events = ZMQ_POLLIN | (hasOutgoing ? ZMQ_POLLOUT : 0);
+		long timeout = 10;
+		if (wakeup.isValid()) {
+			timeout = static_cast<long>(std::max<int64_t>(0, chrono::duration_cast<chrono::milliseconds>(deadline - now).count() + 1));
+		}
+
 		int pollRes = 0;
 		try {
-			pollRes = zmq::poll(&backEndPoll, 1, 10);
+			pollRes = zmq::poll(pollItems, pollCount, timeout);
 		} catch (zmq::error_t & ex) {
 			if (ex.num() != ETERM) {
-				Logger::log(Logger::Error, "Error while polling for messages:", ex.what());
+				LOGGER_LOG(Logger::Error, "Error while polling for messages:", ex.what());
 			}
 			break;
 		}
+		if (pollCount > 1 && (pollItems[1].revents & ZMQ_POLLIN)) {
+			wakeup.clear();
+		}
 
 		if (backEndPoll.revents & ZMQ_POLLIN) {
-			diWork = true;
+			TRACE_ZONE("RendererController::receive");
 			zmq::message_t ctrlMsg, payloadMsg;
 			bool recv = false;
 			try {
@@ -1210,27 +1467,39 @@ void RendererController::run() {
 				assert(recv && "Failed recv for payload while poll returned ZMQ_POLLIN event.");
 			} catch (zmq::error_t & ex) {
 				if (ex.num() != ETERM) {
-					Logger::log(Logger::Error, "Error while renderer is receiving message:", ex.what());
+					LOGGER_LOG(Logger::Error, "Error while renderer is receiving message:", ex.what());
 				}
 				transitionState(RUNNING, IDLE);
 				return;
 			}
 
 			ControlFrame frame(ctrlMsg);
+			++receivedMessages;
 
 			assert(!!frame && "Client sent malformed control frame");
 
 			if (frame.control == ControlMessage::DATA_MSG) {
-				handle(VRayMessage::fromZmqMessage(payloadMsg));
+				if (latencyTracer) {
+					const auto dequeued = chrono::high_resolution_clock::now();
+					VRayMessage message = VRayMessage::fromZmqMessage(payloadMsg);
+					const bool sceneChange = message.getType() == VRayMessage::Type::ChangePlugin;
+					const auto decoded = chrono::high_resolution_clock::now();
+					handle(std::move(message));
+					if (sceneChange) {
+						latencyTracer->applied(receivedMessages, dequeued, decoded, chrono::high_resolution_clock::now());
+					}
+				} else {
+					handle(VRayMessage::fromZmqMessage(payloadMsg));
+				}
 			} else if (frame.control == ControlMessage::PING_MSG) {
 				sendHB = true;
 			}
 		}
 
 		if (backEndPoll.revents & ZMQ_POLLOUT) {
+			TRACE_ZONE("RendererController::send");
 			if (sendHB) {
 				bool sent = false;
-				diWork = true;
 				try {
 					sent = zmqRendererSocket.send(ControlFrame::make(clType, ControlMessage::PONG_MSG), ZMQ_SNDMORE);
 					assert(sent && "Failed sending ControlFrame for PONG.");
@@ -1238,46 +1507,74 @@ void RendererController::run() {
 					assert(sent && "Failed sending empty frame for PONG.");
 				} catch (zmq::error_t & ex) {
 					if (ex.num() != ETERM) {
-						Logger::log(Logger::Error, "Error while renderer is sending message:", ex.what());
+						LOGGER_LOG(Logger::Error, "Error while renderer is sending message:", ex.what());
 					}
 					transitionState(RUNNING, IDLE);
 					return;
 				}
 				sendHB = !sent;
+				if (sent) {
+					++sentMessages;
+				}
 			}
 
-			if (!outstandingMessages.empty()) {
-				lock_guard<mutex> lock(messageMtx);
-				for (int c = 0; c < MAX_CONSEQ_MESSAGES && !outstandingMessages.empty() && runState == RUNNING; ++c) {
-					diWork = true;
-					bool sent = false;
-					try {
-						sent = zmqRendererSocket.send(ControlFrame::make(clType), ZMQ_SNDMORE);
-						if (sent) {
-							zmqRendererSocket.send(std::move(outstandingMessages.front()));
-						}
-					} catch (zmq::error_t & ex) {
-						if (ex.num() != ETERM) {
-							Logger::log(Logger::Error, "Error while renderer is sending message:", ex.what());
-						}
-						transitionState(RUNNING, IDLE);
-						return;
+			sendBudget.setDrainRate(drainRate);
+			sendBudget.begin(chrono::high_resolution_clock::now());
+			while (runState == RUNNING && clientLink.hasRoom(linkWindow)) {
+				OutgoingMessage * front = outstandingMessages.peek();
+				if (!front) {
+					break;
+				}
+				if (front->slot && !rtImage) {
+					// from now on the image in the slot can't be replaced
+					rtImage.reset(front->slot->image.exchange(nullptr, std::memory_order_acq_rel));
+					if (!rtImage) {
+						outstandingMessages.pop();
+						continue;
+					}
+				}
+				OutgoingMessage & outgoing = front->slot ? *rtImage : *front;
+				const size_t outgoingSize = outgoing.message.size();
+				if (!sendBudget.canSend(outgoingSize, chrono::high_resolution_clock::now())) {
+					break;
+				}
+				bool sent = false;
+				try {
+					sent = zmqRendererSocket.send(ControlFrame::make(clType), ZMQ_SNDMORE);
+					if (sent) {
+						// counted before the proxy can forward it
+						clientLink.queued(outgoingSize, chrono::high_resolution_clock::now());
+						zmqRendererSocket.send(std::move(outgoing.message));
 					}
-					if (!sent) {
-						break;
+				} catch (zmq::error_t & ex) {
+					if (ex.num() != ETERM) {
+						LOGGER_LOG(Logger::Error, "Error while renderer is sending message:", ex.what());
 					}
-					outstandingMessages.pop();
+					transitionState(RUNNING, IDLE);
+					return;
 				}
+				if (!sent) {
+					break;
+				}
+				++sentMessages;
+				if (outgoing.kind != MessageKind::Ordered && latencyTracer) {
+					latencyTracer->imageSent(outgoing.queued, sentMessages, chrono::high_resolution_clock::now());
+				}
+				if (outgoing.kind != MessageKind::Ordered && settings.adaptiveQuality) {
+					const auto waited = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - outgoing.queued).count();
+					viewportQuality.imageSent(outgoingSize, waited);
+				}
+				sendBudget.sent(outgoingSize);
+				rtImage.reset();
+				outstandingMessages.pop();
 			}
-			if (!diWork) {
-				this_thread::sleep_for(chrono::milliseconds(1));
-			}
+			sendBudget.end();
 		}
 	}
 
 	if (clType == ClientType::Exporter) {
 		try {
-			Logger::log(Logger::Debug, "Renderer stopping, sending abort message to client.");
+			LOGGER_LOG(Logger::Debug, "Renderer stopping, sending abort message to client.");
 			// lets try fast cleanup
 			int wait = EXPORTER_TIMEOUT / 2;
 			zmqRendererSocket.setsockopt(ZMQ_SNDTIMEO, &wait, sizeof(wait));
@@ -1285,7 +1582,7 @@ void RendererController::run() {
 			zmqRendererSocket.send(VRayMessage::msgRendererState(VRayMessage::RendererState::Abort, currentFrame));
 		} catch (zmq::error_t & ex) {
 			if (ex.num() != ETERM) {
-				Logger::log(Logger::Error, "Error while renderer is sending cleanup message:", ex.what());
+				LOGGER_LOG(Logger::Error, "Error while renderer is sending cleanup message:", ex.what());
 			}
 		}
 	}
@@ -12,11 +12,60 @@
 #endif
 
 #include <vraysdk.hpp>
-#include <queue>
+#include <chrono>
 #include <memory>
+#include <atomic>
 #include <unordered_set>
 
 #include "utils/logger.h"
+#include "instancer_cache.h"
+#include "renderer_callbacks.h"
+#include "image_pipeline.h"
+#include "viewport_quality.h"
+#include "message_filter.h"
+#include "send_budget.h"
+#include "latency_tracer.h"
+#include "client_link.h"
+#include "utils/buffer_pool.h"
+#include "utils/mpsc_queue.h"
+#include "utils/wakeup.h"
+
+/// Settings for each RendererController, set from the server's command line
+struct ControllerSettings {
+	ControllerSettings()
+		: showVFB(false)
+		, viewportDelta(false)
+		, deltaKeyframeInterval(30)
+		, adaptiveQuality(false)
+		, targetFps(24.f)
+		, maxLatencyMs(200)
+		, progressiveViewport(false)
+		, bucketBatchMs(30)
+		, bucketHalf(false)
+		, progressIntervalMs(100)
+		, vrayLogLevel(29999)
+		, maxVRayLogsPerSecond(50)
+		, sendSliceMs(5)
+		, sendBatchKB(4096)
+		, traceLatency(false)
+	{}
+
+	bool showVFB; ///< Enable/disable vfb
+	bool viewportDelta; ///< Send only changed tiles of RGBA_REAL RT images as bucket images
+	int deltaKeyframeInterval; ///< When @viewportDelta is on, send the full RT image every N updates
+	bool adaptiveQuality; ///< Lower RT image quality, format and resolution when they can't be sent fast enough
+	float targetFps; ///< With @adaptiveQuality, the desired RT image rate
+	int maxLatencyMs; ///< With @adaptiveQuality, max time an RT image may wait to be sent
+	bool progressiveViewport; ///< Send RT images at half resolution while the client is changing the scene
+	int bucketBatchMs; ///< Max time buckets are gathered before being sent as a single image, 0 sends each bucket right away
+	bool bucketHalf; ///< Send batched buckets as RGBA_HALF instead of RGBA_REAL
+	int progressIntervalMs; ///< Min time between progress updates sent to the client, 0 sends all
+	int vrayLogLevel; ///< V-Ray log lines with greater level are not sent, default is V-Ray's MessageInfo
+	int maxVRayLogsPerSecond; ///< Max V-Ray log lines sent per second, 0 for no limit
+	int sendSliceMs; ///< Max time spent sending before checking for incoming messages again
+	int sendBatchKB; ///< Max size of the messages sent before checking for incoming messages again, lower while the client's connection is slower
+	bool traceLatency; ///< Measure the time from a scene change to the first RT image showing it
+};
 
 /// Wrapper over VRay::VRayRenderer to process incomming messages
 class RendererController {
@@ -30,8 +79,8 @@ public:
 
 	/// Create a wrapper
 	/// @sendFn - function called when data needs to be sent back to client (image or message)
-	/// @showVFB - enable/disable vfb
-	RendererController(zmq::context_t & zmqContext, uint64_t clId, ClientType type, bool showVFB);
+	/// @settings - vfb and image sending settings
+	RendererController(zmq::context_t & zmqContext, uint64_t clId, ClientType type, const ControllerSettings & settings);
 	~RendererController();
 
 	RendererController(const RendererController &) = delete;
@@ -51,7 +100,19 @@ public:
 
 	/// Check if currently this controller is serving messages
 	bool isRunning() const;
+
+	/// Log the image statistics gathered since the last call and reset them
+	/// @periodMs - time since the last call, used to compute rates
+	void reportStats(int64_t periodMs);
+
+	/// Get the tracer the proxy stamps this client's messages in, nullptr if settings.traceLatency is off
+	LatencyTracer * getLatencyTracer() const { return latencyTracer.get(); }
+
+	/// Get the link the proxy reports this client's forwarded messages to
+	ClientLink & getClientLink() { return clientLink; }
 private:
+	friend class RendererCallbacks;
+
 	/// Cleany stop amd free the renderer
 	void stopRenderer(bool lockMtx = true);
 
@@ -73,11 +134,52 @@ private:
 	/// Callback for VRayRenderer::setOnDumpMessage, sends message to client
 	void vrayMessageDumpHandler(VRay::VRayRenderer &, const char * msg, int level, void * arg);
 
-	/// Actual sender for images
+	/// Actual sender for images, @imageMtx must be locked
 	/// @img - the image received from vray
 	/// @fullImageType - the image enconding format (JPG, RGBA_REAL, etc)
 	/// @sourceType - RT image update or image done
-	void sendImages(VRay::VRayImage * img, VRayBaseTypes::AttrImage::ImageType fullImageType, VRayBaseTypes::ImageSourceType sourceType);
+	/// @quality - jpeg quality used if @fullImageType is JPG
+	/// @downscale - the final image is sent at 1/@downscale of it's size, RT images are also fit to the client's display size
+	void sendImages(VRay::VRayImage * img, VRayBaseTypes::AttrImage::ImageType fullImageType, VRayBaseTypes::ImageSourceType sourceType, int quality, int downscale);
+
+	/// Render element requested by the client, fetched by @fetchElement and converted by @convertElement
+	struct ElementJob {
+		VRay::RenderElement::Type type; ///< The element
+		VRayBaseTypes::AttrImage::ImageType format; ///< Requested packed format or ImageUtils::NATIVE_CHANNELS, NONE for full AColor pixels
+		std::unique_ptr<VRay::VRayImage> image; ///< The element's image, only between @fetchElement and the end of @sendImages
+		const VRay::AColor * pixels; ///< Pixel data of @image
+		size_t pixelCount; ///< Number of pixels in @pixels
+		int channels; ///< Channels used by the element's pixel format
+		BufferPool::Buffer buffer; ///< The converted image, taken from the BufferPool
+		size_t size; ///< Bytes used in @buffer
+		VRayBaseTypes::AttrImage::ImageType imageType; ///< Type of the data in @buffer
+		int width; ///< Width of the image in @buffer
+		int height; ///< Height of the image in @buffer
+		bool ready; ///< True if @buffer has the image
+
+		ElementJob(VRay::RenderElement::Type type, VRayBaseTypes::AttrImage::ImageType format)
+			: type(type), format(format), pixels(nullptr), pixelCount(0), channels(0), size(0)
+			, imageType(VRayBaseTypes::AttrImage::ImageType::NONE), width(0), height(0), ready(false) {}
+	};
+
+	/// Get the image of a render element from the renderer, AppSDK calls are made only from the calling thread
+	/// @return - false if the element has no image to send
+	bool fetchElement(const VRay::RenderElements & elements, ElementJob & job);
+
+	/// Convert the image fetched by @fetchElement to the requested packed format or it's native channel count
+	/// Does not call the AppSDK, so it runs in parallel for different elements of the same image
+	void convertElement(ElementJob & job);
+
+	/// Queue progress that passed @messageFilter, called with it's lock held
+	void queueProgress(const MessageFilter::Progress & progress);
+
+	/// Queue V-Ray log lines that passed @messageFilter, called with it's lock held
+	void queueLogs(const std::vector<MessageFilter::Log> & logs);
+
+	/// Add message to the send queue
+	/// @kind - RT images are measured by @viewportQuality, a queued RtImage is replaced by the new one
+	/// @return - size of the message
+	size_t queueMessage(zmq::message_t && message, MessageKind kind = MessageKind::Ordered);
 
 	/// Update plugin in current renderer from message data
 	void pluginMessage(VRayMessage && message);
@@ -112,25 +214,76 @@ private:
 
 	uint64_t clientId; ///< Our id
 	zmq::context_t & zmqContext; ///< The zmq context to pass to socket
-	std::mutex messageMtx; ///< Lock protecting the queue for sending
-	std::queue<zmq::message_t> outstandingMessages; ///< Queue for messages to be sent
+	struct RtImageSlot;
+
+	/// Message waiting in the send queue
+	struct OutgoingMessage {
+		zmq::message_t message; ///< The message data
+		std::chrono::high_resolution_clock::time_point queued; ///< When the message was queued
+		MessageKind kind; ///< What the message is
+		std::shared_ptr<RtImageSlot> slot; ///< Set if this is only the place of an RT image in the queue, the image is in the slot
+
+		OutgoingMessage(): kind(MessageKind::Ordered) {}
+
+		OutgoingMessage(zmq::message_t && message, MessageKind kind)
+			: message(std::move(message))
+			, queued(std::chrono::high_resolution_clock::now())
+			, kind(kind)
+		{}
+	};
+
+	/// Newest RT image for a place in the send queue, producers replace it until the sending thread takes it
+	/// The sending thread leaves it in the slot while the proxy holds a full window for the client's connection
+	struct RtImageSlot {
+		std::atomic<OutgoingMessage*> image; ///< The image, nullptr once taken for sending
+
+		explicit RtImageSlot(OutgoingMessage * image): image(image) {}
+		~RtImageSlot() { delete image.load(); }
+	};
+
+	MpscQueue<OutgoingMessage> outstandingMessages; ///< Queue for messages to be sent, only the run thread takes from it
+	Wakeup wakeup; ///< Wakes the run thread when a message is queued or something is held back to be sent later
+	std::shared_ptr<RtImageSlot> rtImageSlot; ///< Slot of the last queued RT image, reset when it can't be replaced anymore. Only used from @sendImages
+	std::atomic<uint64_t> rtImagesReplaced; ///< RT images replaced before being sent since last @reportStats
 
 	/// Hash map that stores plugins that reference other plugins that are not yet exported
 	/// When creating a new plugin, this map is checked to see if some other plugin is waiting for the new one
 	/// When commit action comes this is flushed and the storred error messages (in Logger object) are also displayed
 	std::unordered_map<std::string, std::vector<std::pair<VRayMessage, Logger>>> delayedMessages;
 
+	/// Last instancer list for each "plugin::property", so updates rebuild only the changed instances
+	/// Cleared whenever plugins are removed/replaced or the renderer is reset, since cached lists hold plugin references
+	std::unordered_map<std::string, InstancerCache> instancers;
+
 	VRay::RendererOptions options; ///< Options for VRayRenderer
-	VRay::VRayRenderer * renderer; ///< Pointer to VRayRenderer
-	std::unordered_set<VRay::RenderElement::Type, std::hash<int>> elementsToSend; ///< Renderer elements to send to client when sending images
+	RendererBackend * renderer; ///< The renderer, VRayRenderer or a wrapper of it chosen at compile time
+	/// Maps render element to requested image format, NONE means the element's native float format
+	typedef std::unordered_map<VRay::RenderElement::Type, VRayBaseTypes::AttrImage::ImageType, std::hash<int>> ElementFormats;
+	ElementFormats elementsToSend; ///< Renderer elements to send to client when sending images
 	std::mutex elemsToSendMtx;
 	VRayMessage::RendererType type; ///< RT or Animation
 	float currentFrame; ///< Currently rendered frame
 	int jpegQuality; ///< Desiered jpeg quality for images sent to client
 	VRayBaseTypes::AttrImage::ImageType viewportType; ///< Desiered image type for imageUpdate callback
+	std::vector<ElementJob> elementJobs; ///< Render elements for the current call to @sendImages
+
+	const ControllerSettings settings; ///< Settings passed from the server
+	ImagePipeline imagePipeline; ///< Converts the main image and buckets, it's image functions are used under @imageMtx
+	ViewportQuality viewportQuality; ///< Picks RT image settings if settings.adaptiveQuality is on
+	std::atomic<int64_t> lastSceneChange; ///< Time of the last plugin change from the client, in high_resolution_clock ticks
+
+	std::mutex bucketMtx; ///< Protects the bucket functions of @imagePipeline
+	std::atomic<uint64_t> bucketCount; ///< Buckets received since last @reportStats
+
+	MessageFilter messageFilter; ///< Coalesces progress and V-Ray log messages
+	SendBudget sendBudget; ///< Limits each batch of sent messages by time and size
+	std::unique_ptr<LatencyTracer> latencyTracer; ///< Traces scene changes to the client if settings.traceLatency is on
+	ClientLink clientLink; ///< Messages sent to the proxy that the client's connection did not take yet
 
 	std::mutex rendererMtx; ///< Protects all callbacks in order to ensure they are executing with valid renderer
-	bool vfbClosed; ///< True if user closed VFB and we dont want to save current renderer as persistent
+	std::atomic<bool> vfbClosed; ///< True if user closed VFB and we dont want to save current renderer as persistent
+	std::mutex imageMtx; ///< Serializes @sendImages between the image callbacks of the renderer
+	std::shared_ptr<RendererCallbacks> callbacks; ///< Receives the renderer's callbacks, detached before the renderer is freed or saved
 };
 
 
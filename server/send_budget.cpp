@@ -0,0 +1,79 @@
+#include "send_budget.h"
+#include <algorithm>
+
+using namespace std::chrono;
+
+namespace {
+/// Least byte budget of a batch, so a slow connection still gets small messages out together
+const size_t MIN_BUDGET_BYTES = 64 * 1024;
+}
+
+SendBudget::SendBudget(int sliceMs, size_t maxBytes, int maxMessages)
+	: slice(milliseconds(sliceMs))
+	, maxBytes(maxBytes)
+	, maxMessages(maxMessages)
+	, budgetBytes(maxBytes)
+	, batchBytes(0)
+	, batchMessages(0)
+	, batchLimit(Limit::None)
+	, stats()
+{}
+
+void SendBudget::setDrainRate(double bytesPerSecond) {
+	if (bytesPerSecond <= 0) {
+		budgetBytes = maxBytes;
+		return;
+	}
+	const double sliceBytes = bytesPerSecond * duration_cast<duration<double>>(slice).count();
+	budgetBytes = std::min(maxBytes, std::max(std::min(maxBytes, MIN_BUDGET_BYTES), static_cast<size_t>(sliceBytes)));
+}
+
+void SendBudget::begin(time_point now) {
+	batchStart = now;
+	batchBytes = 0;
+	batchMessages = 0;
+	batchLimit = Limit::None;
+}
+
+bool SendBudget::canSend(size_t bytes, time_point now) {
+	if (!batchMessages) {
+		return true;
+	}
+	if (batchMessages >= maxMessages) {
+		return false;
+	}
+	if (now - batchStart >= slice) {
+		batchLimit = Limit::Time;
+		return false;
+	}
+	if (batchBytes + bytes > budgetBytes) {
+		batchLimit = Limit::Bytes;
+		return false;
+	}
+	return true;
+}
+
+void SendBudget::sent(size_t bytes) {
+	batchBytes += bytes;
+	++batchMessages;
+}
+
+void SendBudget::end() {
+	if (!batchMessages) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(statsMtx);
+	++stats.batches;
+	stats.messages += batchMessages;
+	stats.bytes += batchBytes;
+	stats.byteLimited += batchLimit == Limit::Bytes;
+	stats.timeLimited += batchLimit == Limit::Time;
+	stats.budgetBytes = budgetBytes;
+}
+
+SendBudget::Stats SendBudget::takeStats() {
+	std::lock_guard<std::mutex> lock(statsMtx);
+	Stats result = stats;
+	stats = Stats();
+	return result;
+}
@@ -0,0 +1,72 @@
+#ifndef SEND_BUDGET_H
+#define SEND_BUDGET_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/// Limits how much the controller's run thread sends before it goes back to poll for incoming messages
+/// Each batch may take up to a time slice and a byte budget, so many small messages go out together while a few
+/// huge images can't delay PING handling. Sends go to the proxy over inproc and return at memory speed, so the
+/// byte budget follows the client's connection instead: what it drains in one slice, as measured by ClientLink.
+/// Used from the run thread, only @takeStats can be called from other threads.
+class SendBudget {
+public:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// Counters since the last call to @takeStats
+	struct Stats {
+		uint64_t batches; ///< Batches with at least one message
+		uint64_t messages; ///< Messages sent
+		uint64_t bytes; ///< Bytes sent
+		uint64_t byteLimited; ///< Batches ended by the byte budget
+		uint64_t timeLimited; ///< Batches ended by the time slice
+		size_t budgetBytes; ///< Byte budget of the last batch
+	};
+
+	/// @sliceMs - max time for one batch
+	/// @maxBytes - max bytes in one batch, the first message is sent even if it is larger
+	/// @maxMessages - max messages in one batch
+	SendBudget(int sliceMs, size_t maxBytes, int maxMessages);
+
+	/// Set how fast the client's connection takes bytes, the byte budget of the next batches is what it takes in one slice
+	/// @bytesPerSecond - 0 if not measured yet, the budget is @maxBytes then
+	void setDrainRate(double bytesPerSecond);
+
+	/// Start a batch
+	void begin(time_point now);
+
+	/// Check if message of @bytes can be sent in the current batch, the first one always can
+	bool canSend(size_t bytes, time_point now);
+
+	/// Account for a message of @bytes that was sent
+	void sent(size_t bytes);
+
+	/// End the batch and count it in the stats
+	void end();
+
+	/// Get the counters and reset them
+	Stats takeStats();
+
+private:
+	/// What ended the current batch
+	enum class Limit {
+		None,
+		Bytes,
+		Time,
+	};
+
+	const std::chrono::microseconds slice; ///< Max time for one batch
+	const size_t maxBytes; ///< Max bytes in one batch
+	const int maxMessages; ///< Max messages in one batch
+	size_t budgetBytes; ///< Bytes allowed in one batch, follows the drain rate up to @maxBytes
+	time_point batchStart; ///< Start of the current batch
+	size_t batchBytes; ///< Bytes sent in the current batch
+	int batchMessages; ///< Messages sent in the current batch
+	Limit batchLimit; ///< Set if the current batch was ended by a budget
+	std::mutex statsMtx; ///< Protects @stats
+	Stats stats; ///< Counters for @takeStats
+};
+
+#endif // SEND_BUDGET_H
@@ -0,0 +1,45 @@
+#ifndef SESSION_FORMAT_H
+#define SESSION_FORMAT_H
+
+#include <cstdint>
+
+/// Layout of session recording files
+/// The file is a FileHeader followed by records appended back to back. Each record is a RecordHeader followed by
+/// the id, control and payload frames exactly as the client sent them, padded with zeros to a multiple of 8 bytes.
+/// All fields are little endian and 8 byte aligned, so a mapped file can be read in place.
+namespace SessionFormat {
+
+/// First bytes of every recording
+const char MAGIC[8] = {'V', 'R', 'Z', 'S', 'E', 'S', 'S', '1'};
+
+/// Version of this layout, changes when the headers change
+const uint32_t VERSION = 1;
+
+/// Alignment of each record
+const uint64_t ALIGNMENT = 8;
+
+struct FileHeader {
+	char magic[8]; ///< Same as MAGIC
+	uint32_t version; ///< Same as VERSION
+	uint32_t protocolVersion; ///< ZMQ_PROTOCOL_VERSION of the server that recorded the session
+	uint64_t startTimeUs; ///< Wall clock time the recording started, microseconds since epoch
+};
+
+struct RecordHeader {
+	uint64_t timeNs; ///< Time the frames were received, nanoseconds since the recording started
+	uint64_t payloadSize; ///< Size of the payload frame
+	uint32_t idSize; ///< Size of the client id frame
+	uint32_t controlSize; ///< Size of the control frame
+	uint32_t droppedBefore; ///< Number of messages not recorded between the previous record and this one
+	uint32_t reserved; ///< Zero
+};
+
+/// Size of the record starting with @header, including the padding
+inline uint64_t recordSize(const RecordHeader & header) {
+	const uint64_t size = sizeof(RecordHeader) + header.idSize + header.controlSize + header.payloadSize;
+	return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+} // namespace SessionFormat
+
+#endif // SESSION_FORMAT_H
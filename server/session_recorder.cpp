@@ -0,0 +1,163 @@
+#include "session_recorder.h"
+#include "utils/logger.h"
+
+#include <zmq_wrapper.hpp>
+#include <cstring>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+/// Messages are dropped while more than this is waiting to be written
+const uint64_t MAX_QUEUED_BYTES = 256 * 1024 * 1024;
+
+/// Max time written data stays in the file buffer
+const milliseconds FLUSH_INTERVAL(1000);
+}
+
+SessionRecorder::SessionRecorder()
+	: opened(false)
+	, queuedBytes(0)
+	, droppedSinceRecord(0)
+	, running(false)
+	, writerIdle(false)
+	, recordCount(0)
+	, byteCount(0)
+	, droppedCount(0)
+{}
+
+SessionRecorder::~SessionRecorder() {
+	close();
+}
+
+bool SessionRecorder::open(const std::string & path) {
+	if (opened) {
+		LOGGER_LOG(Logger::Warning, "Session recording already open");
+		return false;
+	}
+
+	file.open(path.c_str(), ios::binary | ios::trunc);
+	if (!file) {
+		LOGGER_LOG(Logger::Error, "Failed to create session recording", path);
+		return false;
+	}
+
+	SessionFormat::FileHeader header;
+	memcpy(header.magic, SessionFormat::MAGIC, sizeof(header.magic));
+	header.version = SessionFormat::VERSION;
+	header.protocolVersion = ZMQ_PROTOCOL_VERSION;
+	header.startTimeUs = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	start = high_resolution_clock::now();
+	opened = true;
+	running = true;
+	writer = thread(&SessionRecorder::writerBase, this);
+	LOGGER_LOG(Logger::Debug, "Recording session to", path);
+	return true;
+}
+
+void SessionRecorder::record(const zmq::message_t & id, const zmq::message_t & control, const zmq::message_t & payload) {
+	const uint64_t size = id.size() + control.size() + payload.size();
+	if (queuedBytes.load(memory_order_relaxed) + size > MAX_QUEUED_BYTES) {
+		++droppedSinceRecord;
+		droppedCount.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	Record rec;
+	rec.header.timeNs = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+	rec.header.payloadSize = payload.size();
+	rec.header.idSize = static_cast<uint32_t>(id.size());
+	rec.header.controlSize = static_cast<uint32_t>(control.size());
+	rec.header.droppedBefore = droppedSinceRecord;
+	droppedSinceRecord = 0;
+
+	try {
+		// zmq only adds a reference to the data of large messages
+		rec.id.copy(&id);
+		rec.control.copy(&control);
+		rec.payload.copy(&payload);
+	} catch (zmq::error_t & ex) {
+		LOGGER_LOG(Logger::Error, "Failed to record message:", ex.what());
+		return;
+	}
+
+	queuedBytes.fetch_add(size, memory_order_relaxed);
+	records.push(move(rec));
+	if (writerIdle.load()) {
+		cond.notify_one();
+	}
+}
+
+void SessionRecorder::write(const Record & record) {
+	static const char padding[SessionFormat::ALIGNMENT] = {0, };
+	const uint64_t dataSize = sizeof(record.header) + record.header.idSize + record.header.controlSize + record.header.payloadSize;
+	const uint64_t size = SessionFormat::recordSize(record.header);
+
+	file.write(reinterpret_cast<const char *>(&record.header), sizeof(record.header));
+	file.write(static_cast<const char *>(record.id.data()), record.id.size());
+	file.write(static_cast<const char *>(record.control.data()), record.control.size());
+	file.write(static_cast<const char *>(record.payload.data()), record.payload.size());
+	file.write(padding, size - dataSize);
+
+	recordCount.fetch_add(1, memory_order_relaxed);
+	byteCount.fetch_add(size, memory_order_relaxed);
+}
+
+void SessionRecorder::writerBase() {
+	auto lastFlush = high_resolution_clock::now();
+	bool failed = false;
+	while (true) {
+		const bool stopping = !running.load(memory_order_acquire);
+		while (Record * rec = records.peek()) {
+			if (!failed) {
+				write(*rec);
+				if (!file) {
+					LOGGER_LOG(Logger::Error, "Failed writing session recording, stopping it");
+					failed = true;
+				}
+			}
+			queuedBytes.fetch_sub(rec->id.size() + rec->control.size() + rec->payload.size(), memory_order_relaxed);
+			records.pop();
+		}
+
+		const auto now = high_resolution_clock::now();
+		if (stopping || now - lastFlush >= FLUSH_INTERVAL) {
+			file.flush();
+			lastFlush = now;
+		}
+		if (stopping) {
+			break;
+		}
+
+		unique_lock<mutex> lock(mtx);
+		writerIdle.store(true);
+		// recheck after publishing idle, @record may have pushed before seeing it
+		if (records.empty()) {
+			cond.wait_for(lock, FLUSH_INTERVAL);
+		}
+		writerIdle.store(false, memory_order_relaxed);
+	}
+}
+
+void SessionRecorder::close() {
+	if (!opened) {
+		return;
+	}
+	running = false;
+	cond.notify_one();
+	if (writer.joinable()) {
+		writer.join();
+	}
+	file.close();
+	opened = false;
+}
+
+SessionRecorder::Stats SessionRecorder::takeStats() {
+	Stats stats;
+	stats.records = recordCount.exchange(0, memory_order_relaxed);
+	stats.bytes = byteCount.exchange(0, memory_order_relaxed);
+	stats.dropped = droppedCount.exchange(0, memory_order_relaxed);
+	return stats;
+}
@@ -0,0 +1,93 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include "session_format.h"
+#include "utils/mpsc_queue.h"
+
+#include <zmq.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/// Records the frames clients send to the server into a session file that can be replayed later
+/// The proxy thread only makes zmq copies of the frames, which share the data of large messages instead of
+/// copying it, and queues them. A writer thread appends them to the file. If the disk can't keep up and
+/// too much data is queued, messages are dropped and the next record counts them in it's droppedBefore.
+class SessionRecorder {
+public:
+	/// Counters since the last call to @takeStats
+	struct Stats {
+		uint64_t records; ///< Records written
+		uint64_t bytes; ///< Bytes written
+		uint64_t dropped; ///< Messages dropped because of the queue limit
+	};
+
+	SessionRecorder();
+
+	/// Calls @close
+	~SessionRecorder();
+
+	SessionRecorder(const SessionRecorder &) = delete;
+	SessionRecorder & operator=(const SessionRecorder &) = delete;
+
+	/// Create the file at @path, write the file header and start the writer thread
+	/// @return - false if the file can't be created
+	bool open(const std::string & path);
+
+	/// Check if @open succeeded and @close was not called since
+	bool isOpen() const { return opened; }
+
+	/// Queue one message from a client, must be called from a single thread
+	/// The messages are not changed and can be sent after this returns
+	void record(const zmq::message_t & id, const zmq::message_t & control, const zmq::message_t & payload);
+
+	/// Write everything queued, close the file and join the writer thread
+	void close();
+
+	/// Get the counters and reset them
+	Stats takeStats();
+
+private:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// Message waiting for the writer
+	struct Record {
+		SessionFormat::RecordHeader header; ///< Header with the sizes of the frames
+		zmq::message_t id; ///< Copy of the client id frame
+		zmq::message_t control; ///< Copy of the control frame
+		zmq::message_t payload; ///< Copy of the payload frame
+
+		Record(): header() {}
+	};
+
+	/// Append @record to the file
+	void write(const Record & record);
+
+	/// Thread base for the writer
+	void writerBase();
+
+	bool opened; ///< True between successful @open and @close
+	std::ofstream file; ///< The recording, used only by the writer thread after @open
+	time_point start; ///< Time of @open, record times are relative to it
+
+	MpscQueue<Record> records; ///< Records waiting for the writer
+	std::atomic<uint64_t> queuedBytes; ///< Size of the frames in @records
+	uint32_t droppedSinceRecord; ///< Messages dropped since the last queued record, used only by @record
+
+	std::atomic<bool> running; ///< Cleared by @close
+	std::atomic<bool> writerIdle; ///< True while the writer waits, @record notifies @cond only then
+	std::mutex mtx; ///< Protects @cond
+	std::condition_variable cond; ///< Wakes the writer
+	std::thread writer; ///< The writer thread
+
+	std::atomic<uint64_t> recordCount; ///< Counter for @takeStats
+	std::atomic<uint64_t> byteCount; ///< Counter for @takeStats
+	std::atomic<uint64_t> droppedCount; ///< Counter for @takeStats
+};
+
+#endif // SESSION_RECORDER_H
@@ -0,0 +1,247 @@
+#include "async_log_writer.h"
+#include <csignal>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+/// Signals handled by AsyncLogWriter::installCrashHandler
+const int CRASH_SIGNALS[] = {SIGSEGV, SIGABRT, SIGFPE, SIGILL};
+
+/// Wake the writer before the timer once this part of the ring is used
+const size_t WAKE_FRACTION = 4;
+
+/// How long the crash handler waits for the writer thread to finish the batch it is writing
+const milliseconds CRASH_DRAIN_WAIT(200);
+
+/// Max time a message that is not dropped right away waits for space in the ring
+const milliseconds FULL_WAIT(200);
+
+/// A producer checks the ring again at least this often, in case the writer's notify came before it waited
+const milliseconds FULL_RECHECK(1);
+
+size_t roundUpPow2(int value) {
+	size_t result = 2;
+	while (result < static_cast<size_t>(value)) {
+		result <<= 1;
+	}
+	return result;
+}
+}
+
+std::atomic<AsyncLogWriter*> AsyncLogWriter::crashInstance(nullptr);
+
+AsyncLogWriter::AsyncLogWriter(int capacity, int flushIntervalMs, WriteCb write, FlushCb flush)
+	: slots(new Slot[roundUpPow2(capacity)])
+	, mask(roundUpPow2(capacity) - 1)
+	, pushPosition(0)
+	, popPosition(0)
+	, flushInterval(flushIntervalMs)
+	, write(write)
+	, flush(flush)
+	, draining(false)
+	, running(true)
+	, droppedSinceNote(0)
+	, dropped(0)
+	, waited(0)
+	, written(0)
+	, flushes(0)
+	, spaceWaiters(0)
+{
+	for (size_t c = 0; c <= mask; ++c) {
+		slots[c].sequence.store(c, memory_order_relaxed);
+	}
+	writer = thread(&AsyncLogWriter::writerBase, this);
+}
+
+AsyncLogWriter::~AsyncLogWriter() {
+	stop();
+}
+
+void AsyncLogWriter::push(Logger::Level level, const std::string & message) {
+	if (!running.load(memory_order_acquire)) {
+		return;
+	}
+	const auto now = high_resolution_clock::now();
+	if (!tryPush(level, message, now)) {
+		// APIDump is replayed as code, so it should not have holes
+		if (level != Logger::APIDump && level < Logger::Warning) {
+			countDropped();
+			return;
+		}
+		if (!waitPush(level, message, now)) {
+			countDropped();
+			return;
+		}
+	}
+	if (level >= Logger::Error) {
+		cond.notify_one();
+	}
+}
+
+bool AsyncLogWriter::waitPush(Logger::Level level, const std::string & message, time_point now) {
+	waited.fetch_add(1, memory_order_relaxed);
+	cond.notify_one();
+	const auto deadline = steady_clock::now() + FULL_WAIT;
+	unique_lock<mutex> lock(spaceMtx);
+	spaceWaiters.fetch_add(1);
+	bool pushed = false;
+	while (!(pushed = tryPush(level, message, now)) && running.load(memory_order_acquire) && steady_clock::now() < deadline) {
+		spaceCond.wait_for(lock, FULL_RECHECK);
+	}
+	spaceWaiters.fetch_sub(1);
+	return pushed;
+}
+
+void AsyncLogWriter::countDropped() {
+	droppedSinceNote.fetch_add(1, memory_order_relaxed);
+	dropped.fetch_add(1, memory_order_relaxed);
+}
+
+bool AsyncLogWriter::tryPush(Logger::Level level, const std::string & message, time_point now) {
+	size_t position = pushPosition.load(memory_order_relaxed);
+	while (true) {
+		Slot & slot = slots[position & mask];
+		const size_t sequence = slot.sequence.load(memory_order_acquire);
+		if (sequence == position) {
+			if (pushPosition.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+				slot.entry.level = level;
+				slot.entry.time = now;
+				slot.entry.message.assign(message);
+				slot.sequence.store(position + 1, memory_order_release);
+				if (((position + 1) & (mask / WAKE_FRACTION)) == 0) {
+					cond.notify_one();
+				}
+				return true;
+			}
+		} else if (sequence < position) {
+			// slot still holds the message from one lap ago
+			return false;
+		} else {
+			position = pushPosition.load(memory_order_relaxed);
+		}
+	}
+}
+
+int AsyncLogWriter::drain(bool & hadError) {
+	int count = 0;
+	while (true) {
+		Slot & slot = slots[popPosition & mask];
+		if (slot.sequence.load(memory_order_acquire) != popPosition + 1) {
+			break;
+		}
+		if (write) {
+			write(slot.entry);
+		}
+		hadError = hadError || slot.entry.level >= Logger::Error;
+		slot.sequence.store(popPosition + mask + 1, memory_order_release);
+		++popPosition;
+		++count;
+	}
+	written.fetch_add(count, memory_order_relaxed);
+	writeDropNote();
+	return count;
+}
+
+void AsyncLogWriter::writeDropNote() {
+	const uint64_t droppedCount = droppedSinceNote.exchange(0, memory_order_relaxed);
+	if (droppedCount && write) {
+		Entry note;
+		note.level = Logger::Warning;
+		note.time = high_resolution_clock::now();
+		note.message = to_string(droppedCount) + " log messages dropped, log buffer was full";
+		write(note);
+	}
+}
+
+void AsyncLogWriter::writerBase() {
+	auto lastFlush = high_resolution_clock::now();
+	bool pending = false;
+	while (true) {
+		const bool stopping = !running.load(memory_order_acquire);
+		if (!draining.exchange(true, memory_order_acquire)) {
+			bool hadError = false;
+			const int count = drain(hadError);
+			pending = count > 0 || pending;
+			if (count && spaceWaiters.load()) {
+				spaceCond.notify_all();
+			}
+			const auto now = high_resolution_clock::now();
+			if (pending && (stopping || hadError || now - lastFlush >= flushInterval)) {
+				if (flush) {
+					flush();
+				}
+				flushes.fetch_add(1, memory_order_relaxed);
+				lastFlush = now;
+				pending = false;
+			}
+			draining.store(false, memory_order_release);
+		}
+		if (stopping) {
+			break;
+		}
+
+		unique_lock<mutex> lock(mtx);
+		if (pending) {
+			cond.wait_until(lock, lastFlush + flushInterval);
+		} else {
+			cond.wait_for(lock, flushInterval);
+		}
+	}
+}
+
+void AsyncLogWriter::stop() {
+	if (!running.exchange(false, memory_order_acq_rel)) {
+		return;
+	}
+	AsyncLogWriter * self = this;
+	if (crashInstance.compare_exchange_strong(self, nullptr)) {
+		for (int sig : CRASH_SIGNALS) {
+			signal(sig, SIG_DFL);
+		}
+	}
+	cond.notify_one();
+	spaceCond.notify_all();
+	if (writer.joinable()) {
+		writer.join();
+	}
+}
+
+void AsyncLogWriter::installCrashHandler() {
+	crashInstance.store(this);
+	for (int sig : CRASH_SIGNALS) {
+		signal(sig, &AsyncLogWriter::crashHandler);
+	}
+}
+
+void AsyncLogWriter::crashHandler(int sig) {
+	for (int handled : CRASH_SIGNALS) {
+		signal(handled, SIG_DFL);
+	}
+	// best effort - the process is going down anyway, so use the normal write path even if it is not signal safe
+	AsyncLogWriter * instance = crashInstance.exchange(nullptr);
+	if (instance) {
+		const auto deadline = high_resolution_clock::now() + CRASH_DRAIN_WAIT;
+		bool owned = false;
+		while (!(owned = !instance->draining.exchange(true, memory_order_acquire)) && high_resolution_clock::now() < deadline) {
+			this_thread::yield();
+		}
+		if (owned) {
+			bool hadError = false;
+			instance->drain(hadError);
+		}
+		if (instance->flush) {
+			instance->flush();
+		}
+	}
+	raise(sig);
+}
+
+AsyncLogWriter::Stats AsyncLogWriter::takeStats() {
+	Stats stats;
+	stats.written = written.exchange(0, memory_order_relaxed);
+	stats.dropped = dropped.exchange(0, memory_order_relaxed);
+	stats.waited = waited.exchange(0, memory_order_relaxed);
+	stats.flushes = flushes.exchange(0, memory_order_relaxed);
+	return stats;
+}
@@ -0,0 +1,131 @@
+#ifndef ASYNC_LOG_WRITER_H
+#define ASYNC_LOG_WRITER_H
+
+#include "logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/// Moves writing of log messages off the threads that log them
+/// Messages are formatted in the logging thread's staging stream (see Logger::write) and copied into a fixed
+/// ring of slots that keep their string capacity between uses, so the ring does not allocate or take a lock
+/// once the slots have grown. A background thread passes them to the write
+/// callback in batches and calls the flush callback on a timer and after errors.
+/// When the ring is full APIDump, Warning and Error messages wait for space on a condition variable for a bounded
+/// time, so a stuck output can't stop the server. The rest, and those that waited too long, are dropped and counted.
+class AsyncLogWriter {
+public:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// Logged message as passed to the write callback
+	struct Entry {
+		Logger::Level level; ///< The level of the message
+		time_point time; ///< When it was logged
+		std::string message; ///< The message text
+	};
+
+	/// Called on the writer thread for each message in order
+	typedef std::function<void(const Entry &)> WriteCb;
+
+	/// Called on the writer thread after a batch when the flush interval passed
+	typedef std::function<void()> FlushCb;
+
+	/// Counters since the last call to @takeStats
+	struct Stats {
+		uint64_t written; ///< Messages passed to the write callback
+		uint64_t dropped; ///< Messages dropped because the ring was full, including those that waited too long
+		uint64_t waited; ///< Messages that had to wait for space
+		uint64_t flushes; ///< Calls to the flush callback
+	};
+
+	/// Start the writer thread
+	/// @capacity - number of slots in the ring, rounded up to power of 2
+	/// @flushIntervalMs - max time messages stay in the output buffers
+	AsyncLogWriter(int capacity, int flushIntervalMs, WriteCb write, FlushCb flush);
+
+	/// Calls @stop
+	~AsyncLogWriter();
+
+	AsyncLogWriter(const AsyncLogWriter &) = delete;
+	AsyncLogWriter & operator=(const AsyncLogWriter &) = delete;
+
+	/// Queue message, can be called from any thread
+	void push(Logger::Level level, const std::string & message);
+
+	/// Write all queued messages, flush and join the writer thread, messages pushed after this are dropped
+	void stop();
+
+	/// Write what is queued and flush from a handler for SIGSEGV, SIGABRT, SIGFPE and SIGILL before the process dies
+	/// Only one writer can be installed, @stop resets the signals to their default handlers
+	void installCrashHandler();
+
+	/// Get the counters and reset them
+	Stats takeStats();
+
+private:
+	/// One message in the ring
+	struct Slot {
+		std::atomic<size_t> sequence; ///< Slot is free for position == sequence and readable for position + 1
+		Entry entry; ///< The message, it's string is reused
+	};
+
+	/// Try to claim a slot and copy the message in
+	/// @return - false if the ring is full
+	bool tryPush(Logger::Level level, const std::string & message, time_point now);
+
+	/// Wait for the writer to free a slot and push the message, for levels that are not dropped right away
+	/// @return - false if there was no space in time or the writer stopped
+	bool waitPush(Logger::Level level, const std::string & message, time_point now);
+
+	/// Count a message that could not be queued
+	void countDropped();
+
+	/// Pass all readable slots to @write
+	/// @hadError - set to true if an Error message was written
+	/// @return - number of messages written
+	int drain(bool & hadError);
+
+	/// Write note for the dropped messages if there are any
+	void writeDropNote();
+
+	/// Thread base for the writer
+	void writerBase();
+
+	/// Signal handler installed by @installCrashHandler
+	static void crashHandler(int sig);
+
+	std::unique_ptr<Slot[]> slots; ///< The ring
+	const size_t mask; ///< Ring size - 1
+	std::atomic<size_t> pushPosition; ///< Next position producers claim
+	size_t popPosition; ///< Next position the writer reads, owned by whoever holds @draining
+
+	const std::chrono::milliseconds flushInterval; ///< Max time between flushes while there are messages
+	WriteCb write; ///< Output for messages
+	FlushCb flush; ///< Flushes the output
+
+	std::atomic<bool> draining; ///< Held while reading the ring, lets the crash handler take over from the writer
+	std::atomic<bool> running; ///< Cleared by @stop
+	std::atomic<uint64_t> droppedSinceNote; ///< Dropped messages not yet reported with a note
+	std::atomic<uint64_t> dropped; ///< Counter for @takeStats
+	std::atomic<uint64_t> waited; ///< Counter for @takeStats
+	std::atomic<uint64_t> written; ///< Counter for @takeStats
+	std::atomic<uint64_t> flushes; ///< Counter for @takeStats
+
+	std::mutex mtx; ///< Protects @cond
+	std::condition_variable cond; ///< Wakes the writer before the flush interval, notified without the lock
+	std::mutex spaceMtx; ///< Protects @spaceCond
+	std::condition_variable spaceCond; ///< Wakes producers waiting in @waitPush after the writer freed slots
+	std::atomic<int> spaceWaiters; ///< Producers in @waitPush
+	std::thread writer; ///< The writer thread
+
+	static std::atomic<AsyncLogWriter*> crashInstance; ///< Writer flushed by @crashHandler
+};
+
+#endif // ASYNC_LOG_WRITER_H
@@ -0,0 +1,183 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "buffer_pool.h"
+#include "logger.h"
+#include <cstdlib>
+
+#ifdef __linux__
+	#include <sys/mman.h>
+#endif
+
+namespace {
+/// Smallest buffer size, smaller requests get a buffer of this size
+const size_t MIN_BUFFER_SIZE = 64 * 1024;
+
+/// Transparent huge page size
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+}
+
+BufferPool::Buffer & BufferPool::Buffer::operator=(Buffer && other) {
+	if (this != &other) {
+		reset();
+		ptr = other.ptr;
+		other.ptr = nullptr;
+	}
+	return *this;
+}
+
+size_t BufferPool::Buffer::capacity() const {
+	return ptr ? getHeader(ptr)->capacity : 0;
+}
+
+void BufferPool::Buffer::reset() {
+	if (ptr) {
+		getHeader(ptr)->pool->put(ptr);
+		ptr = nullptr;
+	}
+}
+
+BufferPool::BufferPool(size_t maxIdleBytes)
+	: idleBytes(0)
+	, maxIdleBytes(maxIdleBytes)
+	, hugePages(false)
+	, acquiredCount(0)
+	, allocatedCount(0)
+	, freedCount(0)
+{
+	static_assert(sizeof(Header) <= HEADER_SIZE, "BufferPool::Header does not fit in HEADER_SIZE");
+}
+
+BufferPool::~BufferPool() {
+	// buffers still in use must not outlive the pool, only the idle ones are freed here
+	for (std::vector<void*> & buffers : idle) {
+		for (void * data : buffers) {
+			deallocate(data);
+		}
+	}
+}
+
+BufferPool & BufferPool::getInstance() {
+	static BufferPool pool(256 * 1024 * 1024);
+	return pool;
+}
+
+int BufferPool::getSizeClass(size_t bytes) {
+	for (int sizeClass = 0; sizeClass < CLASS_COUNT; ++sizeClass) {
+		if (bytes <= getClassSize(sizeClass)) {
+			return sizeClass;
+		}
+	}
+	return -1;
+}
+
+size_t BufferPool::getClassSize(int sizeClass) {
+	const size_t base = MIN_BUFFER_SIZE << (sizeClass / 2);
+	return sizeClass % 2 ? base + base / 2 : base;
+}
+
+BufferPool::Buffer BufferPool::acquire(size_t bytes) {
+	const int sizeClass = getSizeClass(bytes);
+	if (sizeClass == -1) {
+		LOGGER_LOG(Logger::Error, "BufferPool: requested buffer is too large", bytes);
+		return Buffer();
+	}
+	++acquiredCount;
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		std::vector<void*> & buffers = idle[sizeClass];
+		if (!buffers.empty()) {
+			void * data = buffers.back();
+			buffers.pop_back();
+			idleBytes -= getHeader(data)->capacity;
+			return Buffer(data);
+		}
+	}
+
+	void * data = allocate(sizeClass);
+	if (!data) {
+		LOGGER_LOG(Logger::Error, "BufferPool: failed to allocate", getClassSize(sizeClass), "bytes");
+		return Buffer();
+	}
+	++allocatedCount;
+	return Buffer(data);
+}
+
+bool BufferPool::acquire(Buffer & buffer, size_t bytes) {
+	if (buffer && buffer.capacity() >= bytes) {
+		return true;
+	}
+	// return the small buffer first so it can be reused by the next caller
+	buffer.reset();
+	buffer = acquire(bytes);
+	return !!buffer;
+}
+
+void * BufferPool::allocate(int sizeClass) {
+	const size_t capacity = getClassSize(sizeClass);
+	const size_t total = capacity + HEADER_SIZE;
+	void * memory = nullptr;
+	bool mapped = false;
+
+#ifdef __linux__
+	if (hugePages && capacity >= HUGE_PAGE_SIZE) {
+		// mmap gives page aligned memory, the header takes part of the first page
+		memory = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) {
+			memory = nullptr;
+		} else {
+			mapped = true;
+			if (madvise(memory, total, MADV_HUGEPAGE)) {
+				LOGGER_LOG(Logger::Debug, "BufferPool: madvise(MADV_HUGEPAGE) failed, using normal pages");
+			}
+		}
+	}
+#endif
+	if (!memory) {
+		memory = std::malloc(total);
+		if (!memory) {
+			return nullptr;
+		}
+	}
+
+	Header * header = static_cast<Header*>(memory);
+	header->pool = this;
+	header->capacity = capacity;
+	header->sizeClass = sizeClass;
+	header->mapped = mapped;
+	return static_cast<char*>(memory) + HEADER_SIZE;
+}
+
+void BufferPool::deallocate(void * data) {
+	Header * header = getHeader(data);
+#ifdef __linux__
+	if (header->mapped) {
+		munmap(header, header->capacity + HEADER_SIZE);
+		return;
+	}
+#endif
+	std::free(header);
+}
+
+void BufferPool::put(void * data) {
+	const size_t capacity = getHeader(data)->capacity;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (idleBytes + capacity <= maxIdleBytes) {
+			idle[getHeader(data)->sizeClass].push_back(data);
+			idleBytes += capacity;
+			return;
+		}
+	}
+	++freedCount;
+	deallocate(data);
+}
+
+BufferPool::Stats BufferPool::takeStats() {
+	Stats stats;
+	stats.acquired = acquiredCount.exchange(0);
+	stats.allocated = allocatedCount.exchange(0);
+	stats.freed = freedCount.exchange(0);
+	std::lock_guard<std::mutex> lock(mtx);
+	stats.idleBytes = idleBytes;
+	return stats;
+}
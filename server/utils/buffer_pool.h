@@ -0,0 +1,128 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/// Size classed pool of large buffers used for image data sent to the client
+/// Every image update needs a few multi-MB buffers (region copy, downscale, packed pixels) for a short time,
+/// the pool keeps them between updates and shares them between all renderers so memory does not grow with the
+/// number of sessions
+/// The serialized message is still allocated by VRayMessage::msgImageSet, taking it from the pool needs a hook
+/// in the wrapper
+class BufferPool {
+public:
+	/// Buffer taken from the pool, returned to it when destroyed
+	class Buffer {
+	public:
+		Buffer(): ptr(nullptr) {}
+		Buffer(Buffer && other): ptr(other.ptr) { other.ptr = nullptr; }
+		Buffer & operator=(Buffer && other);
+		~Buffer() { reset(); }
+
+		Buffer(const Buffer &) = delete;
+		Buffer & operator=(const Buffer &) = delete;
+
+		/// Get the data, nullptr for empty buffer
+		void * data() const { return ptr; }
+
+		/// Get the data as array of @T
+		template <typename T>
+		T * as() const { return static_cast<T*>(ptr); }
+
+		/// Get the usable size in bytes, can be more than requested
+		size_t capacity() const;
+
+		/// Return the data to the pool and make this buffer empty
+		void reset();
+
+		explicit operator bool() const { return ptr != nullptr; }
+
+	private:
+		friend class BufferPool;
+		explicit Buffer(void * ptr): ptr(ptr) {}
+
+		void * ptr; ///< The data, preceded by a BufferPool::Header
+	};
+
+	/// Counters since the last call to @takeStats
+	struct Stats {
+		uint64_t acquired; ///< Number of buffers taken
+		uint64_t allocated; ///< Number of buffers that were not in the pool and had to be allocated
+		uint64_t freed; ///< Number of returned buffers freed because the pool was full
+		size_t idleBytes; ///< Bytes currently kept in the pool
+	};
+
+	/// @maxIdleBytes - max size of unused buffers kept, buffers returned above it are freed
+	explicit BufferPool(size_t maxIdleBytes);
+	~BufferPool();
+
+	BufferPool(const BufferPool &) = delete;
+	BufferPool & operator=(const BufferPool &) = delete;
+
+	/// Get a buffer with at least @bytes capacity
+	/// @return - empty buffer if @bytes is too large or the allocation failed
+	Buffer acquire(size_t bytes);
+
+	/// Make @buffer hold at least @bytes, keeps it as is if it is large enough
+	/// @return - false if no buffer could be taken, @buffer is empty then
+	bool acquire(Buffer & buffer, size_t bytes);
+
+	/// Back buffers of 2MB or more with transparent huge pages, only supported on Linux
+	/// Affects only buffers allocated after the call
+	void setHugePages(bool enable) { hugePages = enable; }
+
+	/// Get the counters and reset them
+	Stats takeStats();
+
+	/// Get the pool shared by all RendererController instances
+	static BufferPool & getInstance();
+
+private:
+	/// Stored at the start of each allocation, the data begins HEADER_SIZE bytes after it
+	struct Header {
+		BufferPool * pool; ///< The owner
+		size_t capacity; ///< Usable bytes after the header
+		int sizeClass; ///< Index in @idle
+		bool mapped; ///< True if allocated with mmap
+	};
+
+	/// Get the smallest size class that fits @bytes, -1 if there is none
+	static int getSizeClass(size_t bytes);
+
+	/// Get the capacity of buffers in @sizeClass
+	static size_t getClassSize(int sizeClass);
+
+	/// Get the header of buffer data
+	static Header * getHeader(void * data) { return reinterpret_cast<Header*>(static_cast<char*>(data) - HEADER_SIZE); }
+
+	/// Allocate new buffer for @sizeClass
+	void * allocate(int sizeClass);
+
+	/// Free the memory of a buffer
+	static void deallocate(void * data);
+
+	/// Put back a buffer taken from this pool
+	void put(void * data);
+
+	/// Space reserved for the Header, keeps the data 64 byte aligned for mapped buffers
+	static const size_t HEADER_SIZE = 64;
+
+	/// Sizes are 64KB * (1 or 1.5) * 2^n, so no more than a third of a buffer is unused
+	static const int CLASS_COUNT = 40;
+
+	std::mutex mtx; ///< Protects @idle and @idleBytes
+	std::vector<void*> idle[CLASS_COUNT]; ///< Unused buffers for each size class
+	size_t idleBytes; ///< Total capacity of the buffers in @idle
+	const size_t maxIdleBytes; ///< Limit for @idleBytes
+	std::atomic<bool> hugePages; ///< Use madvise(MADV_HUGEPAGE) for new buffers
+
+	std::atomic<uint64_t> acquiredCount; ///< For @Stats::acquired
+	std::atomic<uint64_t> allocatedCount; ///< For @Stats::allocated
+	std::atomic<uint64_t> freedCount; ///< For @Stats::freed
+};
+
+#endif // BUFFER_POOL_H
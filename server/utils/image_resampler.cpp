@@ -0,0 +1,92 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "image_resampler.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#define IMAGE_RESAMPLER_SSE
+	#include <xmmintrin.h>
+#endif
+
+void ImageResampler::Axis::build(int newSrcSize, int newDstSize) {
+	if (newSrcSize == srcSize && newDstSize == dstSize) {
+		return;
+	}
+	srcSize = newSrcSize;
+	dstSize = newDstSize;
+	first.resize(dstSize);
+	count.resize(dstSize);
+	offset.resize(dstSize);
+	weights.clear();
+
+	const double scale = static_cast<double>(srcSize) / dstSize;
+	for (int c = 0; c < dstSize; ++c) {
+		const double start = c * scale;
+		const double end = std::min((c + 1) * scale, static_cast<double>(srcSize));
+		const int from = static_cast<int>(start);
+		const int to = std::min(static_cast<int>(std::ceil(end)), srcSize);
+		first[c] = from;
+		count[c] = to - from;
+		offset[c] = static_cast<int>(weights.size());
+		for (int pixel = from; pixel < to; ++pixel) {
+			const double covered = std::min(end, pixel + 1.) - std::max(start, static_cast<double>(pixel));
+			weights.push_back(static_cast<float>(covered / (end - start)));
+		}
+	}
+}
+
+void ImageResampler::resize(const VRay::AColor * src, int srcStride, int width, int height, int dstWidth, int dstHeight, VRay::AColor * dst) {
+	static_assert(sizeof(VRay::AColor) == 4 * sizeof(float), "AColor is expected to be 4 packed floats");
+	dstWidth = std::max(1, std::min(dstWidth, width));
+	dstHeight = std::max(1, std::min(dstHeight, height));
+	horizontal.build(width, dstWidth);
+	vertical.build(height, dstHeight);
+	row.resize(width);
+	float * rowData = reinterpret_cast<float*>(row.data());
+
+	for (int y = 0; y < dstHeight; ++y) {
+		const float * rowWeights = vertical.weights.data() + vertical.offset[y];
+		for (int c = 0; c < vertical.count[y]; ++c) {
+			const float * line = reinterpret_cast<const float*>(src + static_cast<size_t>(vertical.first[y] + c) * srcStride);
+#ifdef IMAGE_RESAMPLER_SSE
+			const __m128 weight = _mm_set1_ps(rowWeights[c]);
+			if (c == 0) {
+				for (int x = 0; x < width; ++x) {
+					_mm_storeu_ps(rowData + x * 4, _mm_mul_ps(_mm_loadu_ps(line + x * 4), weight));
+				}
+			} else {
+				for (int x = 0; x < width; ++x) {
+					const __m128 sum = _mm_loadu_ps(rowData + x * 4);
+					_mm_storeu_ps(rowData + x * 4, _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(line + x * 4), weight)));
+				}
+			}
+#else
+			const float weight = rowWeights[c];
+			for (int x = 0; x < width * 4; ++x) {
+				rowData[x] = (c == 0 ? 0.f : rowData[x]) + line[x] * weight;
+			}
+#endif
+		}
+
+		float * out = reinterpret_cast<float*>(dst + static_cast<size_t>(y) * dstWidth);
+		for (int x = 0; x < dstWidth; ++x) {
+			const float * columnWeights = horizontal.weights.data() + horizontal.offset[x];
+			const float * pixels = rowData + horizontal.first[x] * 4;
+#ifdef IMAGE_RESAMPLER_SSE
+			__m128 sum = _mm_setzero_ps();
+			for (int c = 0; c < horizontal.count[x]; ++c) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pixels + c * 4), _mm_set1_ps(columnWeights[c])));
+			}
+			_mm_storeu_ps(out + x * 4, sum);
+#else
+			float sum[4] = {0.f, 0.f, 0.f, 0.f};
+			for (int c = 0; c < horizontal.count[x]; ++c) {
+				for (int channel = 0; channel < 4; ++channel) {
+					sum[channel] += pixels[c * 4 + channel] * columnWeights[c];
+				}
+			}
+			std::copy(sum, sum + 4, out + x * 4);
+#endif
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef IMAGE_RESAMPLER_H
+#define IMAGE_RESAMPLER_H
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+#include <vraysdk.hpp>
+#include <vector>
+
+/// Shrinks float images with a box filter - each destination pixel is the area weighted average of the
+/// source pixels it covers, so any ratio is supported. The image is processed one destination row at a time,
+/// first summing the covered source rows, then the covered columns; each pixel is a single SSE vector.
+/// Filter weights and the row buffer are kept between calls, so resizing to the same size does not allocate.
+class ImageResampler {
+public:
+	/// Resize @src into @dst, @dstWidth and @dstHeight are clamped to the source size
+	/// @src - first pixel of the image, rows are @srcStride pixels apart
+	/// @width, @height - size of the source image
+	/// @dst - tightly packed result, must have space for @dstWidth * @dstHeight pixels
+	void resize(const VRay::AColor * src, int srcStride, int width, int height, int dstWidth, int dstHeight, VRay::AColor * dst);
+
+private:
+	/// Source pixels and weights for each destination pixel along one axis
+	struct Axis {
+		int srcSize; ///< Size of the source axis the weights are made for
+		int dstSize; ///< Size of the destination axis the weights are made for
+		std::vector<int> first; ///< First covered source pixel for each destination pixel
+		std::vector<int> count; ///< Number of covered source pixels for each destination pixel
+		std::vector<int> offset; ///< Index in @weights of the first weight for each destination pixel
+		std::vector<float> weights; ///< Part of each covered source pixel in the destination pixel, sum to 1
+
+		Axis(): srcSize(0), dstSize(0) {}
+
+		/// Compute the weights, does nothing if they are for the same sizes
+		void build(int srcSize, int dstSize);
+	};
+
+	Axis horizontal; ///< Weights for the columns
+	Axis vertical; ///< Weights for the rows
+	std::vector<VRay::AColor> row; ///< Weighted sum of the source rows for one destination row
+};
+
+#endif // IMAGE_RESAMPLER_H
@@ -0,0 +1,252 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "image_utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#define IMAGE_UTILS_SSE2
+	#include <emmintrin.h>
+#endif
+
+// F16C is not part of the baseline x86-64 target, so it is compiled for separately and selected at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define IMAGE_UTILS_F16C __attribute__((target("f16c")))
+	#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+	#define IMAGE_UTILS_F16C
+	#include <immintrin.h>
+	#include <intrin.h>
+#endif
+
+namespace ImageUtils {
+
+bool Region::clip(int imageWidth, int imageHeight) {
+	const int right = std::min(left + width, imageWidth);
+	const int bottom = std::min(top + height, imageHeight);
+	left = std::max(0, left);
+	top = std::max(0, top);
+	width = std::max(0, right - left);
+	height = std::max(0, bottom - top);
+	return width > 0 && height > 0;
+}
+
+void copyRegion(const VRay::AColor * src, int srcWidth, const Region & region, VRay::AColor * dst) {
+	const size_t rowBytes = region.width * sizeof(VRay::AColor);
+	const VRay::AColor * srcRow = src + static_cast<size_t>(region.top) * srcWidth + region.left;
+	for (int row = 0; row < region.height; ++row) {
+		memcpy(dst, srcRow, rowBytes);
+		dst += region.width;
+		srcRow += srcWidth;
+	}
+}
+
+void pasteRegion(const VRay::AColor * src, const Region & region, VRay::AColor * dst, int dstWidth) {
+	const size_t rowBytes = region.width * sizeof(VRay::AColor);
+	VRay::AColor * dstRow = dst + static_cast<size_t>(region.top) * dstWidth + region.left;
+	for (int row = 0; row < region.height; ++row) {
+		memcpy(dstRow, src, rowBytes);
+		src += region.width;
+		dstRow += dstWidth;
+	}
+}
+
+bool regionDiffers(const VRay::AColor * a, const VRay::AColor * b, int width, const Region & region, float threshold) {
+	static_assert(sizeof(VRay::AColor) == 4 * sizeof(float), "AColor is expected to be 4 packed floats");
+	const size_t offset = static_cast<size_t>(region.top) * width + region.left;
+	const float * rowA = reinterpret_cast<const float*>(a + offset);
+	const float * rowB = reinterpret_cast<const float*>(b + offset);
+	const int rowFloats = region.width * 4;
+	const size_t stride = static_cast<size_t>(width) * 4;
+
+#ifdef IMAGE_UTILS_SSE2
+	// one AColor per iteration: |a - b| > threshold for any channel, sign bit is cleared to get abs
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 limit = _mm_set1_ps(threshold);
+	for (int row = 0; row < region.height; ++row) {
+		__m128 over = _mm_setzero_ps();
+		for (int c = 0; c < rowFloats; c += 4) {
+			const __m128 diff = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(rowA + c), _mm_loadu_ps(rowB + c)), absMask);
+			over = _mm_or_ps(over, _mm_cmpgt_ps(diff, limit));
+		}
+		if (_mm_movemask_ps(over)) {
+			return true;
+		}
+		rowA += stride;
+		rowB += stride;
+	}
+#else
+	for (int row = 0; row < region.height; ++row) {
+		for (int c = 0; c < rowFloats; ++c) {
+			if (std::fabs(rowA[c] - rowB[c]) > threshold) {
+				return true;
+			}
+		}
+		rowA += stride;
+		rowB += stride;
+	}
+#endif
+	return false;
+}
+
+void packChannels(const VRay::AColor * src, size_t count, int channels, float * dst) {
+	const float * values = reinterpret_cast<const float*>(src);
+	if (channels == 1) {
+		for (size_t c = 0; c < count; ++c) {
+			dst[c] = values[c * 4];
+		}
+	} else {
+		for (size_t c = 0; c < count; ++c) {
+			dst[c * 3 + 0] = values[c * 4 + 0];
+			dst[c * 3 + 1] = values[c * 4 + 1];
+			dst[c * 3 + 2] = values[c * 4 + 2];
+		}
+	}
+}
+
+namespace {
+
+/// Scalar float to half conversion with round to nearest even
+uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const uint32_t absBits = bits & 0x7fffffff;
+
+	if (absBits >= 0x7f800000) {
+		// inf or nan, keep nan a nan
+		return static_cast<uint16_t>(sign | 0x7c00 | (absBits > 0x7f800000 ? 0x200 : 0));
+	}
+	if (absBits >= 0x477ff000) {
+		// rounds to more than the max half
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+	if (absBits < 0x38800000) {
+		// denormal half or zero
+		if (absBits < 0x33000000) {
+			return static_cast<uint16_t>(sign);
+		}
+		const uint32_t exponent = absBits >> 23;
+		const uint32_t mantissa = (absBits & 0x7fffff) | 0x800000;
+		const uint32_t shift = 126 - exponent;
+		uint32_t half = mantissa >> shift;
+		const uint32_t rest = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) {
+			++half;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	uint32_t half = ((absBits - 0x38000000) >> 13);
+	const uint32_t rest = absBits & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+		++half;
+	}
+	return static_cast<uint16_t>(sign | half);
+}
+
+#ifdef IMAGE_UTILS_F16C
+bool cpuHasF16C() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 29)) != 0;
+#else
+	return __builtin_cpu_supports("f16c");
+#endif
+}
+
+IMAGE_UTILS_F16C void convertToHalfF16C(const float * src, size_t count, uint16_t * dst) {
+	size_t c = 0;
+	for (; c + 8 <= count; c += 8) {
+		const __m128i lo = _mm_cvtps_ph(_mm_loadu_ps(src + c), _MM_FROUND_TO_NEAREST_INT);
+		const __m128i hi = _mm_cvtps_ph(_mm_loadu_ps(src + c + 4), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), _mm_unpacklo_epi64(lo, hi));
+	}
+	for (; c < count; ++c) {
+		dst[c] = floatToHalf(src[c]);
+	}
+}
+#endif
+
+/// sRGB encoded values for getSrgbTable, built on first use
+struct SrgbTable {
+	uint8_t values[SRGB_TABLE_SIZE];
+
+	SrgbTable() {
+		for (int c = 0; c < SRGB_TABLE_SIZE; ++c) {
+			const float linear = static_cast<float>(c) / (SRGB_TABLE_SIZE - 1);
+			const float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.f / 2.4f) - 0.055f;
+			values[c] = static_cast<uint8_t>(srgb * 255.f + 0.5f);
+		}
+	}
+};
+
+} // namespace
+
+const uint8_t * getSrgbTable() {
+	static const SrgbTable table;
+	return table.values;
+}
+
+void convertToHalf(const VRay::AColor * src, size_t count, uint16_t * dst) {
+	const float * values = reinterpret_cast<const float*>(src);
+	const size_t valueCount = count * 4;
+#ifdef IMAGE_UTILS_F16C
+	static const bool hasF16C = cpuHasF16C();
+	if (hasF16C) {
+		convertToHalfF16C(values, valueCount, dst);
+		return;
+	}
+#endif
+	for (size_t c = 0; c < valueCount; ++c) {
+		dst[c] = floatToHalf(values[c]);
+	}
+}
+
+void convertToSrgb8(const VRay::AColor * src, size_t count, uint8_t * dst) {
+	const uint8_t * table = getSrgbTable();
+	const float * values = reinterpret_cast<const float*>(src);
+
+#ifdef IMAGE_UTILS_SSE2
+	// clamp and scale all 4 channels at once, color goes through the table and alpha is scaled to 255
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 scale = _mm_setr_ps(SRGB_TABLE_SIZE - 1, SRGB_TABLE_SIZE - 1, SRGB_TABLE_SIZE - 1, 255.f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	alignas(16) int32_t idx[4];
+	for (size_t c = 0; c < count; ++c) {
+		// max returns it's second operand for NaN, so NaN ends up as 0
+		const __m128 pixel = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + c * 4), zero), one);
+		_mm_store_si128(reinterpret_cast<__m128i*>(idx), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(pixel, scale), half)));
+		dst[c * 4 + 0] = table[idx[0]];
+		dst[c * 4 + 1] = table[idx[1]];
+		dst[c * 4 + 2] = table[idx[2]];
+		dst[c * 4 + 3] = static_cast<uint8_t>(idx[3]);
+	}
+#else
+	for (size_t c = 0; c < count; ++c) {
+		for (int channel = 0; channel < 4; ++channel) {
+			// written so NaN fails the first test and becomes 0, std::min/max would pass it through
+			const float source = values[c * 4 + channel];
+			const float value = !(source > 0.f) ? 0.f : (source < 1.f ? source : 1.f);
+			if (channel < 3) {
+				dst[c * 4 + channel] = table[static_cast<int>(value * (SRGB_TABLE_SIZE - 1) + 0.5f)];
+			} else {
+				dst[c * 4 + channel] = static_cast<uint8_t>(value * 255.f + 0.5f);
+			}
+		}
+	}
+#endif
+}
+
+void convertToPacked(const VRay::AColor * src, size_t count, VRayBaseTypes::AttrImage::ImageType type, void * dst) {
+	if (type == RGBA_HALF) {
+		convertToHalf(src, count, reinterpret_cast<uint16_t*>(dst));
+	} else if (type == RGBA_SRGB_8) {
+		convertToSrgb8(src, count, reinterpret_cast<uint8_t*>(dst));
+	}
+}
+
+} // namespace ImageUtils
@@ -0,0 +1,99 @@
+#ifndef IMAGE_UTILS_H
+#define IMAGE_UTILS_H
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+#include <vraysdk.hpp>
+#include <base_types.h>
+#include <cstdint>
+
+/// Helpers for preparing image data that is sent to the client
+namespace ImageUtils {
+
+/// Packed image formats for float images, not yet part of VRayBaseTypes::AttrImage::ImageType
+/// Values are chosen well after the wrapper's types and must match the client
+const VRayBaseTypes::AttrImage::ImageType RGBA_HALF = static_cast<VRayBaseTypes::AttrImage::ImageType>(100); ///< 4 x 16 bit IEEE half float
+const VRayBaseTypes::AttrImage::ImageType RGBA_SRGB_8 = static_cast<VRayBaseTypes::AttrImage::ImageType>(101); ///< 4 x 8 bit, sRGB color and linear alpha
+
+/// Check if @type is one of the packed formats above
+inline bool isPackedType(VRayBaseTypes::AttrImage::ImageType type) {
+	return type == RGBA_HALF || type == RGBA_SRGB_8;
+}
+
+/// Get bytes per pixel for one of the packed formats
+inline int packedPixelSize(VRayBaseTypes::AttrImage::ImageType type) {
+	return type == RGBA_HALF ? 4 * sizeof(uint16_t) : 4 * sizeof(uint8_t);
+}
+
+/// Not an image type, render elements requested with it keep the BW_REAL and RGB_REAL types but are sent
+/// with 1 and 3 floats per pixel instead of 4, clients that don't ask for it get the full AColor
+const VRayBaseTypes::AttrImage::ImageType NATIVE_CHANNELS = static_cast<VRayBaseTypes::AttrImage::ImageType>(102);
+
+/// Rectangle inside an image, in pixels
+struct Region {
+	int left;
+	int top;
+	int width;
+	int height;
+
+	Region(): left(0), top(0), width(0), height(0) {}
+	Region(int left, int top, int width, int height): left(left), top(top), width(width), height(height) {}
+
+	/// Get the number of pixels in the region
+	size_t area() const { return static_cast<size_t>(width) * height; }
+
+	/// Check if region covers the full @imageWidth x @imageHeight image
+	bool isFull(int imageWidth, int imageHeight) const {
+		return left == 0 && top == 0 && width == imageWidth && height == imageHeight;
+	}
+
+	/// Clip region to the bounds of @imageWidth x @imageHeight image
+	/// @return - false if there is nothing left after clipping
+	bool clip(int imageWidth, int imageHeight);
+};
+
+/// Copy @region from @src image with @srcWidth pixels per row into @dst which is tightly packed
+/// @dst must have space for at least @region.area() pixels
+void copyRegion(const VRay::AColor * src, int srcWidth, const Region & region, VRay::AColor * dst);
+
+/// Copy tightly packed @src into @region of @dst image with @dstWidth pixels per row
+void pasteRegion(const VRay::AColor * src, const Region & region, VRay::AColor * dst, int dstWidth);
+
+/// Check if @region of two images with the same layout differ
+/// @a, @b - the images, both with @width pixels per row
+/// @threshold - max allowed absolute difference for any channel of any pixel
+/// @return - true if at least one channel differs by more than @threshold
+bool regionDiffers(const VRay::AColor * a, const VRay::AColor * b, int width, const Region & region, float threshold);
+
+/// Copy the first @channels (1 or 3) floats of @count pixels, used to send render elements at their native channel count
+/// @dst must have space for @channels * @count values
+void packChannels(const VRay::AColor * src, size_t count, int channels, float * dst);
+
+/// Number of entries in the table returned by getSrgbTable
+const int SRGB_TABLE_SIZE = 4096;
+
+/// Get the table with 8 bit sRGB encoded values for linear values in [0, 1] split in SRGB_TABLE_SIZE steps
+/// Index it with the clamped value * (SRGB_TABLE_SIZE - 1) rounded to nearest
+const uint8_t * getSrgbTable();
+
+/// Convert @count pixels to 4 x half float, uses F16C when the CPU supports it
+/// @dst must have space for 4 * @count values
+void convertToHalf(const VRay::AColor * src, size_t count, uint16_t * dst);
+
+/// Convert @count pixels to 4 x 8 bit with sRGB curve applied to color, alpha is linear
+/// Values are clamped to [0, 1]
+/// @dst must have space for 4 * @count values
+void convertToSrgb8(const VRay::AColor * src, size_t count, uint8_t * dst);
+
+/// Convert @count pixels to @type (one of the packed formats)
+/// @dst must have space for @count * packedPixelSize(@type) bytes
+void convertToPacked(const VRay::AColor * src, size_t count, VRayBaseTypes::AttrImage::ImageType type, void * dst);
+
+} // namespace ImageUtils
+
+#endif // IMAGE_UTILS_H
@@ -0,0 +1,551 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "jpeg_encoder.h"
+#include "image_utils.h"
+#include "trace_profiler.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#define JPEG_ENCODER_SSE2
+	#include <emmintrin.h>
+	#include <xmmintrin.h>
+#endif
+
+namespace {
+
+/// Maps zigzag position to position in a row major 8x8 block
+const uint8_t zigzagToNatural[64] = {
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+/// Base quantization tables from the JPEG standard (Annex K.1), natural order
+const uint8_t baseQuantY[64] = {
+	16, 11, 10, 16,  24,  40,  51,  61,
+	12, 12, 14, 19,  26,  58,  60,  55,
+	14, 13, 16, 24,  40,  57,  69,  56,
+	14, 17, 22, 29,  51,  87,  80,  62,
+	18, 22, 37, 56,  68, 109, 103,  77,
+	24, 35, 55, 64,  81, 104, 113,  92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103,  99,
+};
+
+const uint8_t baseQuantC[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99,
+	18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99,
+	47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+/// Standard Huffman tables (Annex K.3), code counts per length followed by the values
+const uint8_t dcBitsY[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const uint8_t dcValuesY[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+const uint8_t dcBitsC[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+const uint8_t dcValuesC[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+const uint8_t acBitsY[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+const uint8_t acValuesY[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+	0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa,
+};
+
+const uint8_t acBitsC[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+const uint8_t acValuesC[162] = {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+	0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+	0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+	0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa,
+};
+
+/// Huffman code for each symbol of a table
+struct HuffmanTable {
+	uint16_t code[256];
+	uint8_t length[256];
+
+	HuffmanTable(const uint8_t * bits, const uint8_t * values) {
+		memset(length, 0, sizeof(length));
+		int symbol = 0;
+		uint16_t next = 0;
+		for (int len = 1; len <= 16; ++len) {
+			for (int c = 0; c < bits[len - 1]; ++c) {
+				code[values[symbol]] = next++;
+				length[values[symbol]] = static_cast<uint8_t>(len);
+				++symbol;
+			}
+			next <<= 1;
+		}
+	}
+};
+
+struct HuffmanTables {
+	HuffmanTable dcY, acY, dcC, acC;
+
+	HuffmanTables()
+		: dcY(dcBitsY, dcValuesY)
+		, acY(acBitsY, acValuesY)
+		, dcC(dcBitsC, dcValuesC)
+		, acC(acBitsC, acValuesC)
+	{}
+};
+
+const HuffmanTables & getHuffmanTables() {
+	static const HuffmanTables tables;
+	return tables;
+}
+
+/// Writes bits MSB first, stuffing a zero byte after each 0xFF
+/// @bytes is only grown and keeps its size between uses so it is not cleared on every strip
+class BitWriter {
+public:
+	explicit BitWriter(std::vector<uint8_t> & bytes): bytes(bytes), out(bytes.data()), buffer(0), count(0) {}
+
+	/// Make sure there is space for at least @size more bytes
+	void ensure(size_t size) {
+		const size_t written = out - bytes.data();
+		if (bytes.size() < written + size) {
+			bytes.resize(std::max(bytes.size() * 2, written + size));
+			out = bytes.data() + written;
+		}
+	}
+
+	void write(uint32_t bits, int length) {
+		buffer = (buffer << length) | (bits & ((1u << length) - 1));
+		count += length;
+		if (count >= 32) {
+			emit();
+		}
+	}
+
+	/// Pad the last byte with 1 bits and write all pending bytes
+	void flush() {
+		if (count & 7) {
+			write(0x7F, 8 - (count & 7));
+		}
+		emit();
+	}
+
+	/// Get the number of bytes written so far
+	size_t size() const { return out - bytes.data(); }
+
+private:
+	void emit() {
+		while (count >= 8) {
+			count -= 8;
+			const uint8_t byte = static_cast<uint8_t>(buffer >> count);
+			*out++ = byte;
+			if (byte == 0xFF) {
+				*out++ = 0;
+			}
+		}
+	}
+
+	std::vector<uint8_t> & bytes;
+	uint8_t * out;
+	uint64_t buffer;
+	int count;
+};
+
+/// Upper bound of the bytes written for one MCU: 6 blocks of 64 codes with up to 27 bits each, doubled for byte stuffing
+const size_t MAX_MCU_BYTES = 6 * 64 * 27 / 8 * 2 + 16;
+
+/// Number of bits needed for magnitudes of quantized coefficients and DC differences, which are below 2048
+struct BitLengthTable {
+	uint8_t bits[2048];
+
+	BitLengthTable() {
+		bits[0] = 0;
+		for (int c = 1; c < 2048; ++c) {
+			bits[c] = static_cast<uint8_t>(bits[c / 2] + 1);
+		}
+	}
+};
+
+const BitLengthTable & getBitLengthTable() {
+	static const BitLengthTable table;
+	return table;
+}
+
+/// In place AAN forward DCT of a row or column of 8 values @step apart, the output is scaled by the AAN factors
+inline void dct8(float * d, int step) {
+	float * d0 = d, * d1 = d + step, * d2 = d + step * 2, * d3 = d + step * 3;
+	float * d4 = d + step * 4, * d5 = d + step * 5, * d6 = d + step * 6, * d7 = d + step * 7;
+
+	const float tmp0 = *d0 + *d7, tmp7 = *d0 - *d7;
+	const float tmp1 = *d1 + *d6, tmp6 = *d1 - *d6;
+	const float tmp2 = *d2 + *d5, tmp5 = *d2 - *d5;
+	const float tmp3 = *d3 + *d4, tmp4 = *d3 - *d4;
+
+	// even part
+	float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+	float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+	*d0 = tmp10 + tmp11;
+	*d4 = tmp10 - tmp11;
+	const float z1 = (tmp12 + tmp13) * 0.707106781f;
+	*d2 = tmp13 + z1;
+	*d6 = tmp13 - z1;
+
+	// odd part
+	tmp10 = tmp4 + tmp5;
+	tmp11 = tmp5 + tmp6;
+	tmp12 = tmp6 + tmp7;
+	const float z5 = (tmp10 - tmp12) * 0.382683433f;
+	const float z2 = tmp10 * 0.541196100f + z5;
+	const float z4 = tmp12 * 1.306562965f + z5;
+	const float z3 = tmp11 * 0.707106781f;
+	const float z11 = tmp7 + z3, z13 = tmp7 - z3;
+	*d5 = z13 + z2;
+	*d3 = z13 - z2;
+	*d1 = z11 + z4;
+	*d7 = z11 - z4;
+}
+
+/// Write the magnitude category and the extra bits for @value
+inline void writeValue(BitWriter & writer, const HuffmanTable & table, const uint8_t * bitLength, int symbolRun, int value) {
+	const int magnitude = std::min(value < 0 ? -value : value, 2047);
+	const int bits = bitLength[magnitude];
+	const int symbol = (symbolRun << 4) | bits;
+	// code and extra bits together are at most 27 bits so they are written at once
+	const uint32_t extra = static_cast<uint32_t>(value < 0 ? value - 1 : value) & ((1u << bits) - 1);
+	writer.write((static_cast<uint32_t>(table.code[symbol]) << bits) | extra, table.length[symbol] + bits);
+}
+
+/// Transform, quantize and write a single 8x8 block
+/// @block - level shifted samples, overwritten with DCT coefficients
+/// @return - the quantized DC coefficient
+int encodeBlock(BitWriter & writer, float * block, const float * scale, int prevDC, const HuffmanTable & dcTable, const HuffmanTable & acTable) {
+	for (int row = 0; row < 8; ++row) {
+		dct8(block + row * 8, 1);
+	}
+	for (int col = 0; col < 8; ++col) {
+		dct8(block + col, 8);
+	}
+
+	int quantized[64];
+#ifdef JPEG_ENCODER_SSE2
+	for (int c = 0; c < 64; c += 4) {
+		const __m128 value = _mm_mul_ps(_mm_loadu_ps(block + c), _mm_loadu_ps(scale + c));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(quantized + c), _mm_cvtps_epi32(value));
+	}
+#else
+	for (int c = 0; c < 64; ++c) {
+		const float value = block[c] * scale[c];
+		quantized[c] = static_cast<int>(value < 0 ? value - 0.5f : value + 0.5f);
+	}
+#endif
+	int coefs[64];
+	for (int c = 0; c < 64; ++c) {
+		coefs[c] = quantized[zigzagToNatural[c]];
+	}
+
+	const uint8_t * bitLength = getBitLengthTable().bits;
+	writeValue(writer, dcTable, bitLength, 0, coefs[0] - prevDC);
+
+	int last = 63;
+	while (last > 0 && !coefs[last]) {
+		--last;
+	}
+	int run = 0;
+	for (int c = 1; c <= last; ++c) {
+		if (!coefs[c]) {
+			++run;
+			continue;
+		}
+		while (run >= 16) {
+			// ZRL - 16 zeros
+			writer.write(acTable.code[0xF0], acTable.length[0xF0]);
+			run -= 16;
+		}
+		writeValue(writer, acTable, bitLength, run, coefs[c]);
+		run = 0;
+	}
+	if (last < 63) {
+		writer.write(acTable.code[0], acTable.length[0]);
+	}
+	return coefs[0];
+}
+
+void writeMarker(std::vector<uint8_t> & out, uint8_t marker, int length) {
+	out.push_back(0xFF);
+	out.push_back(marker);
+	out.push_back(static_cast<uint8_t>(length >> 8));
+	out.push_back(static_cast<uint8_t>(length & 0xFF));
+}
+
+void writeHuffman(std::vector<uint8_t> & out, uint8_t classId, const uint8_t * bits, const uint8_t * values) {
+	out.push_back(classId);
+	out.insert(out.end(), bits, bits + 16);
+	int count = 0;
+	for (int c = 0; c < 16; ++c) {
+		count += bits[c];
+	}
+	out.insert(out.end(), values, values + count);
+}
+
+/// Clamp @value to [0, 1] and get it's sRGB encoded value in [0, 255], NaN becomes 0
+inline float toSrgb(const uint8_t * table, float value) {
+	const float clamped = !(value > 0.f) ? 0.f : (value < 1.f ? value : 1.f);
+	return table[static_cast<int>(clamped * (ImageUtils::SRGB_TABLE_SIZE - 1) + 0.5f)];
+}
+
+/// Convert @width RGBA float pixels to level shifted Y, Cb and Cr, repeating the last pixel up to @paddedWidth
+/// Color is linear and is sRGB encoded first, same as the RGBA_SRGB_8 format, alpha is ignored
+void convertRow(const float * src, int width, int paddedWidth, float * y, float * cb, float * cr) {
+	const uint8_t * table = ImageUtils::getSrgbTable();
+	int x = 0;
+#ifdef JPEG_ENCODER_SSE2
+	// clamping and indexing is done 4 pixels at once, only the table lookup is scalar
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 scale = _mm_set1_ps(ImageUtils::SRGB_TABLE_SIZE - 1);
+	const __m128 half = _mm_set1_ps(0.5f);
+	int32_t ri[4], gi[4], bi[4];
+	for (; x + 4 <= width; x += 4) {
+		__m128 r = _mm_loadu_ps(src + x * 4);
+		__m128 g = _mm_loadu_ps(src + x * 4 + 4);
+		__m128 b = _mm_loadu_ps(src + x * 4 + 8);
+		__m128 a = _mm_loadu_ps(src + x * 4 + 12);
+		_MM_TRANSPOSE4_PS(r, g, b, a);
+		// max returns it's second operand for NaN, so NaN ends up as 0
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ri), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(r, zero), one), scale), half)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(gi), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(g, zero), one), scale), half)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(bi), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b, zero), one), scale), half)));
+		r = _mm_setr_ps(table[ri[0]], table[ri[1]], table[ri[2]], table[ri[3]]);
+		g = _mm_setr_ps(table[gi[0]], table[gi[1]], table[gi[2]], table[gi[3]]);
+		b = _mm_setr_ps(table[bi[0]], table[bi[1]], table[bi[2]], table[bi[3]]);
+		const __m128 luma = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.299f)), _mm_mul_ps(g, _mm_set1_ps(0.587f))), _mm_mul_ps(b, _mm_set1_ps(0.114f)));
+		_mm_storeu_ps(y + x, _mm_sub_ps(luma, _mm_set1_ps(128.f)));
+		_mm_storeu_ps(cb + x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(-0.168736f)), _mm_mul_ps(g, _mm_set1_ps(-0.331264f))), _mm_mul_ps(b, _mm_set1_ps(0.5f))));
+		_mm_storeu_ps(cr + x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.5f)), _mm_mul_ps(g, _mm_set1_ps(-0.418688f))), _mm_mul_ps(b, _mm_set1_ps(-0.081312f))));
+	}
+#endif
+	for (; x < width; ++x) {
+		const float * pixel = src + x * 4;
+		const float r = toSrgb(table, pixel[0]);
+		const float g = toSrgb(table, pixel[1]);
+		const float b = toSrgb(table, pixel[2]);
+		y[x] = 0.299f * r + 0.587f * g + 0.114f * b - 128.f;
+		cb[x] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+		cr[x] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+	}
+	std::fill(y + width, y + paddedWidth, y[width - 1]);
+	std::fill(cb + width, cb + paddedWidth, cb[width - 1]);
+	std::fill(cr + width, cr + paddedWidth, cr[width - 1]);
+}
+
+/// Average 2x2 pixels of two consecutive rows with @width values each into a single row of half the width
+void downsampleRows(const float * src, int width, float * dst) {
+	const float * next = src + width;
+	for (int x = 0; x < width / 2; ++x) {
+		dst[x] = 0.25f * (src[x * 2] + src[x * 2 + 1] + next[x * 2] + next[x * 2 + 1]);
+	}
+}
+
+} // namespace
+
+JpegEncoder::JpegEncoder(TaskPool & pool)
+	: pool(pool)
+	, quality(-1)
+	, source(nullptr)
+	, sourceStride(0)
+	, width(0)
+	, height(0)
+	, mcuColumns(0)
+	, mcuRows(0)
+	, mcuRowsPerStrip(0)
+	, stripCount(0)
+{}
+
+void JpegEncoder::setQuality(int newQuality) {
+	newQuality = std::max(1, std::min(100, newQuality));
+	if (newQuality == quality) {
+		return;
+	}
+	quality = newQuality;
+
+	// same scaling as libjpeg's jpeg_quality_scaling
+	const int percent = quality < 50 ? 5000 / quality : 200 - quality * 2;
+	const float aanScale[8] = {1.f, 1.387039845f, 1.306562965f, 1.175875602f, 1.f, 0.785694958f, 0.541196100f, 0.275899379f};
+
+	for (int c = 0; c < 64; ++c) {
+		const int pos = zigzagToNatural[c];
+		quantY[c] = static_cast<uint8_t>(std::max(1, std::min(255, (baseQuantY[pos] * percent + 50) / 100)));
+		quantC[c] = static_cast<uint8_t>(std::max(1, std::min(255, (baseQuantC[pos] * percent + 50) / 100)));
+
+		const float aan = aanScale[pos / 8] * aanScale[pos % 8] * 8.f;
+		scaleY[pos] = 1.f / (quantY[c] * aan);
+		scaleC[pos] = 1.f / (quantC[c] * aan);
+	}
+}
+
+bool JpegEncoder::encode(const VRay::AColor * data, int stride, int imageWidth, int imageHeight, int imageQuality) {
+	static_assert(sizeof(VRay::AColor) == 4 * sizeof(float), "AColor is expected to be 4 packed floats");
+	TRACE_ZONE("JpegEncoder::encode");
+	if (imageWidth <= 0 || imageHeight <= 0 || imageWidth > 0xFFFF || imageHeight > 0xFFFF || stride < imageWidth) {
+		return false;
+	}
+
+	setQuality(imageQuality);
+	source = data;
+	sourceStride = stride;
+	width = imageWidth;
+	height = imageHeight;
+	mcuColumns = (width + 15) / 16;
+	mcuRows = (height + 15) / 16;
+
+	// few strips per thread so a slow one does not hold the rest, the restart interval is limited to 16 bits
+	const int targetStrips = pool.getConcurrency() > 1 ? pool.getConcurrency() * 4 : 1;
+	mcuRowsPerStrip = std::max(1, (mcuRows + targetStrips - 1) / targetStrips);
+	mcuRowsPerStrip = std::min(mcuRowsPerStrip, std::max(1, 0xFFFF / mcuColumns));
+	stripCount = (mcuRows + mcuRowsPerStrip - 1) / mcuRowsPerStrip;
+	if (stripCount > 1 && mcuColumns * mcuRowsPerStrip > 0xFFFF) {
+		// a single MCU row does not fit in the restart interval
+		stripCount = 1;
+		mcuRowsPerStrip = mcuRows;
+	}
+
+	if (static_cast<int>(strips.size()) < stripCount) {
+		strips.resize(stripCount);
+	}
+
+	pool.parallelFor(stripCount, [this](int index) {
+		encodeStrip(index);
+	});
+
+	size_t total = 0;
+	for (int c = 0; c < stripCount; ++c) {
+		total += strips[c].length + 2;
+	}
+
+	output.clear();
+	output.reserve(total + 1024);
+	writeHeader();
+	for (int c = 0; c < stripCount; ++c) {
+		output.insert(output.end(), strips[c].bytes.begin(), strips[c].bytes.begin() + strips[c].length);
+		if (c + 1 < stripCount) {
+			output.push_back(0xFF);
+			output.push_back(static_cast<uint8_t>(0xD0 + (c & 7)));
+		}
+	}
+	output.push_back(0xFF);
+	output.push_back(0xD9);
+	return true;
+}
+
+void JpegEncoder::writeHeader() {
+	static const uint8_t soiApp0[] = {
+		0xFF, 0xD8, // SOI
+		0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+	};
+	output.insert(output.end(), soiApp0, soiApp0 + sizeof(soiApp0));
+
+	writeMarker(output, 0xDB, 2 + 2 * 65);
+	output.push_back(0x00);
+	output.insert(output.end(), quantY, quantY + 64);
+	output.push_back(0x01);
+	output.insert(output.end(), quantC, quantC + 64);
+
+	// 3 components, Y is 2x2 sampled, Cb and Cr 1x1 with the chroma table
+	writeMarker(output, 0xC0, 17);
+	const uint8_t frame[] = {
+		8,
+		static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height & 0xFF),
+		static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width & 0xFF),
+		3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1,
+	};
+	output.insert(output.end(), frame, frame + sizeof(frame));
+
+	writeMarker(output, 0xC4, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+	writeHuffman(output, 0x00, dcBitsY, dcValuesY);
+	writeHuffman(output, 0x10, acBitsY, acValuesY);
+	writeHuffman(output, 0x01, dcBitsC, dcValuesC);
+	writeHuffman(output, 0x11, acBitsC, acValuesC);
+
+	if (stripCount > 1) {
+		const int interval = mcuColumns * mcuRowsPerStrip;
+		writeMarker(output, 0xDD, 4);
+		output.push_back(static_cast<uint8_t>(interval >> 8));
+		output.push_back(static_cast<uint8_t>(interval & 0xFF));
+	}
+
+	writeMarker(output, 0xDA, 12);
+	const uint8_t scan[] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+	output.insert(output.end(), scan, scan + sizeof(scan));
+}
+
+void JpegEncoder::encodeStrip(int index) {
+	TRACE_ZONE("JpegEncoder::encodeStrip");
+	const HuffmanTables & tables = getHuffmanTables();
+	Strip & strip = strips[index];
+	const int planeWidth = mcuColumns * 16;
+	const int chromaWidth = mcuColumns * 8;
+	strip.planeY.resize(planeWidth * 16);
+	strip.rowCb.resize(planeWidth * 2);
+	strip.rowCr.resize(planeWidth * 2);
+	strip.planeCb.resize(chromaWidth * 8);
+	strip.planeCr.resize(chromaWidth * 8);
+
+	BitWriter writer(strip.bytes);
+	int prevY = 0, prevCb = 0, prevCr = 0;
+	float block[64];
+
+	const int firstRow = index * mcuRowsPerStrip;
+	const int lastRow = std::min(mcuRows, firstRow + mcuRowsPerStrip);
+	for (int mcuRow = firstRow; mcuRow < lastRow; ++mcuRow) {
+		// convert 16 rows to YCbCr, edges are padded by repeating the last row and column
+		for (int y = 0; y < 16; ++y) {
+			const int srcY = std::min(mcuRow * 16 + y, height - 1);
+			const float * src = reinterpret_cast<const float*>(source + static_cast<size_t>(srcY) * sourceStride);
+			const int pair = (y & 1) * planeWidth;
+			convertRow(src, width, planeWidth, strip.planeY.data() + y * planeWidth, strip.rowCb.data() + pair, strip.rowCr.data() + pair);
+			if (y & 1) {
+				downsampleRows(strip.rowCb.data(), planeWidth, strip.planeCb.data() + (y / 2) * chromaWidth);
+				downsampleRows(strip.rowCr.data(), planeWidth, strip.planeCr.data() + (y / 2) * chromaWidth);
+			}
+		}
+
+		for (int mcu = 0; mcu < mcuColumns; ++mcu) {
+			writer.ensure(MAX_MCU_BYTES);
+			for (int part = 0; part < 4; ++part) {
+				const float * src = strip.planeY.data() + (part / 2) * 8 * planeWidth + mcu * 16 + (part % 2) * 8;
+				for (int y = 0; y < 8; ++y) {
+					memcpy(block + y * 8, src + y * planeWidth, 8 * sizeof(float));
+				}
+				prevY = encodeBlock(writer, block, scaleY, prevY, tables.dcY, tables.acY);
+			}
+			for (int y = 0; y < 8; ++y) {
+				memcpy(block + y * 8, strip.planeCb.data() + y * chromaWidth + mcu * 8, 8 * sizeof(float));
+			}
+			prevCb = encodeBlock(writer, block, scaleC, prevCb, tables.dcC, tables.acC);
+			for (int y = 0; y < 8; ++y) {
+				memcpy(block + y * 8, strip.planeCr.data() + y * chromaWidth + mcu * 8, 8 * sizeof(float));
+			}
+			prevCr = encodeBlock(writer, block, scaleC, prevCr, tables.dcC, tables.acC);
+		}
+	}
+	writer.ensure(16);
+	writer.flush();
+	strip.length = writer.size();
+}
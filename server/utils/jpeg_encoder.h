@@ -0,0 +1,87 @@
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+#include <vraysdk.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "task_pool.h"
+
+/// Baseline JPEG encoder (YCbCr 4:2:0, standard Huffman tables) for float images
+/// The image is split into horizontal strips that are encoded in parallel, strips are
+/// separated with restart markers so their entropy coded data can be concatenated as is
+/// All buffers are kept between calls so encoding the same size image does not allocate
+class JpegEncoder {
+public:
+	/// Create encoder that runs strips on @pool
+	explicit JpegEncoder(TaskPool & pool = TaskPool::getInstance());
+
+	/// Encode an image, values are linear and are clamped to [0, 1] and sRGB encoded to 8 bit like ImageUtils::RGBA_SRGB_8
+	/// @data - first pixel of the image
+	/// @stride - number of pixels between the start of two rows in @data, can be more than @width to encode part of an image
+	/// @width, @height - size of the encoded image, at most 65535
+	/// @quality - in [1, 100], same scale as libjpeg
+	/// @return - false if the size is not valid
+	bool encode(const VRay::AColor * data, int stride, int width, int height, int quality);
+
+	/// Get the result of the last @encode
+	const uint8_t * getData() const { return output.data(); }
+
+	/// Get the size in bytes of the result of the last @encode
+	size_t getSize() const { return output.size(); }
+
+	/// Get the number of strips used by the last @encode
+	int getStripCount() const { return stripCount; }
+
+private:
+	/// Work buffers and output of one strip, each strip is encoded by a single thread
+	struct Strip {
+		std::vector<float> planeY; ///< 16 rows of luma for the current MCU row
+		std::vector<float> rowCb; ///< 2 rows of full resolution Cb, downsampled into @planeCb
+		std::vector<float> rowCr; ///< 2 rows of full resolution Cr, downsampled into @planeCr
+		std::vector<float> planeCb; ///< 8 rows of subsampled Cb for the current MCU row
+		std::vector<float> planeCr; ///< 8 rows of subsampled Cr for the current MCU row
+		std::vector<uint8_t> bytes; ///< Entropy coded data, byte stuffed and padded to a byte boundary
+		size_t length; ///< Number of used bytes in @bytes, which only grows between frames
+
+		Strip(): length(0) {}
+	};
+
+	/// Build the quantization tables for @quality if it changed
+	void setQuality(int quality);
+
+	/// Encode MCU rows of strip @index into its @Strip::bytes
+	void encodeStrip(int index);
+
+	/// Write all markers preceding the scan data into @output
+	void writeHeader();
+
+	TaskPool & pool; ///< Runs the strips
+
+	int quality; ///< Quality of the current tables
+	uint8_t quantY[64]; ///< Luma quantization table in zigzag order, as written in the file
+	uint8_t quantC[64]; ///< Chroma quantization table in zigzag order, as written in the file
+	float scaleY[64]; ///< Combined DCT scale and luma quantization in natural order
+	float scaleC[64]; ///< Combined DCT scale and chroma quantization in natural order
+
+	const VRay::AColor * source; ///< Image passed to the current @encode
+	int sourceStride; ///< Stride passed to the current @encode
+	int width; ///< Width of the current image
+	int height; ///< Height of the current image
+	int mcuColumns; ///< Number of 16x16 MCUs in a row
+	int mcuRows; ///< Number of MCU rows
+	int mcuRowsPerStrip; ///< MCU rows encoded by one strip, the last one can have less
+	int stripCount; ///< Number of strips for the current image
+
+	std::vector<Strip> strips; ///< Per strip state, kept between frames
+	std::vector<uint8_t> output; ///< The encoded file, kept between frames
+};
+
+#endif // JPEG_ENCODER_H
@@ -0,0 +1,84 @@
+#include "latency_histogram.h"
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+namespace {
+/// Get the bucket for @ns, the number of bits needed to represent it
+int getBucket(uint64_t ns) {
+	if (!ns) {
+		return 0;
+	}
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, ns);
+	const int bits = static_cast<int>(index) + 1;
+#else
+	const int bits = 64 - __builtin_clzll(ns);
+#endif
+	return bits < LatencyHistogram::BUCKET_COUNT ? bits : LatencyHistogram::BUCKET_COUNT - 1;
+}
+}
+
+LatencyHistogram::Snapshot::Snapshot()
+	: count(0)
+	, totalNs(0)
+	, maxNs(0)
+	, buckets()
+{}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot & other) {
+	count += other.count;
+	totalNs += other.totalNs;
+	maxNs = maxNs > other.maxNs ? maxNs : other.maxNs;
+	for (int c = 0; c < BUCKET_COUNT; ++c) {
+		buckets[c] += other.buckets[c];
+	}
+}
+
+uint64_t LatencyHistogram::Snapshot::percentileNs(double fraction) const {
+	if (!count) {
+		return 0;
+	}
+	const double target = fraction * count;
+	uint64_t seen = 0;
+	for (int c = 0; c < BUCKET_COUNT; ++c) {
+		seen += buckets[c];
+		if (seen >= target && buckets[c]) {
+			const uint64_t upper = c ? (uint64_t(1) << c) - 1 : 0;
+			return upper < maxNs ? upper : maxNs;
+		}
+	}
+	return maxNs;
+}
+
+LatencyHistogram::LatencyHistogram()
+	: count(0)
+	, totalNs(0)
+	, maxNs(0)
+{
+	for (int c = 0; c < BUCKET_COUNT; ++c) {
+		buckets[c].store(0, std::memory_order_relaxed);
+	}
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+	buckets[getBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	totalNs.fetch_add(ns, std::memory_order_relaxed);
+	uint64_t longest = maxNs.load(std::memory_order_relaxed);
+	while (ns > longest && !maxNs.compare_exchange_weak(longest, ns, std::memory_order_relaxed)) {}
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::take() {
+	// not a consistent cut while other threads record, which is fine for stats
+	Snapshot snapshot;
+	snapshot.count = count.exchange(0, std::memory_order_relaxed);
+	snapshot.totalNs = totalNs.exchange(0, std::memory_order_relaxed);
+	snapshot.maxNs = maxNs.exchange(0, std::memory_order_relaxed);
+	for (int c = 0; c < BUCKET_COUNT; ++c) {
+		snapshot.buckets[c] = buckets[c].exchange(0, std::memory_order_relaxed);
+	}
+	return snapshot;
+}
@@ -0,0 +1,53 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+/// Lock free histogram of durations in nanoseconds, for the periodic stats output
+/// Bucket i counts durations in [2^(i-1), 2^i), so percentiles are known within a factor of 2 which is
+/// enough to tell a 10us call from a 1ms one. Recording is a few relaxed atomic adds.
+class LatencyHistogram {
+public:
+	/// Number of buckets, the last one also counts everything longer than ~4.5 minutes
+	static const int BUCKET_COUNT = 40;
+
+	/// Copy of the histogram taken by @take
+	struct Snapshot {
+		uint64_t count; ///< Recorded durations
+		uint64_t totalNs; ///< Sum of the recorded durations
+		uint64_t maxNs; ///< Longest recorded duration
+		uint64_t buckets[BUCKET_COUNT]; ///< Durations in each bucket
+
+		Snapshot();
+
+		/// Add the durations of @other to this
+		void merge(const Snapshot & other);
+
+		/// Get upper bound of the duration @fraction of the recorded ones are shorter than, capped at @maxNs
+		/// @fraction - in [0, 1], for example 0.99 for the 99th percentile
+		uint64_t percentileNs(double fraction) const;
+
+		/// Get the average duration, 0 if nothing was recorded
+		double averageNs() const { return count ? static_cast<double>(totalNs) / count : 0.; }
+	};
+
+	LatencyHistogram();
+
+	LatencyHistogram(const LatencyHistogram &) = delete;
+	LatencyHistogram & operator=(const LatencyHistogram &) = delete;
+
+	/// Add one duration, safe to call from any thread
+	void record(uint64_t ns);
+
+	/// Get the durations recorded since the last call and reset the histogram
+	Snapshot take();
+
+private:
+	std::atomic<uint64_t> buckets[BUCKET_COUNT]; ///< Durations in each bucket
+	std::atomic<uint64_t> count; ///< See Snapshot::count
+	std::atomic<uint64_t> totalNs; ///< See Snapshot::totalNs
+	std::atomic<uint64_t> maxNs; ///< See Snapshot::maxNs
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -1,8 +1,53 @@
 #include "logger.h"
 #include <algorithm>
 
+namespace {
+/// True while the calling thread's staging stream is formatting a message
+thread_local bool stagingBusy = false;
+
+std::stringstream & getThreadStream() {
+	thread_local std::stringstream stream("", std::ios_base::ate | std::ios_base::in | std::ios_base::out);
+	return stream;
+}
+}
+
+std::atomic<int> Logger::enabledLevel(Logger::Debug);
+
+Logger::StagingStream::StagingStream()
+	: stream(nullptr)
+{
+	if (stagingBusy) {
+		own.reset(new std::stringstream("", std::ios_base::ate | std::ios_base::in | std::ios_base::out));
+		stream = own.get();
+		return;
+	}
+	stagingBusy = true;
+	stream = &getThreadStream();
+	// empty it and undo any manipulators the previous message used
+	stream->str(std::string());
+	stream->clear();
+	stream->flags(std::ios_base::skipws | std::ios_base::dec);
+	stream->precision(6);
+	stream->width(0);
+	stream->fill(' ');
+}
+
+Logger::StagingStream::~StagingStream() {
+	if (!own) {
+		stagingBusy = false;
+	}
+}
+
 Logger::Logger()
-	: currentLevel(Debug) {}
+	: isBuffered(false)
+	, currentLevel(Debug) {}
+
+void Logger::setCurrentlevel(Logger::Level lvl) {
+	currentLevel = lvl;
+	if (this == &getInstance()) {
+		enabledLevel.store(lvl, std::memory_order_relaxed);
+	}
+}
 
 void Logger::setCallback(Logger::StringCb cb) {
 	msgCallback = cb;
@@ -10,16 +55,15 @@ void Logger::setCallback(Logger::StringCb cb) {
 
 /// Base case for the logImpl - calls the callback with the generated string and Level
 void Logger::logImpl(Logger::Level lvl, std::stringstream & stream) {
-	if (lvl == APIDump && currentLevel != APIDump) {
-		return;
-	}
 	auto msg = stream.str();
 	// just hack replace all slashes to fix paths
 	std::replace(msg.begin(), msg.end(), '\\', '/');
 	if (isBuffered) {
 		bufferedMessages.push_back(std::make_pair(lvl, msg));
 	} else {
-		msgCallback(lvl, msg);
+		if (msgCallback) {
+			msgCallback(lvl, msg);
+		}
 	}
 }
 
@@ -1,7 +1,9 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <sstream>
 #include <string>
 
@@ -15,6 +17,23 @@
 #include <vraysdk.hpp>
 #include <base_types.h>
 
+/// Messages with Logger::Level below this are compiled out of LOGGER_LOG, 0 keeps all of them
+/// Release builds set it to Logger::Profile to strip the APIDump and Info messages from the hot loops
+#ifndef LOGGER_MIN_LEVEL
+	#define LOGGER_MIN_LEVEL 0
+#endif
+
+/// Log message with the global Logger, arguments are not evaluated if @lvl is disabled
+/// Disabled levels cost one branch at runtime and no code at all below LOGGER_MIN_LEVEL
+/// @lvl - Logger::Level of the message
+/// @... - parts of the message, same as Logger::log
+#define LOGGER_LOG(lvl, ...) \
+	do { \
+		if (Logger::isEnabled(lvl)) { \
+			Logger::getInstance().write(lvl, __VA_ARGS__); \
+		} \
+	} while (0)
+
 namespace LoggerFormat {
 
 
@@ -172,29 +191,47 @@ public:
 
 	/// Set current level - used to filter Level::Info if not required
 	/// @lvl - the desiered Level
-	void setCurrentlevel(Level lvl) { currentLevel = lvl; }
+	void setCurrentlevel(Level lvl);
 
 	/// Return the current log level
 	Level getCurrentLevel() const { return currentLevel; }
 
+	/// Check if messages with @lvl are logged by the global instance
+	/// Does not call @getInstance so LOGGER_LOG is a single load and compare for disabled levels
+	static bool isEnabled(Level lvl) {
+		return lvl >= LOGGER_MIN_LEVEL && lvl >= enabledLevel.load(std::memory_order_relaxed);
+	}
+
 	/// Multiple argument function used to conviniently join different type of arguments in one message
+	/// @instance - the logger to write to, can be one made with @makeBuffered
 	/// @lvl - the level for this particular log message
 	/// @rest ... - parts of the message
 	template <typename ... R>
 	static void log(Logger & instance, Level lvl, const R & ... rest) {
-		if (lvl >= getInstance().currentLevel) {
-			std::stringstream stream("", std::ios_base::ate | std::ios_base::in | std::ios_base::out);
-			getInstance().logImpl(lvl, stream, rest...);
+		if (lvl >= LOGGER_MIN_LEVEL && lvl >= instance.currentLevel) {
+			instance.write(lvl, rest...);
 		}
 	}
 
 
 	/// Multiple argument function used to conviniently join different type of arguments in one message
+	/// Prefer LOGGER_LOG in hot code, this evaluates all arguments even if @lvl is disabled
 	/// @lvl - the level for this particular log message
 	/// @rest ... - parts of the message
 	template <typename ... R>
 	static void log(Level lvl, const R & ... rest) {
-		Logger::log(getInstance(), lvl, rest...);
+		if (isEnabled(lvl)) {
+			getInstance().write(lvl, rest...);
+		}
+	}
+
+	/// Format and output message without checking the level, used by LOGGER_LOG after @isEnabled
+	/// @lvl - the level for this particular log message
+	/// @rest ... - parts of the message
+	template <typename ... R>
+	void write(Level lvl, const R & ... rest) {
+		StagingStream staging;
+		logImpl(lvl, staging.get(), rest...);
 	}
 
 
@@ -218,16 +255,31 @@ public:
 private:
 	Logger();
 
+	/// Formatting stream of the calling thread, kept between messages so a message does not construct a stream
+	/// A message logged while the thread's stream is in use, from the callback for example, gets a stream of it's own
+	class StagingStream {
+	public:
+		StagingStream();
+		~StagingStream();
+
+		StagingStream(const StagingStream &) = delete;
+		StagingStream & operator=(const StagingStream &) = delete;
+
+		/// Get the empty stream with default formatting
+		std::stringstream & get() { return *stream; }
+	private:
+		std::stringstream * stream; ///< The thread's stream or @own
+		std::unique_ptr<std::stringstream> own; ///< Used when the thread's stream is busy
+	};
+
 	/// Implementation of Logger::log without any copies of it's arguments
 	template <typename T, typename ... R>
 	void logImpl(Level lvl, std::stringstream & stream, const T & val, const R & ... rest) {
-		if (lvl >= currentLevel) {
-			if (lvl != APIDump) {
-				stream << ' ';
-			}
-			LoggerFormat::hookFormat(stream, val);
-			logImpl(lvl, stream, rest...);
+		if (lvl != APIDump) {
+			stream << ' ';
 		}
+		LoggerFormat::hookFormat(stream, val);
+		logImpl(lvl, stream, rest...);
 	}
 
 	/// Base case for logImpl
@@ -237,6 +289,8 @@ private:
 	std::vector<std::pair<Level, std::string>> bufferedMessages; ///< Serves as alternative destination for messages (instead of callback)
 	Level currentLevel; ///< Current log Level
 	StringCb msgCallback; ///< Current callback
+
+	static std::atomic<int> enabledLevel; ///< Current level of the global instance, checked by @isEnabled
 };
 
 
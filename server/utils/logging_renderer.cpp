@@ -0,0 +1,75 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "logging_renderer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace {
+/// Max number of distinct method name pointers, the wrapper has less than 200 LOG calls
+const size_t SLOT_COUNT = 512;
+
+/// Histogram of one method name
+struct Slot {
+	std::atomic<const char *> name; ///< The name pointer, set once
+	LatencyHistogram histogram; ///< Durations of the method's calls
+};
+
+/// Open addressing table keyed by name pointer, slots are only ever added
+Slot slots[SLOT_COUNT];
+
+/// Used for calls after the table is full
+LatencyHistogram overflow;
+}
+
+LatencyHistogram & TimingLogger::getHistogram(const char * name) {
+	size_t index = (reinterpret_cast<uintptr_t>(name) >> 3) % SLOT_COUNT;
+	for (size_t probe = 0; probe < SLOT_COUNT; ++probe) {
+		Slot & slot = slots[index];
+		const char * current = slot.name.load(std::memory_order_acquire);
+		if (current == name) {
+			return slot.histogram;
+		}
+		if (!current && slot.name.compare_exchange_strong(current, name, std::memory_order_acq_rel)) {
+			return slot.histogram;
+		}
+		if (current == name) {
+			// another thread added the same name first
+			return slot.histogram;
+		}
+		index = (index + 1) % SLOT_COUNT;
+	}
+	return overflow;
+}
+
+void TimingLogger::report() {
+	// the same name can be in several slots when the compiler did not merge the string literals
+	std::map<std::string, LatencyHistogram::Snapshot> methods;
+	for (Slot & slot : slots) {
+		const char * name = slot.name.load(std::memory_order_acquire);
+		if (name) {
+			const LatencyHistogram::Snapshot snapshot = slot.histogram.take();
+			if (snapshot.count) {
+				methods[name].merge(snapshot);
+			}
+		}
+	}
+	const LatencyHistogram::Snapshot other = overflow.take();
+	if (other.count) {
+		methods["(other)"].merge(other);
+	}
+	if (methods.empty()) {
+		return;
+	}
+
+	std::vector<std::pair<std::string, LatencyHistogram::Snapshot>> sorted(methods.begin(), methods.end());
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, LatencyHistogram::Snapshot> & left, const std::pair<std::string, LatencyHistogram::Snapshot> & right) {
+		return left.second.totalNs > right.second.totalNs;
+	});
+	for (const auto & method : sorted) {
+		const LatencyHistogram::Snapshot & stats = method.second;
+		LOGGER_LOG(Logger::Debug, "AppSDK", method.first + ":", stats.count, "calls,", stats.totalNs / 1000, "us total, avg", stats.averageNs() / 1000.,
+			"us, p50 <", stats.percentileNs(0.5) / 1000., "us, p99 <", stats.percentileNs(0.99) / 1000., "us, max", stats.maxNs / 1000., "us");
+	}
+}
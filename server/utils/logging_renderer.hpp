@@ -12,10 +12,147 @@
 
 #include <vraysdk.hpp>
 
-struct NullLogger;
-struct StreamLogger;
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+#include "logger.h"
+#include "latency_histogram.h"
+
+/// Policies for LoggingVRayRenderer, each has a Scope that lives for the duration of one wrapped call
+/// and a static report() called with the periodic stats
+
+/// Does nothing, the wrapper compiles to plain VRayRenderer calls
+struct NullLogger {
+	struct Scope {
+		template <typename ... Args>
+		explicit Scope(const char *, const Args & ...) {}
+	};
+
+	static void report() {}
+};
+
+namespace LoggingRendererArgs {
+/// Argument categories that can be printed
+enum class Kind { String, Number, Enum, Other };
+
+template <typename T>
+struct KindOf {
+	static const Kind value =
+		std::is_convertible<const T &, std::string>::value ? Kind::String :
+		std::is_arithmetic<T>::value ? Kind::Number :
+		std::is_enum<T>::value ? Kind::Enum : Kind::Other;
+};
+
+inline const char * toText(const char * arg) {
+	return arg ? arg : "(null)";
+}
+
+inline const std::string & toText(const std::string & arg) {
+	return arg;
+}
+
+template <typename T>
+void write(std::ostream & out, const T & arg, std::integral_constant<Kind, Kind::String>) {
+	out << '"' << toText(arg) << '"';
+}
+
+template <typename T>
+void write(std::ostream & out, const T & arg, std::integral_constant<Kind, Kind::Number>) {
+	out << arg;
+}
+
+template <typename T>
+void write(std::ostream & out, const T & arg, std::integral_constant<Kind, Kind::Enum>) {
+	out << static_cast<long long>(arg);
+}
+
+template <typename T>
+void write(std::ostream & out, const T &, std::integral_constant<Kind, Kind::Other>) {
+	out << '?';
+}
+
+inline void writeAll(std::ostream &) {}
+
+template <typename T, typename ... Rest>
+void writeAll(std::ostream & out, const T & arg, const Rest & ... rest) {
+	write(out, arg, std::integral_constant<Kind, KindOf<T>::value>());
+	if (sizeof...(rest)) {
+		out << ", ";
+	}
+	writeAll(out, rest...);
+}
+}
+
+/// Logs each call with it's arguments and duration as Logger::Debug, arguments that are not strings,
+/// numbers or enums are printed as ?
+struct StreamLogger {
+	class Scope {
+	public:
+		template <typename ... Args>
+		explicit Scope(const char * name, const Args & ... args)
+			: enabled(Logger::isEnabled(Logger::Debug))
+		{
+			if (enabled) {
+				std::ostringstream out;
+				out << name << '(';
+				LoggingRendererArgs::writeAll(out, args...);
+				out << ')';
+				call = out.str();
+				start = std::chrono::high_resolution_clock::now();
+			}
+		}
+
+		~Scope() {
+			if (enabled) {
+				const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+				LOGGER_LOG(Logger::Debug, "AppSDK", call, elapsed, "us");
+			}
+		}
+
+		Scope(const Scope &) = delete;
+		Scope & operator=(const Scope &) = delete;
+	private:
+		bool enabled; ///< Debug logging was enabled when the call started
+		std::string call; ///< The formatted call
+		std::chrono::high_resolution_clock::time_point start; ///< When the call started
+	};
+
+	static void report() {}
+};
+
+/// Records a latency histogram for each wrapped method, @report logs and resets them
+struct TimingLogger {
+	class Scope {
+	public:
+		template <typename ... Args>
+		explicit Scope(const char * name, const Args & ...)
+			: histogram(getHistogram(name))
+			, start(std::chrono::high_resolution_clock::now())
+		{}
+
+		~Scope() {
+			histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count());
+		}
+
+		Scope(const Scope &) = delete;
+		Scope & operator=(const Scope &) = delete;
+	private:
+		LatencyHistogram & histogram; ///< Histogram of the method
+		std::chrono::high_resolution_clock::time_point start; ///< When the call started
+	};
+
+	/// Get the histogram for method @name, lock free after the first call with the same @name pointer
+	static LatencyHistogram & getHistogram(const char * name);
+
+	/// Log the histograms of the methods called since the last report, slowest total first, and reset them
+	static void report();
+};
+
+/// Wraps the call in a scope of the policy, the call is timed until the wrapper method returns
+#define LOG(...) typename LogType::Scope logScope(__VA_ARGS__)
 
-#define LOG()
 namespace VRay
 {
 template <typename LogType = NullLogger>
@@ -26,6 +163,11 @@ public:
 	using BaseClass = VRay::VRayRenderer;
 	using BaseClass::vfb;
 
+	/// Get the wrapped renderer, callbacks receive it instead of the wrapper
+	const VRayRenderer & getBase() const {
+		return *this;
+	}
+
 		
 	LoggingVRayRenderer(): VRayRenderer() {
 		LOG("LoggingVRayRenderer");
@@ -34,7 +176,7 @@ public:
 		LOG("LoggingVRayRenderer", rendererOptions);
 	}
 	~LoggingVRayRenderer() {
-		LOG("~LoggingVRayRenderer", );	
+		LOG("~LoggingVRayRenderer");	
 	}
 
 	Error getLastError() const {
@@ -555,11 +697,11 @@ public:
 		return BaseClass::resetHosts(hosts);
 	}
 	VRayImage* getImage() const {
-		LOG(" getImage");
+		LOG("getImage");
 		return BaseClass::getImage();
 	}
 	VRayImage* getImage(const GetImageOptions &options) const {
-		LOG(" getImage", options);
+		LOG("getImage", options);
 		return BaseClass::getImage(options);
 	}
 	bool saveImage(const char* fileName) const {
@@ -720,36 +862,36 @@ public:
 	}
 
 	template<class T, bool (T::*TMethod)(VRayRenderer&, const char* pluginType, std::string& pluginName, void*)> int loadFiltered(const char* fileName, T& obj, const void* userData = NULL) {
-		LOG("loadFiltered", fileName, obj, userData)
-		return BaseClass::loadFiltered<T, T::TMethod>(fileName, obj, userData);
+		LOG("loadFiltered", fileName, obj, userData);
+		return BaseClass::loadFiltered<T, TMethod>(fileName, obj, userData);
 	}
 	template<class T, bool (T::*TMethod)(VRayRenderer&, const char* pluginType, std::string& pluginName, void*)> int loadFiltered(const std::string& fileName, T& obj, const void* userData = NULL) {
-		LOG("loadFiltered", fileName, obj, userData)
-		return BaseClass::loadFiltered<T, T::TMethod>(fileName, obj, userData);
+		LOG("loadFiltered", fileName, obj, userData);
+		return BaseClass::loadFiltered<T, TMethod>(fileName, obj, userData);
 	}
 	template<class T, bool (T::*TMethod)(VRayRenderer&, const char* pluginType, std::string& pluginName, void*)> int appendFiltered(const char* fileName, T& obj, const void* userData = NULL) {
-		LOG("appendFiltered", fileName, obj, userData)
-		return BaseClass::appendFiltered<T, T::TMethod>(fileName, obj, userData);
+		LOG("appendFiltered", fileName, obj, userData);
+		return BaseClass::appendFiltered<T, TMethod>(fileName, obj, userData);
 	}
 	template<class T, bool (T::*TMethod)(VRayRenderer&, const char* pluginType, std::string& pluginName, void*)> int appendFiltered(const std::string& fileName, T& obj, const void* userData = NULL) {
-		LOG("appendFiltered", fileName, obj, userData)
-		return BaseClass::appendFiltered<T, T::TMethod>(fileName, obj, userData);
+		LOG("appendFiltered", fileName, obj, userData);
+		return BaseClass::appendFiltered<T, TMethod>(fileName, obj, userData);
 	}
 	template<class T, bool (T::*TMethod)(VRayRenderer&, const char* pluginType, std::string& pluginName, void*)> int loadAsTextFiltered(const char* fileName, T& obj, const void* userData = NULL) {
-		LOG("loadAsTextFiltered", fileName, obj, userData)
-		return BaseClass::loadAsTextFiltered<T, T::TMethod>(fileName, obj, userData);
+		LOG("loadAsTextFiltered", fileName, obj, userData);
+		return BaseClass::loadAsTextFiltered<T, TMethod>(fileName, obj, userData);
 	}
 	template<class T, bool (T::*TMethod)(VRayRenderer&, const char* pluginType, std::string& pluginName, void*)> int loadAsTextFiltered(const std::string& fileName, T& obj, const void* userData = NULL){
-		LOG("loadAsTextFiltered", fileName, obj, userData)
-		return BaseClass::loadAsTextFiltered<T, T::TMethod>(fileName, obj, userData);
+		LOG("loadAsTextFiltered", fileName, obj, userData);
+		return BaseClass::loadAsTextFiltered<T, TMethod>(fileName, obj, userData);
 	}
 	template<class T, bool (T::*TMethod)(VRayRenderer&, const char* pluginType, std::string& pluginName, void*)> int appendAsTextFiltered(const char* fileName, T& obj, const void* userData = NULL) {
-		LOG("appendAsTextFiltered", fileName, obj, userData)
-		return BaseClass::appendAsTextFiltered<T, T::TMethod>(fileName, obj, userData);
+		LOG("appendAsTextFiltered", fileName, obj, userData);
+		return BaseClass::appendAsTextFiltered<T, TMethod>(fileName, obj, userData);
 	}
 	template<class T, bool (T::*TMethod)(VRayRenderer&, const char* pluginType, std::string& pluginName, void*)> int appendAsTextFiltered(const std::string& fileName, T& obj, const void* userData = NULL) {
-		LOG("appendAsTextFiltered", fileName, obj, userData)
-		return BaseClass::appendAsTextFiltered<T, T::TMethod>(fileName, obj, userData);
+		LOG("appendAsTextFiltered", fileName, obj, userData);
+		return BaseClass::appendAsTextFiltered<T, TMethod>(fileName, obj, userData);
 	}
 	template<class T> std::vector<T> getPlugins() const {
 		LOG("getPlugins");
@@ -802,79 +944,79 @@ public:
 
 	
 	template<class T, void (T::*TMethod)(VRayRenderer&, void*)> void setOnRenderStart(T& cls, const void* userData = NULL) {
-		LOG("setOnRenderStart")
-		return BaseClass::setOnRenderStart<T, T::TMethod>(cls, userData);
+		LOG("setOnRenderStart");
+		return BaseClass::setOnRenderStart<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, void*)> void setOnImageReady(T& cls, const void* userData = NULL) {
-		LOG("setOnImageReady")
-		return BaseClass::setOnImageReady<T, T::TMethod>(cls, userData);
+		LOG("setOnImageReady");
+		return BaseClass::setOnImageReady<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, void*)> void setOnRendererClose(T& cls, const void* userData = NULL) {
-		LOG("setOnRendererClose")
-		return BaseClass::setOnRendererClose<T, T::TMethod>(cls, userData);
+		LOG("setOnRendererClose");
+		return BaseClass::setOnRendererClose<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, VRayImage* img, void*)> void setOnRTImageUpdated(T& cls, const void* userData = NULL) {
-		LOG("setOnRTImageUpdated")
-		return BaseClass::setOnRTImageUpdated<T, T::TMethod>(cls, userData);
+		LOG("setOnRTImageUpdated");
+		return BaseClass::setOnRTImageUpdated<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, const char* msg, int level, void*)> void setOnDumpMessage(T& cls, const void* userData = NULL) {
-		LOG("setOnDumpMessage")
-		return BaseClass::setOnDumpMessage<T, T::TMethod>(cls, userData);
+		LOG("setOnDumpMessage");
+		return BaseClass::setOnDumpMessage<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, int x, int y, int width, int height, const char* host, void*)> void setOnBucketInit(T& cls, const void* userData = NULL) {
-		LOG("setOnBucketInit")
-		return BaseClass::setOnBucketInit<T, T::TMethod>(cls, userData);
+		LOG("setOnBucketInit");
+		return BaseClass::setOnBucketInit<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, int x, int y, const char* host, VRayImage* img, void*)> void setOnBucketReady(T& cls, const void* userData = NULL) {
-		LOG("setOnBucketReady")
-		return BaseClass::setOnBucketReady<T, T::TMethod>(cls, userData);
+		LOG("setOnBucketReady");
+		return BaseClass::setOnBucketReady<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, int x, int y, int width, int height, const char* host, void*)> void setOnBucketFailed(T& cls, const void* userData = NULL) {
-		LOG("setOnBucketFailed")
-		return BaseClass::setOnBucketFailed<T, T::TMethod>(cls, userData);
+		LOG("setOnBucketFailed");
+		return BaseClass::setOnBucketFailed<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, void*)> void setOnSequenceStart(T& cls, const void* userData = NULL) {
-		LOG("setOnSequenceStart")
-		return BaseClass::setOnSequenceStart<T, T::TMethod>(cls, userData);
+		LOG("setOnSequenceStart");
+		return BaseClass::setOnSequenceStart<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, void*)> void setOnSequenceDone(T& cls, const void* userData = NULL) {
-		LOG("setOnSequenceDone")
-		return BaseClass::setOnSequenceDone<T, T::TMethod>(cls, userData);
+		LOG("setOnSequenceDone");
+		return BaseClass::setOnSequenceDone<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, const char* msg, int elementNumber, int elementsCount, void*)> void setOnProgress(T& cls, const void* userData = NULL) {
-		LOG("setOnProgress")
-		return BaseClass::setOnProgress<T, T::TMethod>(cls, userData);
+		LOG("setOnProgress");
+		return BaseClass::setOnProgress<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, const char* propName, void*)> void setOnRenderViewChanged(T& cls, const void* userData = NULL) {
-		LOG("setOnRenderViewChanged")
-		return BaseClass::setOnRenderViewChanged<T, T::TMethod>(cls, userData);
+		LOG("setOnRenderViewChanged");
+		return BaseClass::setOnRenderViewChanged<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, bool isRendering, void*)> void setOnRenderLast(T& cls, const void* userData = NULL) {
-		LOG("setOnRenderLast")
-		return BaseClass::setOnRenderLast<T, T::TMethod>(cls, userData);
+		LOG("setOnRenderLast");
+		return BaseClass::setOnRenderLast<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, void*)> void setOnVFBClosed(T& cls, const void* userData = NULL) {
-		LOG("setOnVFBClosed")
-		return BaseClass::setOnVFBClosed(cls, userData);
+		LOG("setOnVFBClosed");
+		return BaseClass::setOnVFBClosed<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, void*)> void setOnPostEffectsUpdated(T& cls, const void* userData = NULL) {
-		LOG("setOnPostEffectsUpdated")
-		return BaseClass::setOnPostEffectsUpdated<T, T::TMethod>(cls, userData);
+		LOG("setOnPostEffectsUpdated");
+		return BaseClass::setOnPostEffectsUpdated<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, void*)> void setOnShowMessagesWindow(T& cls, const void* userData = NULL) {
-		LOG("setOnShowMessagesWindow")
-		return BaseClass::setOnShowMessagesWindow<T, T::TMethod>(cls, userData);
+		LOG("setOnShowMessagesWindow");
+		return BaseClass::setOnShowMessagesWindow<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, const char* hostName, void*)> void setOnHostConnected(T& cls, const void* userData = NULL) {
-		LOG("setOnHostConnected")
-		return BaseClass::setOnHostConnected<T, T::TMethod>(cls, userData);
+		LOG("setOnHostConnected");
+		return BaseClass::setOnHostConnected<T, TMethod>(cls, userData);
 	}
 	template<class T, void (T::*TMethod)(VRayRenderer&, const char* hostName, void*)> void setOnHostDisconnected(T& cls, const void* userData = NULL) {
-		LOG("setOnHostDisconnected")
-		return BaseClass::setOnHostDisconnected<T, T::TMethod>(cls, userData);
+		LOG("setOnHostDisconnected");
+		return BaseClass::setOnHostDisconnected<T, TMethod>(cls, userData);
 	}
 
 };	
 }
 
-typedef VRay::LoggingVRayRenderer<NullLogger> VRayRenderer;
+#undef LOG
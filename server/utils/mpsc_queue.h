@@ -0,0 +1,72 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+/// Unbounded lock free queue for many producers and a single consumer (D. Vyukov's intrusive MPSC node queue)
+/// Push is wait free: one atomic exchange and one store. Only the consumer may call @peek, @pop and @empty.
+/// A pushed item can be invisible to the consumer for a moment while its producer is between the two steps of
+/// @push, items behind it are also delayed until then - the consumer sees that as an empty queue and retries.
+template <typename T>
+class MpscQueue {
+public:
+	MpscQueue()
+		: head(new Node())
+		, tail(head.load(std::memory_order_relaxed))
+	{}
+
+	~MpscQueue() {
+		while (tail) {
+			Node * next = tail->next.load(std::memory_order_relaxed);
+			delete tail;
+			tail = next;
+		}
+	}
+
+	MpscQueue(const MpscQueue &) = delete;
+	MpscQueue & operator=(const MpscQueue &) = delete;
+
+	/// Add @value at the end, can be called from any thread
+	void push(T && value) {
+		Node * node = new Node(std::move(value));
+		Node * prev = head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	/// Get the first item without removing it, nullptr if there is nothing to take
+	/// Consumer only, the item is valid until @pop is called
+	T * peek() {
+		Node * next = tail->next.load(std::memory_order_acquire);
+		return next ? &next->value : nullptr;
+	}
+
+	/// Remove the first item, @peek must have returned non null before that
+	/// Consumer only
+	void pop() {
+		Node * next = tail->next.load(std::memory_order_acquire);
+		// next becomes the stub node, its value is not used anymore
+		next->value = T();
+		delete tail;
+		tail = next;
+	}
+
+	/// Check if there is nothing to take, consumer only
+	bool empty() const {
+		return tail->next.load(std::memory_order_acquire) == nullptr;
+	}
+
+private:
+	struct Node {
+		std::atomic<Node*> next; ///< The item pushed after this one
+		T value; ///< The item, default constructed for the stub node
+
+		Node(): next(nullptr), value() {}
+		explicit Node(T && value): next(nullptr), value(std::move(value)) {}
+	};
+
+	std::atomic<Node*> head; ///< Last pushed node, producers append after it
+	Node * tail; ///< Stub node, the first item is in the node after it
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,91 @@
+#include "task_pool.h"
+#include "trace_profiler.h"
+#include <algorithm>
+
+TaskPool::TaskPool(int threadCount)
+	: running(true)
+{
+	for (int c = 0; c < threadCount; ++c) {
+		workers.emplace_back(&TaskPool::workerBase, this);
+	}
+}
+
+TaskPool::~TaskPool() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		running = false;
+	}
+	cond.notify_all();
+	for (auto & worker : workers) {
+		worker.join();
+	}
+}
+
+TaskPool & TaskPool::getInstance() {
+	// leave some cores for V-Ray which is usually rendering while we process images
+	static TaskPool pool(std::max(1u, std::thread::hardware_concurrency() / 2) - 1);
+	return pool;
+}
+
+void TaskPool::runBatch(Batch & batch) {
+	for (int index = batch.next++; index < batch.count; index = batch.next++) {
+		batch.job(index);
+		if (++batch.done == batch.count) {
+			std::lock_guard<std::mutex> lock(batch.mtx);
+			batch.cond.notify_all();
+		}
+	}
+}
+
+void TaskPool::workerBase() {
+	TraceProfiler::getInstance().setThreadName("TaskPool worker");
+	while (true) {
+		std::shared_ptr<Batch> batch;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cond.wait(lock, [this]() { return !batches.empty() || !running; });
+			if (!running) {
+				return;
+			}
+			batch = batches.front();
+			if (batch->next >= batch->count) {
+				// all indices are taken, remove it so others can be processed
+				batches.pop_front();
+				continue;
+			}
+		}
+		runBatch(*batch);
+	}
+}
+
+void TaskPool::parallelFor(int count, const std::function<void(int)> & job) {
+	if (count <= 0) {
+		return;
+	}
+	if (count == 1 || workers.empty()) {
+		for (int c = 0; c < count; ++c) {
+			job(c);
+		}
+		return;
+	}
+
+	auto batch = std::make_shared<Batch>(job, count);
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		batches.push_back(batch);
+	}
+	cond.notify_all();
+
+	runBatch(*batch);
+
+	{
+		std::unique_lock<std::mutex> lock(batch->mtx);
+		batch->cond.wait(lock, [&batch]() { return batch->done == batch->count; });
+	}
+
+	std::lock_guard<std::mutex> lock(mtx);
+	auto iter = std::find(batches.begin(), batches.end(), batch);
+	if (iter != batches.end()) {
+		batches.erase(iter);
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Fixed set of worker threads that run indexed jobs
+/// Used for image work (encoding, conversion) that should not run on a single V-Ray callback thread
+class TaskPool {
+public:
+	/// Create the pool
+	/// @threadCount - number of worker threads, the thread calling @parallelFor also runs jobs
+	explicit TaskPool(int threadCount);
+	~TaskPool();
+
+	TaskPool(const TaskPool &) = delete;
+	TaskPool & operator=(const TaskPool &) = delete;
+
+	/// Call @job(index) for each index in [0, @count) and return when all are done
+	/// Safe to call from multiple threads at once, jobs of all callers share the workers
+	void parallelFor(int count, const std::function<void(int)> & job);
+
+	/// Get the number of threads that can run jobs at once, including the caller
+	int getConcurrency() const { return static_cast<int>(workers.size()) + 1; }
+
+	/// Get the pool shared by all RendererController instances
+	static TaskPool & getInstance();
+
+private:
+	/// Jobs from a single @parallelFor call
+	struct Batch {
+		const std::function<void(int)> & job; ///< The job to run
+		const int count; ///< Number of indices
+		std::atomic<int> next; ///< Next index to take
+		std::atomic<int> done; ///< Number of finished indices
+		std::mutex mtx; ///< Protects @cond
+		std::condition_variable cond; ///< Signalled when all indices are done
+
+		Batch(const std::function<void(int)> & job, int count): job(job), count(count), next(0), done(0) {}
+	};
+
+	/// Take and run indices from @batch until there are none left
+	static void runBatch(Batch & batch);
+
+	/// Thread base for workers
+	void workerBase();
+
+	std::vector<std::thread> workers; ///< The worker threads
+	std::deque<std::shared_ptr<Batch>> batches; ///< Batches with indices not yet taken
+	std::mutex mtx; ///< Protects @batches and @running
+	std::condition_variable cond; ///< Signalled when batch is added or pool is stopping
+	bool running; ///< Workers exit when this is false
+};
+
+#endif // TASK_POOL_H
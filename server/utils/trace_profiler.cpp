@@ -0,0 +1,135 @@
+#include "trace_profiler.h"
+
+#include <iomanip>
+
+namespace {
+/// Max time a zone stays queued before it is written
+const std::chrono::milliseconds WRITE_INTERVAL(100);
+
+/// Write @text as a JSON string, names are ours so only quotes and backslashes are expected
+void writeJsonString(std::ostream & out, const char * text) {
+	out << '"';
+	for (const char * c = text; *c; ++c) {
+		if (*c == '"' || *c == '\\') {
+			out << '\\';
+		}
+		if (static_cast<unsigned char>(*c) >= 0x20) {
+			out << *c;
+		}
+	}
+	out << '"';
+}
+}
+
+std::atomic<bool> TraceProfiler::enabled(false);
+
+TraceProfiler::TraceProfiler()
+	: running(false)
+{}
+
+TraceProfiler::~TraceProfiler() {
+	stop();
+}
+
+TraceProfiler & TraceProfiler::getInstance() {
+	static TraceProfiler profiler;
+	return profiler;
+}
+
+bool TraceProfiler::start(const std::string & path) {
+	std::lock_guard<std::mutex> lock(mtx);
+	if (running) {
+		return false;
+	}
+	file.open(path, std::ios::trunc | std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	// timestamps are in microseconds, nanosecond precision is enough
+	file << std::fixed << std::setprecision(3);
+	// pid is fixed, all threads belong to the server process
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"VRayZmqServer\"}}";
+	threadIds.clear();
+	startTime = clock::now();
+	running = true;
+	writerThread = std::thread(&TraceProfiler::writerThreadBase, this);
+	enabled.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+void TraceProfiler::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!running) {
+			return;
+		}
+		enabled.store(false, std::memory_order_relaxed);
+		running = false;
+	}
+	stopCond.notify_all();
+	writerThread.join();
+}
+
+void TraceProfiler::setThreadName(const std::string & name) {
+	if (!isEnabled()) {
+		return;
+	}
+	Event event;
+	event.name = nullptr;
+	event.threadName = name;
+	event.thread = std::this_thread::get_id();
+	events.push(std::move(event));
+}
+
+void TraceProfiler::addZone(const char * name, time_point begin, time_point end) {
+	if (!isEnabled()) {
+		return;
+	}
+	Event event;
+	event.name = name;
+	event.thread = std::this_thread::get_id();
+	event.begin = begin;
+	event.end = end;
+	events.push(std::move(event));
+}
+
+void TraceProfiler::writeEvents() {
+	while (Event * event = events.peek()) {
+		auto idIter = threadIds.find(event->thread);
+		if (idIter == threadIds.end()) {
+			idIter = threadIds.emplace(event->thread, static_cast<int>(threadIds.size()) + 1).first;
+		}
+
+		// the process name is always the first event, so each one starts with a comma
+		file << ",\n{\"name\":";
+		if (event->name) {
+			writeJsonString(file, event->name);
+			const double beginUs = std::chrono::duration<double, std::micro>(event->begin - startTime).count();
+			const double durationUs = std::chrono::duration<double, std::micro>(event->end - event->begin).count();
+			file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << idIter->second << ",\"ts\":" << beginUs << ",\"dur\":" << durationUs << '}';
+		} else {
+			file << "\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << idIter->second << ",\"args\":{\"name\":";
+			writeJsonString(file, event->threadName.c_str());
+			file << "}}";
+		}
+		events.pop();
+	}
+}
+
+void TraceProfiler::writerThreadBase() {
+	std::unique_lock<std::mutex> lock(mtx);
+	while (running) {
+		stopCond.wait_for(lock, WRITE_INTERVAL);
+		lock.unlock();
+		writeEvents();
+		file.flush();
+		lock.lock();
+	}
+	lock.unlock();
+
+	// a zone closing right at @stop can be queued after this, it is written by the next @start
+	writeEvents();
+	file << "\n]}\n";
+	file.close();
+}
@@ -0,0 +1,114 @@
+#ifndef TRACE_PROFILER_H
+#define TRACE_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "mpsc_queue.h"
+
+#define TRACE_ZONE_CONCAT_IMPL(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT_IMPL(a, b)
+
+/// Record the rest of the enclosing scope as a zone in the trace, if the profiler is running
+/// @name - string literal, shown as the zone's name in the trace viewer
+#define TRACE_ZONE(name) TraceProfiler::Zone TRACE_ZONE_CONCAT(traceZone, __LINE__)(name)
+
+/// Global singleton writing timed zones of all threads to a Chrome trace-event JSON file
+/// The file opens in chrome://tracing or ui.perfetto.dev as a timeline with a row for each thread.
+/// Closing a zone queues it without locks and a background thread writes the file, so a zone costs
+/// two clock reads and an allocation while running and a single relaxed load when not.
+class TraceProfiler {
+public:
+	typedef std::chrono::high_resolution_clock clock;
+	typedef clock::time_point time_point;
+
+	/// Times the scope it is declared in, use with TRACE_ZONE
+	class Zone {
+	public:
+		explicit Zone(const char * name)
+			: name(TraceProfiler::isEnabled() ? name : nullptr)
+		{
+			if (this->name) {
+				begin = clock::now();
+			}
+		}
+
+		~Zone() {
+			if (name) {
+				TraceProfiler::getInstance().addZone(name, begin, clock::now());
+			}
+		}
+
+		Zone(const Zone &) = delete;
+		Zone & operator=(const Zone &) = delete;
+	private:
+		const char * name; ///< Name of the zone, nullptr if the profiler was not running when it began
+		time_point begin; ///< When the zone began
+	};
+
+	/// Get the TraceProfiler instance
+	static TraceProfiler & getInstance();
+
+	/// Check if zones are being recorded, a single relaxed load
+	static bool isEnabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	/// Start writing zones to @path, the file is overwritten
+	/// @return - false if the file can't be created or the profiler is already running
+	bool start(const std::string & path);
+
+	/// Write the queued zones, close the file and join the writer thread
+	void stop();
+
+	/// Name the calling thread's row in the trace, does nothing if the profiler is not running
+	/// Threads call this when they start, so @start must be called before the threads are created
+	void setThreadName(const std::string & name);
+
+	/// Record a zone of the calling thread, does nothing if the profiler is not running
+	/// @name - must stay valid until @stop, string literals are expected
+	void addZone(const char * name, time_point begin, time_point end);
+
+private:
+	TraceProfiler();
+	~TraceProfiler();
+
+	TraceProfiler(const TraceProfiler &) = delete;
+	TraceProfiler & operator=(const TraceProfiler &) = delete;
+
+	/// One queued trace event
+	struct Event {
+		const char * name; ///< Zone name, nullptr for thread names
+		std::string threadName; ///< Set for thread name events
+		std::thread::id thread; ///< Thread the event belongs to
+		time_point begin; ///< Start of the zone
+		time_point end; ///< End of the zone
+	};
+
+	/// Write all queued events to the file, writer thread only
+	void writeEvents();
+
+	/// Write the events queued until @stop
+	void writerThreadBase();
+
+	static std::atomic<bool> enabled; ///< True between @start and @stop
+
+	MpscQueue<Event> events; ///< Zones and thread names waiting to be written
+	std::mutex mtx; ///< Protects @running and serializes @start and @stop
+	std::condition_variable stopCond; ///< Wakes the writer thread on @stop
+	bool running; ///< Writer thread should keep going
+	std::thread writerThread; ///< Writes @events to @file
+
+	std::ofstream file; ///< The JSON output, only used by the writer thread while running
+	time_point startTime; ///< Trace timestamps are relative to this
+	std::unordered_map<std::thread::id, int> threadIds; ///< Small ids trace viewers expect, numbered in the order threads show up
+};
+
+#endif // TRACE_PROFILER_H
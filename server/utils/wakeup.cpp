@@ -0,0 +1,77 @@
+#include "wakeup.h"
+#include <cstdint>
+#include <string>
+
+Wakeup::Wakeup()
+	: signaled(false)
+{}
+
+Wakeup::~Wakeup() {
+	close();
+}
+
+bool Wakeup::open(zmq::context_t & context) {
+	close();
+	// the address only has to be unique in the context
+	const std::string address = "inproc://wakeup-" + std::to_string(reinterpret_cast<uintptr_t>(this));
+	const int linger = 0;
+	try {
+		std::unique_ptr<zmq::socket_t> readEnd(new zmq::socket_t(context, ZMQ_PAIR));
+		readEnd->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+		// inproc needs the bind before the connect with zmq before 4.0
+		readEnd->bind(address);
+
+		std::unique_ptr<zmq::socket_t> writeEnd(new zmq::socket_t(context, ZMQ_PAIR));
+		writeEnd->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+		writeEnd->connect(address);
+
+		std::lock_guard<std::mutex> lock(sendMtx);
+		receiver = std::move(readEnd);
+		sender = std::move(writeEnd);
+	} catch (zmq::error_t &) {
+		return false;
+	}
+	// signals made while closed were dropped, the caller checks for work before it polls
+	signaled.store(false, std::memory_order_release);
+	return true;
+}
+
+void Wakeup::close() {
+	std::lock_guard<std::mutex> lock(sendMtx);
+	sender.reset();
+	receiver.reset();
+}
+
+zmq::pollitem_t Wakeup::getPollItem() const {
+	zmq::pollitem_t item = {static_cast<void*>(*receiver), 0, ZMQ_POLLIN, 0};
+	return item;
+}
+
+void Wakeup::signal() {
+	if (signaled.exchange(true, std::memory_order_acq_rel)) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(sendMtx);
+	if (!sender) {
+		return;
+	}
+	try {
+		// the only failure is a full pipe, which is already a pending wakeup
+		zmq::message_t message(0);
+		sender->send(message, ZMQ_DONTWAIT);
+	} catch (zmq::error_t &) {
+		// context is terminating, the polling thread is stopping
+	}
+}
+
+void Wakeup::clear() {
+	if (!receiver) {
+		return;
+	}
+	try {
+		zmq::message_t message;
+		while (receiver->recv(&message, ZMQ_DONTWAIT)) {}
+	} catch (zmq::error_t &) {}
+	// reading the flag pairs with the exchange in @signal, so work queued before a signal is visible after this
+	signaled.exchange(false, std::memory_order_acq_rel);
+}
@@ -0,0 +1,60 @@
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+#include <zmq.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+/// Wakes a thread blocked in zmq::poll from other threads
+/// The read end is an inproc PAIR socket polled together with the other zmq sockets, so it works on every
+/// platform zmq does. The sockets live only while the polling thread has it open, since the proxy terminates
+/// the context before it destroys the controllers.
+class Wakeup {
+public:
+	/// Opens @wakeup for the lifetime of the polling loop and closes it on every way out of it
+	class Scope {
+	public:
+		Scope(Wakeup & wakeup, zmq::context_t & context): wakeup(wakeup) { wakeup.open(context); }
+		~Scope() { wakeup.close(); }
+
+		Scope(const Scope &) = delete;
+		Scope & operator=(const Scope &) = delete;
+	private:
+		Wakeup & wakeup;
+	};
+
+	Wakeup();
+	~Wakeup();
+
+	Wakeup(const Wakeup &) = delete;
+	Wakeup & operator=(const Wakeup &) = delete;
+
+	/// Create the socket pair in @context, called by the polling thread
+	/// @return - false if the sockets could not be created, @isValid stays false
+	bool open(zmq::context_t & context);
+
+	/// Close the socket pair, signals after it are ignored
+	void close();
+
+	/// Check if the sockets are open and can be polled, polling thread only
+	bool isValid() const { return receiver != nullptr; }
+
+	/// Get poll item for ZMQ_POLLIN on the read end, polling thread only
+	zmq::pollitem_t getPollItem() const;
+
+	/// Wake the polling thread, signals after the first one are free until it calls @clear
+	/// Can be called from any thread
+	void signal();
+
+	/// Consume all signals, call after poll reported the read end readable and before processing the work
+	void clear();
+
+private:
+	std::mutex sendMtx; ///< zmq sockets can't be used by several threads at once, protects @sender
+	std::unique_ptr<zmq::socket_t> sender; ///< Written to by @signal
+	std::unique_ptr<zmq::socket_t> receiver; ///< Polled for ZMQ_POLLIN
+	std::atomic<bool> signaled; ///< True if there is unread signal in @receiver
+};
+
+#endif // WAKEUP_H
@@ -0,0 +1,78 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "viewport_delta.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace ImageUtils;
+
+ViewportDelta::ViewportDelta(int tileSize, int keyframeInterval, float threshold, float maxDirtyRatio)
+	: tileSize(std::max(1, tileSize))
+	, keyframeInterval(keyframeInterval)
+	, threshold(threshold)
+	, maxDirtyRatio(maxDirtyRatio)
+	, width(0)
+	, height(0)
+	, sinceKeyframe(0)
+{}
+
+void ViewportDelta::reset() {
+	lastSent.clear();
+	width = height = 0;
+	sinceKeyframe = 0;
+}
+
+void ViewportDelta::saveKeyframe(const VRay::AColor * data, int width, int height) {
+	this->width = width;
+	this->height = height;
+	lastSent.assign(data, data + static_cast<size_t>(width) * height);
+	sinceKeyframe = 0;
+}
+
+bool ViewportDelta::update(const VRay::AColor * data, int width, int height, std::vector<Region> & dirty) {
+	dirty.clear();
+	const bool keyframeDue = keyframeInterval > 0 && sinceKeyframe + 1 >= keyframeInterval;
+	if (lastSent.empty() || width != this->width || height != this->height || keyframeDue) {
+		saveKeyframe(data, width, height);
+		return true;
+	}
+
+	size_t dirtyArea = 0;
+	for (int top = 0; top < height; top += tileSize) {
+		const int tileHeight = std::min(tileSize, height - top);
+		Region span;
+		for (int left = 0; left < width; left += tileSize) {
+			const Region tile(left, top, std::min(tileSize, width - left), tileHeight);
+			if (regionDiffers(data, lastSent.data(), width, tile, threshold)) {
+				if (span.width) {
+					span.width += tile.width;
+				} else {
+					span = tile;
+				}
+			} else if (span.width) {
+				dirty.push_back(span);
+				dirtyArea += span.area();
+				span = Region();
+			}
+		}
+		if (span.width) {
+			dirty.push_back(span);
+			dirtyArea += span.area();
+		}
+	}
+
+	if (dirtyArea > maxDirtyRatio * width * height) {
+		dirty.clear();
+		saveKeyframe(data, width, height);
+		return true;
+	}
+
+	for (const Region & span : dirty) {
+		for (int row = span.top; row < span.top + span.height; ++row) {
+			const size_t offset = static_cast<size_t>(row) * width + span.left;
+			memcpy(lastSent.data() + offset, data + offset, span.width * sizeof(VRay::AColor));
+		}
+	}
+
+	++sinceKeyframe;
+	return false;
+}
@@ -0,0 +1,42 @@
+#ifndef VIEWPORT_DELTA_H
+#define VIEWPORT_DELTA_H
+
+#include "utils/image_utils.h"
+#include <vector>
+
+/// Tracks the last viewport image sent to the client and finds which tiles changed since then
+/// Changed tiles in the same tile row are merged in spans so they can be sent as few bucket images
+class ViewportDelta {
+public:
+	/// @tileSize - size of the square tiles that are compared
+	/// @keyframeInterval - every N-th update is sent in full to limit drift, 0 disables periodic keyframes
+	/// @threshold - max per channel difference for a pixel to be considered unchanged
+	/// @maxDirtyRatio - if more than this part of the image is dirty, a keyframe is sent instead
+	ViewportDelta(int tileSize, int keyframeInterval, float threshold, float maxDirtyRatio);
+
+	/// Compare @data with the last sent image and update the last sent image with what will be sent now
+	/// @data - tightly packed image
+	/// @width, @height - size of @data
+	/// @dirty - filled with the changed spans if function returns false
+	/// @return - true if a full image must be sent (first image, size change, keyframe or too many changes)
+	bool update(const VRay::AColor * data, int width, int height, std::vector<ImageUtils::Region> & dirty);
+
+	/// Forget the last sent image, the next update will be a keyframe
+	void reset();
+
+private:
+	/// Save @data as the last sent image
+	void saveKeyframe(const VRay::AColor * data, int width, int height);
+
+	const int tileSize; ///< Size of compared tiles
+	const int keyframeInterval; ///< Send full image every N updates
+	const float threshold; ///< Per channel difference considered as change
+	const float maxDirtyRatio; ///< Part of the image which if dirty makes sending a keyframe cheaper
+
+	std::vector<VRay::AColor> lastSent; ///< The image as the client has it
+	int width; ///< Width of @lastSent
+	int height; ///< Height of @lastSent
+	int sinceKeyframe; ///< Number of deltas since last keyframe
+};
+
+#endif // VIEWPORT_DELTA_H
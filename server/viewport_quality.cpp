@@ -0,0 +1,144 @@
+#define VRAY_RUNTIME_LOAD_SECONDARY
+#include "viewport_quality.h"
+#include "utils/logger.h"
+#include <algorithm>
+
+using namespace std::chrono;
+
+namespace {
+/// Length of a measurement period
+const int PERIOD_MS = 500;
+/// Number of good periods in a row needed to step up
+const int UP_PERIODS = 4;
+/// Jpeg qualities tried before lowering the resolution
+const int JPEG_STEPS[] = {90, 80, 70, 60, 50, 40, 30};
+}
+
+ViewportQuality::ViewportQuality(float targetFps, int maxLatencyMs)
+	: targetFps(std::max(1.f, targetFps))
+	, maxLatencyMs(std::max(1, maxLatencyMs))
+	, level(0)
+	, goodPeriods(0)
+	, backlog(0)
+	, stats()
+{
+	setRequested(VRayBaseTypes::AttrImage::ImageType::JPG, 60);
+}
+
+void ViewportQuality::setRequested(VRayBaseTypes::AttrImage::ImageType type, int quality) {
+	std::lock_guard<std::mutex> lock(mtx);
+	ladder.clear();
+
+	int topQuality = quality;
+	if (type != VRayBaseTypes::AttrImage::ImageType::JPG) {
+		ladder.emplace_back(type, quality, 1);
+		if (type == VRayBaseTypes::AttrImage::ImageType::RGBA_REAL) {
+			ladder.emplace_back(ImageUtils::RGBA_HALF, quality, 1);
+		}
+		topQuality = JPEG_STEPS[0];
+	}
+	ladder.emplace_back(VRayBaseTypes::AttrImage::ImageType::JPG, topQuality, 1);
+	for (int step : JPEG_STEPS) {
+		if (step < topQuality) {
+			ladder.emplace_back(VRayBaseTypes::AttrImage::ImageType::JPG, step, 1);
+		}
+	}
+	for (int downscale : {2, 4}) {
+		ladder.emplace_back(VRayBaseTypes::AttrImage::ImageType::JPG, std::min(topQuality, 50), downscale);
+		ladder.emplace_back(VRayBaseTypes::AttrImage::ImageType::JPG, std::min(topQuality, 35), downscale);
+	}
+
+	level = 0;
+	goodPeriods = 0;
+	stats.level = 0;
+	stats.levelCount = static_cast<int>(ladder.size());
+}
+
+void ViewportQuality::imageQueued(size_t bytes, int64_t produceUs) {
+	std::lock_guard<std::mutex> lock(mtx);
+	++period.queued;
+	period.queuedBytes += bytes;
+	period.produceUs += produceUs;
+	backlog += bytes;
+}
+
+void ViewportQuality::imageSent(size_t bytes, int64_t waitUs) {
+	std::lock_guard<std::mutex> lock(mtx);
+	period.maxWaitUs = std::max(period.maxWaitUs, waitUs);
+	backlog -= std::min(backlog, bytes);
+}
+
+void ViewportQuality::imageDropped(size_t bytes) {
+	std::lock_guard<std::mutex> lock(mtx);
+	backlog -= std::min(backlog, bytes);
+}
+
+ViewportQuality::Level ViewportQuality::getLevel(time_point now, const ClientLink::Sample & link) {
+	std::lock_guard<std::mutex> lock(mtx);
+	period.maxLinkDelayUs = std::max(period.maxLinkDelayUs, link.delayUs);
+	if (period.start == time_point()) {
+		period.start = now;
+	} else if (duration_cast<milliseconds>(now - period.start).count() >= PERIOD_MS) {
+		evaluate(now, link);
+	}
+	return ladder[level];
+}
+
+void ViewportQuality::evaluate(time_point now, const ClientLink::Sample & link) {
+	const float seconds = duration_cast<microseconds>(now - period.start).count() / 1e6f;
+	if (period.queued) {
+		stats.sendRate = period.queuedBytes / seconds;
+		stats.drainRate = static_cast<float>(link.drainRate);
+		stats.latencyMs = period.maxWaitUs / 1000.f;
+		stats.linkDelayMs = period.maxLinkDelayUs / 1000.f;
+		stats.produceMs = period.produceUs / 1000.f / period.queued;
+
+		const float frameBudgetMs = 1000.f / targetFps;
+		// an image waits in the send queue, then behind the messages the proxy holds for the client
+		const float waitMs = stats.latencyMs + stats.linkDelayMs;
+		// time the client's connection needs for everything not sent yet, until the rate is measured only the wait counts
+		const float backlogMs = stats.drainRate > 0 ? (backlog + link.outstanding) / stats.drainRate * 1000.f : 0.f;
+
+		if (waitMs > maxLatencyMs || backlogMs > maxLatencyMs) {
+			changeLevel(level + 1, "send latency over limit");
+		} else if (stats.produceMs > frameBudgetMs) {
+			changeLevel(level + 1, "image preparation over frame budget");
+		} else if (waitMs < maxLatencyMs / 4.f && backlogMs < maxLatencyMs / 4.f && stats.produceMs < frameBudgetMs / 2) {
+			if (++goodPeriods >= UP_PERIODS) {
+				changeLevel(level - 1, "headroom in send queue and frame budget");
+			}
+		} else {
+			goodPeriods = 0;
+		}
+	}
+	// idle periods (no RT images) keep the current level
+
+	period = Period();
+	period.start = now;
+}
+
+void ViewportQuality::changeLevel(int newLevel, const char * reason) {
+	goodPeriods = 0;
+	newLevel = std::max(0, std::min(static_cast<int>(ladder.size()) - 1, newLevel));
+	if (newLevel == level) {
+		return;
+	}
+	if (newLevel > level) {
+		++stats.downgrades;
+	} else {
+		++stats.upgrades;
+	}
+	level = newLevel;
+	stats.level = level;
+	const Level & current = ladder[level];
+	LOGGER_LOG(Logger::Debug, "Viewport quality level", level, "type", static_cast<int>(current.type), "quality", current.quality,
+		"downscale", current.downscale, "-", reason, "( latency", stats.latencyMs, "ms, link delay", stats.linkDelayMs, "ms, produce", stats.produceMs,
+		"ms, queued", stats.sendRate / 1024, "KB/s, drained", stats.drainRate / 1024, "KB/s )");
+}
+
+ViewportQuality::Stats ViewportQuality::takeStats() {
+	std::lock_guard<std::mutex> lock(mtx);
+	const Stats result = stats;
+	stats.downgrades = stats.upgrades = 0;
+	return result;
+}
@@ -0,0 +1,102 @@
+#ifndef VIEWPORT_QUALITY_H
+#define VIEWPORT_QUALITY_H
+
+#include "utils/image_utils.h"
+#include "client_link.h"
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+/// Closed loop controller for the cost of RT images sent to the client
+/// Measures how fast RT images are produced, how long they wait in the send queue and how far the client's
+/// connection is behind (see ClientLink), then steps along a ladder of cheaper settings (packed format, jpeg,
+/// lower quality, lower resolution) to hold the target frame rate and latency. Steps down right away, steps up
+/// only after a few good periods.
+/// All methods are thread safe, images are queued from V-Ray callbacks and sent from the controller's thread.
+class ViewportQuality {
+public:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// Image settings for one step of the ladder
+	struct Level {
+		VRayBaseTypes::AttrImage::ImageType type; ///< The image format
+		int quality; ///< Jpeg quality, unused for other formats
+		int downscale; ///< The image is sent at 1/downscale of it's size
+
+		Level(VRayBaseTypes::AttrImage::ImageType type, int quality, int downscale): type(type), quality(quality), downscale(downscale) {}
+	};
+
+	/// Counters reported in the server stats
+	struct Stats {
+		int level; ///< Current step of the ladder, 0 is what the client requested
+		int levelCount; ///< Number of steps in the ladder
+		int downgrades; ///< Steps down since last @takeStats
+		int upgrades; ///< Steps up since last @takeStats
+		float sendRate; ///< RT image bytes per second queued in the last period
+		float drainRate; ///< Bytes per second the client's connection takes, estimated by ClientLink
+		float latencyMs; ///< Max time an RT image waited in the send queue in the last period
+		float linkDelayMs; ///< Max time a message waited in the proxy for the client's connection in the last period
+		float produceMs; ///< Average time to prepare an RT image in the last period
+	};
+
+	/// @targetFps - desired rate of RT images, images taking longer than 1/@targetFps to prepare are too expensive
+	/// @maxLatencyMs - max time an RT image can wait in the send queue and the proxy together
+	ViewportQuality(float targetFps, int maxLatencyMs);
+
+	/// Set what the client asked for, this is the top of the ladder and the current level is reset to it
+	void setRequested(VRayBaseTypes::AttrImage::ImageType type, int quality);
+
+	/// Record an RT image put in the send queue
+	/// @bytes - size of the message
+	/// @produceUs - time spent preparing it
+	void imageQueued(size_t bytes, int64_t produceUs);
+
+	/// Record an RT image handed to the socket
+	/// @bytes - size of the message
+	/// @waitUs - time it spent in the send queue
+	void imageSent(size_t bytes, int64_t waitUs);
+
+	/// Record an RT image removed from the send queue without being sent, because a newer one replaced it
+	/// @bytes - size of the message
+	void imageDropped(size_t bytes);
+
+	/// Get the settings for the next RT image, the measurements are evaluated at most once per period
+	/// @link - current state of the client's connection
+	Level getLevel(time_point now, const ClientLink::Sample & link);
+
+	/// Get the current state and reset the up/down counters
+	Stats takeStats();
+
+private:
+	/// Measurements for the current period
+	struct Period {
+		time_point start; ///< Start of the period
+		int queued; ///< RT images queued
+		size_t queuedBytes; ///< Size of the queued RT images
+		int64_t produceUs; ///< Total time preparing RT images
+		int64_t maxWaitUs; ///< Max time an RT image waited in the queue
+		int64_t maxLinkDelayUs; ///< Max time a message waited in the proxy
+
+		Period(): queued(0), queuedBytes(0), produceUs(0), maxWaitUs(0), maxLinkDelayUs(0) {}
+	};
+
+	/// Decide if the level should change based on the period that ended at @now
+	/// @link - state of the client's connection at @now
+	void evaluate(time_point now, const ClientLink::Sample & link);
+
+	/// Change the current level and log the reason
+	void changeLevel(int newLevel, const char * reason);
+
+	const float targetFps; ///< Desired RT image rate
+	const int maxLatencyMs; ///< Max queue wait for RT images
+
+	std::mutex mtx; ///< Protects all members below
+	std::vector<Level> ladder; ///< Steps from what the client requested to the cheapest settings
+	int level; ///< Current index in @ladder
+	int goodPeriods; ///< Consecutive periods with enough headroom to step up
+	size_t backlog; ///< Bytes of RT images queued but not yet sent to the proxy
+	Period period; ///< Measurements since last @evaluate
+	Stats stats; ///< Last evaluated state
+};
+
+#endif // VIEWPORT_QUALITY_H
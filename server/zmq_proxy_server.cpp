@@ -1,6 +1,7 @@
 #define VRAY_RUNTIME_LOAD_SECONDARY
 #include "zmq_proxy_server.h"
 #include "utils/logger.h"
+#include "utils/trace_profiler.h"
 #include <chrono>
 #include <random>
 #include <exception>
@@ -14,35 +15,52 @@ using namespace std;
 using namespace std::chrono;
 using namespace zmq;
 
+namespace {
+/// Messages the frontend socket queues for each client, once it is full the renderer's messages are held in the proxy
+/// and it's ClientLink reports that the client's connection is behind
+const int FRONTEND_SNDHWM = 8;
+}
+
 ZmqProxyServer::WorkerWrapper::WorkerWrapper(std::unique_ptr<RendererController> worker, time_point lastKeepAlive, client_id_t id, ClientType clType)
     : worker(move(worker))
     , lastKeepAlive(lastKeepAlive)
     , id(std::move(id))
     , clientType(clType)
+    , messagesIn(0)
+    , messagesOut(0)
 {
 
 }
 
-ZmqProxyServer::ZmqProxyServer(const string & port, bool showVFB, bool checkHeartbeat)
+ZmqProxyServer::ZmqProxyServer(const string & port, const ControllerSettings & controllerSettings, bool checkHeartbeat)
     : checkHeartbeat(checkHeartbeat)
-    , showVFB(showVFB)
+    , controllerSettings(controllerSettings)
     , port(port)
     , context(1)
     , dataTransfered(0)
     , reaperRunning(false)
+    , logWriter(nullptr)
 {
 }
 
+bool ZmqProxyServer::recordSession(const std::string & path) {
+	return recorder.open(path);
+}
+
+void ZmqProxyServer::reportLogStats(AsyncLogWriter * writer) {
+	logWriter = writer;
+}
+
 void ZmqProxyServer::addWorker(client_id_t clientId, time_point now, ClientType type) {
 	WorkerWrapper wrapper = {
-		unique_ptr<RendererController>(new RendererController(context, clientId, type, showVFB)),
+		unique_ptr<RendererController>(new RendererController(context, clientId, type, controllerSettings)),
 		now, clientId, type
 	};
 	wrapper.worker->start();
-	Logger::log(Logger::Info, "workers.emplace(make_pair(clientId, move(wrapper)))");
+	LOGGER_LOG(Logger::Info, "workers.emplace(make_pair(clientId, move(wrapper)))");
 	auto res = workers.emplace(make_pair(clientId, move(wrapper)));
 	assert(res.second && "Failed to add worker!");
-	Logger::log(Logger::Debug, "New client (", clientId, ") connected.");
+	LOGGER_LOG(Logger::Debug, "New client (", clientId, ") connected.");
 }
 
 
@@ -53,7 +71,7 @@ bool ZmqProxyServer::checkForTimeouts(time_point now) {
 
 	lastTimeoutCheck = now;
 	bool signalReaper = false;
-	for (auto workerIter = workers.begin(), end = workers.end(); workerIter != end; /*nop*/) {
+	for (auto workerIter = workers.begin(); workerIter != workers.end(); /*nop*/) {
 		auto inactiveTime = duration_cast<milliseconds>(now - workerIter->second.lastKeepAlive).count();
 		auto maxInactive = HEARBEAT_TIMEOUT;
 
@@ -61,16 +79,20 @@ bool ZmqProxyServer::checkForTimeouts(time_point now) {
 			maxInactive = EXPORTER_TIMEOUT;
 		}
 
-		if (inactiveTime > maxInactive || !workerIter->second.worker->isRunning()) {
+		if (inactiveTime <= maxInactive && !workerIter->second.held.empty()) {
+			// the client is still connected, the renderer is freed after it's last messages are sent
+			++workerIter;
+		} else if (inactiveTime > maxInactive || !workerIter->second.worker->isRunning()) {
 			stoppedClients.insert(workerIter->first);
 			if (inactiveTime > maxInactive) {
-				Logger::log(Logger::Debug, "Client (", workerIter->first, ") timed out - stopping it's renderer");
+				LOGGER_LOG(Logger::Debug, "Client (", workerIter->first, ") timed out - stopping it's renderer");
 			} else {
-				Logger::log(Logger::Debug, "Client (", workerIter->first, ")'s renderer stopped - freeing");
+				LOGGER_LOG(Logger::Debug, "Client (", workerIter->first, ")'s renderer stopped - freeing");
 			}
-			lock_guard<mutex> lk(reaperMtx);
-			deadRenderers.emplace_back(move(workerIter->second));
-			workerIter = workers.erase(workerIter); // should be no-op since worker is moved in dead que
+			if (!workerIter->second.held.empty()) {
+				LOGGER_LOG(Logger::Warning, "Client (", workerIter->first, ") did not take", workerIter->second.held.size(), "messages - dropping them");
+			}
+			workerIter = removeWorker(workerIter);
 			signalReaper = true;
 		} else {
 			++workerIter;
@@ -92,14 +114,14 @@ bool ZmqProxyServer::reportStats(time_point now) {
 
 	const int toFree = deadRenderers.size();
 	if (toFree > 20) {
-		Logger::log(Logger::Error, "Failing to free renderers fast enough:", toFree);
+		LOGGER_LOG(Logger::Error, "Failing to free renderers fast enough:", toFree);
 	} else if (toFree > 10) {
-		Logger::log(Logger::Warning, "Failing to free renderers fast enough:", toFree);
+		LOGGER_LOG(Logger::Warning, "Failing to free renderers fast enough:", toFree);
 	}
 
 	lastDataCheck = now;
 	if (dataTransfered / 1024 > 1) {
-		Logger::log(Logger::Debug, "Data transfered", dataTransfered / 1024., "KB for", dataReportDiff, "ms");
+		LOGGER_LOG(Logger::Debug, "Data transfered", dataTransfered / 1024., "KB for", dataReportDiff, "ms");
 		dataTransfered = 0;
 	}
 
@@ -108,27 +130,116 @@ bool ZmqProxyServer::reportStats(time_point now) {
 		if (worker.second.clientType == ClientType::Exporter) {
 			++exporterCount;
 		}
+		worker.second.worker->reportStats(dataReportDiff);
+	}
+
+	LOGGER_LOG(Logger::Debug, "Exporters:", exporterCount, "Active Blender instaces:", workers.size() - exporterCount);
+
+	const BufferPool::Stats poolStats = BufferPool::getInstance().takeStats();
+	if (poolStats.acquired) {
+		LOGGER_LOG(Logger::Debug, "Image buffers:", poolStats.acquired, "taken,", poolStats.allocated, "allocated,", poolStats.freed, "freed,", poolStats.idleBytes / (1024 * 1024), "MB idle");
+	}
+
+	const SessionRecorder::Stats recordStats = recorder.takeStats();
+	if (recordStats.records || recordStats.dropped) {
+		LOGGER_LOG(Logger::Debug, "Session recording:", recordStats.records, "messages,", recordStats.bytes / 1024, "KB written,", recordStats.dropped, "dropped");
+	}
+
+	if (logWriter) {
+		const AsyncLogWriter::Stats logStats = logWriter->takeStats();
+		if (logStats.written || logStats.dropped || logStats.waited) {
+			LOGGER_LOG(Logger::Debug, "Log messages:", logStats.written, "written,", logStats.flushes, "flushes,", logStats.dropped, "dropped,", logStats.waited, "waited for space");
+		}
 	}
 
-	Logger::log(Logger::Debug, "Exporters:", exporterCount, "Active Blender instaces:", workers.size() - exporterCount);
+	RendererLogPolicy::report();
 
 	return true;
 }
 
+bool ZmqProxyServer::sendToClient(zmq::socket_t & frontend, ClientMessage & message, WorkerWrapper * wrapper) {
+	LOGGER_LOG(Logger::Info, "frontend.send(idMsg, ZMQ_SNDMORE | ZMQ_DONTWAIT)");
+	if (!frontend.send(message.id, ZMQ_SNDMORE | ZMQ_DONTWAIT)) {
+		if (wrapper) {
+			wrapper->worker->getClientLink().blocked(high_resolution_clock::now());
+		}
+		return false;
+	}
+	// only the ID frame can be refused, the rest of a message is always taken
+	const size_t payloadSize = message.payload.size();
+	LOGGER_LOG(Logger::Info, "frontend.send(ctrlMsg, ZMQ_SNDMORE)");
+	frontend.send(message.ctrl, ZMQ_SNDMORE);
+	LOGGER_LOG(Logger::Info, "frontend.send(payloadMsg)");
+	frontend.send(message.payload);
+	if (wrapper) {
+		const auto sentTime = high_resolution_clock::now();
+		wrapper->worker->getClientLink().forwarded(payloadSize, sentTime);
+		LatencyTracer * tracer = wrapper->worker->getLatencyTracer();
+		if (tracer && message.sequence) {
+			tracer->forwarded(message.sequence, sentTime);
+		}
+	}
+	return true;
+}
+
+bool ZmqProxyServer::sendHeldMessages(zmq::socket_t & frontend) {
+	bool stillHeld = false;
+	bool signalReaper = false;
+	for (auto workerIter = workers.begin(); workerIter != workers.end(); /*nop*/) {
+		WorkerWrapper & wrapper = workerIter->second;
+		bool unreachable = false;
+		try {
+			while (!wrapper.held.empty() && sendToClient(frontend, wrapper.held.front(), &wrapper)) {
+				wrapper.held.pop_front();
+			}
+		} catch (zmq::error_t & ex) {
+			if (ex.num() == EHOSTUNREACH) {
+				unreachable = true;
+			} else {
+				LOGGER_LOG(Logger::Error, "Error while sending held message to client (", workerIter->first, "):", ex.what());
+				// dropped, the renderer must not wait for it
+				wrapper.worker->getClientLink().forwarded(wrapper.held.front().payload.size(), high_resolution_clock::now());
+				wrapper.held.pop_front();
+			}
+		}
+
+		if (unreachable) {
+			LOGGER_LOG(Logger::Warning, "Renderer sending data to disconnected client - stopping it!");
+			workerIter = removeWorker(workerIter);
+			signalReaper = true;
+		} else {
+			stillHeld = stillHeld || !wrapper.held.empty();
+			++workerIter;
+		}
+	}
+
+	if (signalReaper) {
+		reaperCond.notify_one();
+	}
+	return stillHeld;
+}
+
+std::unordered_map<client_id_t, ZmqProxyServer::WorkerWrapper>::iterator ZmqProxyServer::removeWorker(std::unordered_map<client_id_t, WorkerWrapper>::iterator workerIter) {
+	lock_guard<mutex> lk(reaperMtx);
+	deadRenderers.emplace_back(move(workerIter->second));
+	return workers.erase(workerIter); // should be no-op since worker is moved in dead que
+}
+
 std::pair<int, bool> ZmqProxyServer::checkSocketOpt(zmq::socket_t & socket, int option) const {
 	std::pair<int, bool> result;
 	size_t more_size = sizeof (result.first);
 	try {
-		Logger::log(Logger::Info, "frontend.getsockopt(", option,", &result, &size)");
+		LOGGER_LOG(Logger::Info, "frontend.getsockopt(", option,", &result, &size)");
 		socket.getsockopt(option, &result.first, &more_size);
 	} catch (zmq::error_t & ex) {
 		result.second = true;
-		Logger::log(Logger::Error, "zmq::socket_t::getsockopt:", ex.what());
+		LOGGER_LOG(Logger::Error, "zmq::socket_t::getsockopt:", ex.what());
 	}
 	return result;
 }
 
 void ZmqProxyServer::reaperThreadBase() {
+	TraceProfiler::getInstance().setThreadName("ZmqProxyServer reaper");
 	while (reaperRunning) {
 		if (deadRenderers.empty()) {
 			unique_lock<mutex> lk(reaperMtx);
@@ -149,9 +260,10 @@ void ZmqProxyServer::reaperThreadBase() {
 			lk.unlock();
 
 			assert(!!worker.worker && "Already free-ed Renderer inside deadRenderers");
-			Logger::log(Logger::Debug, "worker.worker->stop()");
+			TRACE_ZONE("ZmqProxyServer::reap");
+			LOGGER_LOG(Logger::Debug, "worker.worker->stop()");
 			worker.worker->stop();
-			Logger::log(Logger::Debug, "worker.worker.reset()");
+			LOGGER_LOG(Logger::Debug, "worker.worker.reset()");
 			worker.worker.reset();
 		}
 	}
@@ -159,6 +271,7 @@ void ZmqProxyServer::reaperThreadBase() {
 
 
 void ZmqProxyServer::run() {
+	TraceProfiler::getInstance().setThreadName("ZmqProxyServer");
 	zmq::socket_t backend(context, ZMQ_ROUTER);
 	zmq::socket_t frontend(context, ZMQ_ROUTER);
 
@@ -167,7 +280,7 @@ void ZmqProxyServer::run() {
 		frontend.setsockopt(ZMQ_ROUTER_MANDATORY, 1);
 
 		backend.setsockopt(ZMQ_SNDHWM, 0);
-		frontend.setsockopt(ZMQ_SNDHWM, 0);
+		frontend.setsockopt(ZMQ_SNDHWM, FRONTEND_SNDHWM);
 
 		int wait = SOCKET_IO_TIMEOUT;
 		frontend.setsockopt(ZMQ_SNDTIMEO, &wait, sizeof(wait));
@@ -182,7 +295,7 @@ void ZmqProxyServer::run() {
 		backend.bind("inproc://backend");
 		frontend.bind((string("tcp://*:") + port).c_str());
 	} catch (zmq::error_t & ex) {
-		Logger::log(Logger::Error, "While initializing server:", ex.what());
+		LOGGER_LOG(Logger::Error, "While initializing server:", ex.what());
 		qApp->quit();
 		return;
 	}
@@ -200,6 +313,8 @@ void ZmqProxyServer::run() {
 	lastTimeoutCheck = now;
 	lastDataCheck = now;
 	lastHeartbeat = now;
+	// clients can't be polled for ZMQ_POLLOUT on the ROUTER socket, held messages are retried every millisecond
+	bool messagesHeld = false;
 
 	while (true) {
 		bool didWork = false;
@@ -207,37 +322,40 @@ void ZmqProxyServer::run() {
 
 		int pollResult = 0;
 		try {
-			Logger::log(Logger::Info, "zmq::poll()");
-			pollResult = zmq::poll(pollItems, 2, 100);
+			LOGGER_LOG(Logger::Info, "zmq::poll()");
+			pollResult = zmq::poll(pollItems, 2, messagesHeld ? 1 : 100);
 		} catch (zmq::error_t & ex) {
-			Logger::log(Logger::Error, "zmq::poll:", ex.what());
+			LOGGER_LOG(Logger::Error, "zmq::poll:", ex.what());
 			qApp->quit();
 			return;
 		}
 
 		if (pollItems[0].revents & ZMQ_POLLIN) {
+			TRACE_ZONE("ZmqProxyServer::frontend");
 			didWork = true;
 			bool stopServing = false;
 			while (true) {
 				zmq::message_t idMsg, ctrlMsg, payloadMsg;
 				bool recv = true;
 				try {
-					Logger::log(Logger::Info, "frontend.recv(&idMsg)");
+					LOGGER_LOG(Logger::Info, "frontend.recv(&idMsg)");
 					recv = recv && frontend.recv(&idMsg);
 					assert(idMsg.more() && "Missing control frame and payload from client's message!");
-					Logger::log(Logger::Info, "frontend.recv(&ctrlMsg)");
+					LOGGER_LOG(Logger::Info, "frontend.recv(&ctrlMsg)");
 					recv = recv && frontend.recv(&ctrlMsg);
 					assert(ctrlMsg.more() && "Missing payload from client's message!");
-					Logger::log(Logger::Info, "frontend.recv(&payloadMsg)");
+					LOGGER_LOG(Logger::Info, "frontend.recv(&payloadMsg)");
 					recv = recv && frontend.recv(&payloadMsg);
 					assert(!payloadMsg.more() && "Unexpected parts after client's payload!");
 				} catch (zmq::error_t & ex) {
-					Logger::log(Logger::Error, "zmq::socket_t::recv:", ex.what());
+					LOGGER_LOG(Logger::Error, "zmq::socket_t::recv:", ex.what());
 					break;
 				}
 
 				if (!recv) {
-					Logger::log(Logger::Warning, "Timeout recv");
+					LOGGER_LOG(Logger::Warning, "Timeout recv");
+				} else if (recorder.isOpen()) {
+					recorder.record(idMsg, ctrlMsg, payloadMsg);
 				}
 
 				ControlFrame frame(ctrlMsg);
@@ -246,7 +364,7 @@ void ZmqProxyServer::run() {
 				assert(idMsg.size() == sizeof(client_id_t) && "ID frame with unexpected size");
 
 				if (frame.control == ControlMessage::STOP_MSG) {
-					Logger::log(Logger::Debug, "Client requested server to stop!");
+					LOGGER_LOG(Logger::Debug, "Client requested server to stop!");
 					stopServing = true;
 				}
 
@@ -263,24 +381,31 @@ void ZmqProxyServer::run() {
 					}
 					assert(payloadMsg.size() == 0 && "Missing empty frame after handshake!");
 					if (frame.control == ControlMessage::HEARTBEAT_CONNECT_MSG || frame.control == ControlMessage::EXPORTER_CONNECT_MSG) {
-						Logger::log(Logger::Info, "addWorker(clId, now, frame.type)");
+						LOGGER_LOG(Logger::Info, "addWorker(clId, now, frame.type)");
 						addWorker(clId, now, frame.type);
 					}
 				} else if (!stoppedController) {
-					workerIter->second.lastKeepAlive = now;
+					WorkerWrapper & wrapper = workerIter->second;
+					wrapper.lastKeepAlive = now;
 					lastHeartbeat = std::max(lastHeartbeat, now);
+					LatencyTracer * tracer = wrapper.worker->getLatencyTracer();
+					if (tracer) {
+						// stamped before sending, the worker may look it up as soon as it gets the message
+						tracer->received(wrapper.messagesIn + 1, high_resolution_clock::now());
+					}
 					try {
-						Logger::log(Logger::Info, "backend.send(idMsg, ZMQ_SNDMORE)");
+						LOGGER_LOG(Logger::Info, "backend.send(idMsg, ZMQ_SNDMORE)");
 						backend.send(idMsg, ZMQ_SNDMORE);
-						Logger::log(Logger::Info, "backend.send(ctrlMsg, ZMQ_SNDMORE)");
+						LOGGER_LOG(Logger::Info, "backend.send(ctrlMsg, ZMQ_SNDMORE)");
 						backend.send(ctrlMsg, ZMQ_SNDMORE);
-						Logger::log(Logger::Info, "backend.send(payloadMsg)");
+						LOGGER_LOG(Logger::Info, "backend.send(payloadMsg)");
 						backend.send(payloadMsg);
+						++wrapper.messagesIn;
 					} catch (zmq::error_t & ex) {
 						if (ex.num() == EHOSTUNREACH) {
 							assert(!"Client sending data to inexistent renderer");
 						} else {
-							Logger::log(Logger::Error, "Error while handling client (", clId ,") message: ", ex.what());
+							LOGGER_LOG(Logger::Error, "Error while handling client (", clId ,") message: ", ex.what());
 						}
 					}
 				}
@@ -304,24 +429,25 @@ void ZmqProxyServer::run() {
 		}
 
 		if (pollItems[1].revents & ZMQ_POLLIN) {
+			TRACE_ZONE("ZmqProxyServer::backend");
 			didWork = true;
 			while (true) {
 				zmq::message_t idMsg, ctrlMsg, payloadMsg;
 
 				try {
-					Logger::log(Logger::Info, "backend.recv(&idMsg)");
+					LOGGER_LOG(Logger::Info, "backend.recv(&idMsg)");
 					backend.recv(&idMsg);
 					assert(idMsg.more() && "Missing control frame and payload from render's message!");
 
-					Logger::log(Logger::Info, "backend.recv(&ctrlMsg)");
+					LOGGER_LOG(Logger::Info, "backend.recv(&ctrlMsg)");
 					backend.recv(&ctrlMsg);
 					assert(ctrlMsg.more() && "Missing payload from render's message!");
 
-					Logger::log(Logger::Info, "backend.recv(&payloadMsg)");
+					LOGGER_LOG(Logger::Info, "backend.recv(&payloadMsg)");
 					backend.recv(&payloadMsg);
 					assert(!payloadMsg.more() && "Unexpected parts after renderer's payload!");
 				} catch (zmq::error_t & ex) {
-					Logger::log(Logger::Error, ex.what());
+					LOGGER_LOG(Logger::Error, ex.what());
 					break;
 				}
 
@@ -331,34 +457,47 @@ void ZmqProxyServer::run() {
 				assert(!!frame && "Malformed frame sent from renderer/heartbeat");
 
 				const client_id_t clId = *reinterpret_cast<client_id_t*>(idMsg.data());
+				const size_t payloadSize = payloadMsg.size();
+				dataTransfered += sizeof(client_id_t) + payloadSize;
+
+				auto workerIter = workers.find(clId);
+				WorkerWrapper * wrapper = workerIter != workers.end() ? &workerIter->second : nullptr;
+				ClientMessage message = {move(idMsg), move(ctrlMsg), move(payloadMsg), 0};
+				// counted even if forwarding fails, so the sequence numbers stay the same as the worker's
+				if (wrapper && controllerSettings.traceLatency) {
+					message.sequence = ++wrapper->messagesOut;
+				}
 
 				// check for routing here
 				try {
-					Logger::log(Logger::Info, "frontend.send(idMsg, ZMQ_SNDMORE)");
-					frontend.send(idMsg, ZMQ_SNDMORE);
-					Logger::log(Logger::Info, "frontend.send(ctrlMsg, ZMQ_SNDMORE)");
-					frontend.send(ctrlMsg, ZMQ_SNDMORE);
-					Logger::log(Logger::Info, "frontend.send(payloadMsg)");
-					frontend.send(payloadMsg);
+					if (wrapper && !wrapper->held.empty()) {
+						// the client's older messages are still waiting
+						wrapper->held.push_back(move(message));
+						messagesHeld = true;
+					} else if (!sendToClient(frontend, message, wrapper)) {
+						if (wrapper) {
+							wrapper->held.push_back(move(message));
+							messagesHeld = true;
+						} else {
+							LOGGER_LOG(Logger::Warning, "Client (", clId, ") is not taking messages from it's stopped renderer - dropping one");
+						}
+					}
 				} catch (zmq::error_t & ex) {
 					if (ex.num() == EHOSTUNREACH) {
-						auto workerIter = workers.find(clId);
-						if (workerIter != workers.end()) {
-							Logger::log(Logger::Warning, "Renderer sending data to disconnected client - stopping it!");
-							{
-								lock_guard<mutex> lk(reaperMtx);
-								deadRenderers.emplace_back(move(workerIter->second));
-								workers.erase(workerIter); // should be no-op since worker is moved in dead que
-							}
+						if (wrapper) {
+							LOGGER_LOG(Logger::Warning, "Renderer sending data to disconnected client - stopping it!");
+							removeWorker(workerIter);
 							reaperCond.notify_one();
 						}
 					} else {
-						Logger::log(Logger::Error, "Error while handling renderer (", clId ,") message: ", ex.what());
+						LOGGER_LOG(Logger::Error, "Error while handling renderer (", clId ,") message: ", ex.what());
+						if (wrapper) {
+							// dropped, the renderer must not wait for it
+							wrapper->worker->getClientLink().forwarded(payloadSize, high_resolution_clock::now());
+						}
 					}
 				}
 
-				dataTransfered += sizeof(client_id_t) + payloadMsg.size();
-
 				const auto moreCheck = checkSocketOpt(backend, ZMQ_RCVMORE);
 				if (moreCheck.first == 0 || moreCheck.second) {
 					break;
@@ -371,6 +510,10 @@ void ZmqProxyServer::run() {
 			}
 		}
 
+		if (messagesHeld) {
+			messagesHeld = sendHeldMessages(frontend);
+		}
+
 		if (reportStats(now)) {
 			didWork = true;
 		}
@@ -380,7 +523,7 @@ void ZmqProxyServer::run() {
 
 		if (checkHeartbeat) {
 			if (duration_cast<milliseconds>(now - lastHeartbeat).count() > EXPORTER_TIMEOUT) {
-				Logger::log(Logger::Error, "No active blender instaces for more than", HEARBEAT_TIMEOUT, "ms Shutting down");
+				LOGGER_LOG(Logger::Error, "No active blender instaces for more than", HEARBEAT_TIMEOUT, "ms Shutting down");
 				break;
 			}
 		}
@@ -390,21 +533,21 @@ void ZmqProxyServer::run() {
 		}
 	}
 
-	Logger::log(Logger::Debug, "Stopping reaper thread.");
+	LOGGER_LOG(Logger::Debug, "Stopping reaper thread.");
 	reaperRunning = false;
 	reaperCond.notify_all(); // reaper waits on this for items or flag
 	reaperThread.join();
 
-	Logger::log(Logger::Debug, "Closing server sockets.");
+	LOGGER_LOG(Logger::Debug, "Closing server sockets.");
 	// close sockets and context
 	frontend.close();
 	backend.close();
 	context.close();
 
-	Logger::log(Logger::Debug, "Server stopping all renderers.");
+	LOGGER_LOG(Logger::Debug, "Server stopping all renderers.");
 	deadRenderers.clear();
 	workers.clear();
 
-	Logger::log(Logger::Debug, "Server thread stopping.");
+	LOGGER_LOG(Logger::Debug, "Server thread stopping.");
 	qApp->quit();
 }
@@ -1,6 +1,7 @@
 #ifndef _ZMQ_PROXY_SERVER_H_
 #define _ZMQ_PROXY_SERVER_H_
 
+#include <deque>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -17,6 +18,8 @@
 #endif
 #include <vraysdk.hpp>
 #include "renderer_controller.h"
+#include "session_recorder.h"
+#include "utils/async_log_writer.h"
 #include <set>
 
 /// Wrapper class over uint64_t to enable custom printing in Logger
@@ -68,12 +71,23 @@ namespace std {
 class ZmqProxyServer {
 	typedef std::chrono::high_resolution_clock::time_point time_point;
 
+	/// A renderer's message for it's client
+	struct ClientMessage {
+		zmq::message_t id; ///< The client ID frame
+		zmq::message_t ctrl; ///< The control frame
+		zmq::message_t payload; ///< The payload frame
+		uint64_t sequence; ///< Number of the message for the latency tracer, 0 if not traced
+	};
+
 	/// Context for a singe Renderer
 	struct WorkerWrapper {
 		std::unique_ptr<RendererController> worker; ///< Pointer to the RendererController
 		time_point                          lastKeepAlive; ///< Last time we got message from this client
 		client_id_t                         id; ///< The associated client ID, used for message routing
 		ClientType                          clientType; ///< Either heartbeat or exporter
+		uint64_t                            messagesIn; ///< Messages forwarded to the worker
+		uint64_t                            messagesOut; ///< Messages forwarded from the worker
+		std::deque<ClientMessage>           held; ///< Messages from the worker the frontend socket could not take yet, oldest first
 
 		WorkerWrapper(const WorkerWrapper &) = delete;
 		WorkerWrapper & operator=(const WorkerWrapper &) = delete;
@@ -81,6 +95,9 @@ class ZmqProxyServer {
 			lastKeepAlive = o.lastKeepAlive;
 			id = o.id;
 			clientType = o.clientType;
+			messagesIn = o.messagesIn;
+			messagesOut = o.messagesOut;
+			held = std::move(o.held);
 		}
 
 		WorkerWrapper(std::unique_ptr<RendererController> worker, time_point lastKeepAlive, client_id_t id, ClientType clType);
@@ -90,9 +107,17 @@ public:
 	/// Create new server
 	/// @port - the listening port
 	/// @appsdkPath - full path to the appsdk that will be passet to VRay::Init
-	/// @showVFB - flag passed to VRay::Init to enable/disable UI
+	/// @controllerSettings - settings passed to each RendererController
 	/// @checkHeartbeat - if true server will remain active until there are heartbeat clients and shutdown if all disconnect
-	ZmqProxyServer(const std::string &port, bool showVFB = false, bool checkHeartbeat = true);
+	ZmqProxyServer(const std::string &port, const ControllerSettings & controllerSettings, bool checkHeartbeat = true);
+
+	/// Record all messages clients send to @path, call before @run
+	/// @return - false if the file can't be created
+	bool recordSession(const std::string & path);
+
+	/// Report the counters of @writer with the periodic stats, call before @run
+	/// @writer - must outlive the server, nullptr to stop reporting
+	void reportLogStats(AsyncLogWriter * writer);
 
 	/// Starts serving requests until there are active clients (heartbeat or exporter)
 	void run();
@@ -110,6 +135,23 @@ private:
 	/// @now - current time
 	void addWorker(client_id_t clientId, time_point now, ClientType type);
 
+	/// Send a renderer's message to it's client without waiting for the frontend socket
+	/// @frontend - the clients' socket
+	/// @message - the message, left untouched if it can't be sent
+	/// @wrapper - the renderer that sent it, it's ClientLink is updated, can be nullptr
+	/// @return - false if the socket can't take more messages for this client
+	bool sendToClient(zmq::socket_t & frontend, ClientMessage & message, WorkerWrapper * wrapper);
+
+	/// Send the held messages of all renderers that the frontend socket can take now
+	/// @frontend - the clients' socket
+	/// @return - true if some messages are still held
+	bool sendHeldMessages(zmq::socket_t & frontend);
+
+	/// Move a renderer to @deadRenderers, the reaper thread must be signalled after
+	/// @workerIter - the renderer in @workers
+	/// @return - the iterator after the removed renderer
+	std::unordered_map<client_id_t, WorkerWrapper>::iterator removeWorker(std::unordered_map<client_id_t, WorkerWrapper>::iterator workerIter);
+
 	/// Use Logger::log to print stats, does nothing if called more often that once a second
 	/// @now - current time
 	/// @return - true if actually printed
@@ -125,7 +167,7 @@ private:
 	void reaperThreadBase();
 private:
 	const bool  checkHeartbeat; ///< If true server stops itself if there are no active clients
-	bool        showVFB; ///< Flag for appsdk UI
+	ControllerSettings controllerSettings; ///< Settings for each RendererController (vfb, image sending)
 	std::string port; ///< Listening port
 
 	std::unordered_map<client_id_t, WorkerWrapper> workers; ///< Map of all active clients
@@ -142,6 +184,9 @@ private:
 	std::condition_variable reaperCond; ///< Cond var to signal thread that will reap renderers
 	std::mutex reaperMtx; ///< Mutex protecting @deadRenderers
 	volatile bool reaperRunning; ///< Flag to stop repaer thread
+
+	SessionRecorder recorder; ///< Records client messages if @recordSession was called
+	AsyncLogWriter * logWriter; ///< Set by @reportLogStats, can be nullptr
 };
 
 #endif // _ZMQ_PROXY_SERVER_H_